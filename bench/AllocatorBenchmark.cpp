@@ -0,0 +1,726 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Allocator benchmark suite.
+ *
+ *  Runs every workload against every allocator of the library, the AllocatorStatistic proxies over them and the system malloc,
+ *  on 1 to N threads, and prints ops/sec, sampled latency percentiles and the resident memory grown during the run.
+ *
+ *  Build it together with every source file of src/Memory and src/Util, with optimizations and the repository's include directory, for example:
+ *      g++ -std=c++17 -O2 -DNDEBUG -Iinclude bench/AllocatorBenchmark.cpp <library sources> -pthread -o allocator_bench
+ *
+ *  Usage: allocator_bench [--threads N] [--ops N] [--filter TEXT] [--csv]
+ *      --threads N   Highest thread count, thread counts double from 1 up to N. Defaults to the hardware concurrency.
+ *      --ops N       Operations per thread and run. Defaults to 1000000.
+ *      --filter TEXT Only run the combinations whose "workload/allocator" name contains TEXT.
+ *      --csv         Print comma separated values instead of a table.
+ */
+#include <Shared/Memory/ArenaAllocator.hpp>
+#include <Shared/Memory/AllocatorStatistic.hpp>
+#include <Shared/Memory/GuardedAllocator.hpp>
+#include <Shared/Memory/Heap.hpp>
+#include <Shared/Memory/HeapProfiler.hpp>
+#include <Shared/Memory/NumaAllocator.hpp>
+#include <Shared/Memory/PersistentAllocator.hpp>
+#include <Shared/Memory/PoolAllocator.hpp>
+#include <Shared/Memory/SlabAllocator.hpp>
+#include <Shared/Memory/StackAllocator.hpp>
+#include <Shared/Memory/StatisticAllocator.hpp>
+#include <Shared/Memory/ThreadCacheAllocator.hpp>
+#include <Shared/Memory/ThreadHeapAllocator.hpp>
+#include <Shared/Memory/TraceRecorder.hpp>
+#include <Shared/Memory/VirtualAllocator.hpp>
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Util/LatencyHistogram.hpp>
+
+#include "MallocAllocator.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(PLATFORM_OS_WIN)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <Windows.h>
+#   include <Psapi.h>
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_ANDROID)
+#   include <unistd.h>
+#endif
+
+namespace
+{
+    using namespace Memory;
+    using Bench::MallocAllocator;
+
+    /*
+        Benchmarked allocators
+    */
+
+    enum SubjectFlags : uint32_t
+    {
+        ThreadSafe = 1, // Usable from multiple threads at once
+        Offers = 2, // Implements ObjectAllocator
+        FixedSize = 4, // Only serves PoolBlockSize sized blocks
+        NoFree = 8 // Memory is only released by reset
+    };
+
+    constexpr size_t PoolBlockSize = 64;
+
+    // Stream discarding everything written to it, so traces are recorded without storage costs
+    class NullStream : public std::ostream
+    {
+    public:
+
+        NullStream() :
+            std::ostream(&m_buffer)
+        {
+        }
+
+    private:
+
+        struct Buffer : std::streambuf
+        {
+            virtual int_type overflow(int_type c) override
+            {
+                return traits_type::not_eof(c);
+            }
+
+            virtual std::streamsize xsputn(const char_type*, std::streamsize count) override
+            {
+                return count;
+            }
+        };
+
+        Buffer m_buffer;
+    };
+
+    // Heap file in the temporary directory, removed before and after the run so every run starts with an empty heap
+    struct TempFile
+    {
+        std::string path;
+
+        explicit TempFile(const char* name)
+        {
+            std::error_code error;
+            std::filesystem::path dir = std::filesystem::temp_directory_path(error);
+            this->path = ((error ? std::filesystem::path(".") : dir) / name).string();
+            std::remove(this->path.c_str());
+        }
+
+        ~TempFile()
+        {
+            std::remove(this->path.c_str());
+        }
+    };
+
+    // An allocator stack built for a single run, destroyed in reverse order of construction
+    struct Instance
+    {
+        std::vector<std::shared_ptr<void>> resources; // Used by the allocators, released after every allocator is destroyed
+        std::vector<std::unique_ptr<BasicAllocator>> owned;
+        BasicAllocator* top = nullptr;
+        ObjectAllocator* object = nullptr;
+
+        template<class T, class... Args>
+        T* addResource(Args&&... args)
+        {
+            std::shared_ptr<T> ret = std::make_shared<T>(std::forward<Args>(args)...);
+            this->resources.push_back(ret);
+            return ret.get();
+        }
+
+        template<class T, class... Args>
+        T* add(Args&&... args)
+        {
+            T* ret = new T(std::forward<Args>(args)...);
+            this->owned.emplace_back(ret);
+            this->top = ret;
+            return ret;
+        }
+
+        ~Instance()
+        {
+            while (!this->owned.empty())
+                this->owned.pop_back();
+            while (!this->resources.empty())
+                this->resources.pop_back();
+        }
+    };
+
+    struct Subject
+    {
+        const char* name;
+        uint32_t flags;
+        std::function<void(Instance&)> build;
+    };
+
+    std::vector<Subject> getSubjects()
+    {
+        using PoolType = PoolAllocator<PoolBlockSize>;
+
+        std::vector<Subject> ret;
+        ret.push_back({ "malloc", ThreadSafe, [](Instance& inst) { inst.add<MallocAllocator>(); } });
+        ret.push_back({ "Heap", ThreadSafe | Offers, [](Instance& inst) { inst.object = inst.add<Heap>(); } });
+        ret.push_back({ "Stat(Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<AllocatorStatistic>(static_cast<ObjectAllocator*>(heap));
+        } });
+        ret.push_back({ "Stat[sharded](Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<AllocatorStatistic>(static_cast<ObjectAllocator*>(heap), AllocatorStatistic::Sharded);
+        } });
+        ret.push_back({ "Stat[sharded,timing](Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<AllocatorStatistic>(static_cast<ObjectAllocator*>(heap), AllocatorStatistic::Sharded | AllocatorStatistic::Timing);
+        } });
+        ret.push_back({ "StatisticAllocator<Heap>", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<StatisticAllocator<Heap>>(heap);
+        } });
+        ret.push_back({ "HeapProfiler(Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<HeapProfiler>(static_cast<ObjectAllocator*>(heap));
+        } });
+        ret.push_back({ "TraceRecorder(Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            NullStream* out = inst.addResource<NullStream>();
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<TraceRecorder>(static_cast<ObjectAllocator*>(heap), *out);
+        } });
+        ret.push_back({ "Guarded(Heap)", ThreadSafe | Offers, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.object = inst.add<GuardedAllocator>(static_cast<ObjectAllocator*>(heap));
+        } });
+        ret.push_back({ "ThreadCache(Heap)", ThreadSafe, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.add<ThreadCacheAllocator>(heap);
+        } });
+        ret.push_back({ "Stat[sharded](ThreadCache(Heap))", ThreadSafe, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            ThreadCacheAllocator* cache = inst.add<ThreadCacheAllocator>(heap);
+            inst.add<AllocatorStatistic>(static_cast<BasicAllocator*>(cache), AllocatorStatistic::Sharded);
+        } });
+        ret.push_back({ "ThreadHeap(Heap)", ThreadSafe, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.add<ThreadHeapAllocator>(heap);
+        } });
+        ret.push_back({ "Stat[sharded](ThreadHeap(Heap))", ThreadSafe, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            ThreadHeapAllocator* heaps = inst.add<ThreadHeapAllocator>(heap);
+            inst.add<AllocatorStatistic>(static_cast<BasicAllocator*>(heaps), AllocatorStatistic::Sharded);
+        } });
+        ret.push_back({ "Slab(Heap)", ThreadSafe, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.add<SlabAllocator>(heap);
+        } });
+        ret.push_back({ "VirtualAllocator", ThreadSafe | Offers, [](Instance& inst) { inst.object = inst.add<VirtualAllocator>(); } });
+        ret.push_back({ "NumaAllocator", ThreadSafe, [](Instance& inst) { inst.add<NumaAllocator>(); } });
+        ret.push_back({ "PersistentAllocator", ThreadSafe | Offers, [](Instance& inst) {
+            TempFile* file = inst.addResource<TempFile>("allocator_bench.heap");
+            inst.object = inst.add<PersistentAllocator>(file->path.c_str());
+        } });
+        ret.push_back({ "Pool<64>(Heap)", ThreadSafe | FixedSize, [](Instance& inst) {
+            Heap* heap = inst.add<Heap>();
+            inst.add<PoolType>(heap);
+        } });
+        ret.push_back({ "Arena", NoFree, [](Instance& inst) { inst.add<ArenaAllocator>(); } });
+        ret.push_back({ "Stack", NoFree, [](Instance& inst) { inst.add<StackAllocator>(); } });
+        ret.push_back({ "Stat(Arena)", NoFree, [](Instance& inst) {
+            ArenaAllocator* arena = inst.add<ArenaAllocator>();
+            inst.add<AllocatorStatistic>(static_cast<BasicAllocator*>(arena));
+        } });
+        return ret;
+    }
+
+    /*
+        Measurement helpers
+    */
+
+    constexpr uint32_t LatencySampleMask = 15; // One in this many operations plus one is timed
+
+    inline uint64_t getNanoseconds() noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Resident set size of the process in bytes, 0 if unknown
+    int64_t getResidentBytes()
+    {
+#if defined(PLATFORM_OS_WIN)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return static_cast<int64_t>(counters.WorkingSetSize);
+        return 0;
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_ANDROID)
+        long long pages = 0;
+        if (FILE* file = std::fopen("/proc/self/statm", "r"))
+        {
+            long long total = 0;
+            if (std::fscanf(file, "%lld %lld", &total, &pages) != 2)
+                pages = 0;
+            std::fclose(file);
+        }
+        return static_cast<int64_t>(pages) * static_cast<int64_t>(sysconf(_SC_PAGESIZE));
+#else
+        return 0;
+#endif
+    }
+
+    // Deterministic per thread random numbers
+    struct Random
+    {
+        uint64_t state;
+
+        explicit Random(uint64_t seed) noexcept :
+            state(seed * 0x9E3779B97F4A7C15ull + 1)
+        {
+        }
+
+        uint32_t next() noexcept
+        {
+            this->state ^= this->state << 13;
+            this->state ^= this->state >> 7;
+            this->state ^= this->state << 17;
+            return static_cast<uint32_t>(this->state >> 32);
+        }
+
+        // Mostly small sizes with a long tail, like typical object allocations
+        size_t nextSize(uint32_t flags) noexcept
+        {
+            if ((flags & FixedSize) != 0)
+                return PoolBlockSize;
+
+            uint32_t value = this->next();
+            if ((value & 7) != 0)
+                return 16 + (value >> 8) % 240;
+            return 256 + (value >> 8) % 3840;
+        }
+    };
+
+    struct Context
+    {
+        Instance* instance;
+        uint32_t flags;
+        uint32_t thread;
+        uint32_t threads;
+        size_t ops;
+        Util::LatencyHistogram* latency;
+    };
+
+    // Times the sampled calls of a single thread
+    struct Sampler
+    {
+        Util::LatencyHistogram* latency;
+        uint32_t calls = 0;
+        uint64_t start = 0;
+
+        explicit Sampler(Util::LatencyHistogram* histogram) noexcept :
+            latency(histogram)
+        {
+        }
+
+        inline void begin() noexcept
+        {
+            this->start = (++this->calls & LatencySampleMask) == 0 ? getNanoseconds() : 0;
+        }
+
+        inline void end() noexcept
+        {
+            if (this->start != 0)
+                this->latency->record(getNanoseconds() - this->start);
+        }
+    };
+
+    /*
+        Workloads, each returns the amount of operations done by the calling thread
+    */
+
+    // Random sized allocations replacing a random slot of a fixed size working set
+    size_t runChurn(const Context& ctx)
+    {
+        constexpr size_t Slots = 1024;
+
+        BasicAllocator* allocator = ctx.instance->top;
+        Random random(ctx.thread);
+        Sampler sampler(ctx.latency);
+        std::vector<void*> slots(Slots, nullptr);
+        size_t ops = 0;
+
+        for (size_t i = 0; i < ctx.ops; ++i)
+        {
+            // Arenas only release memory wholesale, the working set is dropped once per round
+            if ((ctx.flags & NoFree) != 0 && (i % Slots) == 0)
+            {
+                allocator->reset();
+                std::fill(slots.begin(), slots.end(), nullptr);
+            }
+
+            void*& slot = slots[random.next() % Slots];
+            if (slot != nullptr)
+            {
+                sampler.begin();
+                allocator->free(slot);
+                sampler.end();
+                ++ops;
+            }
+
+            sampler.begin();
+            slot = allocator->alloc(random.nextSize(ctx.flags));
+            sampler.end();
+            ++ops;
+        }
+
+        if ((ctx.flags & NoFree) == 0)
+        {
+            for (void* ptr : slots)
+                allocator->free(ptr);
+        }
+        return ops;
+    }
+
+    // Bounded single producer single consumer queue of blocks
+    struct Channel
+    {
+        static constexpr size_t Capacity = 4096;
+
+        void* slots[Capacity];
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<size_t> head{ 0 };
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<size_t> tail{ 0 };
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<bool> done{ false };
+
+        bool push(void* ptr) noexcept
+        {
+            size_t tail_value = this->tail.load(std::memory_order_relaxed);
+            if (tail_value - this->head.load(std::memory_order_acquire) == Capacity)
+                return false;
+            this->slots[tail_value % Capacity] = ptr;
+            this->tail.store(tail_value + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(void*& ptr) noexcept
+        {
+            size_t head_value = this->head.load(std::memory_order_relaxed);
+            if (head_value == this->tail.load(std::memory_order_acquire))
+                return false;
+            ptr = this->slots[head_value % Capacity];
+            this->head.store(head_value + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    std::vector<std::unique_ptr<Channel>> s_channels;
+
+    // Even threads allocate and odd threads free the blocks of their neighbour, every free is a cross thread free
+    size_t runProducerConsumer(const Context& ctx)
+    {
+        BasicAllocator* allocator = ctx.instance->top;
+        Channel& channel = *s_channels[ctx.thread / 2];
+        Sampler sampler(ctx.latency);
+        size_t ops = 0;
+
+        if ((ctx.thread & 1) == 0)
+        {
+            Random random(ctx.thread);
+            for (size_t i = 0; i < ctx.ops; ++i)
+            {
+                sampler.begin();
+                void* ptr = allocator->alloc(random.nextSize(ctx.flags));
+                sampler.end();
+                ++ops;
+
+                while (!channel.push(ptr))
+                    std::this_thread::yield();
+            }
+            channel.done.store(true, std::memory_order_release);
+        }
+        else
+        {
+            for (;;)
+            {
+                void* ptr = nullptr;
+                if (channel.pop(ptr))
+                {
+                    sampler.begin();
+                    allocator->free(ptr);
+                    sampler.end();
+                    ++ops;
+                }
+                else if (channel.done.load(std::memory_order_acquire))
+                {
+                    // The producer may have pushed its last blocks right before finishing
+                    if (!channel.pop(ptr))
+                        break;
+                    allocator->free(ptr);
+                    ++ops;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        return ops;
+    }
+
+    // Vectors growing by half of their size from 16 bytes to 64 KiB through realloc
+    size_t runReallocGrowth(const Context& ctx)
+    {
+        BasicAllocator* allocator = ctx.instance->top;
+        Sampler sampler(ctx.latency);
+        size_t ops = 0;
+
+        while (ops < ctx.ops)
+        {
+            sampler.begin();
+            void* ptr = allocator->alloc(16);
+            sampler.end();
+            ++ops;
+
+            for (size_t bytes = 24; bytes <= 64 * 1024 && ptr != nullptr; bytes += bytes / 2)
+            {
+                sampler.begin();
+                ptr = allocator->realloc(ptr, bytes);
+                sampler.end();
+                ++ops;
+
+                // Touch the new tail, like a container appending elements would
+                if (ptr != nullptr)
+                    static_cast<char*>(ptr)[bytes - 1] = 1;
+            }
+
+            sampler.begin();
+            allocator->free(ptr);
+            sampler.end();
+            ++ops;
+        }
+        return ops;
+    }
+
+    // Cache like usage: blocks are offered, some are reclaimed, the rest is purged periodically
+    size_t runOffers(const Context& ctx)
+    {
+        constexpr size_t Batch = 64;
+
+        ObjectAllocator* allocator = ctx.instance->object;
+        Random random(ctx.thread);
+        Sampler sampler(ctx.latency);
+        void* tickets[Batch];
+        size_t ops = 0;
+        size_t round = 0;
+
+        while (ops < ctx.ops)
+        {
+            for (size_t i = 0; i < Batch; ++i)
+            {
+                sampler.begin();
+                void* ptr = allocator->alloc(256 + random.next() % 3840);
+                sampler.end();
+
+                sampler.begin();
+                tickets[i] = ptr != nullptr ? allocator->offer(ptr, static_cast<uint32_t>(i % 4)) : nullptr;
+                sampler.end();
+                ops += 2;
+            }
+
+            // Every other offer is reclaimed, the rest waits for a purge. Offers on every priority are purged now and then, so none of them piles up
+            for (size_t i = 0; i < Batch; i += 2)
+            {
+                if (tickets[i] == nullptr)
+                    continue;
+
+                sampler.begin();
+                void* ptr = allocator->reclaim(tickets[i]);
+                sampler.end();
+                ++ops;
+
+                if (ptr != nullptr)
+                {
+                    allocator->free(ptr);
+                    ++ops;
+                }
+            }
+
+            if ((++round % 16) == 0)
+            {
+                sampler.begin();
+                allocator->purge((round % 64) == 0 ? std::numeric_limits<uint32_t>::max() : 1);
+                sampler.end();
+                ++ops;
+            }
+        }
+
+        allocator->purge();
+        return ops;
+    }
+
+    struct Workload
+    {
+        const char* name;
+        uint32_t required; // Subject flags the workload needs
+        uint32_t excluded; // Subject flags the workload can't run with
+        bool paired; // Threads work in producer consumer pairs
+        size_t (*run)(const Context& ctx);
+    };
+
+    const Workload s_workloads[] = {
+        { "churn", 0, 0, false, &runChurn },
+        { "producer-consumer", ThreadSafe, NoFree, true, &runProducerConsumer },
+        { "realloc-growth", 0, FixedSize | NoFree, false, &runReallocGrowth },
+        { "offer-reclaim-purge", Offers, 0, false, &runOffers }
+    };
+
+    /*
+        Driver
+    */
+
+    struct Result
+    {
+        double ops_per_sec;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t p999;
+        int64_t rss_growth;
+    };
+
+    Result runOnce(const Workload& workload, const Subject& subject, uint32_t threads, size_t ops)
+    {
+        int64_t rss_before = getResidentBytes();
+
+        Instance instance;
+        subject.build(instance);
+
+        Util::LatencyHistogram latency;
+        std::atomic<size_t> total_ops{ 0 };
+        std::atomic<uint32_t> ready{ 0 };
+        std::atomic<bool> go{ false };
+
+        s_channels.clear();
+        if (workload.paired)
+        {
+            for (uint32_t i = 0; i < threads / 2; ++i)
+                s_channels.emplace_back(new Channel());
+        }
+
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([&, i]() {
+                Context ctx{ &instance, subject.flags, i, threads, ops, &latency };
+
+                // Every thread starts at once, so the timing covers the contended part only
+                ready.fetch_add(1, std::memory_order_acq_rel);
+                while (!go.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                total_ops.fetch_add(workload.run(ctx), std::memory_order_relaxed);
+            });
+        }
+
+        while (ready.load(std::memory_order_acquire) != threads)
+            std::this_thread::yield();
+        uint64_t start = getNanoseconds();
+        go.store(true, std::memory_order_release);
+        for (std::thread& worker : workers)
+            worker.join();
+        uint64_t elapsed = getNanoseconds() - start;
+
+        Result ret;
+        ret.ops_per_sec = elapsed != 0 ? static_cast<double>(total_ops.load()) * 1e9 / static_cast<double>(elapsed) : 0.0;
+        ret.p50 = latency.getPercentile(0.5);
+        ret.p99 = latency.getPercentile(0.99);
+        ret.p999 = latency.getPercentile(0.999);
+        ret.rss_growth = getResidentBytes() - rss_before;
+        return ret;
+    }
+
+    bool isSupported(const Workload& workload, const Subject& subject, uint32_t threads)
+    {
+        if ((subject.flags & workload.required) != workload.required || (subject.flags & workload.excluded) != 0)
+            return false;
+        return threads == 1 || (subject.flags & ThreadSafe) != 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t max_threads = std::thread::hardware_concurrency();
+    size_t ops = 1000000;
+    const char* filter = nullptr;
+    bool csv = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            max_threads = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+            ops = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--threads N] [--ops N] [--filter TEXT] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads == 0)
+        max_threads = 1;
+
+    if (csv)
+        std::printf("workload,allocator,threads,ops_per_sec,p50_ns,p99_ns,p999_ns,rss_growth_bytes\n");
+    else
+        std::printf("%-20s %-34s %7s %14s %8s %8s %8s %10s\n", "workload", "allocator", "threads", "ops/sec", "p50 ns", "p99 ns", "p999 ns", "RSS MiB");
+
+    std::vector<Subject> subjects = getSubjects();
+    for (const Workload& workload : s_workloads)
+    {
+        for (const Subject& subject : subjects)
+        {
+            std::string name = std::string(workload.name) + "/" + subject.name;
+            if (filter != nullptr && name.find(filter) == std::string::npos)
+                continue;
+
+            uint32_t last = 0;
+            for (uint32_t threads = 1; threads <= max_threads; threads *= 2)
+            {
+                // Pairs need at least one producer and one consumer
+                uint32_t count = workload.paired && threads < 2 ? 2 : threads;
+                if (count == last || !isSupported(workload, subject, count))
+                    continue;
+                last = count;
+
+                Result result = runOnce(workload, subject, count, ops);
+                if (csv)
+                {
+                    std::printf("%s,%s,%u,%.0f,%llu,%llu,%llu,%lld\n", workload.name, subject.name, count, result.ops_per_sec,
+                        static_cast<unsigned long long>(result.p50), static_cast<unsigned long long>(result.p99), static_cast<unsigned long long>(result.p999),
+                        static_cast<long long>(result.rss_growth));
+                }
+                else
+                {
+                    std::printf("%-20s %-34s %7u %14.0f %8llu %8llu %8llu %10.1f\n", workload.name, subject.name, count, result.ops_per_sec,
+                        static_cast<unsigned long long>(result.p50), static_cast<unsigned long long>(result.p99), static_cast<unsigned long long>(result.p999),
+                        static_cast<double>(result.rss_growth) / (1024.0 * 1024.0));
+                }
+                std::fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
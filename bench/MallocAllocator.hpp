@@ -0,0 +1,96 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_BENCH_MALLOCALLOCATOR_HPP
+#define SHARED_BENCH_MALLOCALLOCATOR_HPP
+
+#include <Shared/Memory/BasicAllocator.hpp>
+#include <Shared/Platform/Target.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(PLATFORM_OS_WIN)
+#   include <malloc.h>
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_ANDROID)
+#   include <malloc.h>
+#elif defined(PLATFORM_OS_OSX) || defined(PLATFORM_OS_IOS)
+#   include <malloc/malloc.h>
+#endif
+
+namespace Bench
+{
+    // The system malloc behind the BasicAllocator interface, memory figures are not available
+    class MallocAllocator : public Memory::BasicAllocator
+    {
+    public:
+
+        using Memory::BasicAllocator::free;
+        using Memory::BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            if (align <= alignof(max_align_t))
+                return std::malloc(bytes);
+#if defined(PLATFORM_OS_WIN)
+            return _aligned_malloc(bytes, align);
+#else
+            void* ret = nullptr;
+            return posix_memalign(&ret, align, bytes) == 0 ? ret : nullptr;
+#endif
+        }
+
+        virtual void free(void* ptr) override
+        {
+            std::free(ptr);
+        }
+
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            if (align <= alignof(max_align_t))
+                return std::realloc(ptr, bytes);
+
+            void* ret = this->alloc(bytes, align);
+            if (ret != nullptr && ptr != nullptr)
+            {
+                size_t size = this->getAllocSize(ptr);
+                std::memcpy(ret, ptr, size < bytes ? size : bytes);
+                this->free(ptr);
+            }
+            return ret;
+        }
+
+        virtual size_t getAllocSize(const void* ptr) const override
+        {
+#if defined(PLATFORM_OS_WIN)
+            return _msize(const_cast<void*>(ptr));
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_ANDROID)
+            return malloc_usable_size(const_cast<void*>(ptr));
+#elif defined(PLATFORM_OS_OSX) || defined(PLATFORM_OS_IOS)
+            return malloc_size(ptr);
+#else
+            (void)ptr;
+            return 0;
+#endif
+        }
+
+        virtual void reset() override
+        {
+        }
+
+        virtual size_t getFreeBytes() const override
+        {
+            return 0;
+        }
+
+        virtual size_t getUsedBytes() const override
+        {
+            return 0;
+        }
+
+        virtual size_t getTotalBytes() const override
+        {
+            return 0;
+        }
+    };
+}
+
+#endif /* SHARED_BENCH_MALLOCALLOCATOR_HPP */
@@ -0,0 +1,179 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Allocator trace replay tool.
+ *
+ *  Loads a trace written by TraceRecorder and replays it against the allocators of the library and the system malloc,
+ *  printing the replay time, the highest used memory reported by the allocator and the calls which could not be replayed.
+ *
+ *  Build it together with every source file of src/Memory and src/Util, with optimizations and the repository's include directory, for example:
+ *      g++ -std=c++17 -O2 -DNDEBUG -Iinclude bench/TraceReplay.cpp <library sources> -pthread -o trace_replay
+ *
+ *  Usage: trace_replay [--filter TEXT] [--runs N] [--csv] TRACE
+ *      --filter TEXT Only replay against the allocators whose name contains TEXT.
+ *      --runs N      Replays per allocator, the fastest one is reported. Defaults to 3.
+ *      --csv         Print comma separated values instead of a table.
+ */
+#include <Shared/Memory/Heap.hpp>
+#include <Shared/Memory/NumaAllocator.hpp>
+#include <Shared/Memory/SlabAllocator.hpp>
+#include <Shared/Memory/ThreadCacheAllocator.hpp>
+#include <Shared/Memory/ThreadHeapAllocator.hpp>
+#include <Shared/Memory/TraceReplay.hpp>
+#include <Shared/Memory/VirtualAllocator.hpp>
+
+#include "MallocAllocator.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    using namespace Memory;
+    using Bench::MallocAllocator;
+
+    // Replay target built from scratch for every run
+    struct Target
+    {
+        std::vector<std::unique_ptr<BasicAllocator>> owned; // Destroyed in reverse order of construction
+        BasicAllocator* basic = nullptr;
+        ObjectAllocator* object = nullptr;
+
+        ~Target()
+        {
+            while (!this->owned.empty())
+                this->owned.pop_back();
+        }
+    };
+
+    struct Subject
+    {
+        const char* name;
+        std::function<void(Target&)> build;
+    };
+
+    std::vector<Subject> getSubjects()
+    {
+        std::vector<Subject> ret;
+        ret.push_back({ "malloc", [](Target& target) {
+            target.owned.emplace_back(target.basic = new MallocAllocator());
+        } });
+        ret.push_back({ "Heap", [](Target& target) {
+            Heap* heap = new Heap();
+            target.owned.emplace_back(heap);
+            target.basic = target.object = heap;
+        } });
+        ret.push_back({ "ThreadCache(Heap)", [](Target& target) {
+            Heap* heap = new Heap();
+            target.owned.emplace_back(heap);
+            target.owned.emplace_back(target.basic = new ThreadCacheAllocator(heap));
+        } });
+        ret.push_back({ "ThreadHeap(Heap)", [](Target& target) {
+            Heap* heap = new Heap();
+            target.owned.emplace_back(heap);
+            target.owned.emplace_back(target.basic = new ThreadHeapAllocator(heap));
+        } });
+        ret.push_back({ "Slab(Heap)", [](Target& target) {
+            Heap* heap = new Heap();
+            target.owned.emplace_back(heap);
+            target.owned.emplace_back(target.basic = new SlabAllocator(heap));
+        } });
+        ret.push_back({ "VirtualAllocator", [](Target& target) {
+            VirtualAllocator* allocator = new VirtualAllocator();
+            target.owned.emplace_back(allocator);
+            target.basic = target.object = allocator;
+        } });
+        ret.push_back({ "NumaAllocator", [](Target& target) {
+            target.owned.emplace_back(target.basic = new NumaAllocator());
+        } });
+        return ret;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* path = nullptr;
+    unsigned long runs = 3;
+    bool csv = false;
+    bool usage = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (path == nullptr && argv[i][0] != '-')
+            path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || path == nullptr)
+    {
+        std::fprintf(stderr, "Usage: %s [--filter TEXT] [--runs N] [--csv] TRACE\n", argv[0]);
+        return 1;
+    }
+    if (runs == 0)
+        runs = 1;
+
+    TraceReplay trace;
+    {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in || !trace.load(in))
+        {
+            std::fprintf(stderr, "Can't load trace %s\n", path);
+            return 1;
+        }
+    }
+
+    if (csv)
+    {
+        std::printf("allocator,records,threads,elapsed_ns,calls_per_sec,highest_used_bytes,skipped,failed,leaked\n");
+    }
+    else
+    {
+        std::printf("%zu records from %u threads\n", trace.getRecordCount(), trace.getThreadCount());
+        std::printf("%-20s %12s %14s %12s %10s %10s %10s\n", "allocator", "elapsed ms", "calls/sec", "used MiB", "skipped", "failed", "leaked");
+    }
+
+    for (const Subject& subject : getSubjects())
+    {
+        if (filter != nullptr && std::strstr(subject.name, filter) == nullptr)
+            continue;
+
+        TraceReplay::Result best = {};
+        for (unsigned long run = 0; run < runs; ++run)
+        {
+            Target target;
+            subject.build(target);
+
+            TraceReplay::Result result = target.object != nullptr ? trace.replay(target.object) : trace.replay(target.basic);
+            if (run == 0 || result.elapsed_ns < best.elapsed_ns)
+                best = result;
+        }
+
+        double seconds = static_cast<double>(best.elapsed_ns) / 1e9;
+        double rate = seconds > 0.0 ? static_cast<double>(best.replayed) / seconds : 0.0;
+        if (csv)
+        {
+            std::printf("%s,%zu,%u,%llu,%.0f,%zu,%llu,%llu,%llu\n", subject.name, trace.getRecordCount(), trace.getThreadCount(),
+                static_cast<unsigned long long>(best.elapsed_ns), rate, best.highest_used,
+                static_cast<unsigned long long>(best.skipped), static_cast<unsigned long long>(best.failed), static_cast<unsigned long long>(best.leaked));
+        }
+        else
+        {
+            std::printf("%-20s %12.2f %14.0f %12.1f %10llu %10llu %10llu\n", subject.name, seconds * 1e3, rate,
+                static_cast<double>(best.highest_used) / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(best.skipped), static_cast<unsigned long long>(best.failed), static_cast<unsigned long long>(best.leaked));
+        }
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_ALLOCATORREGISTRY_HPP
+#define SHARED_MEMORY_ALLOCATORREGISTRY_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/AllocatorStatistic.hpp>
+
+#include <iosfwd>
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Registry of named allocators.
+     *
+     * The AllocatorRegistry class collects allocators under hierarchical names, with components separated by slashes like @b "net/rx/buffers".
+     * The registered allocators can be listed, exported and aggregated over whole subtrees of the name hierarchy, so telemetry only needs to know the registry instead of every single allocator.
+     *
+     * @ref AllocatorStatistic objects contribute every counter of their @ref AllocatorStatistic::Snapshot, any other allocator only contributes its memory figures.
+     * Collecting figures only locks the registry itself, the registered allocators are read the same way as @ref AllocatorStatistic::snapshot does, so allocating threads are never stopped.
+     *
+     * The registry does not own the allocators. An allocator must be removed before it gets destroyed, removal waits for any collection in progress.
+     * A process wide instance is available via @ref getGlobal, but separate registries may be created as well.
+     *
+     * All calls are concurrently safe.
+     *
+     * @see @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API AllocatorRegistry
+    {
+    public:
+
+        /**
+         * @brief Callback of @ref forEach.
+         *
+         * @param name Full name of the allocator.
+         * @param snapshot Figures of the allocator.
+         * @param user The user pointer passed to @ref forEach.
+         */
+        using Visitor = void (*)(const char* name, const AllocatorStatistic::Snapshot& snapshot, void* user);
+
+        /**
+         * @brief Construct an empty registry.
+         */
+        AllocatorRegistry();
+
+        AllocatorRegistry(const AllocatorRegistry&) = delete;
+        AllocatorRegistry& operator=(const AllocatorRegistry&) = delete;
+
+        /**
+         * @brief Destroy the registry.
+         *
+         * The registered allocators are not affected.
+         */
+        ~AllocatorRegistry();
+
+        /**
+         * @brief Get the process wide registry.
+         *
+         * The instance is created on first use and never destroyed, so allocators with static storage duration may remove themselves at any point of the program's shutdown.
+         *
+         * @return The global registry.
+         */
+        static AllocatorRegistry& getGlobal();
+
+        /**
+         * @brief Register an allocator.
+         *
+         * @param name Hierarchical name, non-empty components separated by slashes. The string is copied.
+         * @param allocator The allocator to register.
+         * @return @b true on success, @b false if the name is invalid or already taken.
+         */
+        bool add(const char* name, AllocatorStatistic* allocator);
+
+        /**
+         * @copydoc add(const char*, AllocatorStatistic*)
+         */
+        bool add(const char* name, ObjectAllocator* allocator);
+
+        /**
+         * @copydoc add(const char*, AllocatorStatistic*)
+         */
+        bool add(const char* name, BasicAllocator* allocator);
+
+        /**
+         * @brief Remove an allocator by name.
+         *
+         * @param name Full name the allocator got registered under.
+         * @return @b true if the name was registered.
+         */
+        bool remove(const char* name);
+
+        /**
+         * @brief Remove every registration of an allocator.
+         *
+         * @param allocator The registered allocator.
+         * @return Amount of names removed.
+         */
+        size_t remove(const BasicAllocator* allocator);
+
+        /**
+         * @brief Get the amount of registered allocators.
+         */
+        size_t getCount() const;
+
+        /**
+         * @brief Aggregate the figures of a subtree.
+         *
+         * Combines the snapshots of every allocator whose name equals @a prefix or starts with @a prefix followed by a slash, see @ref AllocatorStatistic::Snapshot::accumulate.
+         *
+         * @param prefix Name of the subtree root, empty or @b nullptr for every allocator.
+         * @param count Optional output for the amount of allocators aggregated.
+         * @return The aggregated snapshot.
+         */
+        AllocatorStatistic::Snapshot getRollup(const char* prefix = nullptr, size_t* count = nullptr) const;
+
+        /**
+         * @brief Visit the allocators of a subtree.
+         *
+         * The visitor is called in name order while the registry is locked, it must not call into the registry.
+         *
+         * @param prefix Name of the subtree root, empty or @b nullptr for every allocator.
+         * @param visitor The function to call for every allocator.
+         * @param user Arbitrary pointer passed on to @a visitor.
+         * @return Amount of allocators visited.
+         */
+        size_t forEach(const char* prefix, Visitor visitor, void* user = nullptr) const;
+
+        /**
+         * @brief Write the allocators of a subtree in Prometheus text exposition format.
+         *
+         * Every allocator is exported with its full name as the @b allocator label, see @ref AllocatorStatistic::Snapshot::writePrometheus.
+         *
+         * @param out The stream to write to.
+         * @param prefix Name of the subtree root, empty or @b nullptr for every allocator.
+         * @param metric_prefix Prefix of the metric names.
+         */
+        void writePrometheus(std::ostream& out, const char* prefix = nullptr, const char* metric_prefix = "allocator") const;
+
+        /**
+         * @brief Check whether a name is valid.
+         *
+         * A valid name is non-empty and consists of non-empty components separated by single slashes.
+         *
+         * @param name The name to check.
+         * @return @b true if the name is valid.
+         */
+        static bool isValidName(const char* name) noexcept;
+
+    protected:
+
+        struct Entry;
+        struct Entries;
+
+        bool addEntry(const char* name, const Entry& entry);
+
+        mutable std::mutex m_mutex;
+        Entries* m_entries;
+    };
+}
+
+#endif /* SHARED_MEMORY_ALLOCATORREGISTRY_HPP */
@@ -5,9 +5,14 @@
 #include <Shared/Shared.hpp>
 
 #include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
 #include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Util/BitMask.hpp>
+#include <Shared/Util/Bits.hpp>
+#include <Shared/Util/LatencyHistogram.hpp>
 
 #include <atomic>
+#include <iosfwd>
 
 namespace Memory
 {
@@ -18,11 +23,225 @@ namespace Memory
      * At the cost of performance it can provide some diagnostic data based on the API calls which the underlying allocator may not.
      *
      * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * By default every thread updates the same set of counters, which can become a false sharing hotspot on highly concurrent workloads.
+     * Constructing the object with the @ref Sharded option gives each thread its own cache line aligned counter block, which are aggregated when the counters are read.
+     *
+     * The @ref Histograms option additionally records log2 bucketed histograms of allocation sizes, alignment requests and reallocation growth, useful for tuning size classes and pool sizes.
+     *
+     * The @ref Timing option measures the latency of every N-th wrapped call on each thread with a steady clock, and records it per @ref Operation into a @ref Util::LatencyHistogram, so tail latencies like p99 or p999 can be queried.
      */
     class SHARED_LIB_API AllocatorStatistic : public ObjectAllocator
     {
     public:
 
+        /**
+         * @brief Construction options.
+         *
+         * Flags which can be combined and passed to the constructors to alter the way statistics are collected.
+         */
+        enum Options : uint32_t
+        {
+            /// Default behavior, every thread updates a single shared counter block.
+            None = 0,
+            /// Each thread updates its own cache line aligned counter block, the getters aggregate them lazily.
+            Sharded = Util::BitMask<0>::value,
+            /// Record histograms of allocation sizes, alignments and reallocation growth.
+            Histograms = Util::BitMask<1>::value,
+            /// Sample the latency of the wrapped calls.
+            Timing = Util::BitMask<2>::value
+        };
+
+        /**
+         * @brief Timed operations.
+         *
+         * Each operation has its own latency histogram in @ref Timing mode.
+         */
+        enum Operation : uint32_t
+        {
+            /// @ref alloc calls, without the bulk variant.
+            Alloc = 0,
+            /// @ref realloc calls.
+            Realloc,
+            /// @ref free calls, without the bulk variant.
+            Free,
+            /// @ref offer calls.
+            Offer,
+            /// @ref reclaim calls.
+            Reclaim,
+            /// Number of operations.
+            OperationCount
+        };
+
+        /// Default sampling rate of the @ref Timing option, one in this many calls is measured on each thread.
+        static constexpr uint32_t DefaultSampleRate = 64;
+
+        /// Number of histogram buckets, one for zero and one for each possible bit width of a value.
+        static constexpr size_t HistogramBuckets = 65;
+
+        /**
+         * @brief Histogram snapshot.
+         *
+         * Bucket 0 counts zero values, bucket @a n counts values in the [2^(n-1), 2^n) range.
+         */
+        struct Histogram
+        {
+            uintmax_t counts[HistogramBuckets];
+
+            /**
+             * @brief Get the bucket of a value.
+             *
+             * @param value The recorded value.
+             * @return Index of the bucket counting @a value.
+             */
+            static inline size_t getBucket(size_t value) noexcept
+            {
+                return Util::getBitWidth(value);
+            }
+
+            /**
+             * @brief Get the smallest value counted by a bucket.
+             *
+             * @param bucket Index of the bucket.
+             * @return The inclusive lower bound of the bucket.
+             */
+            static inline size_t getBucketMin(size_t bucket) noexcept
+            {
+                return bucket == 0 ? 0 : size_t(1) << (bucket - 1);
+            }
+
+            /**
+             * @brief Get the largest value counted by a bucket.
+             *
+             * @param bucket Index of the bucket.
+             * @return The inclusive upper bound of the bucket.
+             */
+            static inline size_t getBucketMax(size_t bucket) noexcept
+            {
+                return bucket >= std::numeric_limits<size_t>::digits ? std::numeric_limits<size_t>::max() : (size_t(1) << bucket) - 1;
+            }
+        };
+
+        /**
+         * @brief Snapshot of every counter.
+         *
+         * Plain structure holding the value of every counter, and the memory figures of the backing allocator, collected in a single pass by @ref snapshot.
+         * Gauges hold the value at the time of the snapshot, totals accumulate since the last counter reset.
+         */
+        struct SHARED_LIB_API Snapshot
+        {
+            // Gauges
+            uint64_t used_bytes; // Backing allocator's used bytes
+            uint64_t total_bytes; // Backing allocator's total bytes
+            uint64_t free_bytes; // Backing allocator's free bytes, not necessarily the difference of the total and the used bytes
+            uint64_t pending_bytes; // Backing allocator's pending bytes, 0 without an ObjectAllocator backing
+            uint64_t highest_usage;
+            uint64_t smallest_alloc;
+            uint64_t largest_alloc;
+            uint64_t largest_alloc_failed;
+
+            // Totals
+            uint64_t allocs;
+            uint64_t alloc_fails;
+            uint64_t alloc_bytes;
+            uint64_t reallocs;
+            uint64_t realloc_fails;
+            uint64_t realloc_growth;
+            uint64_t realloc_shrink;
+            uint64_t realloc_moves;
+            uint64_t realloc_moved;
+            uint64_t offers;
+            uint64_t offer_bytes;
+            uint64_t reclaims;
+            uint64_t reclaim_fails;
+            uint64_t reclaim_bytes;
+            uint64_t expands;
+            uint64_t expand_fails;
+            uint64_t shrinks;
+            uint64_t shrink_fails;
+
+            // Backing allocator's totals, not affected by resetCounters
+            uint64_t local_frees; // Blocks freed by their owner thread, 0 unless the backing counts them, see BasicAllocator::getFreeCounts
+            uint64_t remote_frees; // Blocks freed by other threads, 0 unless the backing counts them
+
+            /// Number of fields in the structure.
+            static constexpr size_t FieldCount = 28;
+
+            /// Size of the binary serialized form in bytes.
+            static constexpr size_t SerializedSize = 8 + FieldCount * 8;
+
+            /**
+             * @brief Get the difference to a previous snapshot.
+             *
+             * Totals are subtracted, yielding the activity between the two snapshots. Gauges keep their current values.
+             * If the counters were reset in between, the affected totals are reported as their current values.
+             *
+             * @param previous An earlier snapshot of the same allocator.
+             * @return The difference snapshot.
+             */
+            Snapshot diff(const Snapshot& previous) const noexcept;
+
+            /**
+             * @brief Add another snapshot to this one.
+             *
+             * Combines the figures of two allocators: totals and memory figures are summed, allocation size extremes are merged.
+             * The highest usage is summed as well, making it an upper bound of the combined highest usage.
+             *
+             * @param other The snapshot to add.
+             */
+            void accumulate(const Snapshot& other) noexcept;
+
+            /**
+             * @brief Serialize into a compact binary form.
+             *
+             * Writes a 4 byte magic and a 4 byte version followed by every field as a 64-bit little endian integer, @ref SerializedSize bytes in total.
+             *
+             * @param buffer The destination buffer.
+             * @param bytes Size of @a buffer.
+             * @return The amount of bytes written, 0 if @a buffer is too small.
+             *
+             * @see @ref deserialize
+             */
+            size_t serialize(void* buffer, size_t bytes) const noexcept;
+
+            /**
+             * @brief Restore from the binary form.
+             *
+             * @param buffer Data written by @ref serialize.
+             * @param bytes Size of @a buffer.
+             * Data written by earlier versions is accepted, the fields it lacks are set to zero.
+             *
+             * @return @b true on success, @b false if the data is truncated or not a serialized snapshot.
+             *
+             * @see @ref serialize
+             */
+            bool deserialize(const void* buffer, size_t bytes) noexcept;
+
+            /**
+             * @brief Write in Prometheus text exposition format.
+             *
+             * Convenience overload of @ref writePrometheus(std::ostream&, const Snapshot*, const char* const*, size_t, const char*) for a single allocator.
+             *
+             * @param out The stream to write to.
+             * @param label Value of the @b allocator label, may be @b nullptr to omit the label.
+             * @param prefix Prefix of the metric names.
+             */
+            void writePrometheus(std::ostream& out, const char* label = nullptr, const char* prefix = "allocator") const;
+
+            /**
+             * @brief Write multiple snapshots in Prometheus text exposition format.
+             *
+             * Each metric family is written once with its type and help lines, followed by a sample for every snapshot distinguished by the @b allocator label.
+             *
+             * @param out The stream to write to.
+             * @param snapshots Array of @a count snapshots.
+             * @param labels Array of @a count label values, may be @b nullptr to omit the label.
+             * @param count Amount of snapshots.
+             * @param prefix Prefix of the metric names.
+             */
+            static void writePrometheus(std::ostream& out, const Snapshot* snapshots, const char* const* labels, size_t count, const char* prefix = "allocator");
+        };
+
         /**
          * @brief Construct an uninitialized AllocatorStatistic object.
          *
@@ -38,10 +257,12 @@ namespace Memory
          * Calling any functions inherited from @ref ObjectAllocator will cause errors.
          *
          * @param backing The backing allocator which will do the actual allocations.
+         * @param options Combination of @ref Options flags.
+         * @param sample_rate One in this many calls is timed on each thread in @ref Timing mode, rounded up to a power of two.
          *
-         * @see @ref BasicAllocator, @ref ObjectAllocator, @ref AllocatorStatistic::AllocatorStatistic(ObjectAllocator*)
+         * @see @ref BasicAllocator, @ref ObjectAllocator, @ref AllocatorStatistic::AllocatorStatistic(ObjectAllocator*, uint32_t, uint32_t)
          */
-        AllocatorStatistic(BasicAllocator* backing);
+        AllocatorStatistic(BasicAllocator* backing, uint32_t options = None, uint32_t sample_rate = DefaultSampleRate);
 
         /**
          * @brief Construct an AllocatorStatistic object.
@@ -50,10 +271,17 @@ namespace Memory
          * All allocation member functions are available.
          *
          * @param backing The backing allocator which will do the actual allocations.
+         * @param options Combination of @ref Options flags.
+         * @param sample_rate One in this many calls is timed on each thread in @ref Timing mode, rounded up to a power of two.
          *
-         * @see @ref BasicAllocator, @ref ObjectAllocator, @ref AllocatorStatistic::AllocatorStatistic(BasicAllocator*)
+         * @see @ref BasicAllocator, @ref ObjectAllocator, @ref AllocatorStatistic::AllocatorStatistic(BasicAllocator*, uint32_t, uint32_t)
          */
-        AllocatorStatistic(ObjectAllocator* backing);
+        AllocatorStatistic(ObjectAllocator* backing, uint32_t options = None, uint32_t sample_rate = DefaultSampleRate);
+
+        AllocatorStatistic(const AllocatorStatistic&) = delete;
+        AllocatorStatistic& operator=(const AllocatorStatistic&) = delete;
+
+        virtual ~AllocatorStatistic();
 
         // -- Statistic API --
 
@@ -274,6 +502,113 @@ namespace Memory
          */
         virtual uintmax_t getTotalReclaimBytes() const;
 
+        /**
+         * @brief Get the call count of @ref tryExpand().
+         *
+         * Get the total amount of times @ref tryExpand() was called since the last counter reset.
+         *
+         * @return The call count of @ref tryExpand().
+         *
+         * @see @ref tryExpand(), @ref getTotalExpandFails(), @ref getInPlaceRate()
+         */
+        virtual uintmax_t getTotalExpands() const;
+
+        /**
+         * @brief Get the amount of times @ref tryExpand() was unsuccessful.
+         *
+         * Get the total amount of times @ref tryExpand() couldn't resize the allocation in place.
+         *
+         * @return The fail count of @ref tryExpand().
+         *
+         * @see @ref tryExpand(), @ref getTotalExpands(), @ref getInPlaceRate()
+         */
+        virtual uintmax_t getTotalExpandFails() const;
+
+        /**
+         * @brief Get the call count of @ref tryShrink().
+         *
+         * Get the total amount of times @ref tryShrink() was called since the last counter reset.
+         *
+         * @return The call count of @ref tryShrink().
+         *
+         * @see @ref tryShrink(), @ref getTotalShrinkFails(), @ref getInPlaceRate()
+         */
+        virtual uintmax_t getTotalShrinks() const;
+
+        /**
+         * @brief Get the amount of times @ref tryShrink() was unsuccessful.
+         *
+         * Get the total amount of times @ref tryShrink() couldn't resize the allocation in place.
+         *
+         * @return The fail count of @ref tryShrink().
+         *
+         * @see @ref tryShrink(), @ref getTotalShrinks(), @ref getInPlaceRate()
+         */
+        virtual uintmax_t getTotalShrinkFails() const;
+
+        /**
+         * @brief Get the success rate of in place resizing.
+         *
+         * The fraction of @ref tryExpand() and @ref tryShrink() calls which resized the allocation in place, since the last counter reset.
+         * Compare with @ref getTotalReallocMoves() to see how many copies the in place path saves.
+         *
+         * @return The success rate in the [0, 1] range, 0 if neither function was called.
+         */
+        virtual double getInPlaceRate() const;
+
+        /**
+         * @brief Get the allocation size histogram.
+         *
+         * Returns a snapshot of the requested sizes of every successful allocation and reallocation.
+         * Only recorded with the @ref Histograms option, all buckets are zero otherwise.
+         *
+         * @return Histogram of requested sizes in bytes.
+         */
+        virtual Histogram getSizeHistogram() const;
+
+        /**
+         * @brief Get the alignment histogram.
+         *
+         * Returns a snapshot of the requested alignments of every successful allocation and reallocation.
+         * Only recorded with the @ref Histograms option, all buckets are zero otherwise.
+         *
+         * @return Histogram of requested alignments in bytes.
+         */
+        virtual Histogram getAlignHistogram() const;
+
+        /**
+         * @brief Get the reallocation growth histogram.
+         *
+         * Returns a snapshot of the size differences of every successful reallocation which grew the allocation.
+         * Only recorded with the @ref Histograms option, all buckets are zero otherwise.
+         *
+         * @return Histogram of reallocation growth in bytes.
+         */
+        virtual Histogram getReallocGrowthHistogram() const;
+
+        /**
+         * @brief Get the latency histogram of an operation.
+         *
+         * The histogram holds the sampled call durations in nanoseconds.
+         *
+         * @param op The timed operation.
+         * @return The latency histogram of @a op, @b nullptr if the @ref Timing option is not set.
+         */
+        virtual const Util::LatencyHistogram* getLatencyHistogram(Operation op) const;
+
+        /**
+         * @brief Get a latency percentile of an operation.
+         *
+         * For example pass 0.5 for the median, 0.99 for p99 or 0.999 for p999.
+         *
+         * @param op The timed operation.
+         * @param percentile The requested percentile in the [0, 1] range.
+         * @return The sampled latency at @a percentile in nanoseconds, 0 if nothing was sampled or the @ref Timing option is not set.
+         *
+         * @see @ref Util::LatencyHistogram::getPercentile
+         */
+        virtual uint64_t getLatencyPercentile(Operation op, double percentile) const;
+
         /**
          * @brief Reset all the counters.
          *
@@ -281,14 +616,33 @@ namespace Memory
          */
         virtual void resetCounters();
 
+        /**
+         * @brief Collect every counter at once.
+         *
+         * Reads every counter in a single pass over the counter blocks, without any virtual calls beyond querying the backing allocator's memory figures.
+         * The counters are read one after another without locking, concurrent calls may still be reflected in only some of them.
+         *
+         * @return Snapshot of the counters.
+         *
+         * @see @ref Snapshot::diff
+         */
+        Snapshot snapshot() const;
+
         // -- ObjectAllocator API -- All calls are wrapped
 
         virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
         virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
         virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
         virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
         virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
         virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
 
         virtual void* offer(void* ptr, uint32_t priority = 0) override;
         virtual void* reclaim(void* ptr) override;
@@ -301,38 +655,92 @@ namespace Memory
         virtual size_t getUsedBytes() const override;
         virtual size_t getPendingBytes() const override;
         virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
 
     protected:
 
+        /**
+         * @brief Block of statistic counters.
+         *
+         * Aligned to the cache line size so that separate blocks updated by separate threads never share a cache line.
+         */
+        struct alignas(PLATFORM_CACHE_LINE_SIZE) Counters
+        {
+            // Very basic stats
+            std::atomic<size_t> smallest{ std::numeric_limits<size_t>::max() }; // Smallest allocation done in size
+            std::atomic<size_t> largest{ 0 }; // Largest allocation done in size
+            std::atomic<size_t> highest{ 0 }; // Highest reported total usage
+
+            // alloc stats
+            std::atomic<uintmax_t> allocC{ 0 }; // Total allocation call count
+            std::atomic<uintmax_t> alloc_failC{ 0 }; // Total allocation call fail count
+            std::atomic<size_t> alloc_largest_fail{ 0 }; // Largest allocation that failed
+            std::atomic<uintmax_t> allocB{ 0 }; // Total allocated bytes during lifetime
+
+            // realloc stats
+            std::atomic<uintmax_t> reallocC{ 0 }; // Total reallocation call count
+            std::atomic<uintmax_t> realloc_failC{ 0 }; // Total reallocation call fail count
+            std::atomic<uintmax_t> realloc_growthB{ 0 }; // Total allocation size growth
+            std::atomic<uintmax_t> realloc_shrinkB{ 0 }; // Total allocation size shrink
+            std::atomic<uintmax_t> realloc_moveC{ 0 }; // Number of times when allocation got moved
+            std::atomic<uintmax_t> realloc_moveB{ 0 }; // Total amount of bytes that had to be moved
+
+            // In place resize stats
+            std::atomic<uintmax_t> expandC{ 0 }; // Total tryExpand call count
+            std::atomic<uintmax_t> expand_failC{ 0 }; // Total tryExpand call fail count
+            std::atomic<uintmax_t> shrinkC{ 0 }; // Total tryShrink call count
+            std::atomic<uintmax_t> shrink_failC{ 0 }; // Total tryShrink call fail count
+
+            // offer/reclaim stats
+            std::atomic<uintmax_t> offerC{ 0 }; // Total offers
+            std::atomic<uintmax_t> offerB{ 0 }; // Total offered bytes
+            std::atomic<uintmax_t> reclaimC{ 0 }; // Total reclaims
+            std::atomic<uintmax_t> reclaim_failC{ 0 }; // Total failed reclaims
+            std::atomic<uintmax_t> reclaimB{ 0 }; // Total reclaimed bytes
+
+            // Histograms, only updated with the Histograms option
+            std::atomic<uintmax_t> size_histogram[HistogramBuckets] = {}; // Requested sizes
+            std::atomic<uintmax_t> align_histogram[HistogramBuckets] = {}; // Requested alignments
+            std::atomic<uintmax_t> growth_histogram[HistogramBuckets] = {}; // Reallocation growth
+        };
+
+        /**
+         * @brief Get the counter block of the calling thread.
+         *
+         * Returns the shared counter block, or the calling thread's shard in @ref Sharded mode.
+         */
+        Counters& getCounters() noexcept;
+
+        // Aggregate a counter over every counter block
+        template<class T>
+        T sumCounters(std::atomic<T> Counters::* counter) const noexcept;
+        template<class T>
+        T maxCounters(std::atomic<T> Counters::* counter) const noexcept;
+        template<class T>
+        T minCounters(std::atomic<T> Counters::* counter) const noexcept;
+
+        // Update the counters after a reallocation of a block previously sized last_size
+        void countRealloc(Counters& counters, void* ptr, void* ret, size_t last_size, size_t bytes, size_t align) noexcept;
+
+        // Timestamp of a sampled call in nanoseconds, 0 if the call is not sampled
+        uint64_t beginSample() const noexcept;
+        void endSample(Operation op, uint64_t start) noexcept;
+
+        // Sum a histogram over every counter block
+        Histogram sumHistogram(std::atomic<uintmax_t> (Counters::* histogram)[HistogramBuckets]) const noexcept;
+
         // Backing data
         BasicAllocator* m_basic_backing;
         ObjectAllocator* m_object_backing;
 
-        // Very basic stats
-        std::atomic<size_t> m_smallest; // Smallest allocation done in size
-        std::atomic<size_t> m_largest; // Largest allocation done in size
-        std::atomic<size_t> m_highest; // Highest reported total usage
-
-        // alloc stats
-        std::atomic<uintmax_t> m_allocC; // Total allocation call count
-        std::atomic<uintmax_t> m_alloc_failC; // Total allocation call fail count
-        std::atomic<size_t> m_alloc_largest_fail; // Largest allocation that failed
-        std::atomic<uintmax_t> m_allocB; // Total allocated bytes during lifetime
-
-        // realloc stats
-        std::atomic<uintmax_t> m_reallocC; // Total reallocation call count
-        std::atomic<uintmax_t> m_realloc_failC; // Total reallocation call fail count
-        std::atomic<uintmax_t> m_realloc_growthB; // Total allocation size growth
-        std::atomic<uintmax_t> m_realloc_shrinkB; // Total allocation size shrink
-        std::atomic<uintmax_t> m_realloc_moveC; // Number of times when allocation got moved
-        std::atomic<uintmax_t> m_realloc_moveB; // Total amount of bytes that had to be moved
-
-        // offer/reclaim stats
-        std::atomic<uintmax_t> m_offerC; // Total offers
-        std::atomic<uintmax_t> m_offerB; // Total offered bytes
-        std::atomic<uintmax_t> m_reclaimC; // Total reclaims
-        std::atomic<uintmax_t> m_reclaim_failC; // Total failed reclaims
-        std::atomic<uintmax_t> m_reclaimB; // Total reclaimed bytes
+        // Stats
+        uint32_t m_options; // Options passed at construction
+        size_t m_shard_mask; // Shard count minus one, the shard count is always a power of two
+        Counters* m_shards; // Per thread counter blocks in Sharded mode, nullptr otherwise
+        Counters m_counters; // Counter block used when not in Sharded mode
+
+        uint32_t m_sample_mask; // Sample rate minus one, the sample rate is always a power of two
+        Util::LatencyHistogram* m_latency; // Histogram of each operation in Timing mode, nullptr otherwise
 
     };
 }
@@ -0,0 +1,101 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_ARENAALLOCATOR_HPP
+#define SHARED_MEMORY_ARENAALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+namespace Memory
+{
+    /**
+     * @brief Monotonic arena allocator.
+     *
+     * The ArenaAllocator class hands out memory by bumping a pointer, either inside a caller supplied buffer or inside a chain of pages mapped from the operating system.
+     * Individual allocations are never deallocated, @ref free is a no-op. All memory is reclaimed at once by @ref reset, which rewinds the arena in constant time and keeps the mapped pages for reuse.
+     * Suited for scratch memory with a well defined lifetime, like per frame or per request data.
+     *
+     * Each allocation is preceded by its size, so @ref getAllocSize works and the most recent allocation can be resized in place by @ref realloc, @ref tryExpand and @ref tryShrink.
+     * The statistic functions report exact figures: used bytes include the size prefixes, alignment padding and page tails skipped when an allocation didn't fit.
+     *
+     * The calls are not concurrently safe.
+     *
+     * @see @ref BasicAllocator, @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API ArenaAllocator : public BasicAllocator
+    {
+    public:
+
+        /// Default minimum size of the pages mapped by a growing arena.
+        static constexpr size_t DefaultPageBytes = 64 * 1024;
+
+        /**
+         * @brief Construct an arena growing on demand.
+         *
+         * Pages are mapped from the operating system when the arena runs out of space. No memory is mapped until the first allocation.
+         *
+         * @param page_bytes Minimum size of a page, larger allocations get a page of their own size.
+         */
+        ArenaAllocator(size_t page_bytes = DefaultPageBytes);
+
+        /**
+         * @brief Construct an arena over a caller supplied buffer.
+         *
+         * The arena never grows, allocations return @b nullptr once the buffer is exhausted.
+         * The buffer must outlive the arena.
+         *
+         * @param buffer The memory to allocate from.
+         * @param bytes Size of @a buffer in bytes.
+         */
+        ArenaAllocator(void* buffer, size_t bytes);
+
+        ArenaAllocator(const ArenaAllocator&) = delete;
+        ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+        /**
+         * @brief Destroy the arena.
+         *
+         * Returns every mapped page to the operating system.
+         */
+        virtual ~ArenaAllocator();
+
+        // -- BasicAllocator API --
+
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        struct Page;
+
+        // Move to the next page able to hold the allocation, mapping one if necessary
+        bool nextPage(size_t bytes, size_t align);
+
+        Page* m_pages; // First page of the chain, nullptr over a caller supplied buffer
+        Page* m_current; // Page currently bumped
+
+        char* m_buffer; // Start of the first region, the caller's buffer or the first page
+        char* m_top; // Next free byte of the current region
+        char* m_end; // End of the current region
+
+        size_t m_page_bytes; // Minimum page size, 0 over a caller supplied buffer
+        size_t m_used; // Bytes consumed since the last reset
+        size_t m_total; // Size of all regions
+    };
+}
+
+#endif /* SHARED_MEMORY_ARENAALLOCATOR_HPP */
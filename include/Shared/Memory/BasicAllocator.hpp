@@ -55,6 +55,28 @@ namespace Memory
          */
         virtual void free(void* ptr) = 0;
 
+        /**
+         * @brief Free a memory block of known size.
+         *
+         * Same as @ref free, but the caller also passes the size the block was requested with, like C++14 sized deallocation does.
+         * Implementations may use @a bytes to skip looking up the size of the block in their metadata. \n
+         * Passing a value other than the @a bytes last passed to @ref alloc, @ref realloc or @ref reallocSized for the block may cause undefined behavior and memory corruption.
+         *
+         * The default implementation ignores @a bytes and calls @ref free.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param ptr Pointer to a valid allocated memory block. May be @b nullptr.
+         * @param bytes The size the block was requested with.
+         *
+         * @see @ref free, @ref alloc
+         */
+        virtual void free(void* ptr, size_t bytes)
+        {
+            (void)bytes;
+            this->free(ptr);
+        }
+
         /**
          * @brief Reallocate memory.
          *
@@ -80,6 +102,76 @@ namespace Memory
          */
         virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) = 0;
 
+        /**
+         * @brief Reallocate memory of known size.
+         *
+         * Same as @ref realloc, but the caller also passes the size the block was requested with.
+         * Implementations may use @a old_bytes to skip looking up the size of the block in their metadata. \n
+         * Passing a value other than the @a bytes last passed to @ref alloc, @ref realloc or @ref reallocSized for the block may cause undefined behavior and memory corruption.
+         * Named differently from @ref realloc, since an overload taking two sizes would be ambiguous with ObjectAllocator's @b realloc taking a destructor function when passed a literal 0.
+         *
+         * The default implementation ignores @a old_bytes and calls @ref realloc.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param ptr Pointer to a valid allocated memory block. May be @b nullptr, in which case @a old_bytes must be zero.
+         * @param old_bytes The size the block was requested with.
+         * @param bytes Amount of bytes requested. May be a zero value.
+         * @param align Requested pointer alignedness. Must be a power of two.
+         * @return A valid pointer to the beginning of the adjusted memory block on success, @b nullptr otherwise.
+         *
+         * @see @ref realloc, @ref free
+         */
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t))
+        {
+            (void)old_bytes;
+            return this->realloc(ptr, bytes, align);
+        }
+
+        /**
+         * @brief Grow a memory block without moving it.
+         *
+         * Try to resize the memory block at @a ptr to at least @a bytes while keeping its address, so none of its content has to be copied.
+         * Unlike @ref realloc this never relocates the allocation: on failure nothing changes and the caller may decide how to proceed, for example allocating a larger block itself. \n
+         * After a successful call @a bytes counts as the size the block was requested with, for the sized @ref free overload and @ref reallocSized as well.
+         * Implementations may grow into adjacent free space or into an unused tail of the block.
+         *
+         * The default implementation succeeds only if the block is already large enough, as reported by @ref getAllocSize.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param ptr Pointer to a valid allocated memory block. May be @b nullptr, in which case the call fails.
+         * @param bytes Amount of bytes requested.
+         * @return @b true if the block at @a ptr now holds at least @a bytes, @b false otherwise.
+         *
+         * @see @ref tryShrink, @ref realloc
+         */
+        virtual bool tryExpand(void* ptr, size_t bytes)
+        {
+            return ptr != nullptr && bytes <= this->getAllocSize(ptr);
+        }
+
+        /**
+         * @brief Shrink a memory block without moving it.
+         *
+         * Same as @ref tryExpand, but meant for a smaller @a bytes: implementations may give the memory past @a bytes back, where they can do so in place. \n
+         * After a successful call @a bytes counts as the size the block was requested with, for the sized @ref free overload and @ref reallocSized as well.
+         *
+         * The default implementation keeps the block as is and succeeds if it's large enough, as reported by @ref getAllocSize.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param ptr Pointer to a valid allocated memory block. May be @b nullptr, in which case the call fails.
+         * @param bytes Amount of bytes requested.
+         * @return @b true if the block at @a ptr now holds at least @a bytes, @b false otherwise.
+         *
+         * @see @ref tryExpand, @ref realloc
+         */
+        virtual bool tryShrink(void* ptr, size_t bytes)
+        {
+            return ptr != nullptr && bytes <= this->getAllocSize(ptr);
+        }
+
         /**
          * @brief Get the allocated memory block's size.
          *
@@ -97,6 +189,57 @@ namespace Memory
          */
         virtual size_t getAllocSize(const void* ptr) const = 0;
 
+        /**
+         * @brief Allocate multiple memory blocks.
+         *
+         * Allocate @a count aligned memory blocks, each at least @a bytes sized, and store the pointers to @a out.
+         * The blocks are independent allocations, each of them may be passed to @ref free or @ref freeBulk separately. \n
+         * Allocation stops at the first failure, the return value tells how many leading entries of @a out got filled.
+         *
+         * The default implementation calls @ref alloc for each block. Implementations may override it to take locks once or carve the blocks from a contiguous run.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param bytes Amount of bytes requested for each block. May be a zero value.
+         * @param count Amount of blocks requested.
+         * @param out Array of at least @a count pointers receiving the allocations.
+         * @param align Requested pointer alignedness. Must be a power of two.
+         * @return The amount of blocks successfully allocated.
+         *
+         * @see @ref alloc, @ref freeBulk
+         */
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t))
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[i] = this->alloc(bytes, align);
+                if (out[i] == nullptr)
+                    return i;
+            }
+            return count;
+        }
+
+        /**
+         * @brief Free multiple memory blocks.
+         *
+         * Free every memory block in @a ptrs, as if @ref free was called on each of them in order.
+         * The blocks don't have to originate from the same @ref allocBulk call.
+         *
+         * The default implementation calls @ref free for each block.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param ptrs Array of pointers to valid allocated memory blocks. Entries may be @b nullptr.
+         * @param count Amount of entries in @a ptrs.
+         *
+         * @see @ref free, @ref allocBulk
+         */
+        virtual void freeBulk(void** ptrs, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                this->free(ptrs[i]);
+        }
+
         /**
          * @brief Reset the memory allocator.
          *
@@ -149,6 +292,27 @@ namespace Memory
          */
         virtual size_t getTotalBytes() const = 0;
 
+        /**
+         * @brief Get the amount of blocks freed by the thread owning them and by other threads.
+         *
+         * Allocators keeping per thread heaps count the two kinds of frees, wrapping allocators forward the counts of their backing allocator.
+         * The default implementation doesn't count anything and fails.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @param local Set to the amount of blocks freed by their owner thread.
+         * @param remote Set to the amount of blocks freed by other threads.
+         * @return @b true if the counts got set, @b false if the allocator doesn't count them, then @a local and @a remote are left untouched.
+         *
+         * @see @ref AllocatorStatistic::Snapshot
+         */
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const
+        {
+            (void)local;
+            (void)remote;
+            return false;
+        }
+
         /**
          * @brief Get required alignment offset.
          *
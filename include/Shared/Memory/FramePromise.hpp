@@ -0,0 +1,138 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_FRAMEPROMISE_HPP
+#define SHARED_MEMORY_FRAMEPROMISE_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <memory>
+#include <new>
+
+namespace Memory
+{
+    /**
+     * @brief Coroutine promise mixin allocating the frames from a BasicAllocator.
+     *
+     * A coroutine promise type deriving from the FramePromise class allocates the coroutine frames from a @ref BasicAllocator instead of the global @b operator @b new. The allocator is selected by the coroutine's arguments:
+     * - A coroutine taking @b std::allocator_arg and a @ref BasicAllocator pointer as its first arguments allocates its frame from that allocator. Member function coroutines take them right after the implicit object argument.
+     * - Any other coroutine allocates from the allocator of the innermost @ref Scope of the calling thread, or from the global @b operator @b new if there is none.
+     *
+     * The allocator is recorded in front of the frame, so frames are freed with a sized free to the allocator which allocated them, on any thread. Wrapping the allocator in an @ref AllocatorStatistic makes the frames visible in its figures.
+     * Allocation failures are reported by throwing @b std::bad_alloc.
+     *
+     * The class has no dependency on the coroutine support library, it builds with any language version.
+     * Thread safety is the same as the selected allocator's.
+     *
+     * Code example:
+     * \code{.cpp}
+        struct Task
+        {
+            struct promise_type : Memory::FramePromise
+            {
+                // The usual promise members
+            };
+        };
+
+        Task handle(std::allocator_arg_t, Memory::BasicAllocator* allocator, Connection& connection);
+
+        Memory::TaskArena arena;
+        handle(std::allocator_arg, &arena, connection); \endcode
+     *
+     * @see @ref TaskArena, @ref StdAllocator
+     */
+    class SHARED_LIB_API FramePromise
+    {
+    public:
+
+        /**
+         * @brief Selects the frame allocator of the calling thread.
+         *
+         * Coroutines created on the thread without an allocator argument allocate their frames from the allocator of the innermost scope. Scopes must be nested properly.
+         */
+        class Scope
+        {
+        public:
+
+            /**
+             * @brief Select a frame allocator.
+             *
+             * @param allocator The allocator of the frames, must outlive every frame allocated from it. @b nullptr selects the global @b operator @b new.
+             */
+            explicit Scope(BasicAllocator* allocator) noexcept :
+                m_previous(FramePromise::getCurrent())
+            {
+                FramePromise::setCurrent(allocator);
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            /**
+             * @brief Restore the frame allocator selected before construction.
+             */
+            ~Scope()
+            {
+                FramePromise::setCurrent(this->m_previous);
+            }
+
+        private:
+
+            BasicAllocator* m_previous;
+        };
+
+        /**
+         * @brief Get the frame allocator of the calling thread.
+         *
+         * @return The allocator of the innermost @ref Scope, @b nullptr if there is none.
+         */
+        static BasicAllocator* getCurrent() noexcept;
+
+        /**
+         * @brief Allocate a frame from the allocator of the calling thread.
+         */
+        static void* operator new(size_t bytes)
+        {
+            return allocFrame(bytes, getCurrent());
+        }
+
+        /**
+         * @brief Allocate a frame from the allocator passed to a coroutine.
+         */
+        template<class... Args>
+        static void* operator new(size_t bytes, std::allocator_arg_t, BasicAllocator* allocator, Args&...)
+        {
+            return allocFrame(bytes, allocator);
+        }
+
+        /**
+         * @brief Allocate a frame from the allocator passed to a member function coroutine.
+         */
+        template<class Class, class... Args>
+        static void* operator new(size_t bytes, Class&, std::allocator_arg_t, BasicAllocator* allocator, Args&...)
+        {
+            return allocFrame(bytes, allocator);
+        }
+
+        /**
+         * @brief Free a frame to the allocator which allocated it.
+         */
+        static void operator delete(void* ptr, size_t bytes) noexcept
+        {
+            freeFrame(ptr, bytes);
+        }
+
+    protected:
+
+        // Leading part of the frame allocation recording the allocator, keeps the frame aligned
+        static constexpr size_t HeaderSize = alignof(max_align_t) >= sizeof(BasicAllocator*) ? alignof(max_align_t) : sizeof(BasicAllocator*);
+
+        static void setCurrent(BasicAllocator* allocator) noexcept;
+
+        static void* allocFrame(size_t bytes, BasicAllocator* allocator);
+        static void freeFrame(void* ptr, size_t bytes) noexcept;
+    };
+}
+
+#endif /* SHARED_MEMORY_FRAMEPROMISE_HPP */
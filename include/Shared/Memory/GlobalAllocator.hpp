@@ -0,0 +1,99 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_GLOBALALLOCATOR_HPP
+#define SHARED_MEMORY_GLOBALALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/AllocatorStatistic.hpp>
+
+#ifndef SHARED_MEMORY_GLOBAL_THREAD_CACHE
+/**
+ * @brief Put a @ref Memory::ThreadCacheAllocator in front of the global heap, 1 by default.
+ */
+#   define SHARED_MEMORY_GLOBAL_THREAD_CACHE 1
+#endif
+
+#ifndef SHARED_MEMORY_GLOBAL_STATISTIC_OPTIONS
+/**
+ * @brief @ref Memory::AllocatorStatistic::Options of the global statistic, none by default.
+ */
+#   define SHARED_MEMORY_GLOBAL_STATISTIC_OPTIONS 0
+#endif
+
+namespace Memory
+{
+    /**
+     * @brief Process wide allocator behind the replaced global allocation functions.
+     *
+     * The GlobalAllocator class owns a single allocator chain for the whole process: a @ref Heap, fronted by a @ref ThreadCacheAllocator unless @ref SHARED_MEMORY_GLOBAL_THREAD_CACHE is 0, wrapped in an @ref AllocatorStatistic.
+     * The global allocation functions can be replaced by calls into it, so code not written against the library gets its allocators and shows up in the statistic:
+     * - Building the library with @b SHARED_MEMORY_OVERRIDE_NEW defined replaces every global @b operator @b new and @b operator @b delete overload, including the sized, aligned and non-throwing ones.
+     * - Building the library with @b SHARED_MEMORY_OVERRIDE_MALLOC defined replaces @b malloc, @b free, @b calloc, @b realloc and the aligned variants on GNU/Linux. A shared library build interposes the C library's allocator when linked first or loaded with @b LD_PRELOAD.
+     *
+     * The chain is constructed in static storage by the first allocation of the process, which may happen before any static constructor runs, and is never destroyed, so memory may still be freed during static destruction.
+     * Allocations made while the chain is being constructed are served from a small static bootstrap buffer. Bootstrap blocks are never reused, freeing them is a no-op.
+     *
+     * The getters are usable whether or not the global allocation functions are replaced, the chain is then only used by callers of the member functions.
+     * All calls are concurrently safe.
+     *
+     * @see @ref AllocatorStatistic, @ref ThreadCacheAllocator, @ref Heap
+     */
+    class SHARED_LIB_API GlobalAllocator
+    {
+    public:
+
+        /// Size of the static buffer serving the allocations made while the chain is constructed.
+        static constexpr size_t BootstrapBytes = 64 * 1024;
+
+        GlobalAllocator() = delete;
+
+        /**
+         * @brief Get the process wide allocator.
+         *
+         * @return The statistic wrapping the chain, constructing the chain on first use. @b nullptr while the chain is being constructed.
+         */
+        static AllocatorStatistic* getStatistic();
+
+        /**
+         * @brief Allocate from the process wide allocator, or from the bootstrap buffer while it's being constructed.
+         *
+         * @return The allocated block, @b nullptr on failure.
+         */
+        static void* alloc(size_t bytes, size_t align = alignof(max_align_t));
+
+        /**
+         * @brief Free a block returned by @ref alloc or @ref realloc.
+         *
+         * @param ptr The block, may be @b nullptr.
+         */
+        static void free(void* ptr);
+
+        /**
+         * @brief Free a block with a size hint.
+         *
+         * @param ptr The block, may be @b nullptr.
+         * @param bytes The size requested when the block was allocated.
+         */
+        static void free(void* ptr, size_t bytes);
+
+        /**
+         * @brief Reallocate a block returned by @ref alloc or @ref realloc.
+         *
+         * @return The reallocated block, @b nullptr on failure, then @a ptr is left untouched.
+         */
+        static void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t));
+
+        /**
+         * @brief Get the usable size of a block returned by @ref alloc or @ref realloc.
+         */
+        static size_t getAllocSize(const void* ptr);
+
+        /**
+         * @brief Check whether a block was allocated from the bootstrap buffer.
+         */
+        static bool isBootstrap(const void* ptr) noexcept;
+    };
+}
+
+#endif /* SHARED_MEMORY_GLOBALALLOCATOR_HPP */
@@ -0,0 +1,281 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_GUARDEDALLOCATOR_HPP
+#define SHARED_MEMORY_GUARDEDALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Memory/VirtualAllocator.hpp>
+#include <Shared/Util/BitMask.hpp>
+
+#include <atomic>
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Sampling heap corruption detector proxy.
+     *
+     * The GuardedAllocator class acts as a proxy layer over the actual allocator, like @ref AllocatorStatistic does, and checks a sample of the allocations for buffer overflows, invalid and double frees and use after free.
+     * One in every @a sample_rate allocations on each thread is sampled, every other call is forwarded to the backing allocator untouched, so the detector is cheap enough to leave enabled in production canaries.
+     *
+     * Sampled blocks are served from a private address space reservation instead of the backing allocator, and carry a header in front of them:
+     * - With @ref Redzones the block is surrounded by @ref RedzoneSize bytes filled with @ref CanaryByte, verified when the block is freed or reallocated, and by @ref verify.
+     * - With @ref GuardPages blocks of at least @ref GuardPageMinSize bytes end right before an inaccessible page, so overflowing writes and reads fault at the first byte past the block, rounded up to the alignment.
+     * - With @ref Quarantine freed blocks are filled with @ref FreedByte, or made inaccessible in case of whole pages, and held back from reuse until more than the quarantine limit is freed after them. Their content is verified when they leave the quarantine.
+     *
+     * Detected errors are reported to the handler set by @ref setErrorHandler. By default they are printed to the standard error output and the process is aborted.
+     *
+     * Allocations with a destructor function and the blocks of @ref allocBulk are never sampled. Offered sampled blocks are kept until reclaimed or freed, @ref purge doesn't release them.
+     * Sampled blocks take at least a page each, @ref getUsedBytes and the other figures include the guarded region.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * @see @ref AllocatorStatistic, @ref VirtualAllocator
+     */
+    class SHARED_LIB_API GuardedAllocator : public ObjectAllocator
+    {
+    public:
+
+        /**
+         * @brief Construction options.
+         *
+         * Checks applied to the sampled blocks, may be combined.
+         */
+        enum Options : uint32_t
+        {
+            /// Sampled blocks are only checked for invalid frees.
+            None = 0,
+            /// Surround sampled blocks by canary filled redzones.
+            Redzones = Util::BitMask<0>::value,
+            /// Delay the reuse of freed sampled blocks, also detects double frees.
+            Quarantine = Util::BitMask<1>::value,
+            /// Place large sampled blocks right before an inaccessible page.
+            GuardPages = Util::BitMask<2>::value
+        };
+
+        /// Detected error types.
+        enum ErrorType : uint32_t
+        {
+            /// A pointer not allocated by the allocator, or with a corrupted header got freed.
+            InvalidFree = 0,
+            /// A quarantined block got freed again.
+            DoubleFree,
+            /// The front redzone of a block got overwritten.
+            Underflow,
+            /// The tail redzone of a block got overwritten.
+            Overflow,
+            /// A quarantined block got written to.
+            UseAfterFree
+        };
+
+        /**
+         * @brief A detected error.
+         */
+        struct Error
+        {
+            ErrorType type;
+            const void* ptr; // The block, or the pointer passed to free
+            size_t size; // Requested size of the block, 0 for invalid frees
+            const void* address; // First corrupted byte, same as ptr for invalid and double frees
+        };
+
+        /**
+         * @brief Callback of @ref setErrorHandler.
+         *
+         * Called without any lock held, may call into the allocator. The block of an error detected while freeing is released once the call returns, except for invalid and double frees.
+         *
+         * @param error The detected error.
+         * @param user The user pointer passed to @ref setErrorHandler.
+         */
+        using ErrorHandler = void (*)(const Error& error, void* user);
+
+        /// Default sampling rate, one in this many allocations is sampled on each thread.
+        static constexpr uint32_t DefaultSampleRate = 256;
+
+        /// Default upper limit of the quarantined bytes.
+        static constexpr size_t DefaultQuarantineBytes = 16 * 1024 * 1024;
+
+        /// Size of the address space reserved for the sampled blocks.
+        static constexpr size_t ReserveBytes = sizeof(void*) >= 8 ? (size_t(4) << 30) : (size_t(64) << 20);
+
+        /// Size of each redzone of the @ref Redzones option.
+        static constexpr size_t RedzoneSize = 32;
+
+        /// Smallest sampled block placed before a guard page by the @ref GuardPages option.
+        static constexpr size_t GuardPageMinSize = 4096;
+
+        /// Fill byte of the redzones.
+        static constexpr uint8_t CanaryByte = 0xCA;
+
+        /// Fill byte of the quarantined blocks.
+        static constexpr uint8_t FreedByte = 0xDF;
+
+        /**
+         * @brief Construct a GuardedAllocator object.
+         *
+         * Reserves @ref ReserveBytes of address space for the sampled blocks. If the reservation fails or runs out, allocations are forwarded to the backing allocator unsampled.
+         * Calling @ref ObjectAllocator member functions other than the ones of @ref BasicAllocator will result in an error.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         * @param options Combination of @ref Options values.
+         * @param sample_rate One in this many allocations is sampled on each thread, rounded up to a power of two. 0 or 1 samples every allocation.
+         * @param quarantine_bytes Upper limit of the quarantined bytes for the @ref Quarantine option.
+         */
+        GuardedAllocator(BasicAllocator* backing, uint32_t options = Redzones | Quarantine | GuardPages, uint32_t sample_rate = DefaultSampleRate, size_t quarantine_bytes = DefaultQuarantineBytes);
+
+        /**
+         * @copydoc GuardedAllocator(BasicAllocator*, uint32_t, uint32_t, size_t)
+         */
+        GuardedAllocator(ObjectAllocator* backing, uint32_t options = Redzones | Quarantine | GuardPages, uint32_t sample_rate = DefaultSampleRate, size_t quarantine_bytes = DefaultQuarantineBytes);
+
+        GuardedAllocator(const GuardedAllocator&) = delete;
+        GuardedAllocator& operator=(const GuardedAllocator&) = delete;
+
+        /**
+         * @brief Destroy the GuardedAllocator object.
+         *
+         * Verifies and releases the quarantined blocks, and releases the address space of the sampled blocks, including the ones still allocated.
+         */
+        virtual ~GuardedAllocator();
+
+        /**
+         * @brief Set the function receiving the detected errors.
+         *
+         * Not concurrently safe with the other calls.
+         *
+         * @param handler The function to call, @b nullptr restores the default handler printing the error and aborting the process.
+         * @param user Arbitrary pointer passed on to @a handler.
+         */
+        void setErrorHandler(ErrorHandler handler, void* user = nullptr) noexcept;
+
+        /**
+         * @brief Check the redzones of every allocated sampled block.
+         *
+         * @return Amount of errors found, each of them got reported to the error handler.
+         */
+        size_t verify();
+
+        /**
+         * @brief Verify and release every quarantined block.
+         */
+        void flushQuarantine();
+
+        /**
+         * @brief Check whether a block was sampled.
+         *
+         * @param ptr Pointer to a valid allocated memory block.
+         */
+        bool isSampled(const void* ptr) const noexcept;
+
+        /**
+         * @brief Get the amount of sampled allocations.
+         */
+        uint64_t getSampledCount() const noexcept;
+
+        /**
+         * @brief Get the amount of detected errors.
+         */
+        uint64_t getErrorCount() const noexcept;
+
+        /**
+         * @brief Get the amount of bytes held in the quarantine.
+         */
+        size_t getQuarantinedBytes() const;
+
+        /**
+         * @brief Get the backing allocator.
+         */
+        BasicAllocator* getBacking() const noexcept;
+
+        /**
+         * @brief Get the name of an error type.
+         */
+        static const char* getErrorName(ErrorType type) noexcept;
+
+        // -- ObjectAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+        virtual void* reclaim(void* ptr) override;
+
+        virtual void reset() override;
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override;
+        virtual void clear() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getPendingBytes() const override;
+        virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
+
+    protected:
+
+        struct Block;
+
+        // Decide whether the calling thread's next allocation is sampled
+        bool shouldSample() const noexcept;
+
+        // Allocate a sampled block from the guarded region, nullptr if it's exhausted
+        void* allocSampled(size_t bytes, size_t align);
+        void freeSampled(void* ptr);
+
+        // Validated header of a sampled block, reports an invalid free and returns nullptr if the pointer doesn't belong to a sampled block
+        Block* getBlock(void* ptr);
+
+        // Report every corrupted redzone of a block, return the amount of errors
+        size_t checkRedzones(const Block* block);
+
+        // Take the oldest quarantined blocks while the quarantine holds more than limit bytes, the allocator must be locked
+        Block* evict(size_t limit);
+
+        // Verify the content of evicted blocks and release them
+        void releaseEvicted(Block* blocks);
+
+        // Make the pages of a block accessible again and return it to the guarded region
+        void release(Block* block) noexcept;
+
+        // Release every sampled block without any checks, no calls may be in progress
+        void releaseAll() noexcept;
+
+        void report(ErrorType type, const void* ptr, size_t size, const void* address);
+
+        // Backing data
+        BasicAllocator* m_basic_backing;
+        ObjectAllocator* m_object_backing;
+
+        uint32_t m_options;
+        uint32_t m_sample_mask;
+        size_t m_quarantine_limit;
+
+        ErrorHandler m_handler;
+        void* m_handler_user;
+
+        // Sampled blocks
+        VirtualAllocator m_guarded;
+        mutable std::mutex m_mutex; // Guards the lists of sampled blocks
+        Block* m_live; // Allocated sampled blocks
+        Block* m_quarantine_head; // Oldest quarantined block
+        Block* m_quarantine_tail;
+        size_t m_quarantined;
+
+        std::atomic<uint64_t> m_sampled;
+        std::atomic<uint64_t> m_errors;
+    };
+}
+
+#endif /* SHARED_MEMORY_GUARDEDALLOCATOR_HPP */
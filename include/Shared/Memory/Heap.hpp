@@ -0,0 +1,125 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_HEAP_HPP
+#define SHARED_MEMORY_HEAP_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Memory/OfferList.hpp>
+
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief General purpose heap allocator.
+     *
+     * The Heap class is a general purpose implementation of the @ref ObjectAllocator interface over memory obtained directly from the operating system.
+     * Small allocations are served from size class segregated free lists carved out of larger memory spans, allocations over the largest size class are mapped individually.
+     * The last few large mappings freed are cached and reused by large allocations of about the same size, and large blocks are resized by remapping their pages where the system supports it, so neither round trips to the operating system nor copies the contents. Purging every priority also returns the cached mappings.
+     * Every allocation carries a small header right before the returned pointer, which makes @ref getAllocSize a constant time operation.
+     *
+     * Offered allocations are kept in priority buckets by an @ref OfferList, @ref purge releases the least important and oldest offers first without walking the live allocations.
+     * Priorities are bucketed logarithmically, so @ref purge may also release allocations offered on a slightly higher priority than requested.
+     *
+     * @ref clear and @ref purge run the destructor functions in batches of a few hundred blocks grouped by function, instead of one by one in memory order.
+     * Allocations without a destructor function never take part, and @ref clear doesn't visit the blocks at all while no live allocation has one.
+     *
+     * All calls are concurrently safe. Destructor functions are called with the heap locked, and may call back into the same heap.
+     *
+     * @see @ref ObjectAllocator, @ref BasicAllocator, @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API Heap : public ObjectAllocator
+    {
+    public:
+
+        /**
+         * @brief Construct an empty heap.
+         *
+         * No memory is obtained from the operating system until the first allocation.
+         */
+        Heap();
+
+        Heap(const Heap&) = delete;
+        Heap& operator=(const Heap&) = delete;
+
+        /**
+         * @brief Destroy the heap.
+         *
+         * Calls the destructor functions of all remaining allocations and returns every memory span to the operating system.
+         *
+         * @see @ref clear
+         */
+        virtual ~Heap();
+
+        // -- ObjectAllocator API --
+
+        using ObjectAllocator::free;
+        using ObjectAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+        virtual void* reclaim(void* ptr) override;
+
+        virtual void reset() override;
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override;
+        virtual void clear() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getPendingBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        struct BlockHeader;
+        struct Span;
+        struct LargeHeader;
+        struct Ticket;
+
+        static constexpr size_t ClassCount = 40; // Number of small size classes
+
+        // Internal helpers, the heap must be locked when called
+        void* allocBlock(size_t bytes, DestructorPtr destructor, size_t align);
+        Span* newSpan(size_t size_class);
+        void releaseBlock(BlockHeader* header);
+        void destroyBlock(BlockHeader* header);
+        void freeBlock(void* ptr);
+        void* reallocBlock(void* ptr, size_t bytes, DestructorPtr destructor, size_t align);
+        void* remapBlock(BlockHeader* header, size_t bytes, DestructorPtr destructor);
+        LargeHeader* takeCached(size_t bytes);
+        void cacheLarge(LargeHeader* large);
+        void releaseCache();
+        void unlinkTicket(Ticket* ticket);
+        void releaseAll();
+
+        mutable std::recursive_mutex m_mutex;
+
+        BlockHeader* m_free[ClassCount]; // Free blocks of each size class
+        Span* m_current[ClassCount]; // Span each size class is currently carving blocks from
+        Span* m_spans; // Every span ever obtained
+        LargeHeader* m_large; // Individually mapped allocations
+        LargeHeader* m_cache; // Freed large mappings kept for reuse, most recent first
+        size_t m_cached_count; // Mappings in the cache
+        size_t m_cached_bytes; // Bytes of the mappings in the cache
+        OfferList m_offers; // Tickets of offered allocations
+
+        size_t m_total; // Bytes obtained from the operating system
+        size_t m_used; // Bytes occupied by live blocks, including headers
+        size_t m_pending; // Usable bytes of offered blocks
+        size_t m_destructible; // Used and offered blocks with a destructor function
+        bool m_clearing; // Set while clear is running destructors
+    };
+}
+
+#endif /* SHARED_MEMORY_HEAP_HPP */
@@ -0,0 +1,186 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_HEAPPROFILER_HPP
+#define SHARED_MEMORY_HEAPPROFILER_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/AllocatorStatistic.hpp>
+
+#include <iosfwd>
+
+namespace Memory
+{
+    /**
+     * @brief Sampling heap profiler.
+     *
+     * The HeapProfiler class extends @ref AllocatorStatistic with call site tracking of live allocations.
+     * Allocations are sampled by bytes: on every thread the distance between two samples is drawn from an exponential distribution with a mean of the sample interval, so on average one sample is taken per interval bytes allocated, and large allocations are more likely to be sampled than small ones.
+     * A sample records the stack trace of the allocation and the calling thread's tag, see @ref TagScope. Samples stay in a live allocation table until the allocation is freed, reallocated or offered.
+     *
+     * The table can be dumped on demand in folded stack format, as consumed by flame graph tools, or in the legacy gperftools heap profile format read by pprof.
+     * The folded dump reports estimated bytes, each sample weighted by its probability of being sampled. The pprof dump reports raw samples, pprof unsamples them itself.
+     *
+     * The sampling state is kept per thread and shared by every profiler the thread uses. Allocations made by the profiler itself are never sampled, so it may be used to profile the allocator behind the global @b operator @b new.
+     * Stack traces are captured on Windows, GNU/Linux, OS X and BSD, elsewhere only tags are recorded.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * @see @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API HeapProfiler : public AllocatorStatistic
+    {
+    public:
+
+        /// Default mean distance between two samples in bytes.
+        static constexpr size_t DefaultSampleInterval = 512 * 1024;
+
+        /// Maximum depth of a recorded stack trace.
+        static constexpr uint32_t MaxFrames = 32;
+
+        /**
+         * @brief Tag allocations of a scope.
+         *
+         * Allocations sampled on the calling thread are tagged with the given string while the object is alive. Scopes may be nested.
+         * The tag is stored by pointer, it must remain valid as long as any profile may be dumped, string literals are recommended.
+         */
+        class SHARED_LIB_API TagScope
+        {
+        public:
+
+            TagScope(const char* tag) noexcept;
+            ~TagScope();
+
+            TagScope(const TagScope&) = delete;
+            TagScope& operator=(const TagScope&) = delete;
+
+        protected:
+
+            const char* m_previous;
+        };
+
+        /**
+         * @brief Construct a HeapProfiler object.
+         *
+         * Construct a HeapProfiler object using only @ref BasicAllocator functions.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         * @param sample_interval Mean distance between two samples in bytes, 0 samples every allocation.
+         * @param options Combination of @ref AllocatorStatistic::Options flags.
+         */
+        HeapProfiler(BasicAllocator* backing, size_t sample_interval = DefaultSampleInterval, uint32_t options = None);
+
+        /**
+         * @brief Construct a HeapProfiler object.
+         *
+         * Construct a HeapProfiler object using only @ref ObjectAllocator functions.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         * @param sample_interval Mean distance between two samples in bytes, 0 samples every allocation.
+         * @param options Combination of @ref AllocatorStatistic::Options flags.
+         */
+        HeapProfiler(ObjectAllocator* backing, size_t sample_interval = DefaultSampleInterval, uint32_t options = None);
+
+        virtual ~HeapProfiler();
+
+        // -- Profiler API --
+
+        /**
+         * @brief Get the tag of the calling thread.
+         *
+         * @return The innermost active tag, @b nullptr if there is none.
+         */
+        static const char* getTag() noexcept;
+
+        /**
+         * @brief Get the sample interval.
+         *
+         * @return Mean distance between two samples in bytes.
+         */
+        size_t getSampleInterval() const noexcept;
+
+        /**
+         * @brief Get the number of sampled live allocations.
+         *
+         * @return Amount of samples in the live allocation table.
+         */
+        size_t getSampleCount() const;
+
+        /**
+         * @brief Get the estimated live bytes.
+         *
+         * @return The estimated size of all live allocations, extrapolated from the samples.
+         */
+        size_t getEstimatedLiveBytes() const;
+
+        /**
+         * @brief Dump the live allocations in folded stack format.
+         *
+         * Writes a line for each distinct call stack, frames from the outermost to the innermost separated by semicolons, followed by a space and the estimated live bytes.
+         * The tag, if any, is written as the outermost frame.
+         *
+         * @param out The stream to write to.
+         */
+        void dumpFolded(std::ostream& out) const;
+
+        /**
+         * @brief Dump the live allocations in pprof heap profile format.
+         *
+         * Writes a legacy text heap profile with raw sample counts, followed by the memory mappings of the process where available so pprof can symbolize the addresses.
+         * Tags are not part of the format and are omitted.
+         *
+         * @param out The stream to write to.
+         */
+        void dumpPprof(std::ostream& out) const;
+
+        /**
+         * @brief Drop every sample.
+         *
+         * Empties the live allocation table while leaving the allocator and the counters intact.
+         */
+        void resetProfile();
+
+        // -- ObjectAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+
+        virtual void reset() override;
+        virtual void clear() override;
+
+    protected:
+
+        struct Sample;
+        struct Shard;
+
+        static constexpr size_t ShardCount = 16;
+
+        // Count the allocation against the calling thread's sampling distance, true if it has to be sampled
+        bool shouldSample(size_t bytes) noexcept;
+
+        void recordSample(void* ptr, size_t bytes);
+        void forgetSample(const void* ptr);
+        // Remove the sample of ptr into sample, false if ptr is not sampled
+        bool takeSample(const void* ptr, Sample& sample);
+        void restoreSample(const void* ptr, const Sample& sample);
+
+        Shard& getShard(const void* ptr) const noexcept;
+
+        size_t m_interval;
+        Shard* m_shards; // Live allocation table, sharded by pointer
+    };
+}
+
+#endif /* SHARED_MEMORY_HEAPPROFILER_HPP */
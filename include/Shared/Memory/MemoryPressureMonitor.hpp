@@ -0,0 +1,201 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_MEMORYPRESSUREMONITOR_HPP
+#define SHARED_MEMORY_MEMORYPRESSUREMONITOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Memory
+{
+    /**
+     * @brief Memory pressure driven purging of offered memory.
+     *
+     * The MemoryPressureMonitor class decides when an @ref ObjectAllocator should purge its offered allocations.
+     * Pressure is detected from watermarks on the allocator's pending and used bytes, from the operating system and from explicit @ref signal calls.
+     * On GNU/Linux and Android the pressure stall information of the process' cgroup, or of the whole system, and the cgroup's memory events are checked, on Windows the low memory resource notification is queried.
+     *
+     * Under moderate pressure the priority levels are purged incrementally, from the least important level upwards, one level with pending data per @ref poll. Pressure is reevaluated after every step, so purging stops as soon as it isn't needed anymore instead of throwing away every offer at once.
+     * A priority level corresponds to the offer priorities of the same bit width: level 0 is priority 0, level 1 is priority 1, level 2 is priorities 2 and 3 and so on.
+     * Under critical pressure everything pending is purged at once. Once the pressure is gone, the next pressure starts again from the lowest level.
+     *
+     * The watermarks have hysteresis: pressure starts when a high watermark is exceeded and ends when every enabled figure is back at or below its low watermark.
+     *
+     * Polling is either done on a background thread started by @ref start, or by the application calling @ref poll periodically.
+     * The allocator must be thread safe when the background thread is used, and must outlive the monitor.
+     *
+     * @see @ref ObjectAllocator::offer, @ref ObjectAllocator::purge
+     */
+    class SHARED_LIB_API MemoryPressureMonitor
+    {
+    public:
+
+        /// Level of memory pressure.
+        enum Level : uint32_t
+        {
+            None = 0, ///< No pressure, nothing is purged.
+            Moderate, ///< Priority levels are purged one after another.
+            Critical ///< Everything pending is purged at once.
+        };
+
+        /// Amount of priority levels purged one by one, the last level holds the highest priorities.
+        static constexpr uint32_t PurgeLevels = 33;
+
+        /// Monitor configuration.
+        struct Config
+        {
+            size_t pending_high = 0; ///< Pending bytes starting pressure, 0 disables the watermark.
+            size_t pending_low = 0; ///< Pending bytes ending pressure.
+            size_t used_high = 0; ///< Used bytes starting pressure, 0 disables the watermark.
+            size_t used_low = 0; ///< Used bytes ending pressure.
+
+            uint32_t interval_ms = 250; ///< Polling interval of the background thread in milliseconds.
+
+            bool system_signals = true; ///< Check the operating system's pressure signals.
+            float psi_some = 10.0f; ///< Percentage of time some tasks stalled on memory during the last 10 seconds, starting moderate pressure.
+            float psi_full = 2.0f; ///< Percentage of time all tasks stalled on memory during the last 10 seconds, starting critical pressure.
+        };
+
+        /**
+         * @brief Construct a MemoryPressureMonitor object with the default configuration.
+         *
+         * Without watermarks only the operating system's signals and @ref signal calls cause purging.
+         *
+         * @param allocator The allocator to purge.
+         */
+        MemoryPressureMonitor(ObjectAllocator* allocator);
+
+        /**
+         * @brief Construct a MemoryPressureMonitor object.
+         *
+         * The monitor is idle until @ref start or @ref poll is called.
+         *
+         * @param allocator The allocator to purge.
+         * @param config Watermarks and signal settings.
+         */
+        MemoryPressureMonitor(ObjectAllocator* allocator, const Config& config);
+
+        MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+        MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+
+        /**
+         * @brief Destroy the MemoryPressureMonitor object.
+         *
+         * Stops the background thread if it's running.
+         */
+        ~MemoryPressureMonitor();
+
+        /**
+         * @brief Start polling on a background thread.
+         *
+         * Does nothing if the thread is already running.
+         *
+         * @exception std::system_error Thrown when the thread couldn't be started.
+         */
+        void start();
+
+        /**
+         * @brief Stop the background thread.
+         *
+         * Waits for the thread to exit. Does nothing if the thread is not running.
+         */
+        void stop();
+
+        /**
+         * @brief Check whether the background thread is running.
+         */
+        bool isRunning() const;
+
+        /**
+         * @brief Evaluate the pressure and purge a step.
+         *
+         * Collects every pressure source and purges the next priority level holding pending data, or everything under critical pressure.
+         * Called periodically by the background thread, should not be called concurrently with it.
+         *
+         * @return The pressure level observed.
+         */
+        Level poll();
+
+        /**
+         * @brief Report pressure from an external source.
+         *
+         * The level is taken into account by the next @ref poll. Wakes up the background thread, so the purge happens right away.
+         *
+         * @param level The pressure level.
+         */
+        void signal(Level level);
+
+        /**
+         * @brief Query the operating system's pressure signals.
+         *
+         * Event counters are only reported once, so like @ref poll this should not be called concurrently with the background thread.
+         *
+         * @return The pressure reported by the operating system, @ref None if there are no signals on the platform.
+         */
+        Level getSystemPressure();
+
+        /**
+         * @brief Get the allocator purged by the monitor.
+         */
+        ObjectAllocator* getAllocator() const noexcept;
+
+        /**
+         * @brief Get the next priority level to purge.
+         *
+         * @return The level between 0 and @ref PurgeLevels, 0 when there is no pressure.
+         */
+        uint32_t getPurgeLevel() const noexcept;
+
+        /**
+         * @brief Get the amount of purge calls made.
+         */
+        uint64_t getPurgeCount() const noexcept;
+
+        /**
+         * @brief Get the amount of pending bytes freed by purging.
+         */
+        uint64_t getPurgedBytes() const noexcept;
+
+        /**
+         * @brief Get the highest offer priority of a purge level.
+         *
+         * @param level The purge level, less than @ref PurgeLevels.
+         * @return The priority to pass to @ref ObjectAllocator::purge.
+         */
+        static uint32_t getLevelPriority(uint32_t level) noexcept;
+
+    protected:
+
+        struct SystemSignals;
+
+        // Purge a single level, returns the pending bytes freed
+        size_t purgeLevel(uint32_t level);
+
+        void run();
+
+        ObjectAllocator* m_allocator;
+        Config m_config;
+        SystemSignals* m_signals;
+
+        bool m_watermark; // Watermark pressure in progress
+
+        std::atomic<uint32_t> m_level; // Next level to purge
+        std::atomic<uint32_t> m_signaled; // Highest level passed to signal since the last poll
+        std::atomic<uint64_t> m_purges;
+        std::atomic<uint64_t> m_purged_bytes;
+
+        mutable std::mutex m_mutex; // Guards the thread state
+        std::condition_variable m_wakeup;
+        std::thread m_thread;
+        bool m_running;
+        bool m_woken;
+    };
+}
+
+#endif /* SHARED_MEMORY_MEMORYPRESSUREMONITOR_HPP */
@@ -0,0 +1,60 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_MEMORYRESOURCEADAPTER_HPP
+#define SHARED_MEMORY_MEMORYRESOURCEADAPTER_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <memory_resource>
+
+namespace Memory
+{
+    /**
+     * @brief Polymorphic memory resource over a BasicAllocator.
+     *
+     * The MemoryResourceAdapter class exposes any @ref BasicAllocator as a @b std::pmr::memory_resource, so the standard @b std::pmr containers can allocate from the library's allocators.
+     * Allocation failures are reported by throwing @b std::bad_alloc, as the standard requires.
+     * Two adapters compare equal if they wrap the same allocator, memory allocated through one may be deallocated through the other.
+     *
+     * The backing allocator must outlive the adapter and every container using it.
+     * Thread safety is the same as the backing allocator's.
+     *
+     * Code example:
+     * \code{.cpp}
+        Memory::ArenaAllocator arena;
+        Memory::MemoryResourceAdapter resource(&arena);
+        std::pmr::vector<int> values(&resource); \endcode
+     *
+     * @see @ref StdAllocator, @ref BasicAllocator
+     */
+    class SHARED_LIB_API MemoryResourceAdapter : public std::pmr::memory_resource
+    {
+    public:
+
+        /**
+         * @brief Construct a MemoryResourceAdapter object.
+         *
+         * @param backing The allocator which will do the actual allocations.
+         */
+        MemoryResourceAdapter(BasicAllocator* backing) noexcept;
+
+        /**
+         * @brief Get the backing allocator.
+         *
+         * @return The wrapped allocator.
+         */
+        BasicAllocator* getBacking() const noexcept;
+
+    protected:
+
+        virtual void* do_allocate(size_t bytes, size_t align) override;
+        virtual void do_deallocate(void* ptr, size_t bytes, size_t align) override;
+        virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        BasicAllocator* m_backing;
+    };
+}
+
+#endif /* SHARED_MEMORY_MEMORYRESOURCEADAPTER_HPP */
@@ -0,0 +1,184 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_NUMAALLOCATOR_HPP
+#define SHARED_MEMORY_NUMAALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+namespace Memory
+{
+    class AllocatorRegistry;
+
+    /**
+     * @brief NUMA aware proxy allocator.
+     *
+     * The NumaAllocator class keeps one backing allocator for every NUMA node, and routes each allocation to the backing allocator of the calling thread's node.
+     * @ref alloc(size_t, size_t, uint32_t) allocates on an explicitly chosen node instead. Whichever thread frees a block, it is returned to the backing allocator it came from.
+     *
+     * Every block carries a small header right before the returned pointer holding its node, at least 8 bytes or the requested alignment.
+     * Allocations of at least @ref BindThreshold bytes are additionally bound to their node with the operating system, where supported, so their pages end up on the node even if another node's thread touches them first.
+     * Smaller allocations rely on the first touch placement of the operating system, which works as long as each node's backing allocator is mostly used by the threads of its node.
+     *
+     * The node of the calling thread is looked up once every @ref NodeRefreshInterval allocations on each thread, a migrated thread may keep allocating from its previous node for a short while.
+     * If there are fewer backing allocators than nodes, the nodes are mapped to them round robin.
+     *
+     * All calls are concurrently safe, as long as the backing allocators are also thread safe.
+     *
+     * @see @ref BasicAllocator, @ref Heap, @ref AllocatorRegistry
+     */
+    class SHARED_LIB_API NumaAllocator : public BasicAllocator
+    {
+    public:
+
+        /// Allocations of at least this size are bound to their node.
+        static constexpr size_t BindThreshold = 64 * 1024;
+
+        /// Amount of allocations on a thread between looking up the thread's node.
+        static constexpr uint32_t NodeRefreshInterval = 64;
+
+        /**
+         * @brief Construct a NumaAllocator over an owned @ref Heap for every node.
+         *
+         * The heaps are destroyed together with the NumaAllocator.
+         */
+        NumaAllocator();
+
+        /**
+         * @brief Construct a NumaAllocator over existing allocators.
+         *
+         * @param backings Array of @a count backing allocators, the one at index @a n serves node @a n. The array is copied, the allocators must outlive the NumaAllocator.
+         * @param count Amount of backing allocators, at least 1.
+         */
+        NumaAllocator(BasicAllocator* const* backings, uint32_t count);
+
+        NumaAllocator(const NumaAllocator&) = delete;
+        NumaAllocator& operator=(const NumaAllocator&) = delete;
+
+        /**
+         * @brief Destroy the NumaAllocator object.
+         *
+         * Destroys the owned heaps, backing allocators passed in are left intact.
+         */
+        virtual ~NumaAllocator();
+
+        /**
+         * @brief Allocate a memory block on a given node.
+         *
+         * Same as @ref alloc(size_t, size_t), but the block comes from the backing allocator of @a node regardless of the calling thread.
+         *
+         * @param bytes Amount of bytes requested. May be a zero value.
+         * @param align Requested pointer alignedness. Must be a power of two.
+         * @param node Index of the node, less than @ref getNodeCount.
+         * @return A valid pointer to the beginning of the requested memory block on success, @b nullptr otherwise, or if @a node is out of range.
+         */
+        void* alloc(size_t bytes, size_t align, uint32_t node);
+
+        /**
+         * @brief Get the amount of nodes, one for each backing allocator.
+         */
+        uint32_t getNodeCount() const noexcept;
+
+        /**
+         * @brief Get the backing allocator of a node.
+         *
+         * @param node Index of the node.
+         * @return The backing allocator, @b nullptr if @a node is out of range.
+         */
+        BasicAllocator* getBacking(uint32_t node) const noexcept;
+
+        /**
+         * @brief Get the node a block was allocated on.
+         *
+         * @param ptr Pointer to a valid allocated memory block.
+         * @return Index of the node.
+         */
+        uint32_t getNode(const void* ptr) const noexcept;
+
+        /**
+         * @brief Get the node serving the calling thread.
+         *
+         * @return Index of the node, less than @ref getNodeCount.
+         */
+        uint32_t getCurrentNode() const noexcept;
+
+        /**
+         * @brief Get the used bytes of a node's backing allocator.
+         *
+         * @param node Index of the node.
+         * @return The used bytes, 0 if @a node is out of range.
+         */
+        size_t getNodeUsedBytes(uint32_t node) const;
+
+        /**
+         * @brief Get the free bytes of a node's backing allocator.
+         *
+         * @param node Index of the node.
+         * @return The free bytes, 0 if @a node is out of range.
+         */
+        size_t getNodeFreeBytes(uint32_t node) const;
+
+        /**
+         * @brief Get the total bytes of a node's backing allocator.
+         *
+         * @param node Index of the node.
+         * @return The total bytes, 0 if @a node is out of range.
+         */
+        size_t getNodeTotalBytes(uint32_t node) const;
+
+        /**
+         * @brief Register the backing allocator of every node.
+         *
+         * The backing allocators are registered as @a prefix/node0, @a prefix/node1 and so on, so the per node figures show up in the registry's rollups and metrics.
+         * Backing allocators implementing @ref AllocatorStatistic or @ref ObjectAllocator are registered with their full figures.
+         *
+         * @param registry The registry to add the nodes to.
+         * @param prefix Name of the NumaAllocator in the registry.
+         * @return @b true if every node got registered.
+         *
+         * @see @ref AllocatorRegistry::add
+         */
+        bool registerNodes(AllocatorRegistry& registry, const char* prefix) const;
+
+        // -- BasicAllocator API -- All calls are wrapped
+
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
+
+    protected:
+
+        struct Header;
+
+        // Distance of the user pointer from the start of the backing block
+        static size_t getOffset(size_t align) noexcept;
+        static Header* getHeader(const void* ptr) noexcept;
+
+        // Write the header into a backing block and return the user pointer
+        void* place(void* block, uint32_t node, size_t offset, size_t bytes) noexcept;
+
+        BasicAllocator** m_backings; // Backing allocator of each node
+        uint32_t m_count;
+        bool m_owned; // The backing allocators are heaps created by the NumaAllocator
+    };
+}
+
+#endif /* SHARED_MEMORY_NUMAALLOCATOR_HPP */
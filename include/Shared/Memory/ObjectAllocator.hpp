@@ -7,6 +7,12 @@
 
 #include <Shared/Platform/Types.hpp>
 
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 namespace Memory
 {
     /**
@@ -22,6 +28,10 @@ namespace Memory
     {
     public:
 
+        using BasicAllocator::alloc;
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
         /**
          * @brief Helper type for destructor functions.
          *
@@ -47,7 +57,8 @@ namespace Memory
          * Code example:
          * \code{.cpp}
             // Assume "allocator" is a pointer to a valid instance of ObjectAllocator
-            void* mem_ptr = allocator->alloc(sizeof(ObjectType), allocator->Destructor<ObjectType>, alignof(ObjectType));
+            // The same can be done in a single call with allocator->make<ObjectType>(initialization_value)
+            void* mem_ptr = allocator->alloc(sizeof(ObjectType), ObjectAllocator::destroy<ObjectType>, alignof(ObjectType));
             // It would be very naughty to not check for nullptr before placement new, as the placement new operator may try to initialize object on the null pointer! (UB)
             if (mem_ptr == nullptr) panic();
             else
@@ -197,7 +208,8 @@ namespace Memory
          * @brief Clear all allocations.
          *
          * Bring the allocator into a default state, but instead of invalidating all allocations it gives a chance to cleanup by calling destructor functions. /n
-         * After calling this function, the content and accessibility of previous allocations are undefined and the offer pointers will be invalidated.
+         * After calling this function, the content and accessibility of previous allocations are undefined and the offer pointers will be invalidated. \n
+         * The order of the destructor calls is unspecified. Implementations are encouraged to run them in batches grouped by destructor function, which groups the objects by type for @ref make, and to skip allocations without a destructor function entirely.
          *
          * @see @ref BasicAllocator::reset
          */
@@ -232,7 +244,263 @@ namespace Memory
             reinterpret_cast<T*>(memory)->~T();
         }
 
+        /**
+         * @brief Array destructor wrapper template function.
+         *
+         * A helper template function that calls the destructor on every element of an array allocated by @ref makeArray, in reverse order.
+         *
+         * @tparam T Type of the array elements.
+         * @param memory The pointer of the allocation holding the array.
+         *
+         * @see @ref makeArray, @ref freeArray
+         */
+        template<class T>
+        static void destroyArray(void* memory) noexcept
+        {
+            size_t count = *reinterpret_cast<size_t*>(memory);
+            T* elements = reinterpret_cast<T*>(reinterpret_cast<char*>(memory) + getArrayPrefix<T>());
+            while (count != 0)
+                elements[--count].~T();
+        }
+
+        /**
+         * @brief Allocate and construct an object.
+         *
+         * Allocate memory for a single object of type @a T and construct it in place, perfect forwarding @a args to the constructor. \n
+         * A destructor function is only registered if @a T is not trivially destructible, such objects carry no destructor metadata and cost no call when freed.
+         * The object is destroyed and deallocated by passing the returned pointer to @ref free, or by the allocator internally. \n
+         * Returns @b nullptr if the allocation fails. Exceptions thrown by the constructor are propagated after the memory is released.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * Code example:
+         * \code{.cpp}
+            // Assume "allocator" is a pointer to a valid instance of ObjectAllocator
+            ObjectType* var = allocator->make<ObjectType>(initialization_value);
+            if (var == nullptr) panic();
+            // -- do stuff --
+            allocator->free(var); \endcode
+         *
+         * @tparam T Type of the object.
+         * @param args Arguments passed to the constructor of @a T.
+         * @return Pointer to the constructed object on success, @b nullptr otherwise.
+         *
+         * @see @ref makeUnique, @ref makeArray, @ref free
+         */
+        template<class T, class... Args>
+        T* make(Args&&... args)
+        {
+            if constexpr (std::is_trivially_destructible_v<T>)
+            {
+                void* memory = this->alloc(sizeof(T), alignof(T));
+                if (memory == nullptr)
+                    return nullptr;
+
+                try
+                {
+                    return new (memory) T(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    this->free(memory);
+                    throw;
+                }
+            }
+            else
+            {
+                void* memory = this->alloc(sizeof(T), &ObjectAllocator::destroy<T>, alignof(T));
+                if (memory == nullptr)
+                    return nullptr;
+
+                if constexpr (std::is_nothrow_constructible_v<T, Args...>)
+                {
+                    return new (memory) T(std::forward<Args>(args)...);
+                }
+                else
+                {
+                    try
+                    {
+                        return new (memory) T(std::forward<Args>(args)...);
+                    }
+                    catch (...)
+                    {
+                        this->discard(memory, sizeof(T), alignof(T));
+                        throw;
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Allocate and value initialize an array of objects.
+         *
+         * Allocate memory for @a count objects of type @a T and value initialize each of them. \n
+         * For types that are not trivially destructible the element count is stored in front of the array and a single destructor function is registered, destroying every element in reverse order. \n
+         * The returned pointer must be deallocated with @ref freeArray. \n
+         * Returns @b nullptr if the allocation fails. Exceptions thrown by a constructor are propagated after the already constructed elements are destroyed and the memory is released.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @tparam T Type of the array elements.
+         * @param count Amount of elements.
+         * @return Pointer to the first element on success, @b nullptr otherwise.
+         *
+         * @see @ref freeArray, @ref makeUniqueArray, @ref make
+         */
+        template<class T>
+        T* makeArray(size_t count)
+        {
+            constexpr size_t prefix = std::is_trivially_destructible_v<T> ? 0 : getArrayPrefix<T>();
+            constexpr size_t align = alignof(T) > alignof(size_t) ? alignof(T) : alignof(size_t);
+
+            if (count > (std::numeric_limits<size_t>::max() - prefix) / sizeof(T))
+                return nullptr;
+
+            size_t bytes = prefix + count * sizeof(T);
+            void* memory;
+            if constexpr (std::is_trivially_destructible_v<T>)
+                memory = this->alloc(bytes, align);
+            else
+                memory = this->alloc(bytes, &ObjectAllocator::destroyArray<T>, align);
+
+            if (memory == nullptr)
+                return nullptr;
+
+            T* elements = reinterpret_cast<T*>(reinterpret_cast<char*>(memory) + prefix);
+            size_t constructed = 0;
+
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                *reinterpret_cast<size_t*>(memory) = 0;
+
+            try
+            {
+                for (; constructed < count; ++constructed)
+                    new (elements + constructed) T();
+            }
+            catch (...)
+            {
+                while (constructed != 0)
+                    elements[--constructed].~T();
+
+                if constexpr (std::is_trivially_destructible_v<T>)
+                    this->free(memory);
+                else
+                    this->discard(memory, bytes, align);
+                throw;
+            }
+
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                *reinterpret_cast<size_t*>(memory) = count;
+
+            return elements;
+        }
+
+        /**
+         * @brief Destroy and deallocate an array.
+         *
+         * Destroy every element of an array allocated by @ref makeArray and deallocate its memory.
+         *
+         * Thread safety depends on actual implementation.
+         *
+         * @tparam T Type of the array elements.
+         * @param elements Pointer returned by @ref makeArray. May be @b nullptr.
+         *
+         * @see @ref makeArray
+         */
+        template<class T>
+        void freeArray(T* elements)
+        {
+            if (elements == nullptr)
+                return;
+
+            if constexpr (std::is_trivially_destructible_v<T>)
+                this->free(elements);
+            else
+                this->free(reinterpret_cast<char*>(elements) - getArrayPrefix<T>());
+        }
+
+        /**
+         * @brief Deleter for std::unique_ptr.
+         *
+         * Deallocates objects created by @ref make, or arrays created by @ref makeArray for array types, through the allocator that created them.
+         *
+         * @see @ref UniquePtr, @ref makeUnique, @ref makeUniqueArray
+         */
+        template<class T>
+        struct Deleter
+        {
+            ObjectAllocator* allocator = nullptr;
+
+            void operator()(T* ptr) const
+            {
+                this->allocator->free(ptr);
+            }
+        };
+
+        template<class T>
+        struct Deleter<T[]>
+        {
+            ObjectAllocator* allocator = nullptr;
+
+            void operator()(T* ptr) const
+            {
+                this->allocator->freeArray(ptr);
+            }
+        };
+
+        /**
+         * @brief std::unique_ptr owning an object or array created by an ObjectAllocator.
+         */
+        template<class T>
+        using UniquePtr = std::unique_ptr<T, Deleter<T>>;
+
+        /**
+         * @brief Allocate and construct an object owned by a @ref UniquePtr.
+         *
+         * Same as @ref make, but the returned smart pointer deallocates the object when it goes out of scope.
+         * The returned pointer is empty if the allocation fails.
+         *
+         * @see @ref make, @ref UniquePtr
+         */
+        template<class T, class... Args>
+        UniquePtr<T> makeUnique(Args&&... args)
+        {
+            return UniquePtr<T>(this->make<T>(std::forward<Args>(args)...), Deleter<T>{ this });
+        }
+
+        /**
+         * @brief Allocate and value initialize an array owned by a @ref UniquePtr.
+         *
+         * Same as @ref makeArray, but the returned smart pointer deallocates the array when it goes out of scope.
+         * The returned pointer is empty if the allocation fails.
+         *
+         * @see @ref makeArray, @ref UniquePtr
+         */
+        template<class T>
+        UniquePtr<T[]> makeUniqueArray(size_t count)
+        {
+            return UniquePtr<T[]>(this->makeArray<T>(count), Deleter<T[]>{ this });
+        }
+
         virtual ~ObjectAllocator() = default;
+
+    protected:
+
+        // Distance of the first array element from the element count
+        template<class T>
+        static constexpr size_t getArrayPrefix() noexcept
+        {
+            return (sizeof(size_t) + alignof(T) - 1) & ~(alignof(T) - 1);
+        }
+
+        // Deallocate memory holding no constructed object without calling the registered destructor
+        void discard(void* memory, size_t bytes, size_t align)
+        {
+            // Dropping the destructor may in theory fail, leaking is preferred over destroying an unconstructed object
+            void* raw = this->realloc(memory, bytes, nullptr, align);
+            if (raw != nullptr)
+                this->free(raw);
+        }
     };
 }
 
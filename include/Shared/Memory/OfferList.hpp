@@ -0,0 +1,117 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_OFFERLIST_HPP
+#define SHARED_MEMORY_OFFERLIST_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+
+namespace Memory
+{
+    /**
+     * @brief Priority ordered list of offered allocations.
+     *
+     * The OfferList class is a building block for @ref ObjectAllocator implementations, tracking offered allocations for @ref ObjectAllocator::purge.
+     * Offers are intrusive @ref Node objects, usually embedded in the structure behind the unique offer pointer, so the list never allocates.
+     *
+     * Priorities are grouped in buckets by bit width: priority 0 has its own bucket, every other bucket holds one power of two range.
+     * Within a bucket the nodes are kept in least recently offered order, a node pushed again after being removed counts as the most recent.
+     * A bitmap of the non-empty buckets makes finding the least important, oldest offer constant time, so purging never scans empty buckets or walks lists.
+     *
+     * Every operation is O(1). The list is not concurrently safe, the owning allocator has to lock it.
+     *
+     * @see @ref ObjectAllocator::offer, @ref Heap
+     */
+    class SHARED_LIB_API OfferList
+    {
+    public:
+
+        /// Link structure of a single offer.
+        struct Node
+        {
+            Node* prev;
+            Node* next;
+            uint32_t bucket;
+        };
+
+        /// Number of priority buckets.
+        static constexpr uint32_t BucketCount = 33;
+
+        /**
+         * @brief Construct an empty list.
+         */
+        OfferList() noexcept;
+
+        OfferList(const OfferList&) = delete;
+        OfferList& operator=(const OfferList&) = delete;
+
+        /**
+         * @brief Add a node as the most recent offer of its priority.
+         *
+         * @param node The node to add, must not be on any list.
+         * @param priority The offer priority, 0 being the least important.
+         */
+        void push(Node* node, uint32_t priority) noexcept;
+
+        /**
+         * @brief Remove a node from the list.
+         *
+         * @param node A node currently on the list.
+         */
+        void remove(Node* node) noexcept;
+
+        /**
+         * @brief Get the next offer to purge.
+         *
+         * Finds the oldest node of the least important non-empty bucket, as long as the bucket is covered by @a priority.
+         *
+         * @param priority Highest priority to consider.
+         * @return The node, @b nullptr if no offer up to the priority's bucket exists.
+         */
+        Node* getOldest(uint32_t priority) const noexcept;
+
+        /**
+         * @brief Remove and return the next offer to purge.
+         *
+         * @param priority Highest priority to consider.
+         * @return The removed node, @b nullptr if no offer up to the priority's bucket exists.
+         *
+         * @see @ref getOldest
+         */
+        Node* pop(uint32_t priority) noexcept;
+
+        /**
+         * @brief Forget every node.
+         *
+         * The nodes are not touched, useful when their memory is released in bulk.
+         */
+        void clear() noexcept;
+
+        /**
+         * @brief Check whether the list is empty.
+         */
+        bool isEmpty() const noexcept;
+
+        /**
+         * @brief Get the amount of nodes on the list.
+         */
+        size_t getCount() const noexcept;
+
+        /**
+         * @brief Get the bucket of a priority.
+         *
+         * @param priority The offer priority.
+         * @return The bucket index, less than @ref BucketCount.
+         */
+        static uint32_t getBucket(uint32_t priority) noexcept;
+
+    protected:
+
+        Node* m_heads[BucketCount]; // Oldest node of each bucket
+        Node* m_tails[BucketCount]; // Most recent node of each bucket
+        uint64_t m_buckets; // Bitmap of non-empty buckets
+        size_t m_count;
+    };
+}
+
+#endif /* SHARED_MEMORY_OFFERLIST_HPP */
@@ -0,0 +1,235 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_PERSISTENTALLOCATOR_HPP
+#define SHARED_MEMORY_PERSISTENTALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Memory/OfferList.hpp>
+
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Allocator keeping its heap in a memory mapped file, surviving restarts.
+     *
+     * The PersistentAllocator class implements the @ref ObjectAllocator interface over a file mapped shared into memory, so a restarted process can map the file again and reclaim the blocks offered before the restart, without rebuilding their content.
+     * The heap is a sequence of chunks, each starting with a small header. The headers hold only sizes, states, offer priorities and allocation stamps, so the file is position independent and may be mapped at any address.
+     * Free chunks are coalesced with their neighbours and kept in size binned free lists, allocations are served first fit from the smallest fitting bin, like @ref VirtualAllocator does with pages.
+     *
+     * When a file holding a heap is opened, the free lists and the offer list are rebuilt by walking the chunks:
+     * - Offered blocks survive, their offer pointers are valid again once converted by @ref getPointer from an offset taken by @ref getOffset before the restart. They can be reclaimed, or return @b nullptr if purged since, as the @ref offer contract allows.
+     * - Allocated blocks and purged offers referenced by a root survive. Every other allocated block and purged offer is freed, the offsets of purged offers convert to @b nullptr from then on.
+     * - Every allocation gets a stamp from a counter kept in the file, so the offset of a freed block doesn't convert to a later block allocated at the same address, in the same session or after a restart.
+     * - The @ref RootCount root slots locate the surviving blocks, see @ref setRoot. A typical index is an offered or rooted block holding the offsets of the other offers.
+     *
+     * Destructor functions are only valid in the process which passed them, surviving blocks have none. The allocator never calls destructors when destroyed, since the blocks stay in the file, call @ref clear first to run them.
+     *
+     * A heap not closed properly, or failing validation, is discarded as a whole: offsets taken before convert to @b nullptr, so every offer appears purged, and every root is empty. @ref isRestored tells which happened.
+     * Pointers not allocated from the current heap are ignored by @ref free, @ref reclaim returns @b nullptr for them and @ref getAllocSize returns 0.
+     * The file format is native: the file may only be opened by builds with the same pointer size and byte order.
+     *
+     * @ref purge releases the storage of the whole pages of free chunks by punching holes into the file on GNU/Linux.
+     *
+     * All calls are concurrently safe. Destructor functions are called with the allocator locked, and may call back into the same allocator.
+     * Only one allocator may use a file at a time.
+     *
+     * @see @ref ObjectAllocator, @ref VirtualAllocator
+     */
+    class SHARED_LIB_API PersistentAllocator : public ObjectAllocator
+    {
+    public:
+
+        /// Default size of a new heap file, the file is sparse where supported.
+        static constexpr size_t DefaultFileBytes = sizeof(void*) >= 8 ? (size_t(4) << 30) : (size_t(256) << 20);
+
+        /// Size of the file header preceding the heap.
+        static constexpr size_t FileHeaderSize = 4096;
+
+        /// Size and alignment granularity of the chunks.
+        static constexpr size_t Granularity = 16;
+
+        /// Amount of root slots.
+        static constexpr size_t RootCount = 8;
+
+        /// Bits of the position in an offset returned by @ref getOffset, the rest holds the stamp of the allocation. Only the first 2^OffsetBits bytes of a file are used.
+        static constexpr uint32_t OffsetBits = 40;
+
+        /// Version of the file format.
+        static constexpr uint32_t FormatVersion = 1;
+
+        /**
+         * @brief Open or create a heap file.
+         *
+         * Maps the whole file. A valid heap left by an earlier allocator is restored, otherwise an empty heap is created.
+         * Files shorter than @a file_bytes are extended, longer files keep their size. If the file can't be opened or mapped every allocation fails.
+         * The file is held exclusively while the allocator lives, opening a file in use by another allocator, in this or in another process, fails the same way instead of taking over its heap.
+         *
+         * @param path Path of the heap file.
+         * @param file_bytes Smallest size of the file, the upper limit of the memory the allocator can hand out.
+         */
+        PersistentAllocator(const char* path, size_t file_bytes = DefaultFileBytes);
+
+        PersistentAllocator(const PersistentAllocator&) = delete;
+        PersistentAllocator& operator=(const PersistentAllocator&) = delete;
+
+        /**
+         * @brief Close the heap file.
+         *
+         * Writes every modified page back to the file and marks the heap closed properly. No destructor functions are called.
+         */
+        virtual ~PersistentAllocator();
+
+        /**
+         * @brief Check whether the heap file got mapped.
+         *
+         * @b false if the file couldn't be opened, mapped or locked, for example because another allocator holds it.
+         */
+        bool isOpen() const noexcept;
+
+        /**
+         * @brief Check whether the heap got restored from the file.
+         *
+         * @return @b true if the blocks of an earlier allocator survived, @b false if the heap was created empty.
+         */
+        bool isRestored() const noexcept;
+
+        /**
+         * @brief Write every modified page back to the file.
+         *
+         * The heap stays marked as open, a crash still discards it. Useful to limit the writes the operating system does when the file is closed.
+         *
+         * @return @b true on success.
+         */
+        bool sync();
+
+        /**
+         * @brief Get the position independent offset of a pointer.
+         *
+         * The offset of a block or an offer pointer also holds the stamp of the allocation, so it stops converting back once the block is freed, or discarded with the whole heap.
+         * Stamps have 64 - @ref OffsetBits bits and wrap around: a later block at the same address converts again only if it got allocated exactly a multiple of 2^(64 - OffsetBits) allocations afterwards.
+         *
+         * @param ptr Pointer into the heap, like a block or an offer pointer.
+         * @return The distance of @a ptr from the start of the file, combined with the stamp for blocks, 0 for @b nullptr.
+         */
+        uint64_t getOffset(const void* ptr) const;
+
+        /**
+         * @brief Get the pointer of an offset.
+         *
+         * @param offset An offset returned by @ref getOffset, possibly by another process.
+         * @return Pointer into the current mapping. @b nullptr for 0, for offsets outside the allocated part of the heap and for the offsets of blocks which aren't allocated any more.
+         */
+        void* getPointer(uint64_t offset) const;
+
+        /**
+         * @brief Set a root slot.
+         *
+         * Roots locate the surviving blocks after a restart. A root referencing an allocated block also keeps the block allocated.
+         * Freeing a block, or a failed reclaim of its offer, empties the roots referencing it. Reallocating a block which moves it updates them.
+         *
+         * @param index Index of the slot, less than @ref RootCount.
+         * @param ptr An allocated block or an offer pointer, @b nullptr empties the slot.
+         */
+        void setRoot(size_t index, void* ptr);
+
+        /**
+         * @brief Get a root slot.
+         *
+         * @param index Index of the slot, less than @ref RootCount.
+         * @return The block or offer pointer stored in the slot, @b nullptr if the slot is empty.
+         */
+        void* getRoot(size_t index) const;
+
+        // -- ObjectAllocator API --
+
+        using ObjectAllocator::free;
+        using ObjectAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+        virtual void* reclaim(void* ptr) override;
+
+        virtual void reset() override;
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override;
+        virtual void clear() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getPendingBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        struct Chunk;
+        struct FileHeader;
+
+        static constexpr size_t BinCount = 64; // Free chunk bins, one per bit width of the granule count
+
+        // Validate the heap found in the file and rebuild the process local structures, false if it has to be discarded
+        bool restore();
+        void format();
+
+        // Internal helpers, the allocator must be locked when called
+        void* allocChunk(size_t bytes, DestructorPtr destructor, size_t align);
+        void* reallocChunk(void* ptr, size_t bytes, DestructorPtr destructor, size_t align);
+        bool resizeChunk(Chunk* chunk, size_t bytes);
+        Chunk* findFree(size_t size);
+        Chunk* carve(size_t size);
+        Chunk* split(Chunk* chunk, size_t size);
+        void absorbNext(Chunk* chunk);
+        void insertFree(Chunk* chunk);
+        void removeFree(Chunk* chunk);
+        void releaseChunk(Chunk* chunk);
+        void destroyChunk(Chunk* chunk);
+        void updateRoots(const void* ptr, const void* replacement);
+        void discardFree();
+        void releaseAll();
+        void setTop(char* top);
+
+        // Validated header of a block or offer pointer, nullptr for pointers not allocated from the current heap
+        Chunk* findChunk(const void* ptr) const noexcept;
+        uint64_t getChunkOffset(const Chunk* chunk) const noexcept;
+
+        Chunk* getNext(Chunk* chunk) const noexcept;
+        Chunk* getPrev(Chunk* chunk) const noexcept;
+        static size_t getUsable(const Chunk* chunk) noexcept;
+        static Chunk* getChunk(const void* ptr) noexcept;
+        static void* getUser(Chunk* chunk) noexcept;
+
+        mutable std::recursive_mutex m_mutex;
+
+        // Mapped file, the members of SystemMemory::FileMapping
+        void* m_file_ptr;
+        size_t m_file_bytes;
+        intptr_t m_file;
+        void* m_file_mapping;
+
+        FileHeader* m_header; // Start of the mapping, nullptr if the file isn't mapped
+        char* m_base; // First chunk
+        char* m_end; // End of the heap
+        char* m_top; // End of the carved chunks, mirrored in the file header
+        Chunk* m_last; // Chunk ending at the top, nullptr if there are no chunks
+
+        Chunk* m_bins[BinCount]; // Free chunks by granule count bit width
+        uint64_t m_bin_mask; // Bitmap of non-empty bins
+        OfferList m_offers; // Offered chunks
+
+        size_t m_used; // Bytes of used, offered and purged chunks
+        size_t m_pending; // Usable bytes of offered chunks
+        bool m_restored;
+        bool m_clearing; // Set while clear is running destructors
+    };
+}
+
+#endif /* SHARED_MEMORY_PERSISTENTALLOCATOR_HPP */
@@ -0,0 +1,337 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_POOLALLOCATOR_HPP
+#define SHARED_MEMORY_POOLALLOCATOR_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace Memory
+{
+    /**
+     * @brief Fixed size block pool allocator.
+     *
+     * The PoolAllocator class hands out blocks of a single size, carved from larger chunks requested from a backing allocator.
+     * Free blocks are kept on an intrusive lock-free list, so many threads can allocate and free blocks without taking a lock.
+     * The list head is a tagged pointer, with the tag incremented on every update to rule out ABA problems. On x86-64 the tag is packed in the unused upper pointer bits, elsewhere a double width atomic is used.
+     * Only growing the pool takes a lock, when the free list runs out and a new chunk has to be requested.
+     *
+     * Requests larger than @a BlockSize or aligned stricter than @a Align fail and return @b nullptr.
+     * Chunks are only returned to the backing allocator by @ref reset or when the pool is destroyed. The backing allocator must outlive the pool.
+     *
+     * All calls except @ref reset are concurrently safe, as long as the backing allocator's @ref alloc is also thread safe.
+     *
+     * @tparam BlockSize Size of a single block in bytes.
+     * @tparam Align Alignment of every block, must be a power of two.
+     *
+     * @see @ref BasicAllocator, @ref Heap
+     */
+    template<size_t BlockSize, size_t Align = alignof(max_align_t)>
+    class PoolAllocator : public BasicAllocator
+    {
+        static_assert(BlockSize > 0, "Block size must be non-zero");
+        static_assert((Align & (Align - 1)) == 0, "Alignment must be a power of two");
+
+        // Free blocks store the link to the next free block in their first bytes
+        struct Node
+        {
+            std::atomic<Node*> next;
+        };
+
+        static constexpr size_t BlockAlign = Align > alignof(Node) ? Align : alignof(Node);
+        static constexpr size_t RawSize = BlockSize > sizeof(Node) ? BlockSize : sizeof(Node);
+
+    public:
+
+        /// Distance between two consecutive blocks in a chunk.
+        static constexpr size_t Stride = (RawSize + BlockAlign - 1) & ~(BlockAlign - 1);
+
+        /// Default amount of blocks requested at once when the pool runs out of free blocks.
+        static constexpr size_t DefaultChunkBlocks = Stride < 1024 ? 64 * 1024 / Stride : 64;
+
+        /**
+         * @brief Construct an empty pool.
+         *
+         * No memory is requested from the backing allocator until the first allocation.
+         *
+         * @param backing The backing allocator the chunks are requested from.
+         * @param chunk_blocks Amount of blocks in a single chunk.
+         */
+        PoolAllocator(BasicAllocator* backing, size_t chunk_blocks = DefaultChunkBlocks) :
+            m_head(Head()),
+            m_used(0),
+            m_backing(backing),
+            m_chunks(nullptr),
+            m_chunk_blocks(chunk_blocks != 0 ? chunk_blocks : DefaultChunkBlocks),
+            m_total(0)
+        {
+        }
+
+        PoolAllocator(const PoolAllocator&) = delete;
+        PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+        /**
+         * @brief Destroy the pool.
+         *
+         * Returns every chunk to the backing allocator.
+         */
+        virtual ~PoolAllocator()
+        {
+            this->releaseChunks();
+        }
+
+        // -- BasicAllocator API --
+
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            if (bytes > BlockSize || align > BlockAlign)
+                return nullptr;
+
+            Node* node = this->pop();
+            if (node == nullptr)
+            {
+                node = this->grow();
+                if (node == nullptr)
+                    return nullptr;
+            }
+
+            this->m_used.fetch_add(1, std::memory_order_relaxed);
+            return node;
+        }
+
+        virtual void free(void* ptr) override
+        {
+            if (ptr == nullptr)
+                return;
+
+            Node* node = reinterpret_cast<Node*>(ptr);
+            this->m_used.fetch_sub(1, std::memory_order_relaxed);
+            this->push(node, node);
+        }
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override
+        {
+            if (bytes > BlockSize || align > BlockAlign)
+                return 0;
+
+            size_t ret = 0;
+            for (; ret < count; ++ret)
+            {
+                Node* node = this->pop();
+                if (node == nullptr)
+                {
+                    node = this->grow();
+                    if (node == nullptr)
+                        break;
+                }
+                out[ret] = node;
+            }
+
+            this->m_used.fetch_add(ret, std::memory_order_relaxed);
+            return ret;
+        }
+
+        virtual void freeBulk(void** ptrs, size_t count) override
+        {
+            // Link the blocks into a chain, then push the whole chain in a single exchange
+            Node* first = nullptr;
+            Node* last = nullptr;
+            size_t freed = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (ptrs[i] == nullptr)
+                    continue;
+
+                Node* node = reinterpret_cast<Node*>(ptrs[i]);
+                node->next.store(first, std::memory_order_relaxed);
+                if (last == nullptr)
+                    last = node;
+                first = node;
+                ++freed;
+            }
+
+            if (first != nullptr)
+            {
+                this->m_used.fetch_sub(freed, std::memory_order_relaxed);
+                this->push(first, last);
+            }
+        }
+
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            if (ptr == nullptr)
+                return this->alloc(bytes, align);
+
+            // Every block has the same size, a block either fits the request or nothing does
+            if (bytes > BlockSize || getAlignedOffset(ptr, align) != 0)
+                return nullptr;
+
+            return ptr;
+        }
+
+        virtual size_t getAllocSize(const void* ptr) const override
+        {
+            (void)ptr;
+            return BlockSize;
+        }
+
+        virtual void reset() override
+        {
+            this->releaseChunks();
+        }
+
+        virtual size_t getFreeBytes() const override
+        {
+            return this->getTotalBytes() - this->getUsedBytes();
+        }
+
+        virtual size_t getUsedBytes() const override
+        {
+            return this->m_used.load(std::memory_order_relaxed) * Stride;
+        }
+
+        virtual size_t getTotalBytes() const override
+        {
+            return this->m_total.load(std::memory_order_relaxed);
+        }
+
+    protected:
+
+        // Header at the beginning of a chunk, padded to the block alignment
+        struct alignas(BlockAlign) Chunk
+        {
+            Chunk* next;
+        };
+
+#if defined(PLATFORM_ARCH_X64)
+        // User space pointers only use the lower 48 bits, the upper 16 hold the tag
+        using Head = uint64_t;
+
+        static constexpr uint64_t PointerMask = (uint64_t(1) << 48) - 1;
+
+        static inline Node* getPointer(Head head) noexcept
+        {
+            return reinterpret_cast<Node*>(static_cast<uintptr_t>(head & PointerMask));
+        }
+
+        static inline Head makeHead(Node* ptr, Head previous) noexcept
+        {
+            return (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)) & PointerMask) | ((previous & ~PointerMask) + (PointerMask + 1));
+        }
+#else
+        struct Head
+        {
+            Node* ptr;
+            uintptr_t tag;
+        };
+
+        static inline Node* getPointer(Head head) noexcept
+        {
+            return head.ptr;
+        }
+
+        static inline Head makeHead(Node* ptr, Head previous) noexcept
+        {
+            return Head{ ptr, previous.tag + 1 };
+        }
+#endif
+
+        Node* pop() noexcept
+        {
+            Head head = this->m_head.load(std::memory_order_acquire);
+            while (getPointer(head) != nullptr)
+            {
+                // The node may be popped and overwritten concurrently, in which case the tag makes the exchange fail
+                Node* next = getPointer(head)->next.load(std::memory_order_relaxed);
+                if (this->m_head.compare_exchange_weak(head, makeHead(next, head), std::memory_order_acquire, std::memory_order_acquire))
+                    return getPointer(head);
+            }
+            return nullptr;
+        }
+
+        // Push a chain of linked nodes in a single exchange
+        void push(Node* first, Node* last) noexcept
+        {
+            Head head = this->m_head.load(std::memory_order_relaxed);
+            do
+            {
+                last->next.store(getPointer(head), std::memory_order_relaxed);
+            } while (!this->m_head.compare_exchange_weak(head, makeHead(first, head), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        Node* grow()
+        {
+            std::lock_guard<std::mutex> lock(this->m_grow_mutex);
+
+            // Another thread may have grown the pool meanwhile
+            Node* node = this->pop();
+            if (node != nullptr)
+                return node;
+
+            size_t chunk_bytes = sizeof(Chunk) + this->m_chunk_blocks * Stride;
+            Chunk* chunk = reinterpret_cast<Chunk*>(this->m_backing->alloc(chunk_bytes, BlockAlign));
+            if (chunk == nullptr)
+                return nullptr;
+
+            chunk->next = this->m_chunks;
+            this->m_chunks = chunk;
+            this->m_total.fetch_add(this->m_chunk_blocks * Stride, std::memory_order_relaxed);
+
+            // The first block is handed out right away, the rest are linked and pushed at once
+            char* blocks = reinterpret_cast<char*>(chunk + 1);
+            node = reinterpret_cast<Node*>(blocks);
+            if (this->m_chunk_blocks > 1)
+            {
+                Node* first = reinterpret_cast<Node*>(blocks + Stride);
+                Node* last = first;
+                for (size_t i = 2; i < this->m_chunk_blocks; ++i)
+                {
+                    Node* next = reinterpret_cast<Node*>(blocks + i * Stride);
+                    new (&last->next) std::atomic<Node*>(next);
+                    last = next;
+                }
+                new (&last->next) std::atomic<Node*>(nullptr);
+                this->push(first, last);
+            }
+
+            return node;
+        }
+
+        void releaseChunks()
+        {
+            std::lock_guard<std::mutex> lock(this->m_grow_mutex);
+
+            Chunk* chunk = this->m_chunks;
+            while (chunk != nullptr)
+            {
+                Chunk* next = chunk->next;
+                this->m_backing->free(chunk);
+                chunk = next;
+            }
+
+            this->m_chunks = nullptr;
+            this->m_head.store(Head(), std::memory_order_relaxed);
+            this->m_used.store(0, std::memory_order_relaxed);
+            this->m_total.store(0, std::memory_order_relaxed);
+        }
+
+        // Contended data is kept on separate cache lines
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<Head> m_head; // Top of the free list
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<size_t> m_used; // Blocks handed out
+
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::mutex m_grow_mutex;
+        BasicAllocator* m_backing;
+        Chunk* m_chunks; // Every chunk requested from the backing allocator
+        size_t m_chunk_blocks;
+        std::atomic<size_t> m_total; // Bytes of blocks in all chunks
+    };
+}
+
+#endif /* SHARED_MEMORY_POOLALLOCATOR_HPP */
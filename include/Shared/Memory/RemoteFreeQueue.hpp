@@ -0,0 +1,93 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_REMOTEFREEQUEUE_HPP
+#define SHARED_MEMORY_REMOTEFREEQUEUE_HPP
+
+#include <Shared/Platform/Types.hpp>
+
+#include <atomic>
+
+namespace Memory
+{
+    /**
+     * @brief Lock-free queue of blocks freed by foreign threads.
+     *
+     * The RemoteFreeQueue class is a building block for allocators owned by a single thread, like the per thread heaps of @ref ThreadHeapAllocator.
+     * Any thread may push a freed block, the owner thread takes every queued block at once and releases them in a batch, so cross thread deallocations never lock the owner's structures.
+     * The queue is intrusive: the first pointer sized word of every block holds the link, so blocks must be at least pointer sized and aligned, and the queue never allocates.
+     *
+     * Blocks are taken in reverse push order. A single compare-and-swap pushes a block, a single exchange takes them all, so there is no ABA problem with one consumer.
+     *
+     * Pushing is concurrently safe, taking blocks is only safe from one thread at a time.
+     *
+     * @see @ref ThreadHeapAllocator
+     */
+    class RemoteFreeQueue
+    {
+    public:
+
+        /**
+         * @brief Construct an empty queue.
+         */
+        RemoteFreeQueue() noexcept :
+            m_head(nullptr)
+        {
+        }
+
+        RemoteFreeQueue(const RemoteFreeQueue&) = delete;
+        RemoteFreeQueue& operator=(const RemoteFreeQueue&) = delete;
+
+        /**
+         * @brief Queue a freed block.
+         *
+         * @param block The block, its first word gets overwritten.
+         */
+        inline void push(void* block) noexcept
+        {
+            void* head = this->m_head.load(std::memory_order_relaxed);
+            do
+            {
+                *reinterpret_cast<void**>(block) = head;
+            } while (!this->m_head.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        /**
+         * @brief Take every queued block.
+         *
+         * @return The most recently pushed block, the rest are linked through @ref getNext. @b nullptr if the queue is empty.
+         */
+        inline void* takeAll() noexcept
+        {
+            // A plain load first keeps the owner's cache line shared while the queue is empty
+            if (this->m_head.load(std::memory_order_relaxed) == nullptr)
+                return nullptr;
+            return this->m_head.exchange(nullptr, std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Check whether any blocks are queued.
+         *
+         * The result may be outdated by the time the call returns.
+         */
+        inline bool isEmpty() const noexcept
+        {
+            return this->m_head.load(std::memory_order_relaxed) == nullptr;
+        }
+
+        /**
+         * @brief Get the block queued before a block taken by @ref takeAll.
+         *
+         * @param block A block of the list returned by @ref takeAll.
+         * @return The next block, @b nullptr at the end of the list.
+         */
+        static inline void* getNext(void* block) noexcept
+        {
+            return *reinterpret_cast<void**>(block);
+        }
+
+    private:
+
+        std::atomic<void*> m_head;
+    };
+}
+
+#endif /* SHARED_MEMORY_REMOTEFREEQUEUE_HPP */
@@ -0,0 +1,151 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_SLABALLOCATOR_HPP
+#define SHARED_MEMORY_SLABALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Size class slab allocator tracking occupancy with bitmaps.
+     *
+     * The SlabAllocator class serves small allocations from @ref SlabSize bytes slabs carved from a single address space reservation, each slab holding blocks of one size class.
+     * Instead of free lists threaded through the blocks, every slab header holds a @ref Util::BitSet with a bit per block, so the metadata is dense and never touches the blocks themselves.
+     * Allocations take the lowest free block of a slab, filling it from the start with contiguous slots. The bitmap scan skips fully used words in vector sized steps where AVX2 or NEON is available.
+     *
+     * @ref allocBulk takes whole words of free bits at once, handing out runs of neighbouring blocks under a single lock.
+     * @ref getUsedBytes is computed from the bitmaps with a population count instead of maintaining shared counters on every call.
+     *
+     * Allocations of at most @ref MaxSmallSize bytes with no more than the default alignment are served from the slabs, every other allocation is forwarded to the backing allocator.
+     * Empty slabs beyond one per size class go back to a shared pool and are reused by any size class.
+     *
+     * All calls are concurrently safe, as long as the backing allocator is also thread safe. Every size class has its own lock, calls on different size classes don't contend.
+     *
+     * @see @ref BasicAllocator, @ref PoolAllocator, @ref ThreadHeapAllocator
+     */
+    class SHARED_LIB_API SlabAllocator : public BasicAllocator
+    {
+    public:
+
+        /// Default size of the reserved address space.
+        static constexpr size_t DefaultReserveBytes = sizeof(void*) >= 8 ? (size_t(4) << 30) : (size_t(64) << 20);
+
+        /// Size and alignment of a slab.
+        static constexpr size_t SlabSize = 64 * 1024;
+
+        /// Largest allocation size served from the slabs.
+        static constexpr size_t MaxSmallSize = 1024;
+
+        /// Bits of the occupancy bitmap of a slab, the most blocks a slab can hold.
+        static constexpr size_t SlabBlocks = 4096;
+
+        /**
+         * @brief Construct a SlabAllocator object.
+         *
+         * Reserves the address space of the slabs, no memory is committed until the first allocation.
+         * If the reservation fails every allocation is forwarded to the backing allocator.
+         *
+         * @param backing The backing allocator serving the large allocations.
+         * @param reserve_bytes Size of the address space to reserve, the upper limit of the memory the slabs can hold.
+         */
+        SlabAllocator(BasicAllocator* backing, size_t reserve_bytes = DefaultReserveBytes);
+
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+        /**
+         * @brief Destroy the SlabAllocator object.
+         *
+         * Releases every slab, including the blocks still allocated from them. Allocations forwarded to the backing allocator are left alone.
+         */
+        virtual ~SlabAllocator();
+
+        /**
+         * @brief Get the backing allocator.
+         */
+        BasicAllocator* getBacking() const noexcept;
+
+        // -- BasicAllocator API -- Large allocations are forwarded
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        /**
+         * @brief Invalidate every allocation.
+         *
+         * Returns the memory of every slab to the system and resets the backing allocator.
+         */
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        struct Slab;
+
+        static constexpr size_t ClassCount = 20; // 16 byte steps up to 128, then 4 classes per power of two
+
+        // Slabs of a size class with free blocks, allocations are served from the first one
+        struct alignas(PLATFORM_CACHE_LINE_SIZE) SizeClass
+        {
+            mutable std::mutex mutex;
+            Slab* slabs = nullptr;
+        };
+
+        static size_t getSizeClass(size_t bytes) noexcept;
+        static size_t getClassSize(size_t size_class) noexcept;
+
+        inline bool isSlabBlock(const void* ptr) const noexcept
+        {
+            return ptr >= this->m_base && ptr < this->m_end;
+        }
+
+        static Slab* getSlab(const void* ptr) noexcept;
+
+        // Size class helpers, the class must be locked when called
+        static void linkSlab(SizeClass& size_class, Slab* slab) noexcept;
+        static void unlinkSlab(SizeClass& size_class, Slab* slab) noexcept;
+        size_t allocBlocks(size_t size_class, size_t count, void** out);
+        void freeBlock(SizeClass& size_class, Slab* slab, void* ptr);
+
+        // Slab pool, locks the allocator
+        Slab* acquireSlab(size_t size_class);
+        void releaseSlab(Slab* slab);
+
+        // Committed bytes of the carved slabs, and allocated bytes of the slabs
+        size_t getSlabBytes() const;
+        size_t getSlabUsedBytes() const;
+
+        BasicAllocator* m_backing;
+
+        char* m_reservation; // Start of the reservation as returned by the system
+        size_t m_reserved; // Size of the reservation
+        char* m_base; // First slab, aligned to the slab size
+        char* m_end; // End of the usable range
+
+        SizeClass m_classes[ClassCount];
+
+        mutable std::mutex m_mutex; // Guards the slab pool
+        char* m_top; // End of the carved slabs
+        Slab* m_pool; // Empty slabs ready for reuse
+    };
+}
+
+#endif /* SHARED_MEMORY_SLABALLOCATOR_HPP */
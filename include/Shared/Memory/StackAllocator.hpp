@@ -0,0 +1,192 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_STACKALLOCATOR_HPP
+#define SHARED_MEMORY_STACKALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+namespace Memory
+{
+    /**
+     * @brief Last in, first out stack allocator with scoped markers.
+     *
+     * The StackAllocator class hands out memory by bumping a pointer like @ref ArenaAllocator does, either inside a caller supplied buffer or inside a chain of pages mapped from the operating system, but also deallocates in reverse allocation order.
+     * Freeing the most recent allocation moves the top of the stack back, freeing any other allocation only marks it, and its memory is reclaimed once every allocation above it got freed.
+     * The position of the top can be captured in a @ref Marker and restored by @ref rollback, deallocating everything allocated since in constant time. @ref Scope does the same for a C++ scope, so nested scratch scopes need no explicit cleanup.
+     *
+     * The most recent allocation can be resized in place by @ref realloc, @ref tryExpand and @ref tryShrink, as long as the current page has room.
+     * Mapped pages are kept until the allocator is destroyed and reused as the stack grows again.
+     * The statistic functions report exact figures: used bytes include the block headers, alignment padding and page tails skipped when an allocation didn't fit.
+     *
+     * The calls are not concurrently safe.
+     *
+     * @see @ref BasicAllocator, @ref ArenaAllocator
+     */
+    class SHARED_LIB_API StackAllocator : public BasicAllocator
+    {
+    public:
+
+        struct Header;
+        struct Page;
+
+        /**
+         * @brief Captured top of the stack.
+         *
+         * Only valid for the allocator which returned it, while no rollback to an earlier marker and no @ref reset happened.
+         */
+        struct Marker
+        {
+            char* top;
+            Header* last;
+            Page* page;
+            size_t used;
+        };
+
+        /**
+         * @brief Rolls the stack back on scope exit.
+         *
+         * Captures the top of the stack when constructed and rolls back to it when destroyed. Scopes must be nested properly.
+         */
+        class Scope
+        {
+        public:
+
+            /**
+             * @brief Capture the top of a stack.
+             *
+             * @param stack The stack to roll back on destruction, must outlive the scope.
+             */
+            explicit Scope(StackAllocator& stack) noexcept :
+                m_stack(stack),
+                m_marker(stack.getMarker())
+            {
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            /**
+             * @brief Deallocate everything allocated since construction.
+             */
+            ~Scope()
+            {
+                this->m_stack.rollback(this->m_marker);
+            }
+
+            /**
+             * @brief Get the captured marker.
+             */
+            const Marker& getMarker() const noexcept
+            {
+                return this->m_marker;
+            }
+
+        private:
+
+            StackAllocator& m_stack;
+            Marker m_marker;
+        };
+
+        /// Default minimum size of the pages mapped by a growing stack.
+        static constexpr size_t DefaultPageBytes = 64 * 1024;
+
+        /**
+         * @brief Construct a stack growing on demand.
+         *
+         * Pages are mapped from the operating system when the stack runs out of space. No memory is mapped until the first allocation.
+         *
+         * @param page_bytes Minimum size of a page, larger allocations get a page of their own size.
+         */
+        StackAllocator(size_t page_bytes = DefaultPageBytes);
+
+        /**
+         * @brief Construct a stack over a caller supplied buffer.
+         *
+         * The stack never grows, allocations return @b nullptr once the buffer is exhausted.
+         * The buffer must outlive the stack.
+         *
+         * @param buffer The memory to allocate from.
+         * @param bytes Size of @a buffer in bytes.
+         */
+        StackAllocator(void* buffer, size_t bytes);
+
+        StackAllocator(const StackAllocator&) = delete;
+        StackAllocator& operator=(const StackAllocator&) = delete;
+
+        /**
+         * @brief Destroy the stack.
+         *
+         * Returns every mapped page to the operating system.
+         */
+        virtual ~StackAllocator();
+
+        /**
+         * @brief Capture the top of the stack.
+         *
+         * @return Marker to pass to @ref rollback.
+         */
+        Marker getMarker() const noexcept;
+
+        /**
+         * @brief Deallocate everything allocated since a marker was captured.
+         *
+         * Allocations made before the marker stay valid, including the ones freed out of order, which are reclaimed if they end up on the top.
+         *
+         * @param marker A marker of this allocator, captured after the last rollback to an earlier marker.
+         */
+        void rollback(const Marker& marker) noexcept;
+
+        /**
+         * @brief Check whether an allocation is the most recent live one.
+         *
+         * @param ptr Pointer to a valid allocated memory block.
+         */
+        bool isTop(const void* ptr) const noexcept;
+
+        // -- BasicAllocator API --
+
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        // Move to the next page able to hold the allocation, mapping one if necessary
+        bool nextPage(size_t bytes, size_t align);
+
+        // Move the top below the most recent allocation, and below every freed allocation exposed by that
+        void pop(Header* header) noexcept;
+        void popFreed() noexcept;
+
+        // Make the page holding a position of the stack current
+        void setPage(Page* page, char* top) noexcept;
+
+        Page* m_pages; // First page of the chain, nullptr over a caller supplied buffer
+        Page* m_current; // Page currently bumped
+
+        char* m_buffer; // Start of the caller's buffer
+        char* m_top; // Next free byte of the current region
+        char* m_end; // End of the current region
+        Header* m_last; // Most recent allocation
+
+        size_t m_page_bytes; // Minimum page size, 0 over a caller supplied buffer
+        size_t m_used; // Bytes below the top
+        size_t m_total; // Size of all regions
+    };
+}
+
+#endif /* SHARED_MEMORY_STACKALLOCATOR_HPP */
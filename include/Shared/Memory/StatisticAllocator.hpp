@@ -0,0 +1,676 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_STATISTICALLOCATOR_HPP
+#define SHARED_MEMORY_STATISTICALLOCATOR_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Util/BitMask.hpp>
+
+#include <atomic>
+#include <limits>
+#include <type_traits>
+
+namespace Memory
+{
+    /**
+     * @brief Compile time statistic selection.
+     *
+     * Policy type for @ref StatisticAllocator, selecting which groups of counters get compiled in.
+     * Any type providing the same static constexpr @b bool members may be used as a policy.
+     *
+     * @tparam Flags Combination of the counter group flags, @ref None to @ref All.
+     */
+    template<uint32_t Flags>
+    struct StatisticPolicy
+    {
+        // Counter groups, plain constants rather than enumerators so they combine into a uint32_t without enum conversions
+
+        /// No statistics, every wrapped call compiles down to a direct call to the backing allocator.
+        static constexpr uint32_t None = 0;
+        /// Allocation and allocation failure counts.
+        static constexpr uint32_t Allocs = Util::BitMask<0>::value;
+        /// Total allocated bytes.
+        static constexpr uint32_t Bytes = Util::BitMask<1>::value;
+        /// Smallest, largest and largest failed allocation sizes.
+        static constexpr uint32_t Extremes = Util::BitMask<2>::value;
+        /// Highest reported usage, queries the backing allocator's used bytes after each allocation.
+        static constexpr uint32_t Highest = Util::BitMask<3>::value;
+        /// Reallocation counts, growth, shrink and moves, in place resize counts. Queries the allocation size before each reallocation.
+        static constexpr uint32_t Reallocs = Util::BitMask<4>::value;
+        /// Offer and reclaim counts and bytes.
+        static constexpr uint32_t Offers = Util::BitMask<5>::value;
+        /// Every counter.
+        static constexpr uint32_t All = Allocs | Bytes | Extremes | Highest | Reallocs | Offers;
+
+        static constexpr bool allocs = (Flags & Allocs) != 0;
+        static constexpr bool bytes = (Flags & Bytes) != 0;
+        static constexpr bool extremes = (Flags & Extremes) != 0;
+        static constexpr bool highest = (Flags & Highest) != 0;
+        static constexpr bool reallocs = (Flags & Reallocs) != 0;
+        static constexpr bool offers = (Flags & Offers) != 0;
+    };
+
+    /// Policy compiling in every counter.
+    using FullStatisticPolicy = StatisticPolicy<StatisticPolicy<0>::All>;
+
+    /// Policy compiling in no counters.
+    using NoStatisticPolicy = StatisticPolicy<StatisticPolicy<0>::None>;
+
+    /**
+     * @brief Common implementation of @ref StatisticAllocator.
+     *
+     * Implements the @ref BasicAllocator API and the counters. Not meant to be used directly.
+     *
+     * @tparam Backing Concrete type of the backing allocator.
+     * @tparam Policy Counter selection, see @ref StatisticPolicy.
+     * @tparam Interface The implemented interface, @ref BasicAllocator or @ref ObjectAllocator.
+     */
+    template<class Backing, class Policy, class Interface>
+    class StatisticAllocatorCore : public Interface
+    {
+        static_assert(std::is_base_of_v<BasicAllocator, Backing>, "Backing must implement BasicAllocator");
+
+    public:
+
+        using Interface::alloc;
+        using Interface::free;
+        using Interface::realloc;
+
+        StatisticAllocatorCore(const StatisticAllocatorCore&) = delete;
+        StatisticAllocatorCore& operator=(const StatisticAllocatorCore&) = delete;
+
+        /**
+         * @brief Get the backing allocator.
+         *
+         * @return The wrapped allocator.
+         */
+        Backing* getBacking() const noexcept
+        {
+            return this->m_backing;
+        }
+
+        // -- Statistic API -- Same as AllocatorStatistic's, only available if the policy compiles the counter in
+
+        size_t getHighestUsage() const noexcept
+        {
+            static_assert(Policy::highest, "The policy doesn't record the highest usage");
+            return this->m_counters.highest.load(std::memory_order_relaxed);
+        }
+
+        size_t getSmallestAlloc() const noexcept
+        {
+            static_assert(Policy::extremes, "The policy doesn't record allocation extremes");
+            size_t ret = this->m_counters.smallest.load(std::memory_order_relaxed);
+            return ret != std::numeric_limits<size_t>::max() ? ret : 0;
+        }
+
+        size_t getLargestAlloc() const noexcept
+        {
+            static_assert(Policy::extremes, "The policy doesn't record allocation extremes");
+            return this->m_counters.largest.load(std::memory_order_relaxed);
+        }
+
+        size_t getLargestAllocFailed() const noexcept
+        {
+            static_assert(Policy::extremes, "The policy doesn't record allocation extremes");
+            return this->m_counters.alloc_largest_fail.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalAllocs() const noexcept
+        {
+            static_assert(Policy::allocs, "The policy doesn't count allocations");
+            return this->m_counters.allocC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalAllocFails() const noexcept
+        {
+            static_assert(Policy::allocs, "The policy doesn't count allocations");
+            return this->m_counters.alloc_failC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalAllocBytes() const noexcept
+        {
+            static_assert(Policy::bytes, "The policy doesn't count allocated bytes");
+            return this->m_counters.allocB.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocs() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.reallocC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocFails() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.realloc_failC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocGrowth() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.realloc_growthB.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocShrink() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.realloc_shrinkB.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocMoves() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.realloc_moveC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReallocMoved() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.realloc_moveB.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalExpands() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.expandC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalExpandFails() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.expand_failC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalShrinks() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.shrinkC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalShrinkFails() const noexcept
+        {
+            static_assert(Policy::reallocs, "The policy doesn't count reallocations");
+            return this->m_counters.shrink_failC.load(std::memory_order_relaxed);
+        }
+
+        double getInPlaceRate() const noexcept
+        {
+            uintmax_t calls = this->getTotalExpands() + this->getTotalShrinks();
+            if (calls == 0)
+                return 0.0;
+
+            uintmax_t fails = this->getTotalExpandFails() + this->getTotalShrinkFails();
+            return static_cast<double>(calls - fails) / static_cast<double>(calls);
+        }
+
+        uintmax_t getTotalOffers() const noexcept
+        {
+            static_assert(Policy::offers, "The policy doesn't count offers");
+            return this->m_counters.offerC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalOfferBytes() const noexcept
+        {
+            static_assert(Policy::offers, "The policy doesn't count offers");
+            return this->m_counters.offerB.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReclaims() const noexcept
+        {
+            static_assert(Policy::offers, "The policy doesn't count offers");
+            return this->m_counters.reclaimC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReclaimFails() const noexcept
+        {
+            static_assert(Policy::offers, "The policy doesn't count offers");
+            return this->m_counters.reclaim_failC.load(std::memory_order_relaxed);
+        }
+
+        uintmax_t getTotalReclaimBytes() const noexcept
+        {
+            static_assert(Policy::offers, "The policy doesn't count offers");
+            return this->m_counters.reclaimB.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Reset all the counters.
+         *
+         * Reset each and every counter to zero while leaving the allocator itself intact.
+         */
+        void resetCounters() noexcept
+        {
+            this->m_counters.smallest = std::numeric_limits<size_t>::max();
+            this->m_counters.largest = 0;
+            this->m_counters.highest = 0;
+            this->m_counters.allocC = 0;
+            this->m_counters.alloc_failC = 0;
+            this->m_counters.alloc_largest_fail = 0;
+            this->m_counters.allocB = 0;
+            this->m_counters.reallocC = 0;
+            this->m_counters.realloc_failC = 0;
+            this->m_counters.realloc_growthB = 0;
+            this->m_counters.realloc_shrinkB = 0;
+            this->m_counters.realloc_moveC = 0;
+            this->m_counters.realloc_moveB = 0;
+            this->m_counters.expandC = 0;
+            this->m_counters.expand_failC = 0;
+            this->m_counters.shrinkC = 0;
+            this->m_counters.shrink_failC = 0;
+            this->m_counters.offerC = 0;
+            this->m_counters.offerB = 0;
+            this->m_counters.reclaimC = 0;
+            this->m_counters.reclaim_failC = 0;
+            this->m_counters.reclaimB = 0;
+        }
+
+        // -- BasicAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            void* ret = this->m_backing->Backing::alloc(bytes, align);
+            this->countAlloc(ret != nullptr, bytes, 1);
+            return ret;
+        }
+
+        virtual void free(void* ptr) override
+        {
+            this->m_backing->Backing::free(ptr);
+        }
+
+        virtual void free(void* ptr, size_t bytes) override
+        {
+            this->m_backing->Backing::free(ptr, bytes);
+        }
+
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            size_t last_size = 0;
+            if constexpr (Policy::reallocs)
+            {
+                if (ptr != nullptr)
+                    last_size = this->m_backing->Backing::getAllocSize(ptr);
+            }
+
+            void* ret = this->m_backing->Backing::realloc(ptr, bytes, align);
+            this->countRealloc(ptr, ret, last_size, bytes);
+            return ret;
+        }
+
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override
+        {
+            void* ret = this->m_backing->Backing::reallocSized(ptr, old_bytes, bytes, align);
+            this->countRealloc(ptr, ret, old_bytes, bytes);
+            return ret;
+        }
+
+        virtual size_t getAllocSize(const void* ptr) const override
+        {
+            return this->m_backing->Backing::getAllocSize(ptr);
+        }
+
+        virtual bool tryExpand(void* ptr, size_t bytes) override
+        {
+            bool ret = this->m_backing->Backing::tryExpand(ptr, bytes);
+            this->countResize(this->m_counters.expandC, this->m_counters.expand_failC, ret, bytes);
+            return ret;
+        }
+
+        virtual bool tryShrink(void* ptr, size_t bytes) override
+        {
+            bool ret = this->m_backing->Backing::tryShrink(ptr, bytes);
+            this->countResize(this->m_counters.shrinkC, this->m_counters.shrink_failC, ret, bytes);
+            return ret;
+        }
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override
+        {
+            size_t ret = this->m_backing->Backing::allocBulk(bytes, count, out, align);
+            if (ret != 0)
+                this->countAlloc(true, bytes, ret);
+            if (ret != count)
+                this->countAlloc(false, bytes, 1);
+            return ret;
+        }
+
+        virtual void freeBulk(void** ptrs, size_t count) override
+        {
+            this->m_backing->Backing::freeBulk(ptrs, count);
+        }
+
+        virtual void reset() override
+        {
+            this->resetCounters();
+            this->m_backing->Backing::reset();
+        }
+
+        virtual size_t getFreeBytes() const override
+        {
+            return this->m_backing->Backing::getFreeBytes();
+        }
+
+        virtual size_t getUsedBytes() const override
+        {
+            return this->m_backing->Backing::getUsedBytes();
+        }
+
+        virtual size_t getTotalBytes() const override
+        {
+            return this->m_backing->Backing::getTotalBytes();
+        }
+
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override
+        {
+            return this->m_backing->Backing::getFreeCounts(local, remote);
+        }
+
+    protected:
+
+        StatisticAllocatorCore(Backing* backing) noexcept :
+            m_backing(backing)
+        {
+        }
+
+        template<class T>
+        static inline void storeMax(std::atomic<T>& target, T value) noexcept
+        {
+            T expected = target.load(std::memory_order_relaxed);
+            while (expected < value)
+                if (target.compare_exchange_weak(expected, value, std::memory_order_relaxed))
+                    break;
+        }
+
+        template<class T>
+        static inline void storeMin(std::atomic<T>& target, T value) noexcept
+        {
+            T expected = target.load(std::memory_order_relaxed);
+            while (expected > value)
+                if (target.compare_exchange_weak(expected, value, std::memory_order_relaxed))
+                    break;
+        }
+
+        // Every update is discarded at compile time unless the policy selects its counter
+        void countAlloc(bool success, size_t bytes, uintmax_t count) noexcept
+        {
+            if constexpr (Policy::allocs)
+            {
+                this->m_counters.allocC.fetch_add(count, std::memory_order_relaxed);
+                if (!success)
+                    this->m_counters.alloc_failC.fetch_add(count, std::memory_order_relaxed);
+            }
+            if constexpr (Policy::bytes)
+            {
+                if (success)
+                    this->m_counters.allocB.fetch_add(bytes * count, std::memory_order_relaxed);
+            }
+            if constexpr (Policy::extremes)
+            {
+                if (success)
+                {
+                    storeMax(this->m_counters.largest, bytes);
+                    storeMin(this->m_counters.smallest, bytes);
+                }
+                else
+                {
+                    storeMax(this->m_counters.alloc_largest_fail, bytes);
+                }
+            }
+            if constexpr (Policy::highest)
+            {
+                if (success)
+                    storeMax(this->m_counters.highest, this->m_backing->Backing::getUsedBytes());
+            }
+            (void)success;
+            (void)bytes;
+            (void)count;
+        }
+
+        void countRealloc(void* ptr, void* ret, size_t last_size, size_t bytes) noexcept
+        {
+            if constexpr (Policy::reallocs)
+            {
+                this->m_counters.reallocC.fetch_add(1, std::memory_order_relaxed);
+                if (ret == nullptr)
+                {
+                    this->m_counters.realloc_failC.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    if (ret != ptr)
+                    {
+                        this->m_counters.realloc_moveC.fetch_add(1, std::memory_order_relaxed);
+                        this->m_counters.realloc_moveB.fetch_add(bytes, std::memory_order_relaxed);
+                    }
+
+                    if (last_size > bytes)
+                        this->m_counters.realloc_shrinkB.fetch_add(last_size - bytes, std::memory_order_relaxed);
+                    else if (last_size < bytes)
+                        this->m_counters.realloc_growthB.fetch_add(bytes - last_size, std::memory_order_relaxed);
+                }
+            }
+            if constexpr (Policy::bytes)
+            {
+                if (ret != nullptr)
+                    this->m_counters.allocB.fetch_add(bytes, std::memory_order_relaxed);
+            }
+            if constexpr (Policy::extremes)
+            {
+                if (ret != nullptr)
+                {
+                    storeMax(this->m_counters.largest, bytes);
+                    storeMin(this->m_counters.smallest, bytes);
+                }
+                else
+                {
+                    storeMax(this->m_counters.alloc_largest_fail, bytes);
+                }
+            }
+            if constexpr (Policy::highest)
+            {
+                if (ret != nullptr)
+                    storeMax(this->m_counters.highest, this->m_backing->Backing::getUsedBytes());
+            }
+            (void)ptr;
+            (void)ret;
+            (void)last_size;
+            (void)bytes;
+        }
+
+        void countResize(std::atomic<uintmax_t>& calls, std::atomic<uintmax_t>& fails, bool success, size_t bytes) noexcept
+        {
+            if constexpr (Policy::reallocs)
+            {
+                calls.fetch_add(1, std::memory_order_relaxed);
+                if (!success)
+                    fails.fetch_add(1, std::memory_order_relaxed);
+            }
+            if constexpr (Policy::extremes)
+            {
+                if (success)
+                {
+                    storeMax(this->m_counters.largest, bytes);
+                    storeMin(this->m_counters.smallest, bytes);
+                }
+            }
+            if constexpr (Policy::highest)
+            {
+                if (success)
+                    storeMax(this->m_counters.highest, this->m_backing->Backing::getUsedBytes());
+            }
+            (void)calls;
+            (void)fails;
+            (void)success;
+            (void)bytes;
+        }
+
+        // Same counters as in AllocatorStatistic, the ones not selected by the policy are never touched
+        struct alignas(PLATFORM_CACHE_LINE_SIZE) Counters
+        {
+            std::atomic<size_t> smallest{ std::numeric_limits<size_t>::max() };
+            std::atomic<size_t> largest{ 0 };
+            std::atomic<size_t> highest{ 0 };
+
+            std::atomic<uintmax_t> allocC{ 0 };
+            std::atomic<uintmax_t> alloc_failC{ 0 };
+            std::atomic<size_t> alloc_largest_fail{ 0 };
+            std::atomic<uintmax_t> allocB{ 0 };
+
+            std::atomic<uintmax_t> reallocC{ 0 };
+            std::atomic<uintmax_t> realloc_failC{ 0 };
+            std::atomic<uintmax_t> realloc_growthB{ 0 };
+            std::atomic<uintmax_t> realloc_shrinkB{ 0 };
+            std::atomic<uintmax_t> realloc_moveC{ 0 };
+            std::atomic<uintmax_t> realloc_moveB{ 0 };
+
+            std::atomic<uintmax_t> expandC{ 0 };
+            std::atomic<uintmax_t> expand_failC{ 0 };
+            std::atomic<uintmax_t> shrinkC{ 0 };
+            std::atomic<uintmax_t> shrink_failC{ 0 };
+
+            std::atomic<uintmax_t> offerC{ 0 };
+            std::atomic<uintmax_t> offerB{ 0 };
+            std::atomic<uintmax_t> reclaimC{ 0 };
+            std::atomic<uintmax_t> reclaim_failC{ 0 };
+            std::atomic<uintmax_t> reclaimB{ 0 };
+        };
+
+        Backing* m_backing;
+        Counters m_counters;
+    };
+
+    /**
+     * @brief Compile time configured allocation statistic class.
+     *
+     * The StatisticAllocator class template collects the same statistics as @ref AllocatorStatistic, without its runtime costs.
+     * The backing allocator's concrete type is known at compile time, so every wrapped call is a direct, inlinable call instead of a virtual one.
+     * The @a Policy selects the counters compiled in, with @ref NoStatisticPolicy every wrapped call compiles down to a plain call into the backing allocator.
+     * Getters of counters not selected by the policy fail to compile.
+     *
+     * The class is final, calls made through a StatisticAllocator typed object bypass virtual dispatch altogether, while it remains usable through the @ref BasicAllocator interface.
+     * If @a Backing implements @ref ObjectAllocator the whole ObjectAllocator API is available as well.
+     * @a Backing must be the dynamic type of the backing allocator, overrides of a further derived class are bypassed. The backing allocator must outlive the StatisticAllocator.
+     * Exceptions thrown by the backing allocator are propagated without being counted.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * Code example:
+     * \code{.cpp}
+        using Policy = Memory::StatisticPolicy<Memory::StatisticPolicy<0>::Allocs | Memory::StatisticPolicy<0>::Bytes>;
+        Memory::Heap heap;
+        Memory::StatisticAllocator<Memory::Heap, Policy> allocator(&heap);
+        void* ptr = allocator.alloc(64);
+        allocator.free(ptr);
+        uintmax_t allocs = allocator.getTotalAllocs(); \endcode
+     *
+     * @tparam Backing Concrete type of the backing allocator.
+     * @tparam Policy Counter selection, see @ref StatisticPolicy.
+     *
+     * @see @ref AllocatorStatistic, @ref StatisticPolicy
+     */
+    template<class Backing, class Policy = FullStatisticPolicy, bool IsObject = std::is_base_of_v<ObjectAllocator, Backing>>
+    class StatisticAllocator final : public StatisticAllocatorCore<Backing, Policy, BasicAllocator>
+    {
+    public:
+
+        /**
+         * @brief Construct a StatisticAllocator object.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         */
+        StatisticAllocator(Backing* backing) noexcept :
+            StatisticAllocatorCore<Backing, Policy, BasicAllocator>(backing)
+        {
+        }
+    };
+
+    template<class Backing, class Policy>
+    class StatisticAllocator<Backing, Policy, true> final : public StatisticAllocatorCore<Backing, Policy, ObjectAllocator>
+    {
+        using Core = StatisticAllocatorCore<Backing, Policy, ObjectAllocator>;
+
+    public:
+
+        using DestructorPtr = ObjectAllocator::DestructorPtr;
+
+        using Core::alloc;
+        using Core::realloc;
+
+        /**
+         * @brief Construct a StatisticAllocator object.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         */
+        StatisticAllocator(Backing* backing) noexcept :
+            Core(backing)
+        {
+        }
+
+        // -- ObjectAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override
+        {
+            void* ret = this->m_backing->Backing::alloc(bytes, destructor, align);
+            this->countAlloc(ret != nullptr, bytes, 1);
+            return ret;
+        }
+
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override
+        {
+            size_t last_size = 0;
+            if constexpr (Policy::reallocs)
+            {
+                if (ptr != nullptr)
+                    last_size = this->m_backing->Backing::getAllocSize(ptr);
+            }
+
+            void* ret = this->m_backing->Backing::realloc(ptr, bytes, destructor, align);
+            this->countRealloc(ptr, ret, last_size, bytes);
+            return ret;
+        }
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override
+        {
+            if constexpr (Policy::offers)
+            {
+                this->m_counters.offerC.fetch_add(1, std::memory_order_relaxed);
+                this->m_counters.offerB.fetch_add(this->m_backing->Backing::getAllocSize(ptr), std::memory_order_relaxed);
+            }
+            return this->m_backing->Backing::offer(ptr, priority);
+        }
+
+        virtual void* reclaim(void* ptr) override
+        {
+            void* ret = this->m_backing->Backing::reclaim(ptr);
+            if constexpr (Policy::offers)
+            {
+                this->m_counters.reclaimC.fetch_add(1, std::memory_order_relaxed);
+                if (ret == nullptr)
+                    this->m_counters.reclaim_failC.fetch_add(1, std::memory_order_relaxed);
+                else
+                    this->m_counters.reclaimB.fetch_add(this->m_backing->Backing::getAllocSize(ret), std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override
+        {
+            this->m_backing->Backing::purge(priority);
+        }
+
+        virtual void clear() override
+        {
+            this->resetCounters();
+            this->m_backing->Backing::clear();
+        }
+
+        virtual size_t getPendingBytes() const override
+        {
+            return this->m_backing->Backing::getPendingBytes();
+        }
+    };
+}
+
+#endif /* SHARED_MEMORY_STATISTICALLOCATOR_HPP */
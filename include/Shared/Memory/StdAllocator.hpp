@@ -0,0 +1,99 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_STDALLOCATOR_HPP
+#define SHARED_MEMORY_STDALLOCATOR_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <limits>
+#include <new>
+
+namespace Memory
+{
+    /**
+     * @brief Standard allocator over a BasicAllocator.
+     *
+     * The StdAllocator class template satisfies the standard @b Allocator requirements, so any standard container can allocate from a @ref BasicAllocator without switching to the @b std::pmr types.
+     * The allocator is stateful, it holds a pointer to the backing allocator. Copies and rebound copies share the backing allocator and compare equal.
+     * Allocation failures are reported by throwing @b std::bad_alloc.
+     *
+     * The backing allocator must outlive every container using it.
+     * Thread safety is the same as the backing allocator's.
+     *
+     * Code example:
+     * \code{.cpp}
+        Memory::Heap heap;
+        std::vector<int, Memory::StdAllocator<int>> values{ Memory::StdAllocator<int>(&heap) }; \endcode
+     *
+     * @tparam T Type of the allocated objects.
+     *
+     * @see @ref MemoryResourceAdapter, @ref BasicAllocator
+     */
+    template<class T>
+    class StdAllocator
+    {
+    public:
+
+        using value_type = T;
+
+        /**
+         * @brief Construct a StdAllocator object.
+         *
+         * @param backing The allocator which will do the actual allocations.
+         */
+        StdAllocator(BasicAllocator* backing) noexcept :
+            m_backing(backing)
+        {
+        }
+
+        template<class U>
+        StdAllocator(const StdAllocator<U>& other) noexcept :
+            m_backing(other.getBacking())
+        {
+        }
+
+        T* allocate(size_t count)
+        {
+            if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+                throw std::bad_array_new_length();
+
+            void* ptr = this->m_backing->alloc(count * sizeof(T), alignof(T));
+            if (ptr == nullptr)
+                throw std::bad_alloc();
+            return reinterpret_cast<T*>(ptr);
+        }
+
+        void deallocate(T* ptr, size_t count) noexcept
+        {
+            this->m_backing->free(ptr, count * sizeof(T));
+        }
+
+        /**
+         * @brief Get the backing allocator.
+         *
+         * @return The wrapped allocator.
+         */
+        BasicAllocator* getBacking() const noexcept
+        {
+            return this->m_backing;
+        }
+
+        template<class U>
+        bool operator==(const StdAllocator<U>& other) const noexcept
+        {
+            return this->m_backing == other.getBacking();
+        }
+
+        template<class U>
+        bool operator!=(const StdAllocator<U>& other) const noexcept
+        {
+            return this->m_backing != other.getBacking();
+        }
+
+    protected:
+
+        BasicAllocator* m_backing;
+    };
+}
+
+#endif /* SHARED_MEMORY_STDALLOCATOR_HPP */
@@ -0,0 +1,86 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_TASKARENA_HPP
+#define SHARED_MEMORY_TASKARENA_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ArenaAllocator.hpp>
+
+namespace Memory
+{
+    /**
+     * @brief Arena released once every block of a task got freed.
+     *
+     * The TaskArena class hands out memory from an @ref ArenaAllocator, and counts the blocks alive. When the last one is freed the arena is reset, so the memory of a completed task is reclaimed in constant time and the pages are reused by the next task.
+     * Combined with @ref FramePromise, the coroutine frames of a task and of the coroutines it awaits are allocated from the task's arena, and the arena resets when the outermost frame is destroyed.
+     * Other allocations of the task, like containers using a @ref StdAllocator over the arena, keep the arena alive until they are freed too.
+     *
+     * Like with @ref ArenaAllocator, individual blocks are only reclaimed by the reset, except that the most recent block can be resized in place.
+     * Keeping one arena per worker or connection and running its tasks one after another avoids mapping pages for every task.
+     *
+     * The calls are not concurrently safe. A task resumed on different threads may use its arena as long as the resumptions don't overlap.
+     *
+     * @see @ref FramePromise, @ref ArenaAllocator
+     */
+    class SHARED_LIB_API TaskArena : public BasicAllocator
+    {
+    public:
+
+        /**
+         * @brief Construct an arena growing on demand.
+         *
+         * @param page_bytes Minimum size of the pages mapped from the operating system, larger allocations get a page of their own size.
+         */
+        TaskArena(size_t page_bytes = ArenaAllocator::DefaultPageBytes);
+
+        /**
+         * @brief Construct an arena over a caller supplied buffer.
+         *
+         * Allocations return @b nullptr once the buffer is exhausted. The buffer must outlive the arena.
+         *
+         * @param buffer The memory to allocate from.
+         * @param bytes Size of @a buffer in bytes.
+         */
+        TaskArena(void* buffer, size_t bytes);
+
+        TaskArena(const TaskArena&) = delete;
+        TaskArena& operator=(const TaskArena&) = delete;
+
+        /**
+         * @brief Get the amount of blocks alive.
+         */
+        size_t getLiveCount() const noexcept;
+
+        /**
+         * @brief Get the amount of times the arena got reset, by the last free or by @ref reset.
+         */
+        uint64_t getResetCount() const noexcept;
+
+        // -- BasicAllocator API --
+
+        using BasicAllocator::free;
+        using BasicAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        ArenaAllocator m_arena;
+        size_t m_live; // Blocks allocated since the last reset and not freed yet
+        uint64_t m_resets;
+    };
+}
+
+#endif /* SHARED_MEMORY_TASKARENA_HPP */
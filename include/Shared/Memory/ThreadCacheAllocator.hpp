@@ -0,0 +1,116 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_THREADCACHEALLOCATOR_HPP
+#define SHARED_MEMORY_THREADCACHEALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+namespace Memory
+{
+    /**
+     * @brief Thread local caching front-end for any allocator.
+     *
+     * The ThreadCacheAllocator class acts as a proxy layer over the actual allocator, like @ref AllocatorStatistic does.
+     * Every thread keeps small bounded magazines of recently freed blocks for each small size class, most short lived small allocations are served from these without ever reaching the backing allocator.
+     * Only allocations of at most @ref MaxCachedSize bytes with no more than the default alignment are cached, every other call is forwarded directly.
+     * Sized deallocations of small blocks skip the size lookup in the backing allocator.
+     *
+     * Cached blocks still count as used memory in the backing allocator. A thread's magazines are returned to the backing allocator when the thread exits, when @ref flush is called or when the ThreadCacheAllocator is destroyed. Calls made by a thread after its magazines got returned on exit, like frees from later thread exit handlers, bypass the caches.
+     * The backing allocator must outlive the ThreadCacheAllocator.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * @see @ref BasicAllocator, @ref Heap, @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API ThreadCacheAllocator : public BasicAllocator
+    {
+    public:
+
+        /// Largest allocation size served from the thread caches.
+        static constexpr size_t MaxCachedSize = 256;
+
+        /// Amount of blocks a single size class magazine may hold.
+        static constexpr size_t MagazineSize = 32;
+
+        /**
+         * @brief Construct a ThreadCacheAllocator object.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         */
+        ThreadCacheAllocator(BasicAllocator* backing);
+
+        ThreadCacheAllocator(const ThreadCacheAllocator&) = delete;
+        ThreadCacheAllocator& operator=(const ThreadCacheAllocator&) = delete;
+
+        /**
+         * @brief Destroy the ThreadCacheAllocator object.
+         *
+         * Returns the cached blocks of every thread to the backing allocator.
+         */
+        virtual ~ThreadCacheAllocator();
+
+        /**
+         * @brief Return cached blocks of the calling thread.
+         *
+         * Free every block cached by the calling thread in the backing allocator.
+         * Useful when a thread is about to idle for a long time.
+         */
+        void flush();
+
+        // -- BasicAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
+
+    protected:
+
+        struct ThreadCache;
+        struct ThreadList;
+
+        static constexpr size_t ClassCount = MaxCachedSize / 16;
+
+        // Get the calling thread's cache for this allocator, creating it if necessary
+        ThreadCache* getCache();
+        ThreadCache* createCache();
+
+        // Small requests are always rounded up to their class size, so a sized free can tell the class of any small block
+        static inline size_t getClassSize(size_t bytes) noexcept
+        {
+            return bytes <= MaxCachedSize ? (bytes == 0 ? 16 : (bytes + 15) & ~size_t(15)) : bytes;
+        }
+
+        // Size class a freed block is cached under, ClassCount if the block can't be cached
+        size_t getFreeClass(void* ptr) const;
+        static void pushBlock(ThreadCache* cache, size_t size_class, void* ptr);
+
+        // Free the cached blocks of a single magazine in the backing allocator
+        static void flushMagazine(ThreadCache* cache, size_t size_class, size_t count);
+        static void flushCache(ThreadCache* cache);
+
+        static ThreadList& getThreadList();
+
+        BasicAllocator* m_backing;
+        uint64_t m_id; // Unique instance identifier, never reused
+        ThreadCache* m_caches; // Caches of every thread using this allocator
+    };
+}
+
+#endif /* SHARED_MEMORY_THREADCACHEALLOCATOR_HPP */
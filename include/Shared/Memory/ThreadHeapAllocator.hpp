@@ -0,0 +1,177 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_THREADHEAPALLOCATOR_HPP
+#define SHARED_MEMORY_THREADHEAPALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/BasicAllocator.hpp>
+
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Allocator with a private heap for every thread and lock-free remote frees.
+     *
+     * The ThreadHeapAllocator class serves small allocations from heaps owned by single threads, and forwards every other call to a backing allocator.
+     * A heap is made of @ref SegmentSize bytes segments carved from a single address space reservation, each segment holding blocks of one size class.
+     * The owner thread allocates and frees blocks of its segments without any locking or atomic read-modify-write operations.
+     *
+     * Blocks freed by any other thread are pushed onto the owner heap's @ref RemoteFreeQueue with a single compare-and-swap, and the owner takes the whole queue at its next allocation, releasing the blocks in a batch.
+     * So blocks handed from producer to consumer threads return to the producer's heap without a global lock, unlike with @ref ThreadCacheAllocator, where they end up in the consumer's cache and go through the backing allocator.
+     * The amount of blocks freed by their owner and by foreign threads is counted, see @ref getRemoteFreeRate. @ref AllocatorStatistic snapshots of a ThreadHeapAllocator include both.
+     *
+     * Allocations of at most @ref MaxSmallSize bytes with no more than the default alignment are served from the heaps, every other allocation is forwarded to the backing allocator.
+     * Empty segments beyond one per size class go back to a shared pool and are reused by any heap. When a thread exits its heap is kept with every block in it, and adopted by the next thread starting to use the allocator.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * @see @ref BasicAllocator, @ref ThreadCacheAllocator, @ref RemoteFreeQueue
+     */
+    class SHARED_LIB_API ThreadHeapAllocator : public BasicAllocator
+    {
+    public:
+
+        /// Default size of the reserved address space.
+        static constexpr size_t DefaultReserveBytes = sizeof(void*) >= 8 ? (size_t(16) << 30) : (size_t(128) << 20);
+
+        /// Size and alignment of a segment.
+        static constexpr size_t SegmentSize = 64 * 1024;
+
+        /// Largest allocation size served from the thread heaps.
+        static constexpr size_t MaxSmallSize = 8192;
+
+        /**
+         * @brief Construct a ThreadHeapAllocator object.
+         *
+         * Reserves the address space of the segments, no memory is committed until the first allocation.
+         * If the reservation fails every allocation is forwarded to the backing allocator.
+         *
+         * @param backing The backing allocator serving the large allocations.
+         * @param reserve_bytes Size of the address space to reserve, the upper limit of the memory the heaps can hold.
+         */
+        ThreadHeapAllocator(BasicAllocator* backing, size_t reserve_bytes = DefaultReserveBytes);
+
+        ThreadHeapAllocator(const ThreadHeapAllocator&) = delete;
+        ThreadHeapAllocator& operator=(const ThreadHeapAllocator&) = delete;
+
+        /**
+         * @brief Destroy the ThreadHeapAllocator object.
+         *
+         * Releases every segment, including the blocks still allocated from them. Allocations forwarded to the backing allocator are left alone.
+         */
+        virtual ~ThreadHeapAllocator();
+
+        /**
+         * @brief Release the blocks freed by foreign threads to the calling thread's heap.
+         *
+         * Happens on every allocation anyway, useful when a thread is about to idle for a long time, so the empty segments can be reused by other threads.
+         */
+        void collect();
+
+        /**
+         * @brief Get the amount of blocks freed by the thread owning them.
+         */
+        uint64_t getLocalFrees() const;
+
+        /**
+         * @brief Get the amount of blocks freed by threads not owning them.
+         *
+         * Blocks are counted once their owner took them from its queue.
+         */
+        uint64_t getRemoteFrees() const;
+
+        /**
+         * @brief Get the rate of remote frees.
+         *
+         * @return Remote frees divided by all frees of heap blocks, 0 if there were none.
+         */
+        double getRemoteFreeRate() const;
+
+        /**
+         * @brief Get the backing allocator.
+         */
+        BasicAllocator* getBacking() const noexcept;
+
+        // -- BasicAllocator API -- Large allocations are forwarded
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        /**
+         * @brief Invalidate every allocation.
+         *
+         * Empties every heap and resets the backing allocator. No calls may be in progress on other threads.
+         */
+        virtual void reset() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
+
+    protected:
+
+        struct Segment;
+        struct ThreadHeap;
+        struct ThreadList;
+
+        static constexpr size_t ClassCount = 32; // 16 byte steps up to 128, then 4 classes per power of two
+
+        static size_t getSizeClass(size_t bytes) noexcept;
+        static size_t getClassSize(size_t size_class) noexcept;
+
+        // Get the calling thread's heap for this allocator, creating or adopting one if necessary
+        ThreadHeap* getHeap();
+        ThreadHeap* findHeap() const;
+        ThreadHeap* createHeap();
+
+        inline bool isSegmentBlock(const void* ptr) const noexcept
+        {
+            return ptr >= this->m_base && ptr < this->m_end;
+        }
+
+        static Segment* getSegment(const void* ptr) noexcept;
+
+        // Segments with free blocks of a class are listed in their heap, allocations are served from the first one
+        static void linkSegment(ThreadHeap* heap, Segment* segment) noexcept;
+        static void unlinkSegment(ThreadHeap* heap, Segment* segment) noexcept;
+
+        void* allocSmall(ThreadHeap* heap, size_t size_class);
+        void freeLocal(ThreadHeap* heap, Segment* segment, void* ptr);
+        void freeRemote(Segment* segment, void* ptr);
+        void drainRemote(ThreadHeap* heap);
+
+        // Segment pool, locks the allocator
+        Segment* acquireSegment(ThreadHeap* heap, size_t size_class);
+        void releaseSegment(Segment* segment);
+
+        // Committed bytes of the carved segments, and allocated bytes of every heap
+        size_t getSegmentBytes() const;
+        size_t getHeapUsedBytes() const;
+
+        static ThreadList& getThreadList();
+
+        BasicAllocator* m_backing;
+        uint64_t m_id; // Unique instance identifier, never reused
+        ThreadHeap* m_heaps; // Heaps of every thread using this allocator, and the abandoned ones
+
+        char* m_reservation; // Start of the reservation as returned by the system
+        size_t m_reserved; // Size of the reservation
+        char* m_base; // First segment, aligned to the segment size
+        char* m_end; // End of the usable range
+
+        mutable std::mutex m_mutex; // Guards the segment pool
+        char* m_top; // End of the carved segments
+        Segment* m_pool; // Empty segments ready for reuse
+    };
+}
+
+#endif /* SHARED_MEMORY_THREADHEAPALLOCATOR_HPP */
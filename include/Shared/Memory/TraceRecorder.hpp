@@ -0,0 +1,222 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_TRACERECORDER_HPP
+#define SHARED_MEMORY_TRACERECORDER_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+namespace Memory
+{
+    /**
+     * @brief Allocator call recording proxy.
+     *
+     * The TraceRecorder class acts as a proxy layer over the actual allocator, like @ref AllocatorStatistic does, and records every allocator call into a compact binary trace.
+     * Each record holds the call, its pointers, size, alignment, the calling thread and a timestamp. Traces can be replayed against any allocator by @ref TraceReplay.
+     *
+     * Records are appended to per thread buffers without any locking or atomic read-modify-write operations. Filled buffers are handed over to a background thread through a lock-free list, which writes them to the output stream.
+     * The buffers are mapped directly from the operating system, recording never calls into the traced allocator.
+     * A thread's partially filled buffer is written once the thread exits, or when the recorder is destroyed.
+     *
+     * Trace format: a @ref HeaderSize bytes header with the "ATRC" magic, the format version and the record size as 32-bit little endian integers, followed by @ref RecordSize bytes long little endian records.
+     * Records are grouped by thread, in call order within each thread. Ordering them by timestamp yields a global order consistent with the hand-off of pointers between threads.
+     *
+     * All calls are concurrently safe, as long as the underlying allocator is also thread safe.
+     *
+     * @see @ref TraceReplay, @ref AllocatorStatistic
+     */
+    class SHARED_LIB_API TraceRecorder : public ObjectAllocator
+    {
+    public:
+
+        /// Recorded call types.
+        enum Call : uint8_t
+        {
+            /// @ref alloc, one record for each block of @ref allocBulk.
+            Alloc = 0,
+            /// @ref free, one record for each block of @ref freeBulk.
+            Free,
+            /// @ref realloc.
+            Realloc,
+            /// @ref offer, the size field holds the priority.
+            Offer,
+            /// @ref reclaim.
+            Reclaim,
+            /// @ref purge, the size field holds the priority.
+            Purge,
+            /// @ref reset.
+            Reset,
+            /// @ref clear.
+            Clear,
+            /// @ref tryExpand, the result is 1 on success.
+            Expand,
+            /// @ref tryShrink, the result is 1 on success.
+            Shrink
+        };
+
+        /**
+         * @brief A single recorded call.
+         */
+        struct Record
+        {
+            uint64_t time; // Nanoseconds since the recorder got constructed
+            uint64_t ptr; // Pointer argument of the call, 0 if none
+            uint64_t result; // Returned pointer or success flag
+            uint64_t size; // Requested bytes or priority
+            uint32_t thread; // Sequential identifier of the calling thread
+            uint8_t call; // One of the Call values
+            uint8_t align_bits; // Base 2 logarithm of the requested alignment
+            uint16_t reserved;
+        };
+
+        /// Size of the trace header in bytes.
+        static constexpr size_t HeaderSize = 16;
+
+        /// Size of a serialized record in bytes.
+        static constexpr size_t RecordSize = 40;
+
+        /// Version of the trace format.
+        static constexpr uint32_t FormatVersion = 1;
+
+        /// Amount of records a thread buffer holds.
+        static constexpr size_t BufferRecords = 4096;
+
+        /// Longest time the background thread waits before writing the filled buffers, in milliseconds.
+        static constexpr uint32_t FlushIntervalMs = 100;
+
+        /**
+         * @brief Construct a TraceRecorder object.
+         *
+         * Writes the trace header and starts the background writer thread.
+         * Calling @ref ObjectAllocator member functions other than the ones of @ref BasicAllocator will result in an error.
+         *
+         * @param backing The backing allocator which will do the actual allocations.
+         * @param out The stream receiving the trace, opened in binary mode. Must outlive the recorder.
+         *
+         * @throw std::system_error If the writer thread can't be started.
+         */
+        TraceRecorder(BasicAllocator* backing, std::ostream& out);
+
+        /**
+         * @copydoc TraceRecorder(BasicAllocator*, std::ostream&)
+         */
+        TraceRecorder(ObjectAllocator* backing, std::ostream& out);
+
+        TraceRecorder(const TraceRecorder&) = delete;
+        TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+        /**
+         * @brief Destroy the TraceRecorder object.
+         *
+         * Writes every buffer, including the partially filled ones of live threads, and stops the writer thread.
+         * No calls may be in progress on other threads.
+         */
+        virtual ~TraceRecorder();
+
+        /**
+         * @brief Write the recorded calls.
+         *
+         * Hands over the calling thread's buffer and waits until the writer thread wrote every handed over buffer and flushed the stream.
+         * Partially filled buffers of other threads are not written.
+         */
+        void flush();
+
+        /**
+         * @brief Get the amount of records written to the stream.
+         */
+        uint64_t getWrittenRecords() const noexcept;
+
+        /**
+         * @brief Get the amount of records lost because no buffer could be mapped.
+         */
+        uint64_t getDroppedRecords() const noexcept;
+
+        /**
+         * @brief Get the backing allocator.
+         */
+        BasicAllocator* getBacking() const noexcept;
+
+        // -- ObjectAllocator API -- All calls are wrapped
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void free(void* ptr, size_t bytes) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual size_t allocBulk(size_t bytes, size_t count, void** out, size_t align = alignof(max_align_t)) override;
+        virtual void freeBulk(void** ptrs, size_t count) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+        virtual void* reclaim(void* ptr) override;
+
+        virtual void reset() override;
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override;
+        virtual void clear() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getPendingBytes() const override;
+        virtual size_t getTotalBytes() const override;
+        virtual bool getFreeCounts(uint64_t& local, uint64_t& remote) const override;
+
+    protected:
+
+        struct Chunk;
+        struct ThreadBuffer;
+        struct ThreadList;
+
+        // Nanoseconds since construction
+        uint64_t getTime() const noexcept;
+
+        // Append a record to the calling thread's buffer
+        void record(Call call, uint64_t time, const void* ptr, uint64_t result, uint64_t size, size_t align) noexcept;
+
+        ThreadBuffer* getBuffer() noexcept;
+        ThreadBuffer* createBuffer() noexcept;
+
+        // Hand a filled chunk over to the writer thread
+        void submit(Chunk* chunk) noexcept;
+
+        void run();
+        void writeChunks(Chunk* chunks);
+
+        static ThreadList& getThreadList();
+
+        // Backing data
+        BasicAllocator* m_basic_backing;
+        ObjectAllocator* m_object_backing;
+
+        std::ostream& m_out;
+        uint64_t m_id; // Unique instance identifier, never reused
+        uint64_t m_start; // Steady clock time of construction in nanoseconds
+        ThreadBuffer* m_buffers; // Buffers of every thread using this recorder, guarded by the registry mutex
+
+        std::atomic<Chunk*> m_submitted; // Lock-free stack of filled chunks, newest first
+        std::atomic<uint64_t> m_submit_count;
+        std::atomic<uint64_t> m_written;
+        std::atomic<uint64_t> m_dropped;
+
+        // Writer thread state
+        std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+        std::condition_variable m_flushed;
+        uint64_t m_flush_count; // Chunks written so far
+        bool m_running;
+        std::thread m_thread;
+    };
+}
+
+#endif /* SHARED_MEMORY_TRACERECORDER_HPP */
@@ -0,0 +1,109 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_TRACEREPLAY_HPP
+#define SHARED_MEMORY_TRACEREPLAY_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/TraceRecorder.hpp>
+
+#include <iosfwd>
+
+namespace Memory
+{
+    /**
+     * @brief Replays allocator traces recorded by @ref TraceRecorder.
+     *
+     * The TraceReplay class loads a trace and drives any allocator with the recorded calls, so allocators can be compared and tuned against captured traffic.
+     * The calls of every thread are merged into a single stream ordered by timestamp and replayed sequentially on the calling thread.
+     * Recorded addresses and offer pointers are mapped to the ones returned by the target allocator, calls referring to blocks which are not known to the replay are skipped.
+     *
+     * When the target is not an @ref ObjectAllocator, offered blocks are kept allocated until reclaimed or freed, purges and clears free nothing, and clears and resets free every known block.
+     * Blocks left allocated at the end of the trace are freed after the timing stopped, and counted as leaked.
+     *
+     * Loading and replaying are not concurrently safe on the same instance, different instances are independent.
+     *
+     * @see @ref TraceRecorder
+     */
+    class SHARED_LIB_API TraceReplay
+    {
+    public:
+
+        /**
+         * @brief Outcome of a replay.
+         */
+        struct Result
+        {
+            uint64_t replayed; // Calls passed to the target
+            uint64_t skipped; // Calls referring to unknown blocks, or recorded as failed
+            uint64_t failed; // Calls which succeeded while recording but failed on the target
+            uint64_t leaked; // Blocks and offers left over at the end of the trace
+            uint64_t elapsed_ns; // Wall time spent replaying, excluding the final cleanup
+            size_t highest_used; // Highest used bytes reported by the target, sampled every 64 calls and at the end
+        };
+
+        /**
+         * @brief Construct an empty TraceReplay object.
+         */
+        TraceReplay();
+
+        TraceReplay(const TraceReplay&) = delete;
+        TraceReplay& operator=(const TraceReplay&) = delete;
+
+        /**
+         * @brief Destroy the TraceReplay object.
+         */
+        ~TraceReplay();
+
+        /**
+         * @brief Load a trace.
+         *
+         * Replaces the previously loaded records. The stream is read until its end, a truncated last record is ignored.
+         *
+         * @param in Stream positioned at the trace header, opened in binary mode.
+         * @return @b true on success, @b false if the header is invalid or the format version is not supported.
+         */
+        bool load(std::istream& in);
+
+        /**
+         * @brief Get the amount of loaded records.
+         */
+        size_t getRecordCount() const noexcept;
+
+        /**
+         * @brief Get the amount of distinct threads in the loaded trace.
+         */
+        uint32_t getThreadCount() const noexcept;
+
+        /**
+         * @brief Get a loaded record.
+         *
+         * @param index Index of the record in replay order, must be less than @ref getRecordCount.
+         */
+        const TraceRecorder::Record& getRecord(size_t index) const noexcept;
+
+        /**
+         * @brief Replay the loaded trace.
+         *
+         * @param target The allocator receiving the calls. Must be empty of the blocks the trace refers to.
+         * @return The outcome of the replay.
+         */
+        Result replay(BasicAllocator* target) const;
+
+        /**
+         * @copydoc replay(BasicAllocator*) const
+         */
+        Result replay(ObjectAllocator* target) const;
+
+    protected:
+
+        struct Records;
+
+        Result replay(BasicAllocator* basic, ObjectAllocator* object) const;
+
+        Records* m_records;
+        uint32_t m_threads;
+    };
+}
+
+#endif /* SHARED_MEMORY_TRACEREPLAY_HPP */
@@ -0,0 +1,189 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_MEMORY_VIRTUALALLOCATOR_HPP
+#define SHARED_MEMORY_VIRTUALALLOCATOR_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+#include <Shared/Memory/OfferList.hpp>
+#include <Shared/Util/BitMask.hpp>
+
+#include <mutex>
+
+namespace Memory
+{
+    /**
+     * @brief Page granular allocator over reserved address space.
+     *
+     * The VirtualAllocator class implements the @ref ObjectAllocator interface over a single contiguous range of address space reserved up front.
+     * Pages are committed lazily as the used part of the range grows. Every allocation occupies a run of whole pages starting with a small header, so the allocator is meant for large allocations like buffers and caches, or as a backing allocator of pools.
+     * Free runs are coalesced with their neighbours and kept in size binned free lists, allocations are served first fit from the smallest fitting bin. The most recent allocation at the end of the range and allocations followed by a free run can grow in place, also through @ref tryExpand without ever moving.
+     *
+     * @ref purge gives memory back to the operating system: after releasing the offered allocations it decommits the pages of every free run, except for the run headers, and the committed pages past the end of the used range.
+     * The pages are decommitted with MADV_FREE or MADV_DONTNEED on POSIX systems and MEM_DECOMMIT on Windows. @ref decommit does the same without touching the offers.
+     * A purged offer keeps a single page until it's passed to @ref reclaim or @ref free, the rest of its pages are freed right away.
+     * @ref clear runs the destructor functions grouped by function, @ref purge runs them in offer order.
+     *
+     * With the @ref HugePages option the reservation is aligned to @ref HugePageSize and runs spanning whole huge pages are advised to be backed by transparent huge pages, where supported.
+     *
+     * All calls are concurrently safe. Destructor functions are called with the allocator locked, and may call back into the same allocator.
+     *
+     * @see @ref ObjectAllocator, @ref Heap
+     */
+    class SHARED_LIB_API VirtualAllocator : public ObjectAllocator
+    {
+    public:
+
+        /// Behavior options, may be combined.
+        enum Options : uint32_t
+        {
+            /// Default behavior.
+            None = 0,
+            /// Use transparent huge pages for large runs.
+            HugePages = Util::BitMask<0>::value,
+            /// Decommit lazily with MADV_FREE where available, the operating system takes the pages only when it needs them.
+            LazyDecommit = Util::BitMask<1>::value
+        };
+
+        /// Default size of the reserved address space.
+        static constexpr size_t DefaultReserveBytes = sizeof(void*) >= 8 ? (size_t(64) << 30) : (size_t(256) << 20);
+
+        /// Size of a transparent huge page.
+        static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+        /// Pages past the end of the used range are committed in steps of this size.
+        static constexpr size_t CommitStep = 1024 * 1024;
+
+        /**
+         * @brief Construct a VirtualAllocator object.
+         *
+         * Reserves the address space, no memory is committed until the first allocation.
+         * If the reservation fails every allocation fails.
+         *
+         * @param reserve_bytes Size of the address space to reserve, the upper limit of the memory the allocator can hand out.
+         * @param options Combination of @ref Options values.
+         */
+        VirtualAllocator(size_t reserve_bytes = DefaultReserveBytes, uint32_t options = None);
+
+        VirtualAllocator(const VirtualAllocator&) = delete;
+        VirtualAllocator& operator=(const VirtualAllocator&) = delete;
+
+        /**
+         * @brief Destroy the VirtualAllocator object.
+         *
+         * Calls the destructor functions of all remaining allocations and releases the reserved address space.
+         *
+         * @see @ref clear
+         */
+        virtual ~VirtualAllocator();
+
+        /**
+         * @brief Return the memory of free pages to the operating system.
+         *
+         * Decommits the free runs and the committed pages past the end of the used range, like @ref purge does, but keeps every offer.
+         */
+        void decommit();
+
+        /**
+         * @brief Get the size of the reserved address space.
+         *
+         * @return The reservation size in bytes, 0 if the reservation failed.
+         */
+        size_t getReservedBytes() const noexcept;
+
+        /**
+         * @brief Check whether a pointer lies inside the reserved address space.
+         *
+         * @param ptr Any pointer.
+         */
+        inline bool contains(const void* ptr) const noexcept
+        {
+            return ptr >= this->m_base && ptr < this->m_end;
+        }
+
+        /**
+         * @brief Get the amount of decommitted bytes in free runs.
+         *
+         * Counted from the last decommit, pages touched again since are not tracked exactly on POSIX systems.
+         */
+        size_t getDecommittedBytes() const;
+
+        // -- ObjectAllocator API --
+
+        using ObjectAllocator::free;
+        using ObjectAllocator::realloc;
+
+        virtual void* alloc(size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* alloc(size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual void free(void* ptr) override;
+        virtual void* realloc(void* ptr, size_t bytes, size_t align = alignof(max_align_t)) override;
+        virtual void* realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align = alignof(max_align_t)) override;
+        virtual size_t getAllocSize(const void* ptr) const override;
+        virtual bool tryExpand(void* ptr, size_t bytes) override;
+        virtual bool tryShrink(void* ptr, size_t bytes) override;
+
+        virtual void* offer(void* ptr, uint32_t priority = 0) override;
+        virtual void* reclaim(void* ptr) override;
+
+        virtual void reset() override;
+        virtual void purge(uint32_t priority = std::numeric_limits<uint32_t>::max()) override;
+        virtual void clear() override;
+
+        virtual size_t getFreeBytes() const override;
+        virtual size_t getUsedBytes() const override;
+        virtual size_t getPendingBytes() const override;
+        virtual size_t getTotalBytes() const override;
+
+    protected:
+
+        struct Run;
+
+        static constexpr size_t BinCount = 64; // Free run bins, one per bit width of the page count
+
+        // Internal helpers, the allocator must be locked when called
+        void* allocRun(size_t bytes, DestructorPtr destructor, size_t align);
+        void* reallocRun(void* ptr, size_t bytes, DestructorPtr destructor, size_t align);
+        bool resizeRun(Run* run, size_t bytes);
+        Run* findFree(size_t pages);
+        Run* carve(size_t pages);
+        bool growTop(size_t bytes);
+        bool recommit(Run* run, size_t pages);
+        Run* split(Run* run, size_t pages);
+        void absorbNext(Run* run);
+        void insertFree(Run* run);
+        void removeFree(Run* run);
+        void releaseRun(Run* run);
+        void destroyRun(Run* run);
+        void adviseRun(Run* run);
+        void decommitFree();
+        void releaseAll();
+
+        Run* getNext(Run* run) const noexcept;
+        Run* getPrev(Run* run) const noexcept;
+        size_t getUsable(const Run* run) const noexcept;
+        static Run* getRun(const void* ptr) noexcept;
+        static void* getUser(Run* run) noexcept;
+
+        mutable std::recursive_mutex m_mutex;
+
+        char* m_base; // Start of the reservation
+        char* m_end; // End of the reservation
+        char* m_top; // End of the used range, every run lies below
+        char* m_committed; // End of the committed range, at or above the top
+        Run* m_last; // Run ending at the top, nullptr if there are no runs
+        size_t m_page; // System page size
+
+        Run* m_bins[BinCount]; // Free runs by page count bit width
+        uint64_t m_bin_mask; // Bitmap of non-empty bins
+        OfferList m_offers; // Offered runs
+
+        size_t m_used; // Bytes of used, offered and purged runs
+        size_t m_pending; // Usable bytes of offered runs
+        size_t m_decommitted; // Decommitted bytes inside free runs
+        uint32_t m_options;
+        bool m_clearing; // Set while clear is running destructors
+    };
+}
+
+#endif /* SHARED_MEMORY_VIRTUALALLOCATOR_HPP */
@@ -98,4 +98,31 @@
 #   define PLATFORM_ARCH PLATFORM_ARCH_UNK
 #endif
 
+/*
+ *  Assumed size of a cache line in bytes, used to keep concurrently written data apart.
+ *  Apple ARM64 and PowerPC cores use 128 byte lines, everything else is assumed to use 64 bytes.
+ */
+#if defined(PLATFORM_ARCH_ARM64) && (defined(PLATFORM_OS_OSX) || defined(PLATFORM_OS_IOS))
+#   define PLATFORM_CACHE_LINE_SIZE 128
+#elif defined(PLATFORM_ARCH_PPC)
+#   define PLATFORM_CACHE_LINE_SIZE 128
+#else
+#   define PLATFORM_CACHE_LINE_SIZE 64
+#endif
+
+/*
+ *  Vector instruction set enabled for the compilation, selects the vectorized kernels where available.
+ *  Only set when the compiler targets the instructions, no runtime dispatch happens.
+ */
+#if (defined(PLATFORM_ARCH_X64) || defined(PLATFORM_ARCH_X86)) && defined(__AVX2__)
+#   define PLATFORM_SIMD_AVX2 "AVX2"
+#   define PLATFORM_SIMD PLATFORM_SIMD_AVX2
+#elif defined(PLATFORM_ARCH_ARM64) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#   define PLATFORM_SIMD_NEON "NEON"
+#   define PLATFORM_SIMD PLATFORM_SIMD_NEON
+#else
+#   define PLATFORM_SIMD_NONE "None"
+#   define PLATFORM_SIMD PLATFORM_SIMD_NONE
+#endif
+
 #endif /* SHARED_PLATFORM_TARGET_HPP */
@@ -0,0 +1,220 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Fixed size bit set with runtime scanning, and the word array kernels behind it.
+ *  The kernels are vectorized with AVX2 or NEON when the compilation targets them, see PLATFORM_SIMD.
+ */
+#ifndef SHARED_UTIL_BITSET_HPP
+#define SHARED_UTIL_BITSET_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include <cstring>
+
+#if defined(PLATFORM_SIMD_AVX2)
+#   include <immintrin.h>
+#elif defined(PLATFORM_SIMD_NEON)
+#   include <arm_neon.h>
+#endif
+
+namespace Util
+{
+    /**
+     * @brief Find the first non-zero word of an array.
+     *
+     * @param words The words to scan.
+     * @param count Amount of words.
+     * @return Index of the first word with any bit set, @a count if every word is zero.
+     */
+    inline size_t findNonZeroWord(const uint64_t* words, size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(PLATFORM_SIMD_AVX2)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i vector = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+            if (!_mm256_testz_si256(vector, vector))
+                break;
+        }
+#elif defined(PLATFORM_SIMD_NEON)
+        for (; i + 2 <= count; i += 2)
+        {
+            uint32x4_t vector = vreinterpretq_u32_u64(vld1q_u64(words + i));
+            if (vmaxvq_u32(vector) != 0)
+                break;
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            if (words[i] != 0)
+                return i;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Count the set bits of a word array.
+     *
+     * @param words The words to count.
+     * @param count Amount of words.
+     * @return The number of one bits in the array.
+     */
+    inline size_t getPopCount(const uint64_t* words, size_t count) noexcept
+    {
+        size_t ret = 0;
+        size_t i = 0;
+#if defined(PLATFORM_SIMD_AVX2)
+        // Nibble lookup, the byte counts are summed per 64 bit lane
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i sum = _mm256_setzero_si256();
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i vector = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+            __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(vector, nibble));
+            __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(vector, 4), nibble));
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+        }
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        ret = static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#elif defined(PLATFORM_SIMD_NEON)
+        for (; i + 2 <= count; i += 2)
+            ret += vaddvq_u8(vcntq_u8(vreinterpretq_u8_u64(vld1q_u64(words + i))));
+#endif
+        for (; i < count; ++i)
+            ret += getPopCount(words[i]);
+        return ret;
+    }
+
+    /**
+     * @brief Fixed size set of bits.
+     *
+     * The BitSet class is the runtime counterpart of @ref BitMask: a fixed amount of bits stored in 64 bit words, with constant time single bit access,
+     * and scans for the first set bit and the amount of set bits running over whole words, vectorized where available.
+     * Bits are numbered from the lowest bit of the first word. The storage is part of the object and aligned for vector loads, so the set is suited for metadata embedded in other structures.
+     *
+     * @tparam Bits Amount of bits in the set.
+     */
+    template<size_t Bits>
+    class BitSet
+    {
+        static_assert(Bits > 0, "Bit count must be non-zero");
+
+    public:
+
+        /// Amount of bits in the set.
+        static constexpr size_t Size = Bits;
+
+        /// Amount of words holding the bits.
+        static constexpr size_t WordCount = (Bits + 63) / 64;
+
+        /**
+         * @brief Construct a set with every bit clear.
+         */
+        BitSet() noexcept
+        {
+            this->resetAll();
+        }
+
+        inline bool test(size_t bit) const noexcept
+        {
+            return (this->m_words[bit / 64] >> (bit % 64) & 1) != 0;
+        }
+
+        inline void set(size_t bit) noexcept
+        {
+            this->m_words[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+
+        inline void reset(size_t bit) noexcept
+        {
+            this->m_words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+        }
+
+        /**
+         * @brief Set the bits of a range and clear every other bit.
+         *
+         * @param begin First bit to set.
+         * @param end One past the last bit to set, at most @ref Size.
+         */
+        void assign(size_t begin, size_t end) noexcept
+        {
+            for (size_t i = 0; i < WordCount; ++i)
+            {
+                size_t low = i * 64;
+                uint64_t word = 0;
+                if (begin < low + 64 && end > low)
+                {
+                    size_t first = begin > low ? begin - low : 0;
+                    size_t last = end < low + 64 ? end - low : 64;
+                    word = (last == 64 ? ~uint64_t(0) : (uint64_t(1) << last) - 1) & ~((uint64_t(1) << first) - 1);
+                }
+                this->m_words[i] = word;
+            }
+        }
+
+        inline void resetAll() noexcept
+        {
+            std::memset(this->m_words, 0, sizeof(this->m_words));
+        }
+
+        /**
+         * @brief Find the first set bit at or after a position.
+         *
+         * @param from The first bit to examine.
+         * @return Index of the first set bit, @ref Size if there is none.
+         */
+        inline size_t findFirstSet(size_t from = 0) const noexcept
+        {
+            if (from >= Bits)
+                return Bits;
+
+            size_t index = from / 64;
+            uint64_t word = this->m_words[index] & (~uint64_t(0) << (from % 64));
+            if (word == 0)
+            {
+                index += 1 + findNonZeroWord(this->m_words + index + 1, WordCount - index - 1);
+                if (index == WordCount)
+                    return Bits;
+                word = this->m_words[index];
+            }
+            return index * 64 + getTrailingZeros(word);
+        }
+
+        /**
+         * @brief Get the amount of set bits.
+         */
+        inline size_t getCount() const noexcept
+        {
+            return getPopCount(this->m_words, WordCount);
+        }
+
+        inline bool isNone() const noexcept
+        {
+            return findNonZeroWord(this->m_words, WordCount) == WordCount;
+        }
+
+        /**
+         * @brief Get the underlying words, for processing many bits at once.
+         *
+         * Bits past @ref Size in the last word must stay clear.
+         */
+        inline uint64_t* getWords() noexcept
+        {
+            return this->m_words;
+        }
+
+        inline const uint64_t* getWords() const noexcept
+        {
+            return this->m_words;
+        }
+
+    private:
+
+        alignas(32) uint64_t m_words[WordCount];
+    };
+}
+
+#endif /* SHARED_UTIL_BITSET_HPP */
@@ -0,0 +1,82 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Bit manipulation helpers, using compiler intrinsics where available.
+ */
+#ifndef SHARED_UTIL_BITS_HPP
+#define SHARED_UTIL_BITS_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Compiler.hpp>
+
+namespace Util
+{
+    /**
+     * @brief Get the number of bits required to represent a value.
+     *
+     * Returns the position of the highest set bit plus one, or 0 if @a value is zero.
+     * For non-zero values this is equal to floor(log2(value)) + 1.
+     *
+     * @param value The value to examine.
+     * @return The bit width of @a value.
+     */
+    inline uint32_t getBitWidth(uint64_t value) noexcept
+    {
+#if defined(PLATFORM_COMPILER_GCC) || defined(PLATFORM_COMPILER_CLANG)
+        return value == 0 ? 0 : 64u - static_cast<uint32_t>(__builtin_clzll(value));
+#else
+        uint32_t ret = 0;
+        while (value != 0)
+        {
+            ++ret;
+            value >>= 1;
+        }
+        return ret;
+#endif
+    }
+
+    /**
+     * @brief Get the number of trailing zero bits of a value.
+     *
+     * Returns the position of the lowest set bit, or 64 if @a value is zero.
+     *
+     * @param value The value to examine.
+     * @return The number of zero bits below the lowest set bit.
+     */
+    inline uint32_t getTrailingZeros(uint64_t value) noexcept
+    {
+#if defined(PLATFORM_COMPILER_GCC) || defined(PLATFORM_COMPILER_CLANG)
+        return value == 0 ? 64u : static_cast<uint32_t>(__builtin_ctzll(value));
+#else
+        if (value == 0)
+            return 64;
+
+        uint32_t ret = 0;
+        while ((value & 1) == 0)
+        {
+            ++ret;
+            value >>= 1;
+        }
+        return ret;
+#endif
+    }
+
+    /**
+     * @brief Get the number of set bits of a value.
+     *
+     * @param value The value to examine.
+     * @return The number of one bits in @a value.
+     */
+    inline uint32_t getPopCount(uint64_t value) noexcept
+    {
+#if defined(PLATFORM_COMPILER_GCC) || defined(PLATFORM_COMPILER_CLANG)
+        return static_cast<uint32_t>(__builtin_popcountll(value));
+#else
+        value = value - ((value >> 1) & 0x5555555555555555ull);
+        value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+        value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<uint32_t>((value * 0x0101010101010101ull) >> 56);
+#endif
+    }
+}
+
+#endif /* SHARED_UTIL_BITS_HPP */
@@ -0,0 +1,123 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_UTIL_LATENCYHISTOGRAM_HPP
+#define SHARED_UTIL_LATENCYHISTOGRAM_HPP
+
+#include <Shared/Shared.hpp>
+
+#include <Shared/Platform/Types.hpp>
+
+#include <atomic>
+
+namespace Util
+{
+    /**
+     * @brief Concurrent log-linear histogram.
+     *
+     * The LatencyHistogram class records unsigned 64-bit values, typically durations in nanoseconds, into buckets with bounded relative error, similar to HDR histograms.
+     * Values below 32 are counted exactly, above that every power of two range is split into 16 linear sub-buckets, keeping the relative error of a reported value under 6.25%.
+     * The whole 64-bit range is covered by a fixed set of counters, recording never allocates.
+     *
+     * All calls are concurrently safe. Recording only uses relaxed atomic operations, a concurrent query may observe a partially recorded value.
+     */
+    class SHARED_LIB_API LatencyHistogram
+    {
+    public:
+
+        /// Number of linear sub-buckets in each power of two range.
+        static constexpr uint32_t SubBuckets = 16;
+
+        /// Total number of buckets, two exact ranges followed by a sub-bucketed range for each remaining bit width.
+        static constexpr size_t BucketCount = (2 + 64 - 5) * SubBuckets;
+
+        LatencyHistogram() noexcept;
+
+        LatencyHistogram(const LatencyHistogram&) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+        /**
+         * @brief Record a value.
+         *
+         * @param value The value to record.
+         * @param count Number of times the value is recorded.
+         */
+        void record(uint64_t value, uint64_t count = 1) noexcept;
+
+        /**
+         * @brief Reset every bucket to zero.
+         */
+        void reset() noexcept;
+
+        /**
+         * @brief Get the number of recorded values.
+         *
+         * @return Number of recorded values.
+         */
+        uint64_t getCount() const noexcept;
+
+        /**
+         * @brief Get the largest recorded value.
+         *
+         * @return The exact largest value recorded, 0 if the histogram is empty.
+         */
+        uint64_t getMax() const noexcept;
+
+        /**
+         * @brief Get the mean of the recorded values.
+         *
+         * @return The arithmetic mean of the recorded values, 0 if the histogram is empty.
+         */
+        double getMean() const noexcept;
+
+        /**
+         * @brief Get a percentile.
+         *
+         * Returns the highest value equivalent to the bucket containing the requested percentile, e.g. pass 0.5 for the median and 0.999 for p999.
+         * The result never exceeds @ref getMax.
+         *
+         * @param percentile The requested percentile in the [0, 1] range.
+         * @return The value at @a percentile, 0 if the histogram is empty.
+         */
+        uint64_t getPercentile(double percentile) const noexcept;
+
+        /**
+         * @brief Get the number of values counted by a bucket.
+         *
+         * @param bucket Index of the bucket, less than @ref BucketCount.
+         * @return Number of values in the bucket.
+         */
+        uint64_t getBucketCount(size_t bucket) const noexcept;
+
+        /**
+         * @brief Get the bucket of a value.
+         *
+         * @param value The recorded value.
+         * @return Index of the bucket counting @a value.
+         */
+        static size_t getBucket(uint64_t value) noexcept;
+
+        /**
+         * @brief Get the smallest value counted by a bucket.
+         *
+         * @param bucket Index of the bucket, less than @ref BucketCount.
+         * @return The inclusive lower bound of the bucket.
+         */
+        static uint64_t getBucketMin(size_t bucket) noexcept;
+
+        /**
+         * @brief Get the largest value counted by a bucket.
+         *
+         * @param bucket Index of the bucket, less than @ref BucketCount.
+         * @return The inclusive upper bound of the bucket.
+         */
+        static uint64_t getBucketMax(size_t bucket) noexcept;
+
+    protected:
+
+        std::atomic<uint64_t> m_buckets[BucketCount];
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_sum;
+        std::atomic<uint64_t> m_max;
+    };
+}
+
+#endif /* SHARED_UTIL_LATENCYHISTOGRAM_HPP */
@@ -0,0 +1,240 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/AllocatorRegistry.hpp>
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    // A registered allocator, the most derived interface known is used for collecting figures
+    struct AllocatorRegistry::Entry
+    {
+        BasicAllocator* basic;
+        ObjectAllocator* object; // nullptr for plain BasicAllocators
+        AllocatorStatistic* statistic; // nullptr if not an AllocatorStatistic
+
+        AllocatorStatistic::Snapshot snapshot() const
+        {
+            if (this->statistic != nullptr)
+                return this->statistic->snapshot();
+
+            AllocatorStatistic::Snapshot ret = {};
+            ret.used_bytes = this->basic->getUsedBytes();
+            ret.total_bytes = this->basic->getTotalBytes();
+            ret.free_bytes = this->basic->getFreeBytes();
+            ret.pending_bytes = this->object != nullptr ? this->object->getPendingBytes() : 0;
+            ret.highest_usage = ret.used_bytes;
+            this->basic->getFreeCounts(ret.local_frees, ret.remote_frees);
+            return ret;
+        }
+    };
+
+    // Sorted by name, so every subtree is a contiguous range
+    struct AllocatorRegistry::Entries
+    {
+        std::map<std::string, Entry> map;
+    };
+
+    namespace
+    {
+        template<class Map>
+        typename Map::const_iterator getSubtreeBegin(const Map& map, const char* prefix)
+        {
+            return prefix != nullptr ? map.lower_bound(prefix) : map.begin();
+        }
+
+        // Whether the name belongs to the subtree, names past the subtree end the iteration
+        inline bool isInSubtree(const std::string& name, const char* prefix, size_t prefix_length) noexcept
+        {
+            if (prefix_length == 0)
+                return true;
+            if (name.compare(0, prefix_length, prefix) != 0)
+                return false;
+            return name.size() == prefix_length || name[prefix_length] == '/';
+        }
+
+        inline bool isPastSubtree(const std::string& name, const char* prefix, size_t prefix_length) noexcept
+        {
+            return prefix_length != 0 && name.compare(0, prefix_length, prefix) != 0;
+        }
+    }
+
+    /*
+        AllocatorRegistry definitions
+    */
+
+    AllocatorRegistry::AllocatorRegistry() :
+        m_entries(new Entries())
+    {
+    }
+
+    AllocatorRegistry::~AllocatorRegistry()
+    {
+        delete this->m_entries;
+    }
+
+    AllocatorRegistry& AllocatorRegistry::getGlobal()
+    {
+        // Intentionally leaked, allocators may be removed during static destruction
+        static AllocatorRegistry* registry = new AllocatorRegistry();
+        return *registry;
+    }
+
+    bool AllocatorRegistry::isValidName(const char* name) noexcept
+    {
+        if (name == nullptr || *name == '\0')
+            return false;
+
+        bool component_start = true;
+        for (; *name != '\0'; ++name)
+        {
+            if (*name == '/')
+            {
+                if (component_start)
+                    return false;
+                component_start = true;
+            }
+            else
+            {
+                component_start = false;
+            }
+        }
+        return !component_start;
+    }
+
+    bool AllocatorRegistry::addEntry(const char* name, const Entry& entry)
+    {
+        if (!isValidName(name) || entry.basic == nullptr)
+            return false;
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_entries->map.emplace(name, entry).second;
+    }
+
+    bool AllocatorRegistry::add(const char* name, AllocatorStatistic* allocator)
+    {
+        return this->addEntry(name, Entry{ allocator, allocator, allocator });
+    }
+
+    bool AllocatorRegistry::add(const char* name, ObjectAllocator* allocator)
+    {
+        return this->addEntry(name, Entry{ allocator, allocator, nullptr });
+    }
+
+    bool AllocatorRegistry::add(const char* name, BasicAllocator* allocator)
+    {
+        return this->addEntry(name, Entry{ allocator, nullptr, nullptr });
+    }
+
+    bool AllocatorRegistry::remove(const char* name)
+    {
+        if (name == nullptr)
+            return false;
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_entries->map.erase(name) != 0;
+    }
+
+    size_t AllocatorRegistry::remove(const BasicAllocator* allocator)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+
+        size_t ret = 0;
+        auto& map = this->m_entries->map;
+        for (auto it = map.begin(); it != map.end();)
+        {
+            if (it->second.basic == allocator)
+            {
+                it = map.erase(it);
+                ++ret;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return ret;
+    }
+
+    size_t AllocatorRegistry::getCount() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_entries->map.size();
+    }
+
+    AllocatorStatistic::Snapshot AllocatorRegistry::getRollup(const char* prefix, size_t* count) const
+    {
+        size_t prefix_length = prefix != nullptr ? std::strlen(prefix) : 0;
+
+        AllocatorStatistic::Snapshot ret = {};
+        size_t visited = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+
+            const auto& map = this->m_entries->map;
+            for (auto it = getSubtreeBegin(map, prefix); it != map.end() && !isPastSubtree(it->first, prefix, prefix_length); ++it)
+            {
+                if (!isInSubtree(it->first, prefix, prefix_length))
+                    continue;
+
+                ret.accumulate(it->second.snapshot());
+                ++visited;
+            }
+        }
+
+        if (count != nullptr)
+            *count = visited;
+        return ret;
+    }
+
+    size_t AllocatorRegistry::forEach(const char* prefix, Visitor visitor, void* user) const
+    {
+        size_t prefix_length = prefix != nullptr ? std::strlen(prefix) : 0;
+        size_t ret = 0;
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+
+        const auto& map = this->m_entries->map;
+        for (auto it = getSubtreeBegin(map, prefix); it != map.end() && !isPastSubtree(it->first, prefix, prefix_length); ++it)
+        {
+            if (!isInSubtree(it->first, prefix, prefix_length))
+                continue;
+
+            visitor(it->first.c_str(), it->second.snapshot(), user);
+            ++ret;
+        }
+        return ret;
+    }
+
+    void AllocatorRegistry::writePrometheus(std::ostream& out, const char* prefix, const char* metric_prefix) const
+    {
+        struct Collected
+        {
+            std::vector<std::string> names;
+            std::vector<AllocatorStatistic::Snapshot> snapshots;
+        } collected;
+
+        // Collect first, so the registry isn't locked while writing to the stream
+        this->forEach(prefix, [](const char* name, const AllocatorStatistic::Snapshot& snapshot, void* user) {
+            Collected& collected = *reinterpret_cast<Collected*>(user);
+            collected.names.emplace_back(name);
+            collected.snapshots.push_back(snapshot);
+        }, &collected);
+
+        std::vector<const char*> labels;
+        labels.reserve(collected.names.size());
+        for (const std::string& name : collected.names)
+            labels.push_back(name.c_str());
+
+        AllocatorStatistic::Snapshot::writePrometheus(out, collected.snapshots.data(), labels.data(), collected.snapshots.size(), metric_prefix);
+    }
+}
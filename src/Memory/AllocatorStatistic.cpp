@@ -4,10 +4,236 @@
 #endif
 #include <Shared/Memory/AllocatorStatistic.hpp>
 
+#include <chrono>
+#include <ostream>
 #include <stdexcept>
+#include <thread>
 
 namespace Memory
 {
+    namespace
+    {
+        std::atomic<size_t> s_thread_counter(0);
+
+        // Sequential index of the calling thread, used to pick a counter shard
+        inline size_t getThreadIndex() noexcept
+        {
+            thread_local size_t index = s_thread_counter.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        template<class T>
+        inline void storeMax(std::atomic<T>& target, T value) noexcept
+        {
+            T expected = target.load(std::memory_order_relaxed);
+            while (expected < value)
+                if (target.compare_exchange_weak(expected, value, std::memory_order_release, std::memory_order_relaxed))
+                    break;
+        }
+
+        template<class T>
+        inline void storeMin(std::atomic<T>& target, T value) noexcept
+        {
+            T expected = target.load(std::memory_order_relaxed);
+            while (expected > value)
+                if (target.compare_exchange_weak(expected, value, std::memory_order_release, std::memory_order_relaxed))
+                    break;
+        }
+
+        inline void countHistogram(std::atomic<uintmax_t>* histogram, size_t value, uintmax_t count = 1) noexcept
+        {
+            histogram[Util::getBitWidth(value)].fetch_add(count, std::memory_order_relaxed);
+        }
+
+        using Snapshot = AllocatorStatistic::Snapshot;
+
+        struct SnapshotField
+        {
+            uint64_t Snapshot::* member;
+            const char* name; // Metric name without the prefix
+            const char* help;
+            bool total; // Monotonic counter rather than a gauge
+        };
+
+        // Serialization order of the snapshot fields, append only
+        const SnapshotField s_snapshot_fields[] = {
+            { &Snapshot::used_bytes, "used_bytes", "Bytes used by the backing allocator.", false },
+            { &Snapshot::total_bytes, "total_bytes", "Total bytes managed by the backing allocator.", false },
+            { &Snapshot::pending_bytes, "pending_bytes", "Bytes of offered allocations pending in the backing allocator.", false },
+            { &Snapshot::highest_usage, "highest_usage_bytes", "Highest reported usage of the backing allocator.", false },
+            { &Snapshot::smallest_alloc, "smallest_alloc_bytes", "Smallest allocation size.", false },
+            { &Snapshot::largest_alloc, "largest_alloc_bytes", "Largest allocation size.", false },
+            { &Snapshot::largest_alloc_failed, "largest_alloc_failed_bytes", "Largest failed allocation size.", false },
+            { &Snapshot::allocs, "allocs_total", "Allocation calls.", true },
+            { &Snapshot::alloc_fails, "alloc_fails_total", "Failed allocation calls.", true },
+            { &Snapshot::alloc_bytes, "alloc_bytes_total", "Bytes requested by successful allocations and reallocations.", true },
+            { &Snapshot::reallocs, "reallocs_total", "Reallocation calls.", true },
+            { &Snapshot::realloc_fails, "realloc_fails_total", "Failed reallocation calls.", true },
+            { &Snapshot::realloc_growth, "realloc_growth_bytes_total", "Bytes gained by reallocations.", true },
+            { &Snapshot::realloc_shrink, "realloc_shrink_bytes_total", "Bytes released by reallocations.", true },
+            { &Snapshot::realloc_moves, "realloc_moves_total", "Reallocations that moved the allocation.", true },
+            { &Snapshot::realloc_moved, "realloc_moved_bytes_total", "Bytes of moved reallocations.", true },
+            { &Snapshot::offers, "offers_total", "Offer calls.", true },
+            { &Snapshot::offer_bytes, "offer_bytes_total", "Bytes offered.", true },
+            { &Snapshot::reclaims, "reclaims_total", "Reclaim calls.", true },
+            { &Snapshot::reclaim_fails, "reclaim_fails_total", "Failed reclaim calls.", true },
+            { &Snapshot::reclaim_bytes, "reclaim_bytes_total", "Bytes reclaimed.", true },
+            { &Snapshot::expands, "expands_total", "In place expand calls.", true },
+            { &Snapshot::expand_fails, "expand_fails_total", "Failed in place expand calls.", true },
+            { &Snapshot::shrinks, "shrinks_total", "In place shrink calls.", true },
+            { &Snapshot::shrink_fails, "shrink_fails_total", "Failed in place shrink calls.", true },
+            { &Snapshot::local_frees, "local_frees_total", "Blocks freed by the thread owning them in the backing allocator.", true },
+            { &Snapshot::remote_frees, "remote_frees_total", "Blocks freed by threads not owning them in the backing allocator.", true },
+            { &Snapshot::free_bytes, "free_bytes", "Free bytes available to the backing allocator.", false }
+        };
+
+        static_assert(sizeof(s_snapshot_fields) / sizeof(s_snapshot_fields[0]) == Snapshot::FieldCount, "Every snapshot field must be listed");
+
+        const uint8_t s_snapshot_magic[4] = { 'A', 'S', 'N', 'P' };
+        const uint32_t s_snapshot_version = 4;
+
+        // Amount of fields serialized by each version
+        const size_t s_snapshot_version_fields[] = { 0, 21, 25, 27, Snapshot::FieldCount };
+
+        static_assert(sizeof(s_snapshot_version_fields) / sizeof(s_snapshot_version_fields[0]) == s_snapshot_version + 1, "Every snapshot version must be listed");
+
+        void writeLabelValue(std::ostream& out, const char* value)
+        {
+            for (; *value != '\0'; ++value)
+            {
+                if (*value == '\\' || *value == '"')
+                    out << '\\' << *value;
+                else if (*value == '\n')
+                    out << "\\n";
+                else
+                    out << *value;
+            }
+        }
+    }
+
+    /*
+        AllocatorStatistic::Snapshot definitions
+    */
+
+    AllocatorStatistic::Snapshot AllocatorStatistic::Snapshot::diff(const Snapshot& previous) const noexcept
+    {
+        Snapshot ret = *this;
+        for (const SnapshotField& field : s_snapshot_fields)
+        {
+            // A total lower than before means the counters got reset in between
+            if (field.total && this->*field.member >= previous.*field.member)
+                ret.*field.member = this->*field.member - previous.*field.member;
+        }
+        return ret;
+    }
+
+    void AllocatorStatistic::Snapshot::accumulate(const Snapshot& other) noexcept
+    {
+        for (const SnapshotField& field : s_snapshot_fields)
+        {
+            if (field.total)
+                this->*field.member += other.*field.member;
+        }
+
+        this->used_bytes += other.used_bytes;
+        this->total_bytes += other.total_bytes;
+        this->free_bytes += other.free_bytes;
+        this->pending_bytes += other.pending_bytes;
+        this->highest_usage += other.highest_usage;
+
+        // A smallest allocation of 0 means there were no allocations yet
+        if (other.smallest_alloc != 0 && (this->smallest_alloc == 0 || other.smallest_alloc < this->smallest_alloc))
+            this->smallest_alloc = other.smallest_alloc;
+        if (other.largest_alloc > this->largest_alloc)
+            this->largest_alloc = other.largest_alloc;
+        if (other.largest_alloc_failed > this->largest_alloc_failed)
+            this->largest_alloc_failed = other.largest_alloc_failed;
+    }
+
+    size_t AllocatorStatistic::Snapshot::serialize(void* buffer, size_t bytes) const noexcept
+    {
+        if (bytes < SerializedSize)
+            return 0;
+
+        uint8_t* out = reinterpret_cast<uint8_t*>(buffer);
+        for (size_t i = 0; i < 4; ++i)
+            out[i] = s_snapshot_magic[i];
+        for (size_t i = 0; i < 4; ++i)
+            out[4 + i] = static_cast<uint8_t>(s_snapshot_version >> (8 * i));
+        out += 8;
+
+        for (const SnapshotField& field : s_snapshot_fields)
+        {
+            uint64_t value = this->*field.member;
+            for (size_t i = 0; i < 8; ++i)
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+            out += 8;
+        }
+        return SerializedSize;
+    }
+
+    bool AllocatorStatistic::Snapshot::deserialize(const void* buffer, size_t bytes) noexcept
+    {
+        if (bytes < 8)
+            return false;
+
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(buffer);
+        uint32_t version = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            if (in[i] != s_snapshot_magic[i])
+                return false;
+            version |= static_cast<uint32_t>(in[4 + i]) << (8 * i);
+        }
+        if (version == 0 || version > s_snapshot_version)
+            return false;
+
+        // Fields are append only, older versions just lack the trailing ones
+        size_t fields = s_snapshot_version_fields[version];
+        if (bytes < 8 + fields * 8)
+            return false;
+        in += 8;
+
+        for (size_t n = 0; n < FieldCount; ++n)
+        {
+            uint64_t value = 0;
+            if (n < fields)
+            {
+                for (size_t i = 0; i < 8; ++i)
+                    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+                in += 8;
+            }
+            this->*s_snapshot_fields[n].member = value;
+        }
+        return true;
+    }
+
+    void AllocatorStatistic::Snapshot::writePrometheus(std::ostream& out, const char* label, const char* prefix) const
+    {
+        writePrometheus(out, this, label != nullptr ? &label : nullptr, 1, prefix);
+    }
+
+    void AllocatorStatistic::Snapshot::writePrometheus(std::ostream& out, const Snapshot* snapshots, const char* const* labels, size_t count, const char* prefix)
+    {
+        for (const SnapshotField& field : s_snapshot_fields)
+        {
+            out << "# HELP " << prefix << '_' << field.name << ' ' << field.help << '\n';
+            out << "# TYPE " << prefix << '_' << field.name << ' ' << (field.total ? "counter" : "gauge") << '\n';
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                out << prefix << '_' << field.name;
+                if (labels != nullptr && labels[i] != nullptr)
+                {
+                    out << "{allocator=\"";
+                    writeLabelValue(out, labels[i]);
+                    out << "\"}";
+                }
+                out << ' ' << snapshots[i].*field.member << '\n';
+            }
+        }
+    }
+
     /*
         AllocatorStatistic definitions
     */
@@ -15,48 +241,158 @@ namespace Memory
     AllocatorStatistic::AllocatorStatistic() :
         m_basic_backing(nullptr),
         m_object_backing(nullptr),
-        m_smallest(std::numeric_limits<size_t>::max()),
-        m_largest(0),
-        m_highest(0),
-        m_allocC(0),
-        m_alloc_failC(0),
-        m_alloc_largest_fail(0),
-        m_allocB(0),
-        m_reallocC(0),
-        m_realloc_failC(0),
-        m_realloc_growthB(0),
-        m_realloc_shrinkB(0),
-        m_realloc_moveC(0),
-        m_realloc_moveB(0),
-        m_offerC(0),
-        m_offerB(0),
-        m_reclaimC(0),
-        m_reclaim_failC(0),
-        m_reclaimB(0)
-    {
-    }
-
-    AllocatorStatistic::AllocatorStatistic(BasicAllocator* backing) :
+        m_options(None),
+        m_shard_mask(0),
+        m_shards(nullptr),
+        m_counters(),
+        m_sample_mask(0),
+        m_latency(nullptr)
+    {
+    }
+
+    AllocatorStatistic::AllocatorStatistic(BasicAllocator* backing, uint32_t options, uint32_t sample_rate) :
         AllocatorStatistic()
     {
         this->m_basic_backing = backing;
+        this->m_options = options;
+
+        if (options & Timing)
+        {
+            uint32_t rate = 1;
+            while (rate < sample_rate)
+                rate <<= 1;
+
+            this->m_latency = new Util::LatencyHistogram[OperationCount];
+            this->m_sample_mask = rate - 1;
+        }
+
+        if (options & Sharded)
+        {
+            size_t threads = std::thread::hardware_concurrency();
+            size_t count = 1;
+            while (count < threads)
+                count <<= 1;
+
+            this->m_shards = new Counters[count];
+            this->m_shard_mask = count - 1;
+        }
     }
 
-    AllocatorStatistic::AllocatorStatistic(ObjectAllocator* backing)
-        : AllocatorStatistic()
+    AllocatorStatistic::AllocatorStatistic(ObjectAllocator* backing, uint32_t options, uint32_t sample_rate)
+        : AllocatorStatistic(static_cast<BasicAllocator*>(backing), options, sample_rate)
     {
-        this->m_basic_backing = backing;
         this->m_object_backing = backing;
     }
 
+    AllocatorStatistic::~AllocatorStatistic()
+    {
+        delete[] this->m_shards;
+        delete[] this->m_latency;
+    }
+
+    AllocatorStatistic::Counters& AllocatorStatistic::getCounters() noexcept
+    {
+        if (this->m_shards != nullptr)
+        {
+            return this->m_shards[getThreadIndex() & this->m_shard_mask];
+        }
+        return this->m_counters;
+    }
+
+    template<class T>
+    T AllocatorStatistic::sumCounters(std::atomic<T> Counters::* counter) const noexcept
+    {
+        if (this->m_shards == nullptr)
+        {
+            return (this->m_counters.*counter).load(std::memory_order_relaxed);
+        }
+
+        T ret = 0;
+        for (size_t i = 0; i <= this->m_shard_mask; ++i)
+            ret += (this->m_shards[i].*counter).load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    template<class T>
+    T AllocatorStatistic::maxCounters(std::atomic<T> Counters::* counter) const noexcept
+    {
+        if (this->m_shards == nullptr)
+        {
+            return (this->m_counters.*counter).load(std::memory_order_relaxed);
+        }
+
+        T ret = std::numeric_limits<T>::min();
+        for (size_t i = 0; i <= this->m_shard_mask; ++i)
+        {
+            T value = (this->m_shards[i].*counter).load(std::memory_order_relaxed);
+            if (value > ret)
+                ret = value;
+        }
+        return ret;
+    }
+
+    template<class T>
+    T AllocatorStatistic::minCounters(std::atomic<T> Counters::* counter) const noexcept
+    {
+        if (this->m_shards == nullptr)
+        {
+            return (this->m_counters.*counter).load(std::memory_order_relaxed);
+        }
+
+        T ret = std::numeric_limits<T>::max();
+        for (size_t i = 0; i <= this->m_shard_mask; ++i)
+        {
+            T value = (this->m_shards[i].*counter).load(std::memory_order_relaxed);
+            if (value < ret)
+                ret = value;
+        }
+        return ret;
+    }
+
+    uint64_t AllocatorStatistic::beginSample() const noexcept
+    {
+        if (this->m_latency == nullptr)
+            return 0;
+
+        thread_local uint32_t calls = 0;
+        if ((++calls & this->m_sample_mask) != 0)
+            return 0;
+
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        return now != 0 ? now : 1;
+    }
+
+    void AllocatorStatistic::endSample(Operation op, uint64_t start) noexcept
+    {
+        if (start == 0)
+            return;
+
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        this->m_latency[op].record(now > start ? now - start : 0);
+    }
+
+    AllocatorStatistic::Histogram AllocatorStatistic::sumHistogram(std::atomic<uintmax_t> (Counters::* histogram)[HistogramBuckets]) const noexcept
+    {
+        const Counters* blocks = this->m_shards != nullptr ? this->m_shards : &this->m_counters;
+        size_t count = this->m_shards != nullptr ? this->m_shard_mask + 1 : 1;
+
+        Histogram ret = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t bucket = 0; bucket < HistogramBuckets; ++bucket)
+                ret.counts[bucket] += (blocks[i].*histogram)[bucket].load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
     size_t AllocatorStatistic::getHighestUsage() const
     {
-        return this->m_highest.load(std::memory_order_relaxed);
+        return this->maxCounters(&Counters::highest);
     }
 
     size_t AllocatorStatistic::getSmallestAlloc() const
     {
-        size_t ret = this->m_smallest.load(std::memory_order_relaxed);
+        size_t ret = this->minCounters(&Counters::smallest);
         if (ret != std::numeric_limits<size_t>::max())
         {
             return ret;
@@ -66,104 +402,243 @@ namespace Memory
 
     size_t AllocatorStatistic::getLargestAlloc() const
     {
-        return this->m_largest.load(std::memory_order_relaxed);
+        return this->maxCounters(&Counters::largest);
     }
 
     uintmax_t AllocatorStatistic::getTotalAllocs() const
     {
-        return this->m_allocC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::allocC);
     }
 
     uintmax_t AllocatorStatistic::getTotalAllocFails() const
     {
-        return this->m_alloc_failC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::alloc_failC);
     }
 
     size_t AllocatorStatistic::getLargestAllocFailed() const
     {
-        return this->m_alloc_largest_fail.load(std::memory_order_relaxed);
+        return this->maxCounters(&Counters::alloc_largest_fail);
     }
 
     uintmax_t AllocatorStatistic::getTotalAllocBytes() const
     {
-        return this->m_allocB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::allocB);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocs() const
     {
-        return this->m_reallocC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::reallocC);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocFails() const
     {
-        return this->m_realloc_failC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::realloc_failC);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocGrowth() const
     {
-        return this->m_realloc_growthB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::realloc_growthB);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocShrink() const
     {
-        return this->m_realloc_shrinkB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::realloc_shrinkB);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocMoves() const
     {
-        return this->m_realloc_moveC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::realloc_moveC);
     }
 
     uintmax_t AllocatorStatistic::getTotalReallocMoved() const
     {
-        return this->m_realloc_moveB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::realloc_moveB);
     }
 
     uintmax_t AllocatorStatistic::getTotalOffers() const
     {
-        return this->m_offerC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::offerC);
     }
 
     uintmax_t AllocatorStatistic::getTotalOfferBytes() const
     {
-        return this->m_offerB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::offerB);
     }
 
     uintmax_t AllocatorStatistic::getTotalReclaims() const
     {
-        return this->m_reclaimC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::reclaimC);
     }
 
     uintmax_t AllocatorStatistic::getTotalReclaimFails() const
     {
-        return this->m_reclaim_failC.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::reclaim_failC);
     }
 
     uintmax_t AllocatorStatistic::getTotalReclaimBytes() const
     {
-        return this->m_reclaimB.load(std::memory_order_relaxed);
+        return this->sumCounters(&Counters::reclaimB);
+    }
+
+    uintmax_t AllocatorStatistic::getTotalExpands() const
+    {
+        return this->sumCounters(&Counters::expandC);
+    }
+
+    uintmax_t AllocatorStatistic::getTotalExpandFails() const
+    {
+        return this->sumCounters(&Counters::expand_failC);
+    }
+
+    uintmax_t AllocatorStatistic::getTotalShrinks() const
+    {
+        return this->sumCounters(&Counters::shrinkC);
+    }
+
+    uintmax_t AllocatorStatistic::getTotalShrinkFails() const
+    {
+        return this->sumCounters(&Counters::shrink_failC);
+    }
+
+    double AllocatorStatistic::getInPlaceRate() const
+    {
+        uintmax_t calls = this->getTotalExpands() + this->getTotalShrinks();
+        if (calls == 0)
+            return 0.0;
+
+        uintmax_t fails = this->getTotalExpandFails() + this->getTotalShrinkFails();
+        return static_cast<double>(calls - fails) / static_cast<double>(calls);
+    }
+
+    AllocatorStatistic::Snapshot AllocatorStatistic::snapshot() const
+    {
+        const Counters* blocks = this->m_shards != nullptr ? this->m_shards : &this->m_counters;
+        size_t count = this->m_shards != nullptr ? this->m_shard_mask + 1 : 1;
+
+        Snapshot ret = {};
+        uint64_t smallest = std::numeric_limits<size_t>::max();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Counters& counters = blocks[i];
+
+            uint64_t value = counters.smallest.load(std::memory_order_relaxed);
+            if (value < smallest)
+                smallest = value;
+            value = counters.largest.load(std::memory_order_relaxed);
+            if (value > ret.largest_alloc)
+                ret.largest_alloc = value;
+            value = counters.highest.load(std::memory_order_relaxed);
+            if (value > ret.highest_usage)
+                ret.highest_usage = value;
+            value = counters.alloc_largest_fail.load(std::memory_order_relaxed);
+            if (value > ret.largest_alloc_failed)
+                ret.largest_alloc_failed = value;
+
+            ret.allocs += counters.allocC.load(std::memory_order_relaxed);
+            ret.alloc_fails += counters.alloc_failC.load(std::memory_order_relaxed);
+            ret.alloc_bytes += counters.allocB.load(std::memory_order_relaxed);
+            ret.reallocs += counters.reallocC.load(std::memory_order_relaxed);
+            ret.realloc_fails += counters.realloc_failC.load(std::memory_order_relaxed);
+            ret.realloc_growth += counters.realloc_growthB.load(std::memory_order_relaxed);
+            ret.realloc_shrink += counters.realloc_shrinkB.load(std::memory_order_relaxed);
+            ret.realloc_moves += counters.realloc_moveC.load(std::memory_order_relaxed);
+            ret.realloc_moved += counters.realloc_moveB.load(std::memory_order_relaxed);
+            ret.offers += counters.offerC.load(std::memory_order_relaxed);
+            ret.offer_bytes += counters.offerB.load(std::memory_order_relaxed);
+            ret.reclaims += counters.reclaimC.load(std::memory_order_relaxed);
+            ret.reclaim_fails += counters.reclaim_failC.load(std::memory_order_relaxed);
+            ret.reclaim_bytes += counters.reclaimB.load(std::memory_order_relaxed);
+            ret.expands += counters.expandC.load(std::memory_order_relaxed);
+            ret.expand_fails += counters.expand_failC.load(std::memory_order_relaxed);
+            ret.shrinks += counters.shrinkC.load(std::memory_order_relaxed);
+            ret.shrink_fails += counters.shrink_failC.load(std::memory_order_relaxed);
+        }
+        ret.smallest_alloc = smallest != std::numeric_limits<size_t>::max() ? smallest : 0;
+
+        ret.used_bytes = this->m_basic_backing->getUsedBytes();
+        ret.total_bytes = this->m_basic_backing->getTotalBytes();
+        ret.free_bytes = this->m_basic_backing->getFreeBytes();
+        ret.pending_bytes = this->m_object_backing != nullptr ? this->m_object_backing->getPendingBytes() : 0;
+
+        this->m_basic_backing->getFreeCounts(ret.local_frees, ret.remote_frees);
+
+        return ret;
+    }
+
+    AllocatorStatistic::Histogram AllocatorStatistic::getSizeHistogram() const
+    {
+        return this->sumHistogram(&Counters::size_histogram);
+    }
+
+    AllocatorStatistic::Histogram AllocatorStatistic::getAlignHistogram() const
+    {
+        return this->sumHistogram(&Counters::align_histogram);
+    }
+
+    AllocatorStatistic::Histogram AllocatorStatistic::getReallocGrowthHistogram() const
+    {
+        return this->sumHistogram(&Counters::growth_histogram);
+    }
+
+    const Util::LatencyHistogram* AllocatorStatistic::getLatencyHistogram(Operation op) const
+    {
+        if (this->m_latency == nullptr || op >= OperationCount)
+            return nullptr;
+        return &this->m_latency[op];
+    }
+
+    uint64_t AllocatorStatistic::getLatencyPercentile(Operation op, double percentile) const
+    {
+        const Util::LatencyHistogram* histogram = this->getLatencyHistogram(op);
+        if (histogram == nullptr)
+            return 0;
+        return histogram->getPercentile(percentile);
     }
 
     void AllocatorStatistic::resetCounters()
     {
-        this->m_smallest = std::numeric_limits<size_t>::max();
-        this->m_largest = 0;
-        this->m_highest = 0;
-        this->m_allocC = 0;
-        this->m_alloc_failC = 0;
-        this->m_alloc_largest_fail = 0;
-        this->m_allocB = 0;
-        this->m_reallocC = 0;
-        this->m_realloc_failC = 0;
-        this->m_realloc_growthB = 0;
-        this->m_realloc_shrinkB = 0;
-        this->m_realloc_moveC = 0;
-        this->m_realloc_moveB = 0;
-        this->m_offerC = 0;
-        this->m_offerB = 0;
-        this->m_reclaimC = 0;
-        this->m_reclaim_failC = 0;
-        this->m_reclaimB = 0;
+        if (this->m_latency != nullptr)
+        {
+            for (uint32_t op = 0; op < OperationCount; ++op)
+                this->m_latency[op].reset();
+        }
+
+        Counters* blocks = this->m_shards != nullptr ? this->m_shards : &this->m_counters;
+        size_t count = this->m_shards != nullptr ? this->m_shard_mask + 1 : 1;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Counters& counters = blocks[i];
+            counters.smallest = std::numeric_limits<size_t>::max();
+            counters.largest = 0;
+            counters.highest = 0;
+            counters.allocC = 0;
+            counters.alloc_failC = 0;
+            counters.alloc_largest_fail = 0;
+            counters.allocB = 0;
+            counters.reallocC = 0;
+            counters.realloc_failC = 0;
+            counters.realloc_growthB = 0;
+            counters.realloc_shrinkB = 0;
+            counters.realloc_moveC = 0;
+            counters.realloc_moveB = 0;
+            counters.expandC = 0;
+            counters.expand_failC = 0;
+            counters.shrinkC = 0;
+            counters.shrink_failC = 0;
+            counters.offerC = 0;
+            counters.offerB = 0;
+            counters.reclaimC = 0;
+            counters.reclaim_failC = 0;
+            counters.reclaimB = 0;
+
+            for (size_t bucket = 0; bucket < HistogramBuckets; ++bucket)
+            {
+                counters.size_histogram[bucket] = 0;
+                counters.align_histogram[bucket] = 0;
+                counters.growth_histogram[bucket] = 0;
+            }
+        }
     }
 
     /*
@@ -172,41 +647,35 @@ namespace Memory
 
     void* AllocatorStatistic::alloc(size_t bytes, size_t align)
     {
-        size_t expected;
-        this->m_allocC.fetch_add(1, std::memory_order_relaxed);
+        Counters& counters = this->getCounters();
+        counters.allocC.fetch_add(1, std::memory_order_relaxed);
 
         try
         {
+            uint64_t sample = this->beginSample();
             void* ret = this->m_basic_backing->alloc(bytes, align);
+            this->endSample(Alloc, sample);
             size_t current_use = this->getUsedBytes();
 
             if (ret != nullptr)
             {
-                this->m_allocB.fetch_add(bytes, std::memory_order_relaxed);
-
-                expected = this->m_largest.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_largest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
-
-                expected = this->m_smallest.load(std::memory_order_relaxed);
-                while (expected > bytes)
-                    if (this->m_smallest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
-
-                expected = this->m_highest.load(std::memory_order_relaxed);
-                while (expected < current_use)
-                    if (this->m_highest.compare_exchange_weak(expected, current_use, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                counters.allocB.fetch_add(bytes, std::memory_order_relaxed);
+
+                storeMax(counters.largest, bytes);
+                storeMin(counters.smallest, bytes);
+                storeMax(counters.highest, current_use);
+
+                if (this->m_options & Histograms)
+                {
+                    countHistogram(counters.size_histogram, bytes);
+                    countHistogram(counters.align_histogram, align);
+                }
             }
             else
             {
-                this->m_alloc_failC.fetch_add(1, std::memory_order_relaxed);
+                counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-                expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                storeMax(counters.alloc_largest_fail, bytes);
             }
             return ret;
         }
@@ -214,12 +683,9 @@ namespace Memory
         {
             std::exception_ptr eptr = std::current_exception();
 
-            this->m_alloc_failC.fetch_add(1, std::memory_order_relaxed);
+            counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-            expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-            while (expected < bytes)
-                if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                    break;
+            storeMax(counters.alloc_largest_fail, bytes);
 
             std::rethrow_exception(eptr);
         }
@@ -227,41 +693,35 @@ namespace Memory
 
     void* AllocatorStatistic::alloc(size_t bytes, DestructorPtr destructor, size_t align)
     {
-        size_t expected;
-        this->m_allocC.fetch_add(1, std::memory_order_relaxed);
+        Counters& counters = this->getCounters();
+        counters.allocC.fetch_add(1, std::memory_order_relaxed);
 
         try
         {
+            uint64_t sample = this->beginSample();
             void* ret = this->m_object_backing->alloc(bytes, destructor, align);
+            this->endSample(Alloc, sample);
             size_t current_use = this->getUsedBytes();
 
             if (ret != nullptr)
             {
-                this->m_allocB.fetch_add(bytes, std::memory_order_relaxed);
-
-                expected = this->m_largest.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_largest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
-
-                expected = this->m_smallest.load(std::memory_order_relaxed);
-                while (expected > bytes)
-                    if (this->m_smallest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
-
-                expected = this->m_highest.load(std::memory_order_relaxed);
-                while (expected < current_use)
-                    if (this->m_highest.compare_exchange_weak(expected, current_use, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                counters.allocB.fetch_add(bytes, std::memory_order_relaxed);
+
+                storeMax(counters.largest, bytes);
+                storeMin(counters.smallest, bytes);
+                storeMax(counters.highest, current_use);
+
+                if (this->m_options & Histograms)
+                {
+                    countHistogram(counters.size_histogram, bytes);
+                    countHistogram(counters.align_histogram, align);
+                }
             }
             else
             {
-                this->m_alloc_failC.fetch_add(1, std::memory_order_relaxed);
+                counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-                expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                storeMax(counters.alloc_largest_fail, bytes);
             }
             return ret;
         }
@@ -269,12 +729,9 @@ namespace Memory
         {
             std::exception_ptr eptr = std::current_exception();
 
-            this->m_alloc_failC.fetch_add(1, std::memory_order_relaxed);
+            counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-            expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-            while (expected < bytes)
-                if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                    break;
+            storeMax(counters.alloc_largest_fail, bytes);
 
             std::rethrow_exception(eptr);
         }
@@ -282,65 +739,127 @@ namespace Memory
 
     void AllocatorStatistic::free(void* ptr)
     {
+        uint64_t sample = this->beginSample();
         this->m_basic_backing->free(ptr);
+        this->endSample(Free, sample);
     }
 
-    void* AllocatorStatistic::realloc(void* ptr, size_t bytes, size_t align)
+    void AllocatorStatistic::free(void* ptr, size_t bytes)
+    {
+        uint64_t sample = this->beginSample();
+        this->m_basic_backing->free(ptr, bytes);
+        this->endSample(Free, sample);
+    }
+
+    size_t AllocatorStatistic::allocBulk(size_t bytes, size_t count, void** out, size_t align)
     {
-        size_t expected;
-        this->m_reallocC.fetch_add(1, std::memory_order_relaxed);
+        // Counters are updated once per batch, every attempted block counts as a separate allocation
+        Counters& counters = this->getCounters();
 
         try
         {
-            size_t last_size = this->getAllocSize(ptr);
-            
-            void* ret = this->m_basic_backing->realloc(ptr, bytes, align);
+            size_t ret = this->m_basic_backing->allocBulk(bytes, count, out, align);
             size_t current_use = this->getUsedBytes();
 
-            if (ret != nullptr)
-            {
-                this->m_allocB.fetch_add(bytes, std::memory_order_relaxed);
+            counters.allocC.fetch_add(ret != count ? ret + 1 : ret, std::memory_order_relaxed);
 
-                expected = this->m_largest.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_largest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
-
-                expected = this->m_smallest.load(std::memory_order_relaxed);
-                while (expected > bytes)
-                    if (this->m_smallest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+            if (ret != 0)
+            {
+                counters.allocB.fetch_add(bytes * ret, std::memory_order_relaxed);
 
-                expected = this->m_highest.load(std::memory_order_relaxed);
-                while (expected < current_use)
-                    if (this->m_highest.compare_exchange_weak(expected, current_use, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                storeMax(counters.largest, bytes);
+                storeMin(counters.smallest, bytes);
+                storeMax(counters.highest, current_use);
 
-                if (ret != ptr)
+                if (this->m_options & Histograms)
                 {
-                    this->m_realloc_moveC.fetch_add(1, std::memory_order_relaxed);
-                    this->m_realloc_moveB.fetch_add(bytes, std::memory_order_relaxed);
+                    countHistogram(counters.size_histogram, bytes, ret);
+                    countHistogram(counters.align_histogram, align, ret);
                 }
+            }
+            if (ret != count)
+            {
+                // The batch stops at the first failure
+                counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-                if (last_size > bytes)
-                {
-                    this->m_realloc_shrinkB.fetch_add(last_size - bytes, std::memory_order_relaxed);
-                }
-                else if (last_size < bytes)
-                {
-                    this->m_realloc_growthB.fetch_add(bytes - last_size, std::memory_order_relaxed);
-                }
+                storeMax(counters.alloc_largest_fail, bytes);
+            }
+            return ret;
+        }
+        catch (...)
+        {
+            std::exception_ptr eptr = std::current_exception();
+
+            counters.allocC.fetch_add(1, std::memory_order_relaxed);
+            counters.alloc_failC.fetch_add(1, std::memory_order_relaxed);
+
+            storeMax(counters.alloc_largest_fail, bytes);
+
+            std::rethrow_exception(eptr);
+        }
+    }
 
+    void AllocatorStatistic::freeBulk(void** ptrs, size_t count)
+    {
+        this->m_basic_backing->freeBulk(ptrs, count);
+    }
+
+    void AllocatorStatistic::countRealloc(Counters& counters, void* ptr, void* ret, size_t last_size, size_t bytes, size_t align) noexcept
+    {
+        size_t current_use = this->getUsedBytes();
+
+        if (ret != nullptr)
+        {
+            counters.allocB.fetch_add(bytes, std::memory_order_relaxed);
+
+            storeMax(counters.largest, bytes);
+            storeMin(counters.smallest, bytes);
+            storeMax(counters.highest, current_use);
+
+            if (ret != ptr)
+            {
+                counters.realloc_moveC.fetch_add(1, std::memory_order_relaxed);
+                counters.realloc_moveB.fetch_add(bytes, std::memory_order_relaxed);
             }
-            else
+
+            if (last_size > bytes)
+            {
+                counters.realloc_shrinkB.fetch_add(last_size - bytes, std::memory_order_relaxed);
+            }
+            else if (last_size < bytes)
             {
-                this->m_realloc_failC.fetch_add(1, std::memory_order_relaxed);
+                counters.realloc_growthB.fetch_add(bytes - last_size, std::memory_order_relaxed);
+            }
 
-                expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+            if (this->m_options & Histograms)
+            {
+                countHistogram(counters.size_histogram, bytes);
+                countHistogram(counters.align_histogram, align);
+                if (last_size < bytes)
+                    countHistogram(counters.growth_histogram, bytes - last_size);
             }
+        }
+        else
+        {
+            counters.realloc_failC.fetch_add(1, std::memory_order_relaxed);
+
+            storeMax(counters.alloc_largest_fail, bytes);
+        }
+    }
+
+    void* AllocatorStatistic::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        Counters& counters = this->getCounters();
+        counters.reallocC.fetch_add(1, std::memory_order_relaxed);
+
+        try
+        {
+            size_t last_size = ptr != nullptr ? this->getAllocSize(ptr) : 0;
+
+            uint64_t sample = this->beginSample();
+            void* ret = this->m_basic_backing->realloc(ptr, bytes, align);
+            this->endSample(Realloc, sample);
+            this->countRealloc(counters, ptr, ret, last_size, bytes, align);
 
             return ret;
         }
@@ -348,12 +867,36 @@ namespace Memory
         {
             std::exception_ptr eptr = std::current_exception();
 
-            this->m_realloc_failC.fetch_add(1, std::memory_order_relaxed);
+            counters.realloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-            expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-            while (expected < bytes)
-                if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                    break;
+            storeMax(counters.alloc_largest_fail, bytes);
+
+            std::rethrow_exception(eptr);
+        }
+    }
+
+    void* AllocatorStatistic::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        Counters& counters = this->getCounters();
+        counters.reallocC.fetch_add(1, std::memory_order_relaxed);
+
+        try
+        {
+            // The caller supplied size spares the metadata lookup
+            uint64_t sample = this->beginSample();
+            void* ret = this->m_basic_backing->reallocSized(ptr, old_bytes, bytes, align);
+            this->endSample(Realloc, sample);
+            this->countRealloc(counters, ptr, ret, old_bytes, bytes, align);
+
+            return ret;
+        }
+        catch (...)
+        {
+            std::exception_ptr eptr = std::current_exception();
+
+            counters.realloc_failC.fetch_add(1, std::memory_order_relaxed);
+
+            storeMax(counters.alloc_largest_fail, bytes);
 
             std::rethrow_exception(eptr);
         }
@@ -361,59 +904,54 @@ namespace Memory
 
     void* AllocatorStatistic::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
     {
-        size_t expected;
-        this->m_reallocC.fetch_add(1, std::memory_order_relaxed);
+        Counters& counters = this->getCounters();
+        counters.reallocC.fetch_add(1, std::memory_order_relaxed);
 
         try
         {
-            size_t last_size = this->getAllocSize(ptr);
+            size_t last_size = ptr != nullptr ? this->getAllocSize(ptr) : 0;
 
+            uint64_t sample = this->beginSample();
             void* ret = this->m_object_backing->realloc(ptr, bytes, destructor, align);
-            size_t current_use = this->getUsedBytes();
+            this->endSample(Realloc, sample);
+            this->countRealloc(counters, ptr, ret, last_size, bytes, align);
 
-            if (ret != nullptr)
-            {
-                this->m_allocB.fetch_add(bytes, std::memory_order_relaxed);
+            return ret;
+        }
+        catch (...)
+        {
+            std::exception_ptr eptr = std::current_exception();
 
-                expected = this->m_largest.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_largest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+            counters.realloc_failC.fetch_add(1, std::memory_order_relaxed);
 
-                expected = this->m_smallest.load(std::memory_order_relaxed);
-                while (expected > bytes)
-                    if (this->m_smallest.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+            storeMax(counters.alloc_largest_fail, bytes);
 
-                expected = this->m_highest.load(std::memory_order_relaxed);
-                while (expected < current_use)
-                    if (this->m_highest.compare_exchange_weak(expected, current_use, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+            std::rethrow_exception(eptr);
+        }
+    }
 
-                if (ret != ptr)
-                {
-                    this->m_realloc_moveC.fetch_add(1, std::memory_order_relaxed);
-                    this->m_realloc_moveB.fetch_add(bytes, std::memory_order_relaxed);
-                }
+    size_t AllocatorStatistic::getAllocSize(const void* ptr) const
+    {
+        return this->m_basic_backing->getAllocSize(ptr);
+    }
 
-                if (last_size > bytes)
-                {
-                    this->m_realloc_shrinkB.fetch_add(last_size - bytes, std::memory_order_relaxed);
-                }
-                else if (last_size < bytes)
-                {
-                    this->m_realloc_growthB.fetch_add(bytes - last_size, std::memory_order_relaxed);
-                }
+    bool AllocatorStatistic::tryExpand(void* ptr, size_t bytes)
+    {
+        Counters& counters = this->getCounters();
+        counters.expandC.fetch_add(1, std::memory_order_relaxed);
 
+        try
+        {
+            bool ret = this->m_basic_backing->tryExpand(ptr, bytes);
+            if (ret)
+            {
+                storeMax(counters.largest, bytes);
+                storeMin(counters.smallest, bytes);
+                storeMax(counters.highest, this->getUsedBytes());
             }
             else
             {
-                this->m_realloc_failC.fetch_add(1, std::memory_order_relaxed);
-
-                expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-                while (expected < bytes)
-                    if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                        break;
+                counters.expand_failC.fetch_add(1, std::memory_order_relaxed);
             }
 
             return ret;
@@ -422,45 +960,72 @@ namespace Memory
         {
             std::exception_ptr eptr = std::current_exception();
 
-            this->m_realloc_failC.fetch_add(1, std::memory_order_relaxed);
-
-            expected = this->m_alloc_largest_fail.load(std::memory_order_relaxed);
-            while (expected < bytes)
-                if (this->m_alloc_largest_fail.compare_exchange_weak(expected, bytes, std::memory_order_release, std::memory_order_relaxed))
-                    break;
+            counters.expand_failC.fetch_add(1, std::memory_order_relaxed);
 
             std::rethrow_exception(eptr);
         }
     }
 
-    size_t AllocatorStatistic::getAllocSize(const void* ptr) const
+    bool AllocatorStatistic::tryShrink(void* ptr, size_t bytes)
     {
-        return this->m_basic_backing->getAllocSize(ptr);
+        Counters& counters = this->getCounters();
+        counters.shrinkC.fetch_add(1, std::memory_order_relaxed);
+
+        try
+        {
+            bool ret = this->m_basic_backing->tryShrink(ptr, bytes);
+            if (ret)
+            {
+                storeMax(counters.largest, bytes);
+                storeMin(counters.smallest, bytes);
+            }
+            else
+            {
+                counters.shrink_failC.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return ret;
+        }
+        catch (...)
+        {
+            std::exception_ptr eptr = std::current_exception();
+
+            counters.shrink_failC.fetch_add(1, std::memory_order_relaxed);
+
+            std::rethrow_exception(eptr);
+        }
     }
 
     void* AllocatorStatistic::offer(void* ptr, uint32_t priority)
     {
-        this->m_offerC.fetch_add(1, std::memory_order_relaxed);
-        this->m_offerB.fetch_add(this->getAllocSize(ptr), std::memory_order_relaxed);
+        Counters& counters = this->getCounters();
+        counters.offerC.fetch_add(1, std::memory_order_relaxed);
+        counters.offerB.fetch_add(this->getAllocSize(ptr), std::memory_order_relaxed);
 
+        uint64_t sample = this->beginSample();
         void* ret = this->m_object_backing->offer(ptr, priority);
+        this->endSample(Offer, sample);
 
         return ret;
     }
 
     void* AllocatorStatistic::reclaim(void* ptr)
     {
-        this->m_reclaimC.fetch_add(1, std::memory_order_relaxed);
+        Counters& counters = this->getCounters();
+        counters.reclaimC.fetch_add(1, std::memory_order_relaxed);
 
+        uint64_t sample = this->beginSample();
         void* ret = this->m_object_backing->reclaim(ptr);
+        this->endSample(Reclaim, sample);
 
         if (ret == nullptr)
         {
-            this->m_reclaim_failC.fetch_add(1, std::memory_order_relaxed);
+            counters.reclaim_failC.fetch_add(1, std::memory_order_relaxed);
         }
         else
         {
-            this->m_reclaimB.fetch_add(this->getAllocSize(ptr), std::memory_order_relaxed);
+            // The ticket passed in is not the allocation, measure the restored block
+            counters.reclaimB.fetch_add(this->getAllocSize(ret), std::memory_order_relaxed);
         }
 
         return ret;
@@ -502,4 +1067,9 @@ namespace Memory
     {
         return this->m_basic_backing->getTotalBytes();
     }
+
+    bool AllocatorStatistic::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        return this->m_basic_backing->getFreeCounts(local, remote);
+    }
 }
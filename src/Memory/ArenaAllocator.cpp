@@ -0,0 +1,259 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/ArenaAllocator.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    // Header of a mapped page, the usable region follows the structure
+    struct alignas(alignof(max_align_t)) ArenaAllocator::Page
+    {
+        Page* next;
+        size_t bytes; // Size of the whole mapping
+    };
+
+    namespace
+    {
+        template<class Page>
+        inline char* getPageBegin(Page* page) noexcept
+        {
+            return reinterpret_cast<char*>(page + 1);
+        }
+
+        template<class Page>
+        inline char* getPageEnd(Page* page) noexcept
+        {
+            return reinterpret_cast<char*>(page) + page->bytes;
+        }
+
+        // Aligned user pointer leaving room for the size prefix, or nullptr if the allocation doesn't fit
+        inline char* fitAllocation(char* top, char* end, size_t bytes, size_t align) noexcept
+        {
+            if (top == nullptr)
+                return nullptr;
+
+            uintptr_t user = reinterpret_cast<uintptr_t>(top) + sizeof(size_t);
+            user += BasicAllocator::getAlignedOffset(reinterpret_cast<void*>(user), align);
+            if (user > reinterpret_cast<uintptr_t>(end) || bytes > reinterpret_cast<uintptr_t>(end) - user)
+                return nullptr;
+
+            return reinterpret_cast<char*>(user);
+        }
+    }
+
+    /*
+        ArenaAllocator definitions
+    */
+
+    ArenaAllocator::ArenaAllocator(size_t page_bytes) :
+        m_pages(nullptr),
+        m_current(nullptr),
+        m_buffer(nullptr),
+        m_top(nullptr),
+        m_end(nullptr),
+        m_page_bytes(page_bytes != 0 ? page_bytes : DefaultPageBytes),
+        m_used(0),
+        m_total(0)
+    {
+    }
+
+    ArenaAllocator::ArenaAllocator(void* buffer, size_t bytes) :
+        m_pages(nullptr),
+        m_current(nullptr),
+        m_buffer(reinterpret_cast<char*>(buffer)),
+        m_top(reinterpret_cast<char*>(buffer)),
+        m_end(reinterpret_cast<char*>(buffer) + bytes),
+        m_page_bytes(0),
+        m_used(0),
+        m_total(bytes)
+    {
+    }
+
+    ArenaAllocator::~ArenaAllocator()
+    {
+        Page* page = this->m_pages;
+        while (page != nullptr)
+        {
+            Page* next = page->next;
+            SystemMemory::unmap(page, page->bytes);
+            page = next;
+        }
+    }
+
+    bool ArenaAllocator::nextPage(size_t bytes, size_t align)
+    {
+        if (this->m_page_bytes == 0)
+            return false;
+
+        if (bytes > std::numeric_limits<size_t>::max() / 2 - align)
+            return false;
+
+        // The tail of the current page is lost until the next reset
+        if (this->m_current != nullptr)
+            this->m_used += static_cast<size_t>(this->m_end - this->m_top);
+
+        // Pages kept from before the last reset are reused first
+        Page* page = this->m_current != nullptr ? this->m_current->next : nullptr;
+        while (page != nullptr)
+        {
+            this->m_current = page;
+            this->m_top = getPageBegin(page);
+            this->m_end = getPageEnd(page);
+
+            if (fitAllocation(this->m_top, this->m_end, bytes, align) != nullptr)
+                return true;
+
+            this->m_used += static_cast<size_t>(this->m_end - this->m_top);
+            page = page->next;
+        }
+
+        size_t needed = SystemMemory::roundToPages(sizeof(Page) + sizeof(size_t) + align + bytes);
+        if (needed < this->m_page_bytes)
+            needed = SystemMemory::roundToPages(this->m_page_bytes);
+
+        page = reinterpret_cast<Page*>(SystemMemory::map(needed));
+        if (page == nullptr)
+            return false;
+
+        page->bytes = needed;
+        if (this->m_current != nullptr)
+        {
+            page->next = this->m_current->next;
+            this->m_current->next = page;
+        }
+        else
+        {
+            page->next = nullptr;
+            this->m_pages = page;
+            this->m_buffer = getPageBegin(page);
+        }
+
+        this->m_current = page;
+        this->m_top = getPageBegin(page);
+        this->m_end = getPageEnd(page);
+        this->m_total += static_cast<size_t>(this->m_end - this->m_top);
+
+        return true;
+    }
+
+    /*
+        Overridden BasicAllocator function definitions
+    */
+
+    void* ArenaAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (align < alignof(size_t))
+            align = alignof(size_t);
+
+        char* user = fitAllocation(this->m_top, this->m_end, bytes, align);
+        if (user == nullptr)
+        {
+            if (!this->nextPage(bytes, align))
+                return nullptr;
+            user = fitAllocation(this->m_top, this->m_end, bytes, align);
+        }
+
+        reinterpret_cast<size_t*>(user)[-1] = bytes;
+
+        char* top = user + bytes;
+        this->m_used += static_cast<size_t>(top - this->m_top);
+        this->m_top = top;
+
+        return user;
+    }
+
+    void ArenaAllocator::free(void* ptr)
+    {
+        (void)ptr;
+    }
+
+    void* ArenaAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        if (getAlignedOffset(ptr, align) == 0 && this->ArenaAllocator::tryExpand(ptr, bytes))
+            return ptr;
+
+        size_t size = reinterpret_cast<size_t*>(ptr)[-1];
+        void* ret = this->alloc(bytes, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, size < bytes ? size : bytes);
+        return ret;
+    }
+
+    size_t ArenaAllocator::getAllocSize(const void* ptr) const
+    {
+        return reinterpret_cast<const size_t*>(ptr)[-1];
+    }
+
+    bool ArenaAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        char* user = reinterpret_cast<char*>(ptr);
+        size_t size = reinterpret_cast<size_t*>(user)[-1];
+
+        // The most recent allocation can be resized as long as the region has room
+        if (user + size == this->m_top && bytes <= static_cast<size_t>(this->m_end - user))
+        {
+            this->m_used = this->m_used - size + bytes;
+            this->m_top = user + bytes;
+            reinterpret_cast<size_t*>(user)[-1] = bytes;
+            return true;
+        }
+
+        return bytes <= size;
+    }
+
+    bool ArenaAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr || bytes > reinterpret_cast<size_t*>(ptr)[-1])
+            return false;
+
+        // Only the most recent allocation gives its tail back
+        return this->ArenaAllocator::tryExpand(ptr, bytes);
+    }
+
+    void ArenaAllocator::reset()
+    {
+        this->m_used = 0;
+        if (this->m_pages != nullptr)
+        {
+            this->m_current = this->m_pages;
+            this->m_top = getPageBegin(this->m_pages);
+            this->m_end = getPageEnd(this->m_pages);
+        }
+        else
+        {
+            this->m_top = this->m_buffer;
+        }
+    }
+
+    size_t ArenaAllocator::getFreeBytes() const
+    {
+        return this->m_total - this->m_used;
+    }
+
+    size_t ArenaAllocator::getUsedBytes() const
+    {
+        return this->m_used;
+    }
+
+    size_t ArenaAllocator::getTotalBytes() const
+    {
+        return this->m_total;
+    }
+}
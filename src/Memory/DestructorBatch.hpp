@@ -0,0 +1,149 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Internal helper running destructor functions in batches grouped by function.
+ *  Not part of the public interface, only used by the allocator implementations.
+ */
+#ifndef SHARED_MEMORY_DESTRUCTORBATCH_HPP
+#define SHARED_MEMORY_DESTRUCTORBATCH_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Memory/ObjectAllocator.hpp>
+
+#include <cstring>
+
+namespace Memory
+{
+    /**
+     * @brief Collected destructor calls, run grouped by destructor function.
+     *
+     * Allocators destroying many blocks at once add them to a batch while walking their structures, and the batch runs the destructors group by group, in collection order within a group.
+     * Every @ref ObjectAllocator::destroy and @ref ObjectAllocator::destroyArray instantiation is a distinct function, so a group of the @ref ObjectAllocator::make path holds the objects of a single type.
+     * Consecutive calls go to the same target, instead of jumping between types in allocation order.
+     * Blocks without a destructor function are never added, so trivially destructible objects cost nothing.
+     *
+     * The batch holds up to @ref Capacity blocks of @ref MaxGroups distinct functions and runs once either is full, so the blocks are still in cache when destroyed and the batch never allocates.
+     *
+     * @tparam Fn Callable invoked as fn(destructor, block) for every block. It has to check whether the block is still alive, an earlier destructor may have freed it.
+     */
+    template<class Fn>
+    class DestructorBatch
+    {
+    public:
+
+        using DestructorPtr = ObjectAllocator::DestructorPtr;
+
+        static constexpr size_t Capacity = 512;
+        static constexpr size_t MaxGroups = 64;
+
+        explicit DestructorBatch(Fn& fn) noexcept :
+            m_fn(fn),
+            m_count(0),
+            m_group_count(0),
+            m_last(0)
+        {
+            std::memset(this->m_slots, 0, sizeof(this->m_slots));
+        }
+
+        DestructorBatch(const DestructorBatch&) = delete;
+        DestructorBatch& operator=(const DestructorBatch&) = delete;
+
+        // Queue a block, may run the batch first
+        inline void add(DestructorPtr destructor, void* block)
+        {
+            // Objects of the same type tend to be allocated together, a repeated function skips the lookup
+            size_t group = this->m_last;
+            if (this->m_count == Capacity || this->m_group_count == 0 || this->m_destructors[group] != destructor)
+            {
+                if (this->m_count == Capacity)
+                    this->run();
+                group = this->findGroup(destructor);
+            }
+
+            this->m_blocks[this->m_count] = block;
+            this->m_groups[this->m_count] = static_cast<uint8_t>(group);
+            ++this->m_count;
+            ++this->m_sizes[group];
+            this->m_last = group;
+        }
+
+        // Destroy every queued block, blocks may be added again while running
+        void run()
+        {
+            size_t count = this->m_count;
+            size_t group_count = this->m_group_count;
+            if (count == 0)
+                return;
+
+            void* grouped[Capacity];
+            DestructorPtr destructors[MaxGroups];
+            size_t starts[MaxGroups + 1];
+            starts[0] = 0;
+            for (size_t i = 0; i < group_count; ++i)
+            {
+                destructors[i] = this->m_destructors[i];
+                starts[i + 1] = starts[i] + this->m_sizes[i];
+            }
+
+            for (size_t i = 0; i < count; ++i)
+                grouped[starts[this->m_groups[i]]++] = this->m_blocks[i];
+
+            // The scatter moved every start to the end of its group, the batch is empty again before any destructor runs
+            this->m_count = 0;
+            this->m_group_count = 0;
+            this->m_last = 0;
+            std::memset(this->m_slots, 0, sizeof(this->m_slots));
+
+            size_t offset = 0;
+            for (size_t i = 0; i < group_count; ++i)
+            {
+                DestructorPtr destructor = destructors[i];
+                for (size_t end = starts[i]; offset < end; ++offset)
+                    this->m_fn(destructor, grouped[offset]);
+            }
+        }
+
+    private:
+
+        static constexpr size_t SlotCount = 2 * MaxGroups; // Open addressing table of the groups, at most half full
+
+        // Index of the group of a function, running the batch first if the table is full
+        size_t findGroup(DestructorPtr destructor)
+        {
+            uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(destructor)) * 0x9E3779B97F4A7C15ull;
+            for (size_t slot = static_cast<size_t>(hash >> 57);; slot = (slot + 1) % SlotCount)
+            {
+                uint8_t index = this->m_slots[slot];
+                if (index == 0)
+                {
+                    if (this->m_group_count == MaxGroups)
+                    {
+                        this->run();
+                        slot = static_cast<size_t>(hash >> 57);
+                    }
+
+                    size_t group = this->m_group_count++;
+                    this->m_destructors[group] = destructor;
+                    this->m_sizes[group] = 0;
+                    this->m_slots[slot] = static_cast<uint8_t>(group + 1);
+                    return group;
+                }
+                if (this->m_destructors[index - 1] == destructor)
+                    return index - 1;
+            }
+        }
+
+        Fn& m_fn;
+
+        void* m_blocks[Capacity]; // Blocks in collection order
+        uint8_t m_groups[Capacity]; // Group of every queued block
+        size_t m_count;
+
+        size_t m_group_count;
+        size_t m_last; // Group of the most recently added block
+        uint8_t m_slots[SlotCount]; // Group index + 1, 0 for empty slots
+        DestructorPtr m_destructors[MaxGroups];
+        size_t m_sizes[MaxGroups]; // Blocks queued in each group
+    };
+}
+
+#endif /* SHARED_MEMORY_DESTRUCTORBATCH_HPP */
@@ -0,0 +1,54 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/FramePromise.hpp>
+
+namespace Memory
+{
+    namespace
+    {
+        thread_local BasicAllocator* s_current = nullptr;
+    }
+
+    /*
+        FramePromise definitions
+    */
+
+    BasicAllocator* FramePromise::getCurrent() noexcept
+    {
+        return s_current;
+    }
+
+    void FramePromise::setCurrent(BasicAllocator* allocator) noexcept
+    {
+        s_current = allocator;
+    }
+
+    void* FramePromise::allocFrame(size_t bytes, BasicAllocator* allocator)
+    {
+        if (bytes > std::numeric_limits<size_t>::max() - HeaderSize)
+            throw std::bad_alloc();
+
+        // Frames without an allocator still get the header, so every frame is freed the same way
+        void* ptr = allocator != nullptr ? allocator->alloc(HeaderSize + bytes, alignof(max_align_t)) : ::operator new(HeaderSize + bytes);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+
+        *reinterpret_cast<BasicAllocator**>(ptr) = allocator;
+        return reinterpret_cast<char*>(ptr) + HeaderSize;
+    }
+
+    void FramePromise::freeFrame(void* ptr, size_t bytes) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        void* header = reinterpret_cast<char*>(ptr) - HeaderSize;
+        BasicAllocator* allocator = *reinterpret_cast<BasicAllocator**>(header);
+        if (allocator != nullptr)
+            allocator->free(header, HeaderSize + bytes);
+        else
+            ::operator delete(header);
+    }
+}
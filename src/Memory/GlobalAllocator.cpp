@@ -0,0 +1,462 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/GlobalAllocator.hpp>
+#include <Shared/Memory/Heap.hpp>
+#include <Shared/Memory/ThreadCacheAllocator.hpp>
+#include <Shared/Platform/Target.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#if defined(SHARED_MEMORY_OVERRIDE_MALLOC) && defined(PLATFORM_OS_LINUX)
+#   include <malloc.h>
+#   include <unistd.h>
+#endif
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    namespace
+    {
+        // The process wide allocator chain, constructed in place and never destroyed
+        struct Chain
+        {
+            Heap heap;
+#if SHARED_MEMORY_GLOBAL_THREAD_CACHE
+            ThreadCacheAllocator cache;
+#endif
+            AllocatorStatistic statistic;
+
+            Chain() :
+                heap(),
+#if SHARED_MEMORY_GLOBAL_THREAD_CACHE
+                cache(&heap),
+                statistic(&cache, SHARED_MEMORY_GLOBAL_STATISTIC_OPTIONS)
+#else
+                statistic(static_cast<ObjectAllocator*>(&heap), SHARED_MEMORY_GLOBAL_STATISTIC_OPTIONS)
+#endif
+            {
+            }
+        };
+
+        enum ChainState : uint32_t
+        {
+            ChainNone = 0,
+            ChainConstructing,
+            ChainReady
+        };
+
+        // Only constant initialized objects, the first allocation may precede every dynamic initializer
+        alignas(Chain) unsigned char s_chain[sizeof(Chain)];
+        std::atomic<uint32_t> s_chain_state(ChainNone);
+        std::atomic<AllocatorStatistic*> s_statistic(nullptr);
+
+        alignas(alignof(max_align_t)) char s_bootstrap[GlobalAllocator::BootstrapBytes];
+        std::atomic<size_t> s_bootstrap_top(0);
+
+        AllocatorStatistic* createChain()
+        {
+            uint32_t state = ChainNone;
+            if (!s_chain_state.compare_exchange_strong(state, ChainConstructing, std::memory_order_acquire))
+            {
+                // Allocations of the constructing thread and of concurrent threads go to the bootstrap buffer meanwhile
+                return state == ChainReady ? s_statistic.load(std::memory_order_acquire) : nullptr;
+            }
+
+            Chain* chain = new (s_chain) Chain();
+            s_statistic.store(&chain->statistic, std::memory_order_release);
+            s_chain_state.store(ChainReady, std::memory_order_release);
+
+            return &chain->statistic;
+        }
+
+        // Bump allocation from the bootstrap buffer, each block is preceded by its size
+        void* allocBootstrap(size_t bytes, size_t align) noexcept
+        {
+            if (align < alignof(max_align_t))
+                align = alignof(max_align_t);
+
+            uintptr_t base = reinterpret_cast<uintptr_t>(s_bootstrap);
+            uintptr_t end = base + GlobalAllocator::BootstrapBytes;
+
+            size_t top = s_bootstrap_top.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                uintptr_t user = base + top + sizeof(size_t);
+                user += BasicAllocator::getAlignedOffset(reinterpret_cast<void*>(user), align);
+                if (user > end || bytes > end - user)
+                    return nullptr;
+
+                if (s_bootstrap_top.compare_exchange_weak(top, static_cast<size_t>(user + bytes - base), std::memory_order_relaxed))
+                {
+                    reinterpret_cast<size_t*>(user)[-1] = bytes;
+                    return reinterpret_cast<void*>(user);
+                }
+            }
+        }
+    }
+
+    /*
+        GlobalAllocator definitions
+    */
+
+    AllocatorStatistic* GlobalAllocator::getStatistic()
+    {
+        AllocatorStatistic* statistic = s_statistic.load(std::memory_order_acquire);
+        if (statistic != nullptr)
+            return statistic;
+
+        return createChain();
+    }
+
+    void* GlobalAllocator::alloc(size_t bytes, size_t align)
+    {
+        AllocatorStatistic* statistic = getStatistic();
+        if (statistic == nullptr)
+            return allocBootstrap(bytes, align);
+
+        return statistic->alloc(bytes, align);
+    }
+
+    void GlobalAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr || isBootstrap(ptr))
+            return;
+
+        // Blocks of other allocators freed before the chain got constructed are leaked
+        AllocatorStatistic* statistic = s_statistic.load(std::memory_order_acquire);
+        if (statistic != nullptr)
+            statistic->free(ptr);
+    }
+
+    void GlobalAllocator::free(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr || isBootstrap(ptr))
+            return;
+
+        AllocatorStatistic* statistic = s_statistic.load(std::memory_order_acquire);
+        if (statistic != nullptr)
+            statistic->free(ptr, bytes);
+    }
+
+    void* GlobalAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return alloc(bytes, align);
+
+        if (isBootstrap(ptr))
+        {
+            void* ret = alloc(bytes, align);
+            if (ret == nullptr)
+                return nullptr;
+
+            size_t size = reinterpret_cast<const size_t*>(ptr)[-1];
+            std::memcpy(ret, ptr, size < bytes ? size : bytes);
+            return ret;
+        }
+
+        return s_statistic.load(std::memory_order_acquire)->realloc(ptr, bytes, align);
+    }
+
+    size_t GlobalAllocator::getAllocSize(const void* ptr)
+    {
+        if (isBootstrap(ptr))
+            return reinterpret_cast<const size_t*>(ptr)[-1];
+
+        return s_statistic.load(std::memory_order_acquire)->getAllocSize(ptr);
+    }
+
+    bool GlobalAllocator::isBootstrap(const void* ptr) noexcept
+    {
+        const char* block = reinterpret_cast<const char*>(ptr);
+        return block >= s_bootstrap && block < s_bootstrap + BootstrapBytes;
+    }
+}
+
+#if defined(SHARED_MEMORY_OVERRIDE_NEW)
+
+/*
+    Replaced global allocation functions
+*/
+
+namespace
+{
+    // Allocation loop of the standard operator new, calling the new handler until the allocation succeeds
+    void* allocNew(size_t bytes, size_t align)
+    {
+        if (bytes == 0)
+            bytes = 1;
+
+        for (;;)
+        {
+            void* ptr = Memory::GlobalAllocator::alloc(bytes, align);
+            if (ptr != nullptr)
+                return ptr;
+
+            std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void* allocNewNoThrow(size_t bytes, size_t align) noexcept
+    {
+        try
+        {
+            return allocNew(bytes, align);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+}
+
+void* operator new(size_t bytes)
+{
+    return allocNew(bytes, alignof(max_align_t));
+}
+
+void* operator new[](size_t bytes)
+{
+    return allocNew(bytes, alignof(max_align_t));
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    return allocNewNoThrow(bytes, alignof(max_align_t));
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+    return allocNewNoThrow(bytes, alignof(max_align_t));
+}
+
+void* operator new(size_t bytes, std::align_val_t align)
+{
+    return allocNew(bytes, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t bytes, std::align_val_t align)
+{
+    return allocNew(bytes, static_cast<size_t>(align));
+}
+
+void* operator new(size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return allocNewNoThrow(bytes, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return allocNewNoThrow(bytes, static_cast<size_t>(align));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete(void* ptr, size_t bytes) noexcept
+{
+    Memory::GlobalAllocator::free(ptr, bytes != 0 ? bytes : 1);
+}
+
+void operator delete[](void* ptr, size_t bytes) noexcept
+{
+    Memory::GlobalAllocator::free(ptr, bytes != 0 ? bytes : 1);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    Memory::GlobalAllocator::free(ptr);
+}
+
+void operator delete(void* ptr, size_t bytes, std::align_val_t) noexcept
+{
+    Memory::GlobalAllocator::free(ptr, bytes != 0 ? bytes : 1);
+}
+
+void operator delete[](void* ptr, size_t bytes, std::align_val_t) noexcept
+{
+    Memory::GlobalAllocator::free(ptr, bytes != 0 ? bytes : 1);
+}
+
+#endif /* SHARED_MEMORY_OVERRIDE_NEW */
+
+#if defined(SHARED_MEMORY_OVERRIDE_MALLOC) && defined(PLATFORM_OS_LINUX)
+
+/*
+    Replaced C allocation functions
+*/
+
+namespace
+{
+    inline bool isValidAlignment(size_t align) noexcept
+    {
+        return align != 0 && (align & (align - 1)) == 0;
+    }
+
+    void* allocC(size_t bytes, size_t align) noexcept
+    {
+        void* ptr = nullptr;
+        try
+        {
+            ptr = Memory::GlobalAllocator::alloc(bytes != 0 ? bytes : 1, align);
+        }
+        catch (...)
+        {
+        }
+
+        if (ptr == nullptr)
+            errno = ENOMEM;
+        return ptr;
+    }
+}
+
+extern "C"
+{
+    void* malloc(size_t bytes) noexcept
+    {
+        return allocC(bytes, alignof(max_align_t));
+    }
+
+    void free(void* ptr) noexcept
+    {
+        Memory::GlobalAllocator::free(ptr);
+    }
+
+    void* calloc(size_t count, size_t bytes) noexcept
+    {
+        if (bytes != 0 && count > std::numeric_limits<size_t>::max() / bytes)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        // Freed blocks are reused, the memory isn't known to be zero
+        void* ptr = allocC(count * bytes, alignof(max_align_t));
+        if (ptr != nullptr)
+            std::memset(ptr, 0, count * bytes);
+        return ptr;
+    }
+
+    void* realloc(void* ptr, size_t bytes) noexcept
+    {
+        if (ptr == nullptr)
+            return allocC(bytes, alignof(max_align_t));
+
+        if (bytes == 0)
+        {
+            Memory::GlobalAllocator::free(ptr);
+            return nullptr;
+        }
+
+        void* ret = nullptr;
+        try
+        {
+            ret = Memory::GlobalAllocator::realloc(ptr, bytes);
+        }
+        catch (...)
+        {
+        }
+
+        if (ret == nullptr)
+            errno = ENOMEM;
+        return ret;
+    }
+
+    int posix_memalign(void** out, size_t align, size_t bytes) noexcept
+    {
+        if (!isValidAlignment(align) || align % sizeof(void*) != 0)
+            return EINVAL;
+
+        void* ptr = allocC(bytes, align);
+        if (ptr == nullptr)
+            return ENOMEM;
+
+        *out = ptr;
+        return 0;
+    }
+
+    void* aligned_alloc(size_t align, size_t bytes) noexcept
+    {
+        if (!isValidAlignment(align))
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return allocC(bytes, align);
+    }
+
+    void* memalign(size_t align, size_t bytes) noexcept
+    {
+        if (!isValidAlignment(align))
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return allocC(bytes, align);
+    }
+
+    void* valloc(size_t bytes) noexcept
+    {
+        return allocC(bytes, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    }
+
+    void* pvalloc(size_t bytes) noexcept
+    {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        if (bytes > std::numeric_limits<size_t>::max() - page)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        return allocC((bytes + page - 1) & ~(page - 1), page);
+    }
+
+    size_t malloc_usable_size(void* ptr) noexcept
+    {
+        return ptr != nullptr ? Memory::GlobalAllocator::getAllocSize(ptr) : 0;
+    }
+}
+
+#endif /* SHARED_MEMORY_OVERRIDE_MALLOC */
@@ -0,0 +1,776 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/GuardedAllocator.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Memory
+{
+    namespace
+    {
+        // Mixed with the address of the header, so stale and foreign data doesn't pass as a header
+        constexpr uint64_t HeaderMagic = 0x6A09E667F3BCC908ull;
+        constexpr uint64_t TagMagic = 0xBB67AE8584CAA73Bull;
+
+        // The address of the header, mixed with TagMagic, is stored in a word right before the user pointer
+        constexpr size_t TagSize = sizeof(uint64_t);
+
+        // Errors collected by verify while the allocator is locked, reported once it's unlocked
+        constexpr size_t VerifyReportLimit = 32;
+
+        enum BlockState : uint32_t
+        {
+            StateLive = 1,
+            StateQuarantined
+        };
+
+        // First byte in a range differing from the fill value, nullptr if there is none
+        inline const char* findCorruption(const char* begin, const char* end, uint8_t value) noexcept
+        {
+            uint64_t pattern = value * 0x0101010101010101ull;
+            while (begin < end && (reinterpret_cast<uintptr_t>(begin) & (sizeof(uint64_t) - 1)) != 0)
+            {
+                if (static_cast<uint8_t>(*begin) != value)
+                    return begin;
+                ++begin;
+            }
+
+            while (static_cast<size_t>(end - begin) >= sizeof(uint64_t))
+            {
+                uint64_t word;
+                std::memcpy(&word, begin, sizeof(word));
+                if (word != pattern)
+                    break;
+                begin += sizeof(uint64_t);
+            }
+
+            for (; begin < end; ++begin)
+            {
+                if (static_cast<uint8_t>(*begin) != value)
+                    return begin;
+            }
+            return nullptr;
+        }
+
+        inline void fill(char* begin, char* end, uint8_t value) noexcept
+        {
+            if (begin < end)
+                std::memset(begin, value, static_cast<size_t>(end - begin));
+        }
+
+        inline char* alignUp(char* ptr, size_t align) noexcept
+        {
+            return ptr + BasicAllocator::getAlignedOffset(ptr, align);
+        }
+
+        inline uint64_t getTag(const char* user) noexcept
+        {
+            uint64_t tag;
+            std::memcpy(&tag, user - TagSize, sizeof(tag));
+            return tag;
+        }
+
+        inline void setTag(char* user, uint64_t tag) noexcept
+        {
+            std::memcpy(user - TagSize, &tag, sizeof(tag));
+        }
+
+        // First byte of a block's tag differing from the expected one, nullptr if the tag is intact
+        template<class Block>
+        inline const char* findTagCorruption(const Block* block) noexcept
+        {
+            uint64_t tag = TagMagic ^ reinterpret_cast<uintptr_t>(block);
+            const char* stored = block->user - TagSize;
+            const char* expected = reinterpret_cast<const char*>(&tag);
+            for (size_t i = 0; i < TagSize; ++i)
+            {
+                if (stored[i] != expected[i])
+                    return stored + i;
+            }
+            return nullptr;
+        }
+
+        template<class Block>
+        inline Block* findUser(Block* list, const char* user) noexcept
+        {
+            while (list != nullptr && list->user != user)
+                list = list->next;
+            return list;
+        }
+
+        template<class Block>
+        inline void linkBlock(Block*& head, Block* block) noexcept
+        {
+            block->prev = nullptr;
+            block->next = head;
+            if (head != nullptr)
+                head->prev = block;
+            head = block;
+        }
+
+        template<class Block>
+        inline void unlinkBlock(Block*& head, Block* block) noexcept
+        {
+            if (block->prev != nullptr)
+                block->prev->next = block->next;
+            else
+                head = block->next;
+            if (block->next != nullptr)
+                block->next->prev = block->prev;
+        }
+
+        void reportDefault(const GuardedAllocator::Error& error, void* user)
+        {
+            (void)user;
+            std::fprintf(stderr, "GuardedAllocator: %s at %p, block %p of %zu bytes\n", GuardedAllocator::getErrorName(error.type), error.address, error.ptr, error.size);
+            std::abort();
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Header at the start of every sampled block's region
+    struct alignas(alignof(max_align_t)) GuardedAllocator::Block
+    {
+        uint64_t magic; // HeaderMagic mixed with the address of the header, cleared once released
+        Block* prev; // Links in the live list or the quarantine
+        Block* next;
+        char* user;
+        size_t size; // Requested bytes
+        size_t footprint; // Bytes taken from the guarded region
+        char* front; // Start of the front redzone, which ends at the tag before the user pointer
+        char* tail; // End of the tail redzone, which starts right after the requested bytes
+        char* guard; // Inaccessible page after the block, nullptr without one
+        char* locked; // First page of the block made inaccessible while quarantined, nullptr if none
+        uint32_t state;
+    };
+
+    /*
+        GuardedAllocator definitions
+    */
+
+    GuardedAllocator::GuardedAllocator(BasicAllocator* backing, uint32_t options, uint32_t sample_rate, size_t quarantine_bytes) :
+        m_basic_backing(backing),
+        m_object_backing(nullptr),
+        m_options(options),
+        m_sample_mask(0),
+        m_quarantine_limit(quarantine_bytes),
+        m_handler(nullptr),
+        m_handler_user(nullptr),
+        m_guarded(ReserveBytes),
+        m_live(nullptr),
+        m_quarantine_head(nullptr),
+        m_quarantine_tail(nullptr),
+        m_quarantined(0),
+        m_sampled(0),
+        m_errors(0)
+    {
+        uint32_t rate = 1;
+        while (rate < sample_rate && rate < (uint32_t(1) << 31))
+            rate <<= 1;
+        this->m_sample_mask = rate - 1;
+    }
+
+    GuardedAllocator::GuardedAllocator(ObjectAllocator* backing, uint32_t options, uint32_t sample_rate, size_t quarantine_bytes) :
+        GuardedAllocator(static_cast<BasicAllocator*>(backing), options, sample_rate, quarantine_bytes)
+    {
+        this->m_object_backing = backing;
+    }
+
+    GuardedAllocator::~GuardedAllocator()
+    {
+        this->flushQuarantine();
+    }
+
+    void GuardedAllocator::setErrorHandler(ErrorHandler handler, void* user) noexcept
+    {
+        this->m_handler = handler;
+        this->m_handler_user = user;
+    }
+
+    size_t GuardedAllocator::verify()
+    {
+        Error errors[VerifyReportLimit];
+        size_t found = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            for (Block* block = this->m_live; block != nullptr; block = block->next)
+            {
+                const char* front = findCorruption(block->front, block->user - TagSize, CanaryByte);
+                if (front == nullptr)
+                    front = findTagCorruption(block);
+                if (front != nullptr)
+                {
+                    if (found < VerifyReportLimit)
+                        errors[found] = Error{ Underflow, block->user, block->size, front };
+                    ++found;
+                }
+
+                const char* tail = findCorruption(block->user + block->size, block->tail, CanaryByte);
+                if (tail != nullptr)
+                {
+                    if (found < VerifyReportLimit)
+                        errors[found] = Error{ Overflow, block->user, block->size, tail };
+                    ++found;
+                }
+            }
+        }
+
+        // Errors past the limit are only counted
+        this->m_errors.fetch_add(found > VerifyReportLimit ? found - VerifyReportLimit : 0, std::memory_order_relaxed);
+        for (size_t i = 0; i < found && i < VerifyReportLimit; ++i)
+            this->report(errors[i].type, errors[i].ptr, errors[i].size, errors[i].address);
+
+        return found;
+    }
+
+    void GuardedAllocator::flushQuarantine()
+    {
+        Block* evicted;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            evicted = this->evict(0);
+        }
+        this->releaseEvicted(evicted);
+    }
+
+    bool GuardedAllocator::isSampled(const void* ptr) const noexcept
+    {
+        return this->m_guarded.contains(ptr);
+    }
+
+    uint64_t GuardedAllocator::getSampledCount() const noexcept
+    {
+        return this->m_sampled.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GuardedAllocator::getErrorCount() const noexcept
+    {
+        return this->m_errors.load(std::memory_order_relaxed);
+    }
+
+    size_t GuardedAllocator::getQuarantinedBytes() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_quarantined;
+    }
+
+    BasicAllocator* GuardedAllocator::getBacking() const noexcept
+    {
+        return this->m_basic_backing;
+    }
+
+    const char* GuardedAllocator::getErrorName(ErrorType type) noexcept
+    {
+        switch (type)
+        {
+        case InvalidFree:
+            return "invalid free";
+        case DoubleFree:
+            return "double free";
+        case Underflow:
+            return "buffer underflow";
+        case Overflow:
+            return "buffer overflow";
+        case UseAfterFree:
+            return "use after free";
+        }
+        return "unknown error";
+    }
+
+    bool GuardedAllocator::shouldSample() const noexcept
+    {
+        // Shared by every instance, like the timing samples of AllocatorStatistic
+        thread_local uint32_t calls = 0;
+        return (++calls & this->m_sample_mask) == 0;
+    }
+
+    void* GuardedAllocator::allocSampled(size_t bytes, size_t align)
+    {
+        if (align < alignof(max_align_t))
+            align = alignof(max_align_t);
+
+        size_t page = SystemMemory::getPageSize();
+        if ((align & (align - 1)) != 0 || align > page || bytes > this->m_guarded.getReservedBytes())
+            return nullptr;
+
+        char* base;
+        char* user;
+        char* tail;
+        char* guard = nullptr;
+        size_t footprint;
+
+        if ((this->m_options & GuardPages) != 0 && bytes >= GuardPageMinSize)
+        {
+            // The block ends at the guard page, as close as the alignment allows
+            size_t data = SystemMemory::roundToPages(sizeof(Block) + TagSize + align - 1 + bytes);
+            footprint = data + page;
+
+            base = reinterpret_cast<char*>(this->m_guarded.alloc(footprint, page));
+            if (base == nullptr)
+                return nullptr;
+
+            guard = base + data;
+            if (!SystemMemory::protect(guard, page))
+            {
+                this->m_guarded.free(base);
+                return nullptr;
+            }
+
+            user = guard - bytes;
+            user -= reinterpret_cast<uintptr_t>(user) & (align - 1);
+            tail = guard;
+        }
+        else
+        {
+            size_t redzone = (this->m_options & Redzones) != 0 ? RedzoneSize : 0;
+            size_t offset = (sizeof(Block) + TagSize + redzone + align - 1) & ~(align - 1);
+            footprint = offset + bytes + redzone;
+
+            base = reinterpret_cast<char*>(this->m_guarded.alloc(footprint, align));
+            if (base == nullptr)
+                return nullptr;
+
+            user = base + offset;
+            tail = user + bytes + redzone;
+        }
+
+        Block* block = reinterpret_cast<Block*>(base);
+        block->magic = HeaderMagic ^ reinterpret_cast<uintptr_t>(block);
+        block->user = user;
+        block->size = bytes;
+        block->footprint = footprint;
+        block->front = base + sizeof(Block);
+        block->tail = tail;
+        block->guard = guard;
+        block->locked = nullptr;
+        block->state = StateLive;
+
+        // Alignment padding is part of the redzones
+        fill(block->front, user - TagSize, CanaryByte);
+        fill(user + bytes, tail, CanaryByte);
+        setTag(user, TagMagic ^ reinterpret_cast<uintptr_t>(block));
+
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            linkBlock(this->m_live, block);
+        }
+        this->m_sampled.fetch_add(1, std::memory_order_relaxed);
+
+        return user;
+    }
+
+    GuardedAllocator::Block* GuardedAllocator::getBlock(void* ptr)
+    {
+        char* user = reinterpret_cast<char*>(ptr);
+        Block* block = reinterpret_cast<Block*>(static_cast<uintptr_t>(getTag(user) ^ TagMagic));
+
+        // The header must precede the block inside the guarded region, and point back to it
+        bool valid = this->m_guarded.contains(block) && reinterpret_cast<char*>(block + 1) <= user - TagSize && BasicAllocator::getAlignedOffset(block, alignof(Block)) == 0;
+        if (valid)
+            valid = block->magic == (HeaderMagic ^ reinterpret_cast<uintptr_t>(block)) && block->user == user;
+
+        if (valid)
+            return block;
+
+        // An underflow may have hit the tag only, the lists tell whether the block exists
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            block = findUser(this->m_live, user);
+            if (block == nullptr)
+                block = findUser(this->m_quarantine_head, user);
+        }
+
+        if (block == nullptr)
+        {
+            this->report(InvalidFree, ptr, 0, ptr);
+            return nullptr;
+        }
+
+        this->report(Underflow, ptr, block->size, findTagCorruption(block));
+        setTag(user, TagMagic ^ reinterpret_cast<uintptr_t>(block));
+        return block;
+    }
+
+    size_t GuardedAllocator::checkRedzones(const Block* block)
+    {
+        size_t found = 0;
+
+        // A corrupted tag got reported by getBlock already
+        const char* front = findCorruption(block->front, block->user - TagSize, CanaryByte);
+        if (front != nullptr)
+        {
+            this->report(Underflow, block->user, block->size, front);
+            ++found;
+        }
+
+        const char* tail = findCorruption(block->user + block->size, block->tail, CanaryByte);
+        if (tail != nullptr)
+        {
+            this->report(Overflow, block->user, block->size, tail);
+            ++found;
+        }
+
+        return found;
+    }
+
+    void GuardedAllocator::freeSampled(void* ptr)
+    {
+        Block* block = this->getBlock(ptr);
+        if (block == nullptr)
+            return;
+
+        if (block->state == StateQuarantined)
+        {
+            this->report(DoubleFree, ptr, block->size, ptr);
+            return;
+        }
+
+        this->checkRedzones(block);
+
+        if ((this->m_options & Quarantine) == 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                unlinkBlock(this->m_live, block);
+            }
+            this->release(block);
+            return;
+        }
+
+        // Whole pages of the block fault on access, the rest is filled
+        char* end = block->user + block->size;
+        if (block->guard != nullptr)
+        {
+            char* locked = alignUp(block->user, SystemMemory::getPageSize());
+            if (locked < block->guard && SystemMemory::protect(locked, static_cast<size_t>(block->guard - locked)))
+            {
+                block->locked = locked;
+                end = locked;
+            }
+        }
+        fill(block->user, end, FreedByte);
+
+        Block* evicted;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            unlinkBlock(this->m_live, block);
+
+            block->state = StateQuarantined;
+            block->prev = this->m_quarantine_tail;
+            block->next = nullptr;
+            if (this->m_quarantine_tail != nullptr)
+                this->m_quarantine_tail->next = block;
+            else
+                this->m_quarantine_head = block;
+            this->m_quarantine_tail = block;
+            this->m_quarantined += block->footprint;
+
+            evicted = this->evict(this->m_quarantine_limit);
+        }
+        this->releaseEvicted(evicted);
+    }
+
+    GuardedAllocator::Block* GuardedAllocator::evict(size_t limit)
+    {
+        Block* evicted = nullptr;
+        Block* last = nullptr;
+        while (this->m_quarantine_head != nullptr && this->m_quarantined > limit)
+        {
+            Block* block = this->m_quarantine_head;
+            this->m_quarantine_head = block->next;
+            this->m_quarantined -= block->footprint;
+
+            block->next = nullptr;
+            if (last != nullptr)
+                last->next = block;
+            else
+                evicted = block;
+            last = block;
+        }
+
+        if (this->m_quarantine_head != nullptr)
+            this->m_quarantine_head->prev = nullptr;
+        else
+            this->m_quarantine_tail = nullptr;
+
+        return evicted;
+    }
+
+    void GuardedAllocator::releaseEvicted(Block* blocks)
+    {
+        while (blocks != nullptr)
+        {
+            Block* next = blocks->next;
+
+            char* end = blocks->locked != nullptr ? blocks->locked : blocks->user + blocks->size;
+            const char* corrupted = findCorruption(blocks->user, end, FreedByte);
+            if (corrupted != nullptr)
+                this->report(UseAfterFree, blocks->user, blocks->size, corrupted);
+
+            this->release(blocks);
+            blocks = next;
+        }
+    }
+
+    void GuardedAllocator::release(Block* block) noexcept
+    {
+        // The guarded region expects every page of a run to be accessible
+        if (block->locked != nullptr)
+            SystemMemory::commit(block->locked, static_cast<size_t>(block->guard - block->locked));
+        if (block->guard != nullptr)
+            SystemMemory::commit(block->guard, SystemMemory::getPageSize());
+
+        // Later frees of the same pointer fail the header check
+        setTag(block->user, 0);
+        block->magic = 0;
+
+        this->m_guarded.free(block);
+    }
+
+    void GuardedAllocator::releaseAll() noexcept
+    {
+        size_t page = SystemMemory::getPageSize();
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+
+        Block* lists[2] = { this->m_live, this->m_quarantine_head };
+        for (Block* block : lists)
+        {
+            for (; block != nullptr; block = block->next)
+            {
+                if (block->locked != nullptr)
+                    SystemMemory::commit(block->locked, static_cast<size_t>(block->guard - block->locked));
+                if (block->guard != nullptr)
+                    SystemMemory::commit(block->guard, page);
+            }
+        }
+
+        this->m_live = nullptr;
+        this->m_quarantine_head = nullptr;
+        this->m_quarantine_tail = nullptr;
+        this->m_quarantined = 0;
+
+        this->m_guarded.reset();
+    }
+
+    void GuardedAllocator::report(ErrorType type, const void* ptr, size_t size, const void* address)
+    {
+        this->m_errors.fetch_add(1, std::memory_order_relaxed);
+
+        Error error{ type, ptr, size, address };
+        if (this->m_handler != nullptr)
+            this->m_handler(error, this->m_handler_user);
+        else
+            reportDefault(error, nullptr);
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* GuardedAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (this->shouldSample())
+        {
+            void* ret = this->allocSampled(bytes, align);
+            if (ret != nullptr)
+                return ret;
+        }
+
+        return this->m_basic_backing->alloc(bytes, align);
+    }
+
+    void* GuardedAllocator::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        return this->m_object_backing->alloc(bytes, destructor, align);
+    }
+
+    void GuardedAllocator::free(void* ptr)
+    {
+        if (this->isSampled(ptr))
+            this->freeSampled(ptr);
+        else
+            this->m_basic_backing->free(ptr);
+    }
+
+    void GuardedAllocator::free(void* ptr, size_t bytes)
+    {
+        if (this->isSampled(ptr))
+            this->freeSampled(ptr);
+        else
+            this->m_basic_backing->free(ptr, bytes);
+    }
+
+    void* GuardedAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        if (!this->isSampled(ptr))
+            return this->m_basic_backing->realloc(ptr, bytes, align);
+
+        // Sampled blocks always move, so the redzones get checked
+        size_t size = this->GuardedAllocator::getAllocSize(ptr);
+        void* ret = this->alloc(bytes, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, size < bytes ? size : bytes);
+        this->freeSampled(ptr);
+        return ret;
+    }
+
+    void* GuardedAllocator::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr || this->isSampled(ptr))
+            return this->GuardedAllocator::realloc(ptr, bytes, align);
+
+        return this->m_basic_backing->reallocSized(ptr, old_bytes, bytes, align);
+    }
+
+    void* GuardedAllocator::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (!this->isSampled(ptr))
+            return this->m_object_backing->realloc(ptr, bytes, destructor, align);
+
+        // Allocations with a destructor are never sampled
+        size_t size = this->GuardedAllocator::getAllocSize(ptr);
+        void* ret = this->m_object_backing->alloc(bytes, destructor, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, size < bytes ? size : bytes);
+        this->freeSampled(ptr);
+        return ret;
+    }
+
+    size_t GuardedAllocator::getAllocSize(const void* ptr) const
+    {
+        if (!this->isSampled(ptr))
+            return this->m_basic_backing->getAllocSize(ptr);
+
+        const char* user = reinterpret_cast<const char*>(ptr);
+        return reinterpret_cast<const Block*>(static_cast<uintptr_t>(getTag(user) ^ TagMagic))->size;
+    }
+
+    bool GuardedAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (!this->isSampled(ptr))
+            return this->m_basic_backing->tryExpand(ptr, bytes);
+
+        return bytes <= this->GuardedAllocator::getAllocSize(ptr);
+    }
+
+    bool GuardedAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (!this->isSampled(ptr))
+            return this->m_basic_backing->tryShrink(ptr, bytes);
+
+        char* user = reinterpret_cast<char*>(ptr);
+        Block* block = reinterpret_cast<Block*>(static_cast<uintptr_t>(getTag(user) ^ TagMagic));
+
+        // The released tail becomes part of the tail redzone
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        if (bytes > block->size)
+            return false;
+
+        fill(user + bytes, user + block->size, CanaryByte);
+        block->size = bytes;
+        return true;
+    }
+
+    size_t GuardedAllocator::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        return this->m_basic_backing->allocBulk(bytes, count, out, align);
+    }
+
+    void GuardedAllocator::freeBulk(void** ptrs, size_t count)
+    {
+        // Runs of unsampled blocks are forwarded in bulk
+        size_t start = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!this->isSampled(ptrs[i]))
+                continue;
+
+            if (i > start)
+                this->m_basic_backing->freeBulk(ptrs + start, i - start);
+            this->freeSampled(ptrs[i]);
+            start = i + 1;
+        }
+
+        if (count > start)
+            this->m_basic_backing->freeBulk(ptrs + start, count - start);
+    }
+
+    void* GuardedAllocator::offer(void* ptr, uint32_t priority)
+    {
+        // Sampled blocks are their own offer pointers, and are never purged
+        if (this->isSampled(ptr))
+            return ptr;
+
+        return this->m_object_backing->offer(ptr, priority);
+    }
+
+    void* GuardedAllocator::reclaim(void* ptr)
+    {
+        if (this->isSampled(ptr))
+            return ptr;
+
+        return this->m_object_backing->reclaim(ptr);
+    }
+
+    void GuardedAllocator::reset()
+    {
+        this->releaseAll();
+        this->m_basic_backing->reset();
+    }
+
+    void GuardedAllocator::purge(uint32_t priority)
+    {
+        this->m_object_backing->purge(priority);
+
+        this->flushQuarantine();
+        this->m_guarded.decommit();
+    }
+
+    void GuardedAllocator::clear()
+    {
+        this->m_object_backing->clear();
+        this->releaseAll();
+    }
+
+    size_t GuardedAllocator::getFreeBytes() const
+    {
+        return this->m_basic_backing->getFreeBytes() + this->m_guarded.getFreeBytes();
+    }
+
+    size_t GuardedAllocator::getUsedBytes() const
+    {
+        return this->m_basic_backing->getUsedBytes() + this->m_guarded.getUsedBytes();
+    }
+
+    size_t GuardedAllocator::getPendingBytes() const
+    {
+        return this->m_object_backing->getPendingBytes();
+    }
+
+    size_t GuardedAllocator::getTotalBytes() const
+    {
+        return this->m_basic_backing->getTotalBytes() + this->m_guarded.getTotalBytes();
+    }
+
+    bool GuardedAllocator::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        return this->m_basic_backing->getFreeCounts(local, remote);
+    }
+}
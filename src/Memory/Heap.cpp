@@ -0,0 +1,749 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/Heap.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include "DestructorBatch.hpp"
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    namespace
+    {
+        constexpr size_t HeaderAlign = alignof(max_align_t);
+        constexpr size_t MinSpanBytes = 64 * 1024; // Smallest span obtained for a size class
+        constexpr size_t MinSpanBlocks = 8; // Least amount of blocks a span must hold
+        constexpr size_t MaxClassSize = 32 * 1024; // Largest block served from a size class
+        constexpr uint8_t LargeClass = 0xFF; // Size class marker of individually mapped blocks
+        constexpr size_t LargeCacheCount = 8; // Most freed large mappings kept for reuse
+        constexpr size_t LargeCacheBytes = 32 * 1024 * 1024; // Most bytes of freed large mappings kept for reuse
+
+        enum BlockState : uint8_t
+        {
+            StateFree = 0,
+            StateUsed,
+            StateOffered,
+            StateTicket
+        };
+
+        // Blocks up to 128 bytes are spaced by 16 bytes, each power of two above is split in 4 classes
+        constexpr size_t getClassSize(size_t index) noexcept
+        {
+            if (index < 8)
+            {
+                return (index + 1) * 16;
+            }
+            size_t exponent = 7 + (index - 8) / 4;
+            size_t sub = (index - 8) % 4;
+            return (size_t(1) << exponent) + (sub + 1) * (size_t(1) << (exponent - 2));
+        }
+
+        inline size_t getClassIndex(size_t bytes) noexcept
+        {
+            if (bytes <= 128)
+            {
+                return bytes == 0 ? 0 : (bytes + 15) / 16 - 1;
+            }
+            size_t exponent = Util::getBitWidth(bytes - 1) - 1;
+            size_t step = size_t(1) << (exponent - 2);
+            size_t sub = (bytes - (size_t(1) << exponent) + step - 1) / step - 1;
+            return 8 + (exponent - 7) * 4 + sub;
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Header preceding every block, a copy holding only the offset precedes over aligned user pointers
+    struct alignas(alignof(max_align_t)) Heap::BlockHeader
+    {
+        union
+        {
+            DestructorPtr destructor; // Destructor of used and offered blocks
+            BlockHeader* next_free; // Next block on the free list of free blocks
+        };
+        uint32_t offset; // Distance of the user pointer from the header
+        uint8_t size_class; // Size class index, or LargeClass
+        uint8_t state; // One of BlockState
+    };
+
+    // Span of equally sized blocks, the blocks follow the structure
+    struct alignas(alignof(max_align_t)) Heap::Span
+    {
+        Span* next;
+        size_t bytes; // Size of the whole mapping
+        uint32_t size_class;
+        uint32_t stride; // Size of a single block
+        uint32_t carved; // Blocks handed out at least once
+        uint32_t capacity; // Total blocks fitting the span
+    };
+
+    // Mapping of a single large block, the block header follows the structure
+    struct alignas(alignof(max_align_t)) Heap::LargeHeader
+    {
+        LargeHeader* prev;
+        LargeHeader* next;
+        size_t bytes; // Size of the whole mapping
+    };
+
+    // Payload of the unique pointer returned by offer
+    struct Heap::Ticket
+    {
+        OfferList::Node node; // Must be the first member, tickets are cast from nodes
+        BlockHeader* block; // The offered block, nullptr once purged
+    };
+
+    namespace
+    {
+        template<class Header>
+        inline Header* getHeader(const void* ptr) noexcept
+        {
+            const Header* user_header = reinterpret_cast<const Header*>(ptr) - 1;
+            return reinterpret_cast<Header*>(const_cast<char*>(reinterpret_cast<const char*>(ptr)) - user_header->offset);
+        }
+
+        template<class Header>
+        inline void* getUserPtr(Header* header) noexcept
+        {
+            return reinterpret_cast<char*>(header) + header->offset;
+        }
+
+        template<class Header, class Large>
+        inline size_t getUsableSize(Header* header) noexcept
+        {
+            if (header->size_class == LargeClass)
+            {
+                const Large* large = reinterpret_cast<const Large*>(header) - 1;
+                return large->bytes - sizeof(Large) - header->offset;
+            }
+            return getClassSize(header->size_class) - header->offset;
+        }
+    }
+
+    /*
+        Heap definitions
+    */
+
+    Heap::Heap() :
+        m_free(),
+        m_current(),
+        m_spans(nullptr),
+        m_large(nullptr),
+        m_cache(nullptr),
+        m_cached_count(0),
+        m_cached_bytes(0),
+        m_offers(),
+        m_total(0),
+        m_used(0),
+        m_pending(0),
+        m_destructible(0),
+        m_clearing(false)
+    {
+        static_assert(getClassSize(ClassCount - 1) == MaxClassSize, "Size class table mismatch");
+    }
+
+    Heap::~Heap()
+    {
+        this->clear();
+    }
+
+    void* Heap::allocBlock(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < HeaderAlign)
+            align = HeaderAlign;
+
+        size_t padding = align - HeaderAlign;
+        if (bytes > std::numeric_limits<size_t>::max() / 2 - padding)
+            return nullptr;
+
+        size_t needed = sizeof(BlockHeader) + padding + bytes;
+        char* base;
+        uint8_t size_class;
+
+        if (needed <= MaxClassSize)
+        {
+            size_class = static_cast<uint8_t>(getClassIndex(needed));
+
+            BlockHeader* block = this->m_free[size_class];
+            if (block != nullptr)
+            {
+                this->m_free[size_class] = block->next_free;
+                base = reinterpret_cast<char*>(block);
+            }
+            else
+            {
+                Span* span = this->m_current[size_class];
+                if (span == nullptr || span->carved == span->capacity)
+                {
+                    span = this->newSpan(size_class);
+                    if (span == nullptr)
+                        return nullptr;
+                }
+                base = reinterpret_cast<char*>(span + 1) + static_cast<size_t>(span->carved++) * span->stride;
+            }
+
+            this->m_used += getClassSize(size_class);
+        }
+        else
+        {
+            size_t mapped = SystemMemory::roundToPages(sizeof(LargeHeader) + needed);
+            LargeHeader* large = this->takeCached(mapped);
+            if (large == nullptr)
+            {
+                large = reinterpret_cast<LargeHeader*>(SystemMemory::map(mapped));
+                if (large == nullptr)
+                    return nullptr;
+                large->bytes = mapped;
+                this->m_total += mapped;
+            }
+
+            large->prev = nullptr;
+            large->next = this->m_large;
+            if (this->m_large != nullptr)
+                this->m_large->prev = large;
+            this->m_large = large;
+
+            this->m_used += large->bytes;
+
+            size_class = LargeClass;
+            base = reinterpret_cast<char*>(large + 1);
+        }
+
+        char* user = reinterpret_cast<char*>(getAlignedPtr(base + sizeof(BlockHeader), align));
+
+        BlockHeader* header = reinterpret_cast<BlockHeader*>(base);
+        header->destructor = destructor;
+        if (destructor != nullptr)
+            ++this->m_destructible;
+        header->offset = static_cast<uint32_t>(user - base);
+        header->size_class = size_class;
+        header->state = StateUsed;
+
+        if (header->offset != sizeof(BlockHeader))
+        {
+            BlockHeader* user_header = reinterpret_cast<BlockHeader*>(user) - 1;
+            user_header->destructor = nullptr;
+            user_header->offset = header->offset;
+            user_header->size_class = size_class;
+            user_header->state = StateUsed;
+        }
+
+        return user;
+    }
+
+    Heap::Span* Heap::newSpan(size_t size_class)
+    {
+        size_t stride = getClassSize(size_class);
+        size_t bytes = SystemMemory::roundToPages(sizeof(Span) + stride * MinSpanBlocks);
+        if (bytes < MinSpanBytes)
+            bytes = MinSpanBytes;
+
+        Span* span = reinterpret_cast<Span*>(SystemMemory::map(bytes));
+        if (span == nullptr)
+            return nullptr;
+
+        span->next = this->m_spans;
+        span->bytes = bytes;
+        span->size_class = static_cast<uint32_t>(size_class);
+        span->stride = static_cast<uint32_t>(stride);
+        span->carved = 0;
+        span->capacity = static_cast<uint32_t>((bytes - sizeof(Span)) / stride);
+
+        this->m_spans = span;
+        this->m_current[size_class] = span;
+        this->m_total += bytes;
+
+        return span;
+    }
+
+    void Heap::releaseBlock(BlockHeader* header)
+    {
+        if (header->size_class == LargeClass)
+        {
+            LargeHeader* large = reinterpret_cast<LargeHeader*>(header) - 1;
+
+            if (large->prev != nullptr)
+                large->prev->next = large->next;
+            else
+                this->m_large = large->next;
+            if (large->next != nullptr)
+                large->next->prev = large->prev;
+
+            this->m_used -= large->bytes;
+            this->cacheLarge(large);
+        }
+        else
+        {
+            header->state = StateFree;
+            header->next_free = this->m_free[header->size_class];
+            this->m_free[header->size_class] = header;
+            this->m_used -= getClassSize(header->size_class);
+        }
+    }
+
+    void Heap::destroyBlock(BlockHeader* header)
+    {
+        DestructorPtr destructor = header->destructor;
+        if (destructor != nullptr)
+        {
+            header->destructor = nullptr;
+            --this->m_destructible;
+            destructor(getUserPtr(header));
+        }
+        this->releaseBlock(header);
+    }
+
+    void* Heap::reallocBlock(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < HeaderAlign)
+            align = HeaderAlign;
+
+        BlockHeader* header = getHeader<BlockHeader>(ptr);
+        size_t usable = getUsableSize<BlockHeader, LargeHeader>(header);
+
+        // Keep the block if it fits, unless a large block would waste more than half of its mapping
+        if (getAlignedOffset(ptr, align) == 0 && bytes <= usable && (header->size_class != LargeClass || bytes >= usable / 2))
+        {
+            if (header->destructor != nullptr)
+                --this->m_destructible;
+            if (destructor != nullptr)
+                ++this->m_destructible;
+            header->destructor = destructor;
+            return ptr;
+        }
+
+        // Large blocks staying large are remapped, page aligned mappings keep the user pointer's alignment up to the page size
+        if (header->size_class == LargeClass && getAlignedOffset(ptr, align) == 0 && align <= SystemMemory::getPageSize())
+        {
+            void* ret = this->remapBlock(header, bytes, destructor);
+            if (ret != nullptr)
+                return ret;
+        }
+
+        void* ret = this->allocBlock(bytes, destructor, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, usable < bytes ? usable : bytes);
+        if (header->destructor != nullptr)
+            --this->m_destructible;
+        this->releaseBlock(header);
+
+        return ret;
+    }
+
+    void* Heap::remapBlock(BlockHeader* header, size_t bytes, DestructorPtr destructor)
+    {
+        if (bytes > std::numeric_limits<size_t>::max() / 2 || header->offset + bytes <= MaxClassSize)
+            return nullptr;
+
+        LargeHeader* large = reinterpret_cast<LargeHeader*>(header) - 1;
+        size_t old_bytes = large->bytes;
+        size_t mapped = SystemMemory::roundToPages(sizeof(LargeHeader) + header->offset + bytes);
+
+        large = reinterpret_cast<LargeHeader*>(SystemMemory::remap(large, old_bytes, mapped));
+        if (large == nullptr)
+            return nullptr;
+
+        // The neighbours still point to the old address
+        if (large->prev != nullptr)
+            large->prev->next = large;
+        else
+            this->m_large = large;
+        if (large->next != nullptr)
+            large->next->prev = large;
+
+        large->bytes = mapped;
+        this->m_total = this->m_total - old_bytes + mapped;
+        this->m_used = this->m_used - old_bytes + mapped;
+
+        header = reinterpret_cast<BlockHeader*>(large + 1);
+        if (header->destructor != nullptr)
+            --this->m_destructible;
+        if (destructor != nullptr)
+            ++this->m_destructible;
+        header->destructor = destructor;
+
+        return getUserPtr(header);
+    }
+
+    // Best fit among the cached mappings, wasting at most a quarter of the requested size
+    Heap::LargeHeader* Heap::takeCached(size_t bytes)
+    {
+        LargeHeader* best = nullptr;
+        for (LargeHeader* large = this->m_cache; large != nullptr; large = large->next)
+        {
+            if (large->bytes >= bytes && large->bytes - bytes <= bytes / 4 && (best == nullptr || large->bytes < best->bytes))
+                best = large;
+        }
+        if (best == nullptr)
+            return nullptr;
+
+        if (best->prev != nullptr)
+            best->prev->next = best->next;
+        else
+            this->m_cache = best->next;
+        if (best->next != nullptr)
+            best->next->prev = best->prev;
+
+        --this->m_cached_count;
+        this->m_cached_bytes -= best->bytes;
+        return best;
+    }
+
+    // Keeps the mapping in the cache, evicting the least recently freed ones over the limits
+    void Heap::cacheLarge(LargeHeader* large)
+    {
+        if (large->bytes > LargeCacheBytes)
+        {
+            this->m_total -= large->bytes;
+            SystemMemory::unmap(large, large->bytes);
+            return;
+        }
+
+        large->prev = nullptr;
+        large->next = this->m_cache;
+        if (this->m_cache != nullptr)
+            this->m_cache->prev = large;
+        this->m_cache = large;
+        ++this->m_cached_count;
+        this->m_cached_bytes += large->bytes;
+
+        if (this->m_cached_count <= LargeCacheCount && this->m_cached_bytes <= LargeCacheBytes)
+            return;
+
+        LargeHeader* oldest = this->m_cache;
+        while (oldest->next != nullptr)
+            oldest = oldest->next;
+        while (this->m_cached_count > LargeCacheCount || this->m_cached_bytes > LargeCacheBytes)
+        {
+            LargeHeader* prev = oldest->prev;
+            prev->next = nullptr;
+            --this->m_cached_count;
+            this->m_cached_bytes -= oldest->bytes;
+            this->m_total -= oldest->bytes;
+            SystemMemory::unmap(oldest, oldest->bytes);
+            oldest = prev;
+        }
+    }
+
+    void Heap::releaseCache()
+    {
+        LargeHeader* large = this->m_cache;
+        while (large != nullptr)
+        {
+            LargeHeader* next = large->next;
+            this->m_total -= large->bytes;
+            SystemMemory::unmap(large, large->bytes);
+            large = next;
+        }
+
+        this->m_cache = nullptr;
+        this->m_cached_count = 0;
+        this->m_cached_bytes = 0;
+    }
+
+    void Heap::unlinkTicket(Ticket* ticket)
+    {
+        this->m_offers.remove(&ticket->node);
+        this->m_pending -= getUsableSize<BlockHeader, LargeHeader>(ticket->block);
+    }
+
+    void Heap::releaseAll()
+    {
+        Span* span = this->m_spans;
+        while (span != nullptr)
+        {
+            Span* next = span->next;
+            SystemMemory::unmap(span, span->bytes);
+            span = next;
+        }
+
+        LargeHeader* large = this->m_large;
+        while (large != nullptr)
+        {
+            LargeHeader* next = large->next;
+            SystemMemory::unmap(large, large->bytes);
+            large = next;
+        }
+        this->releaseCache();
+
+        for (size_t i = 0; i < ClassCount; ++i)
+        {
+            this->m_free[i] = nullptr;
+            this->m_current[i] = nullptr;
+        }
+        this->m_offers.clear();
+
+        this->m_spans = nullptr;
+        this->m_large = nullptr;
+        this->m_total = 0;
+        this->m_used = 0;
+        this->m_pending = 0;
+        this->m_destructible = 0;
+    }
+
+    /*
+        Overridden ObjectAllocator function definitions
+    */
+
+    void* Heap::alloc(size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocBlock(bytes, nullptr, align);
+    }
+
+    void* Heap::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocBlock(bytes, destructor, align);
+    }
+
+    void Heap::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->freeBlock(ptr);
+    }
+
+    void Heap::freeBlock(void* ptr)
+    {
+        BlockHeader* header = getHeader<BlockHeader>(ptr);
+
+        if (this->m_clearing)
+        {
+            // Memory is released in bulk once clear finishes, only run the destructor
+            if (header->state == StateUsed)
+            {
+                DestructorPtr destructor = header->destructor;
+                header->state = StateFree;
+                if (destructor != nullptr)
+                    destructor(ptr);
+            }
+            return;
+        }
+
+        if (header->state == StateTicket)
+        {
+            Ticket* ticket = reinterpret_cast<Ticket*>(ptr);
+            if (ticket->block != nullptr)
+            {
+                BlockHeader* block = ticket->block;
+                this->unlinkTicket(ticket);
+                ticket->block = nullptr;
+                this->destroyBlock(block);
+            }
+            this->releaseBlock(header);
+        }
+        else if (header->state == StateUsed)
+        {
+            this->destroyBlock(header);
+        }
+    }
+
+    void* Heap::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocBlock(bytes, nullptr, align);
+
+        return this->reallocBlock(ptr, bytes, getHeader<BlockHeader>(ptr)->destructor, align);
+    }
+
+    void* Heap::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocBlock(bytes, destructor, align);
+
+        return this->reallocBlock(ptr, bytes, destructor, align);
+    }
+
+    size_t Heap::getAllocSize(const void* ptr) const
+    {
+        return getUsableSize<BlockHeader, LargeHeader>(getHeader<BlockHeader>(ptr));
+    }
+
+    size_t Heap::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = this->allocBlock(bytes, nullptr, align);
+            if (out[i] == nullptr)
+                return i;
+        }
+        return count;
+    }
+
+    void Heap::freeBulk(void** ptrs, size_t count)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (ptrs[i] != nullptr)
+                this->freeBlock(ptrs[i]);
+        }
+    }
+
+    void* Heap::offer(void* ptr, uint32_t priority)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        BlockHeader* header = getHeader<BlockHeader>(ptr);
+
+        Ticket* ticket = reinterpret_cast<Ticket*>(this->allocBlock(sizeof(Ticket), nullptr, alignof(Ticket)));
+        if (ticket == nullptr)
+        {
+            // Without a ticket the block can't be tracked, deallocate it right away
+            this->destroyBlock(header);
+            return nullptr;
+        }
+        getHeader<BlockHeader>(ticket)->state = StateTicket;
+
+        header->state = StateOffered;
+
+        ticket->block = header;
+        this->m_offers.push(&ticket->node, priority);
+
+        this->m_pending += getUsableSize<BlockHeader, LargeHeader>(header);
+
+        return ticket;
+    }
+
+    void* Heap::reclaim(void* ptr)
+    {
+        if (ptr == nullptr)
+            return nullptr;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Ticket* ticket = reinterpret_cast<Ticket*>(ptr);
+        void* ret = nullptr;
+
+        if (ticket->block != nullptr)
+        {
+            BlockHeader* block = ticket->block;
+            this->unlinkTicket(ticket);
+            block->state = StateUsed;
+            ret = getUserPtr(block);
+        }
+        this->releaseBlock(getHeader<BlockHeader>(ticket));
+
+        return ret;
+    }
+
+    void Heap::reset()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->releaseAll();
+    }
+
+    void Heap::purge(uint32_t priority)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+
+        // Destructors may offer again, so the offers are checked again after every batch
+        while (this->m_offers.getOldest(priority) != nullptr)
+        {
+            // The unlinked blocks stay offered until destroyed, nothing else can free them meanwhile
+            auto destroy = [this](DestructorPtr, void* block)
+            {
+                this->destroyBlock(reinterpret_cast<BlockHeader*>(block));
+            };
+            DestructorBatch<decltype(destroy)> batch(destroy);
+
+            // Least important first, oldest first within a bucket. Blocks without a destructor are released right away
+            while (OfferList::Node* node = this->m_offers.getOldest(priority))
+            {
+                Ticket* ticket = reinterpret_cast<Ticket*>(node);
+                BlockHeader* block = ticket->block;
+                this->unlinkTicket(ticket);
+                ticket->block = nullptr;
+                if (block->destructor != nullptr)
+                    batch.add(block->destructor, block);
+                else
+                    this->releaseBlock(block);
+            }
+            batch.run();
+        }
+
+        if (priority == std::numeric_limits<uint32_t>::max())
+            this->releaseCache();
+    }
+
+    void Heap::clear()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->m_clearing = true;
+
+        // Without any destructor registered the blocks aren't even visited
+        if (this->m_destructible != 0)
+        {
+            auto destroy = [](DestructorPtr, void* block)
+            {
+                // Destructors earlier in the batch may have freed the block already
+                BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+                if (header->state == StateUsed || header->state == StateOffered)
+                {
+                    DestructorPtr destructor = header->destructor;
+                    header->state = StateFree;
+                    if (destructor != nullptr)
+                        destructor(getUserPtr(header));
+                }
+            };
+
+            DestructorBatch<decltype(destroy)> batch(destroy);
+
+            auto collect = [&batch](BlockHeader* header)
+            {
+                if ((header->state == StateUsed || header->state == StateOffered) && header->destructor != nullptr)
+                    batch.add(header->destructor, header);
+            };
+
+            for (Span* span = this->m_spans; span != nullptr; span = span->next)
+            {
+                char* block = reinterpret_cast<char*>(span + 1);
+                for (uint32_t i = 0; i < span->carved; ++i, block += span->stride)
+                    collect(reinterpret_cast<BlockHeader*>(block));
+            }
+
+            for (LargeHeader* large = this->m_large; large != nullptr; large = large->next)
+                collect(reinterpret_cast<BlockHeader*>(large + 1));
+
+            batch.run();
+        }
+
+        this->m_clearing = false;
+        this->releaseAll();
+    }
+
+    size_t Heap::getFreeBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_total - this->m_used;
+    }
+
+    size_t Heap::getUsedBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_used;
+    }
+
+    size_t Heap::getPendingBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_pending;
+    }
+
+    size_t Heap::getTotalBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_total;
+    }
+}
@@ -0,0 +1,655 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/HeapProfiler.hpp>
+
+#include <Shared/Platform/Target.hpp>
+#include <Shared/Platform/Compiler.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(PLATFORM_OS_WIN)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <Windows.h>
+#   define SHARED_PROFILER_BACKTRACE
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_OSX) || defined(PLATFORM_OS_BSD)
+#   include <execinfo.h>
+#   include <dlfcn.h>
+#   define SHARED_PROFILER_BACKTRACE
+#   define SHARED_PROFILER_DLADDR
+#endif
+
+#if defined(PLATFORM_COMPILER_GCC) || defined(PLATFORM_COMPILER_CLANG)
+#   include <cxxabi.h>
+#   include <cstdlib>
+#endif
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    struct HeapProfiler::Sample
+    {
+        size_t bytes; // Requested size
+        double weight; // Estimated bytes represented by the sample
+        const char* tag;
+        uint32_t depth;
+        void* frames[MaxFrames]; // Innermost first
+    };
+
+    struct alignas(PLATFORM_CACHE_LINE_SIZE) HeapProfiler::Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<const void*, Sample> samples;
+        std::atomic<size_t> count{ 0 }; // Lets frees skip empty shards without locking
+    };
+
+    namespace
+    {
+        // Per thread sampling state, shared by every profiler
+        struct SamplerState
+        {
+            int64_t countdown = 0; // Bytes left until the next sample
+            uint64_t random = 0; // xorshift64* state, 0 until initialized
+            bool busy = false; // Set while the profiler itself allocates
+            const char* tag = nullptr;
+        };
+
+        inline SamplerState& getState() noexcept
+        {
+            thread_local SamplerState state;
+            return state;
+        }
+
+        // Marks the calling thread busy, so the profiler's own allocations aren't sampled
+        class BusyScope
+        {
+        public:
+
+            BusyScope() noexcept :
+                m_state(getState()),
+                m_previous(m_state.busy)
+            {
+                this->m_state.busy = true;
+            }
+
+            ~BusyScope()
+            {
+                this->m_state.busy = this->m_previous;
+            }
+
+        private:
+
+            SamplerState& m_state;
+            bool m_previous;
+        };
+
+        inline uint64_t nextRandom(SamplerState& state) noexcept
+        {
+            if (state.random == 0)
+            {
+                uint64_t seed = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+                seed ^= static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&state));
+                state.random = seed != 0 ? seed : 0x9E3779B97F4A7C15ull;
+            }
+
+            state.random ^= state.random >> 12;
+            state.random ^= state.random << 25;
+            state.random ^= state.random >> 27;
+            return state.random * 0x2545F4914F6CDD1Dull;
+        }
+
+        // Exponentially distributed distance to the next sample, so samples form a Poisson process over the allocated bytes
+        inline int64_t nextDistance(SamplerState& state, size_t interval) noexcept
+        {
+            // Uniform in (0, 1]
+            double uniform = (static_cast<double>(nextRandom(state) >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+            double distance = -std::log(uniform) * static_cast<double>(interval);
+            if (distance < 1.0)
+                return 1;
+            if (distance > 9.0e18)
+                return std::numeric_limits<int64_t>::max();
+            return static_cast<int64_t>(distance);
+        }
+
+        // Estimated bytes a sample stands for, the inverse of its sampling probability times its size
+        inline double getWeight(size_t bytes, size_t interval) noexcept
+        {
+            if (interval == 0 || bytes == 0)
+                return static_cast<double>(bytes);
+            double probability = 1.0 - std::exp(-static_cast<double>(bytes) / static_cast<double>(interval));
+            return static_cast<double>(bytes) / probability;
+        }
+
+        // Room for the frames of the profiler itself
+        constexpr uint32_t MaxFrameBuffer = HeapProfiler::MaxFrames + 2;
+
+        inline uint32_t captureStack(void** frames, uint32_t max_frames) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            // Skip this function and the recording profiler call
+            return static_cast<uint32_t>(CaptureStackBackTrace(2, max_frames, frames, nullptr));
+#elif defined(SHARED_PROFILER_BACKTRACE)
+            void* buffer[MaxFrameBuffer];
+            int depth = backtrace(buffer, static_cast<int>(max_frames + 2 <= MaxFrameBuffer ? max_frames + 2 : MaxFrameBuffer));
+            uint32_t ret = 0;
+            for (int i = 2; i < depth && ret < max_frames; ++i)
+                frames[ret++] = buffer[i];
+            return ret;
+#else
+            (void)frames;
+            (void)max_frames;
+            return 0;
+#endif
+        }
+
+        std::string getSymbolName(void* address)
+        {
+#if defined(SHARED_PROFILER_DLADDR)
+            Dl_info info;
+            if (dladdr(address, &info) != 0 && info.dli_sname != nullptr)
+            {
+                std::string ret;
+#   if defined(PLATFORM_COMPILER_GCC) || defined(PLATFORM_COMPILER_CLANG)
+                int status = 0;
+                char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                if (demangled != nullptr)
+                {
+                    ret = demangled;
+                    std::free(demangled);
+                }
+                else
+#   endif
+                {
+                    ret = info.dli_sname;
+                }
+
+                // Semicolons separate the frames in the folded format
+                for (char& c : ret)
+                    if (c == ';')
+                        c = ':';
+                return ret;
+            }
+#endif
+            char buffer[2 + 2 * sizeof(uintptr_t) + 1];
+            std::snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(address)));
+            return buffer;
+        }
+    }
+
+    /*
+        HeapProfiler::TagScope definitions
+    */
+
+    HeapProfiler::TagScope::TagScope(const char* tag) noexcept :
+        m_previous(getState().tag)
+    {
+        getState().tag = tag;
+    }
+
+    HeapProfiler::TagScope::~TagScope()
+    {
+        getState().tag = this->m_previous;
+    }
+
+    /*
+        HeapProfiler definitions
+    */
+
+    HeapProfiler::HeapProfiler(BasicAllocator* backing, size_t sample_interval, uint32_t options) :
+        AllocatorStatistic(backing, options),
+        m_interval(sample_interval),
+        m_shards(nullptr)
+    {
+        BusyScope busy;
+        this->m_shards = new Shard[ShardCount];
+
+#if defined(SHARED_PROFILER_BACKTRACE) && !defined(PLATFORM_OS_WIN)
+        // The first backtrace call may load libraries and allocate, get it over with while the profiler can tolerate it
+        void* frame;
+        backtrace(&frame, 1);
+#endif
+    }
+
+    HeapProfiler::HeapProfiler(ObjectAllocator* backing, size_t sample_interval, uint32_t options) :
+        HeapProfiler(static_cast<BasicAllocator*>(backing), sample_interval, options)
+    {
+        this->m_object_backing = backing;
+    }
+
+    HeapProfiler::~HeapProfiler()
+    {
+        BusyScope busy;
+        delete[] this->m_shards;
+    }
+
+    const char* HeapProfiler::getTag() noexcept
+    {
+        return getState().tag;
+    }
+
+    size_t HeapProfiler::getSampleInterval() const noexcept
+    {
+        return this->m_interval;
+    }
+
+    HeapProfiler::Shard& HeapProfiler::getShard(const void* ptr) const noexcept
+    {
+        // Allocations are at least 16 bytes apart, mix the higher bits in
+        uintptr_t key = reinterpret_cast<uintptr_t>(ptr) >> 4;
+        key ^= key >> 7;
+        key ^= key >> 13;
+        return this->m_shards[key & (ShardCount - 1)];
+    }
+
+    bool HeapProfiler::shouldSample(size_t bytes) noexcept
+    {
+        SamplerState& state = getState();
+        if (state.busy)
+            return false;
+
+        if (this->m_interval == 0)
+            return true;
+
+        if (state.random == 0)
+            state.countdown = nextDistance(state, this->m_interval);
+
+        int64_t size = bytes < static_cast<size_t>(std::numeric_limits<int64_t>::max()) ? static_cast<int64_t>(bytes) : std::numeric_limits<int64_t>::max();
+        if (state.countdown > size)
+        {
+            state.countdown -= size;
+            return false;
+        }
+
+        state.countdown = nextDistance(state, this->m_interval);
+        return true;
+    }
+
+    void HeapProfiler::recordSample(void* ptr, size_t bytes)
+    {
+        BusyScope busy;
+
+        Sample sample;
+        sample.bytes = bytes;
+        sample.weight = getWeight(bytes, this->m_interval);
+        sample.tag = getState().tag;
+        sample.depth = captureStack(sample.frames, MaxFrames);
+
+        Shard& shard = this->getShard(ptr);
+        try
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.samples[ptr] = sample;
+            shard.count.store(shard.samples.size(), std::memory_order_relaxed);
+        }
+        catch (...)
+        {
+            // Running out of memory for the table only loses the sample
+        }
+    }
+
+    void HeapProfiler::forgetSample(const void* ptr)
+    {
+        // The profiler's own allocations are never sampled, and the shard may already be locked by this thread
+        if (ptr == nullptr || getState().busy)
+            return;
+
+        Shard& shard = this->getShard(ptr);
+        if (shard.count.load(std::memory_order_relaxed) == 0)
+            return;
+
+        BusyScope busy;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.samples.erase(ptr) != 0)
+            shard.count.store(shard.samples.size(), std::memory_order_relaxed);
+    }
+
+    bool HeapProfiler::takeSample(const void* ptr, Sample& sample)
+    {
+        if (ptr == nullptr || getState().busy)
+            return false;
+
+        Shard& shard = this->getShard(ptr);
+        if (shard.count.load(std::memory_order_relaxed) == 0)
+            return false;
+
+        BusyScope busy;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.samples.find(ptr);
+        if (it == shard.samples.end())
+            return false;
+
+        sample = it->second;
+        shard.samples.erase(it);
+        shard.count.store(shard.samples.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    void HeapProfiler::restoreSample(const void* ptr, const Sample& sample)
+    {
+        BusyScope busy;
+        Shard& shard = this->getShard(ptr);
+        try
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.samples[ptr] = sample;
+            shard.count.store(shard.samples.size(), std::memory_order_relaxed);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    size_t HeapProfiler::getSampleCount() const
+    {
+        size_t ret = 0;
+        for (size_t i = 0; i < ShardCount; ++i)
+            ret += this->m_shards[i].count.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    size_t HeapProfiler::getEstimatedLiveBytes() const
+    {
+        BusyScope busy;
+        double ret = 0.0;
+        for (size_t i = 0; i < ShardCount; ++i)
+        {
+            std::lock_guard<std::mutex> lock(this->m_shards[i].mutex);
+            for (const auto& entry : this->m_shards[i].samples)
+                ret += entry.second.weight;
+        }
+        return static_cast<size_t>(ret + 0.5);
+    }
+
+    void HeapProfiler::resetProfile()
+    {
+        BusyScope busy;
+        for (size_t i = 0; i < ShardCount; ++i)
+        {
+            std::lock_guard<std::mutex> lock(this->m_shards[i].mutex);
+            this->m_shards[i].samples.clear();
+            this->m_shards[i].count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    namespace
+    {
+        struct SiteTotals
+        {
+            uintmax_t samples = 0;
+            uintmax_t bytes = 0;
+            double weight = 0.0;
+        };
+
+        using SiteKey = std::pair<const char*, std::vector<void*>>;
+    }
+
+    void HeapProfiler::dumpFolded(std::ostream& out) const
+    {
+        BusyScope busy;
+
+        // Aggregate by call site, the shards are only locked while copying
+        std::map<SiteKey, SiteTotals> sites;
+        for (size_t i = 0; i < ShardCount; ++i)
+        {
+            std::lock_guard<std::mutex> lock(this->m_shards[i].mutex);
+            for (const auto& entry : this->m_shards[i].samples)
+            {
+                const Sample& sample = entry.second;
+                SiteTotals& totals = sites[SiteKey(sample.tag, std::vector<void*>(sample.frames, sample.frames + sample.depth))];
+                totals.samples += 1;
+                totals.bytes += sample.bytes;
+                totals.weight += sample.weight;
+            }
+        }
+
+        std::map<void*, std::string> symbols;
+        for (const auto& site : sites)
+        {
+            bool first = true;
+            if (site.first.first != nullptr)
+            {
+                out << site.first.first;
+                first = false;
+            }
+
+            const std::vector<void*>& frames = site.first.second;
+            for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+            {
+                auto symbol = symbols.find(*it);
+                if (symbol == symbols.end())
+                    symbol = symbols.emplace(*it, getSymbolName(*it)).first;
+
+                if (!first)
+                    out << ';';
+                out << symbol->second;
+                first = false;
+            }
+
+            if (first)
+                out << "[unknown]";
+            out << ' ' << static_cast<uintmax_t>(site.second.weight + 0.5) << '\n';
+        }
+    }
+
+    void HeapProfiler::dumpPprof(std::ostream& out) const
+    {
+        BusyScope busy;
+
+        std::map<std::vector<void*>, SiteTotals> sites;
+        SiteTotals total;
+        for (size_t i = 0; i < ShardCount; ++i)
+        {
+            std::lock_guard<std::mutex> lock(this->m_shards[i].mutex);
+            for (const auto& entry : this->m_shards[i].samples)
+            {
+                const Sample& sample = entry.second;
+                SiteTotals& totals = sites[std::vector<void*>(sample.frames, sample.frames + sample.depth)];
+                totals.samples += 1;
+                totals.bytes += sample.bytes;
+                total.samples += 1;
+                total.bytes += sample.bytes;
+            }
+        }
+
+        // Only live allocations are tracked, the cumulative columns repeat the live figures
+        out << "heap profile: " << total.samples << ": " << total.bytes << " [" << total.samples << ": " << total.bytes << "] @ heap_v2/" << this->m_interval << '\n';
+        for (const auto& site : sites)
+        {
+            out << site.second.samples << ": " << site.second.bytes << " [" << site.second.samples << ": " << site.second.bytes << "] @";
+            for (void* frame : site.first)
+            {
+                char buffer[2 + 2 * sizeof(uintptr_t) + 1];
+                std::snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(frame)));
+                out << ' ' << buffer;
+            }
+            out << '\n';
+        }
+
+#if defined(PLATFORM_OS_LINUX)
+        std::ifstream maps("/proc/self/maps");
+        if (maps)
+            out << "\nMAPPED_LIBRARIES:\n" << maps.rdbuf();
+#endif
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* HeapProfiler::alloc(size_t bytes, size_t align)
+    {
+        void* ret = AllocatorStatistic::alloc(bytes, align);
+        if (ret != nullptr && this->shouldSample(bytes))
+            this->recordSample(ret, bytes);
+        return ret;
+    }
+
+    void* HeapProfiler::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        void* ret = AllocatorStatistic::alloc(bytes, destructor, align);
+        if (ret != nullptr && this->shouldSample(bytes))
+            this->recordSample(ret, bytes);
+        return ret;
+    }
+
+    void HeapProfiler::free(void* ptr)
+    {
+        // The sample is dropped first, once freed the address may be handed out and sampled again by another thread
+        this->forgetSample(ptr);
+        AllocatorStatistic::free(ptr);
+    }
+
+    void HeapProfiler::free(void* ptr, size_t bytes)
+    {
+        this->forgetSample(ptr);
+        AllocatorStatistic::free(ptr, bytes);
+    }
+
+    void* HeapProfiler::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        Sample sample;
+        bool sampled = this->takeSample(ptr, sample);
+
+        void* ret = AllocatorStatistic::realloc(ptr, bytes, align);
+        if (ret == nullptr)
+        {
+            if (sampled)
+                this->restoreSample(ptr, sample);
+        }
+        else if (this->shouldSample(bytes))
+        {
+            this->recordSample(ret, bytes);
+        }
+        return ret;
+    }
+
+    void* HeapProfiler::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        Sample sample;
+        bool sampled = this->takeSample(ptr, sample);
+
+        void* ret = AllocatorStatistic::reallocSized(ptr, old_bytes, bytes, align);
+        if (ret == nullptr)
+        {
+            if (sampled)
+                this->restoreSample(ptr, sample);
+        }
+        else if (this->shouldSample(bytes))
+        {
+            this->recordSample(ret, bytes);
+        }
+        return ret;
+    }
+
+    void* HeapProfiler::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        Sample sample;
+        bool sampled = this->takeSample(ptr, sample);
+
+        void* ret = AllocatorStatistic::realloc(ptr, bytes, destructor, align);
+        if (ret == nullptr)
+        {
+            if (sampled)
+                this->restoreSample(ptr, sample);
+        }
+        else if (this->shouldSample(bytes))
+        {
+            this->recordSample(ret, bytes);
+        }
+        return ret;
+    }
+
+    bool HeapProfiler::tryExpand(void* ptr, size_t bytes)
+    {
+        Sample sample;
+        bool sampled = this->takeSample(ptr, sample);
+
+        // A resized block is sampled again like a reallocated one
+        bool ret = AllocatorStatistic::tryExpand(ptr, bytes);
+        if (!ret)
+        {
+            if (sampled)
+                this->restoreSample(ptr, sample);
+        }
+        else if (this->shouldSample(bytes))
+        {
+            this->recordSample(ptr, bytes);
+        }
+        return ret;
+    }
+
+    bool HeapProfiler::tryShrink(void* ptr, size_t bytes)
+    {
+        Sample sample;
+        bool sampled = this->takeSample(ptr, sample);
+
+        bool ret = AllocatorStatistic::tryShrink(ptr, bytes);
+        if (!ret)
+        {
+            if (sampled)
+                this->restoreSample(ptr, sample);
+        }
+        else if (this->shouldSample(bytes))
+        {
+            this->recordSample(ptr, bytes);
+        }
+        return ret;
+    }
+
+    size_t HeapProfiler::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        size_t ret = AllocatorStatistic::allocBulk(bytes, count, out, align);
+        for (size_t i = 0; i < ret; ++i)
+        {
+            if (this->shouldSample(bytes))
+                this->recordSample(out[i], bytes);
+        }
+        return ret;
+    }
+
+    void HeapProfiler::freeBulk(void** ptrs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            this->forgetSample(ptrs[i]);
+        AllocatorStatistic::freeBulk(ptrs, count);
+    }
+
+    void* HeapProfiler::offer(void* ptr, uint32_t priority)
+    {
+        // Offered memory is no longer in use, a reclaimed block is not sampled again
+        this->forgetSample(ptr);
+        return AllocatorStatistic::offer(ptr, priority);
+    }
+
+    void HeapProfiler::reset()
+    {
+        AllocatorStatistic::reset();
+        this->resetProfile();
+    }
+
+    void HeapProfiler::clear()
+    {
+        AllocatorStatistic::clear();
+        this->resetProfile();
+    }
+}
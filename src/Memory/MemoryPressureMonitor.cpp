@@ -0,0 +1,376 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/MemoryPressureMonitor.hpp>
+
+#include <Shared/Platform/Target.hpp>
+
+#include <chrono>
+#include <limits>
+
+#if defined(PLATFORM_OS_WIN)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <Windows.h>
+#elif defined(PLATFORM_OS_LINUX) || defined(PLATFORM_OS_ANDROID)
+#   define SHARED_MEMORY_PRESSURE_PROCFS
+#   include <cstdio>
+#   include <cstring>
+#   include <string>
+#endif
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+#if defined(PLATFORM_OS_WIN)
+    struct MemoryPressureMonitor::SystemSignals
+    {
+        HANDLE low_memory;
+
+        SystemSignals() :
+            low_memory(CreateMemoryResourceNotification(LowMemoryResourceNotification))
+        {
+        }
+
+        ~SystemSignals()
+        {
+            if (this->low_memory != nullptr)
+                CloseHandle(this->low_memory);
+        }
+
+        Level query(const Config& config)
+        {
+            (void)config;
+
+            BOOL state = FALSE;
+            if (this->low_memory != nullptr && QueryMemoryResourceNotification(this->low_memory, &state) && state)
+                return Moderate;
+            return None;
+        }
+    };
+#elif defined(SHARED_MEMORY_PRESSURE_PROCFS)
+    struct MemoryPressureMonitor::SystemSignals
+    {
+        std::string pressure_path; // Pressure stall information of the cgroup, or of the system
+        std::string events_path; // Memory events of the cgroup, empty outside of a cgroup
+
+        bool events_read = false;
+        unsigned long long high_events = 0; // Times the cgroup got throttled over its high limit
+        unsigned long long max_events = 0; // Times the cgroup hit its hard limit or the OOM killer
+
+        SystemSignals()
+        {
+            // The unified hierarchy line of /proc/self/cgroup looks like "0::/path"
+            std::string group;
+            if (FILE* file = std::fopen("/proc/self/cgroup", "r"))
+            {
+                char line[512];
+                while (std::fgets(line, sizeof(line), file) != nullptr)
+                {
+                    if (std::strncmp(line, "0::", 3) == 0)
+                    {
+                        group = line + 3;
+                        while (!group.empty() && (group.back() == '\n' || group.back() == '/'))
+                            group.pop_back();
+                        break;
+                    }
+                }
+                std::fclose(file);
+            }
+
+            std::string directory = "/sys/fs/cgroup" + group;
+            if (isReadable(directory + "/memory.pressure"))
+                this->pressure_path = directory + "/memory.pressure";
+            else
+                this->pressure_path = "/proc/pressure/memory";
+
+            // The root cgroup has no memory events
+            if (!group.empty() && isReadable(directory + "/memory.events"))
+                this->events_path = directory + "/memory.events";
+        }
+
+        static bool isReadable(const std::string& path)
+        {
+            FILE* file = std::fopen(path.c_str(), "r");
+            if (file == nullptr)
+                return false;
+            std::fclose(file);
+            return true;
+        }
+
+        Level queryStalls(const Config& config)
+        {
+            FILE* file = std::fopen(this->pressure_path.c_str(), "r");
+            if (file == nullptr)
+                return None;
+
+            Level ret = None;
+            char line[256];
+            while (std::fgets(line, sizeof(line), file) != nullptr)
+            {
+                float value = 0.0f;
+                if (std::sscanf(line, "some avg10=%f", &value) == 1 && value >= config.psi_some && ret < Moderate)
+                    ret = Moderate;
+                else if (std::sscanf(line, "full avg10=%f", &value) == 1 && value >= config.psi_full)
+                    ret = Critical;
+            }
+            std::fclose(file);
+
+            return ret;
+        }
+
+        Level queryEvents()
+        {
+            if (this->events_path.empty())
+                return None;
+
+            FILE* file = std::fopen(this->events_path.c_str(), "r");
+            if (file == nullptr)
+                return None;
+
+            unsigned long long high = 0;
+            unsigned long long max = 0;
+            char line[256];
+            while (std::fgets(line, sizeof(line), file) != nullptr)
+            {
+                unsigned long long value = 0;
+                if (std::sscanf(line, "high %llu", &value) == 1)
+                    high = value;
+                else if (std::sscanf(line, "max %llu", &value) == 1 || std::sscanf(line, "oom %llu", &value) == 1)
+                    max += value;
+            }
+            std::fclose(file);
+
+            // Events are cumulative, only new events since the previous query count
+            Level ret = None;
+            if (this->events_read)
+            {
+                if (max > this->max_events)
+                    ret = Critical;
+                else if (high > this->high_events)
+                    ret = Moderate;
+            }
+
+            this->events_read = true;
+            this->high_events = high;
+            this->max_events = max;
+            return ret;
+        }
+
+        Level query(const Config& config)
+        {
+            Level stalls = this->queryStalls(config);
+            Level events = this->queryEvents();
+            return stalls > events ? stalls : events;
+        }
+    };
+#else
+    struct MemoryPressureMonitor::SystemSignals
+    {
+        Level query(const Config& config)
+        {
+            (void)config;
+            return None;
+        }
+    };
+#endif
+
+    /*
+        MemoryPressureMonitor definitions
+    */
+
+    MemoryPressureMonitor::MemoryPressureMonitor(ObjectAllocator* allocator) :
+        MemoryPressureMonitor(allocator, Config())
+    {
+    }
+
+    MemoryPressureMonitor::MemoryPressureMonitor(ObjectAllocator* allocator, const Config& config) :
+        m_allocator(allocator),
+        m_config(config),
+        m_signals(new SystemSignals()),
+        m_watermark(false),
+        m_level(0),
+        m_signaled(None),
+        m_purges(0),
+        m_purged_bytes(0),
+        m_running(false),
+        m_woken(false)
+    {
+    }
+
+    MemoryPressureMonitor::~MemoryPressureMonitor()
+    {
+        this->stop();
+        delete this->m_signals;
+    }
+
+    void MemoryPressureMonitor::start()
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        if (this->m_running)
+            return;
+
+        this->m_running = true;
+        this->m_woken = false;
+        try
+        {
+            this->m_thread = std::thread(&MemoryPressureMonitor::run, this);
+        }
+        catch (...)
+        {
+            this->m_running = false;
+            throw;
+        }
+    }
+
+    void MemoryPressureMonitor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            if (!this->m_running)
+                return;
+
+            this->m_running = false;
+            this->m_wakeup.notify_all();
+        }
+        this->m_thread.join();
+    }
+
+    bool MemoryPressureMonitor::isRunning() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_running;
+    }
+
+    void MemoryPressureMonitor::run()
+    {
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        while (this->m_running)
+        {
+            lock.unlock();
+            this->poll();
+            lock.lock();
+
+            this->m_wakeup.wait_for(lock, std::chrono::milliseconds(this->m_config.interval_ms), [this]() {
+                return !this->m_running || this->m_woken;
+            });
+            this->m_woken = false;
+        }
+    }
+
+    MemoryPressureMonitor::Level MemoryPressureMonitor::poll()
+    {
+        Level pressure = static_cast<Level>(this->m_signaled.exchange(None, std::memory_order_relaxed));
+        if (this->m_config.system_signals)
+        {
+            Level system = this->getSystemPressure();
+            if (system > pressure)
+                pressure = system;
+        }
+
+        size_t pending = this->m_allocator->getPendingBytes();
+        size_t used = this->m_allocator->getUsedBytes();
+
+        const Config& config = this->m_config;
+        if ((config.pending_high != 0 && pending > config.pending_high) || (config.used_high != 0 && used > config.used_high))
+            this->m_watermark = true;
+        else if ((config.pending_high == 0 || pending <= config.pending_low) && (config.used_high == 0 || used <= config.used_low))
+            this->m_watermark = false;
+
+        if (this->m_watermark && pressure < Moderate)
+            pressure = Moderate;
+
+        if (pressure == None)
+        {
+            this->m_level.store(0, std::memory_order_relaxed);
+            return None;
+        }
+
+        if (pending == 0)
+            return pressure;
+
+        if (pressure == Critical)
+        {
+            this->purgeLevel(PurgeLevels - 1);
+            this->m_level.store(0, std::memory_order_relaxed);
+            return pressure;
+        }
+
+        // Skip levels without pending data, so every step actually frees memory. Levels wrap around while the pressure lasts, to catch new offers
+        uint32_t level = this->m_level.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < PurgeLevels; ++i)
+        {
+            size_t freed = this->purgeLevel(level);
+            level = level + 1 < PurgeLevels ? level + 1 : 0;
+            if (freed != 0)
+                break;
+        }
+        this->m_level.store(level, std::memory_order_relaxed);
+
+        return pressure;
+    }
+
+    size_t MemoryPressureMonitor::purgeLevel(uint32_t level)
+    {
+        size_t before = this->m_allocator->getPendingBytes();
+        this->m_allocator->purge(getLevelPriority(level));
+        size_t after = this->m_allocator->getPendingBytes();
+
+        size_t ret = before > after ? before - after : 0;
+        this->m_purges.fetch_add(1, std::memory_order_relaxed);
+        this->m_purged_bytes.fetch_add(ret, std::memory_order_relaxed);
+        return ret;
+    }
+
+    void MemoryPressureMonitor::signal(Level level)
+    {
+        uint32_t current = this->m_signaled.load(std::memory_order_relaxed);
+        while (current < level && !this->m_signaled.compare_exchange_weak(current, level, std::memory_order_relaxed))
+        {
+        }
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_woken = true;
+        this->m_wakeup.notify_all();
+    }
+
+    MemoryPressureMonitor::Level MemoryPressureMonitor::getSystemPressure()
+    {
+        return this->m_signals->query(this->m_config);
+    }
+
+    ObjectAllocator* MemoryPressureMonitor::getAllocator() const noexcept
+    {
+        return this->m_allocator;
+    }
+
+    uint32_t MemoryPressureMonitor::getPurgeLevel() const noexcept
+    {
+        return this->m_level.load(std::memory_order_relaxed);
+    }
+
+    uint64_t MemoryPressureMonitor::getPurgeCount() const noexcept
+    {
+        return this->m_purges.load(std::memory_order_relaxed);
+    }
+
+    uint64_t MemoryPressureMonitor::getPurgedBytes() const noexcept
+    {
+        return this->m_purged_bytes.load(std::memory_order_relaxed);
+    }
+
+    uint32_t MemoryPressureMonitor::getLevelPriority(uint32_t level) noexcept
+    {
+        if (level + 1 >= PurgeLevels)
+            return std::numeric_limits<uint32_t>::max();
+        return (uint32_t(1) << level) - 1;
+    }
+}
@@ -0,0 +1,47 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/MemoryResourceAdapter.hpp>
+
+#include <new>
+
+namespace Memory
+{
+    MemoryResourceAdapter::MemoryResourceAdapter(BasicAllocator* backing) noexcept :
+        m_backing(backing)
+    {
+    }
+
+    BasicAllocator* MemoryResourceAdapter::getBacking() const noexcept
+    {
+        return this->m_backing;
+    }
+
+    /*
+        Overridden std::pmr::memory_resource function definitions
+    */
+
+    void* MemoryResourceAdapter::do_allocate(size_t bytes, size_t align)
+    {
+        void* ptr = this->m_backing->alloc(bytes, align);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    void MemoryResourceAdapter::do_deallocate(void* ptr, size_t bytes, size_t align)
+    {
+        (void)align;
+        this->m_backing->free(ptr, bytes);
+    }
+
+    bool MemoryResourceAdapter::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        if (this == &other)
+            return true;
+
+        const MemoryResourceAdapter* adapter = dynamic_cast<const MemoryResourceAdapter*>(&other);
+        return adapter != nullptr && adapter->m_backing == this->m_backing;
+    }
+}
@@ -0,0 +1,366 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/NumaAllocator.hpp>
+#include <Shared/Memory/AllocatorRegistry.hpp>
+#include <Shared/Memory/AllocatorStatistic.hpp>
+#include <Shared/Memory/Heap.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    struct NumaAllocator::Header
+    {
+        uint32_t node;
+        uint32_t offset; // Distance from the start of the backing block
+    };
+
+    namespace
+    {
+        struct NodeCache
+        {
+            uint32_t node = 0; // System node of the thread, as of the last lookup
+            uint32_t calls = 0; // Calls left until the next lookup
+        };
+
+        uint32_t getThreadNode() noexcept
+        {
+            thread_local NodeCache cache;
+            if (cache.calls == 0)
+            {
+                cache.node = SystemMemory::getNumaNode();
+                cache.calls = NumaAllocator::NodeRefreshInterval;
+            }
+            --cache.calls;
+            return cache.node;
+        }
+    }
+
+    /*
+        NumaAllocator definitions
+    */
+
+    NumaAllocator::NumaAllocator() :
+        m_backings(nullptr),
+        m_count(SystemMemory::getNumaNodeCount()),
+        m_owned(true)
+    {
+        this->m_backings = new BasicAllocator*[this->m_count]();
+        try
+        {
+            for (uint32_t i = 0; i < this->m_count; ++i)
+                this->m_backings[i] = new Heap();
+        }
+        catch (...)
+        {
+            for (uint32_t i = 0; i < this->m_count; ++i)
+                delete this->m_backings[i];
+            delete[] this->m_backings;
+            throw;
+        }
+    }
+
+    NumaAllocator::NumaAllocator(BasicAllocator* const* backings, uint32_t count) :
+        m_backings(new BasicAllocator*[count]),
+        m_count(count),
+        m_owned(false)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            this->m_backings[i] = backings[i];
+    }
+
+    NumaAllocator::~NumaAllocator()
+    {
+        if (this->m_owned)
+        {
+            for (uint32_t i = 0; i < this->m_count; ++i)
+                delete this->m_backings[i];
+        }
+        delete[] this->m_backings;
+    }
+
+    size_t NumaAllocator::getOffset(size_t align) noexcept
+    {
+        return align > sizeof(Header) ? align : sizeof(Header);
+    }
+
+    NumaAllocator::Header* NumaAllocator::getHeader(const void* ptr) noexcept
+    {
+        return reinterpret_cast<Header*>(const_cast<char*>(reinterpret_cast<const char*>(ptr)) - sizeof(Header));
+    }
+
+    void* NumaAllocator::place(void* block, uint32_t node, size_t offset, size_t bytes) noexcept
+    {
+        char* user = reinterpret_cast<char*>(block) + offset;
+        Header* header = getHeader(user);
+        header->node = node;
+        header->offset = static_cast<uint32_t>(offset);
+
+        // Only whole pages inside the block can be bound, the ones shared with neighbouring blocks are left alone
+        if (bytes >= BindThreshold && SystemMemory::getNumaNodeCount() > 1)
+        {
+            size_t page = SystemMemory::getPageSize();
+            uintptr_t begin = (reinterpret_cast<uintptr_t>(user) + page - 1) & ~(page - 1);
+            uintptr_t end = (reinterpret_cast<uintptr_t>(user) + bytes) & ~(page - 1);
+            if (begin < end)
+                SystemMemory::bindToNumaNode(reinterpret_cast<void*>(begin), end - begin, node);
+        }
+
+        return user;
+    }
+
+    void* NumaAllocator::alloc(size_t bytes, size_t align, uint32_t node)
+    {
+        if (node >= this->m_count)
+            return nullptr;
+
+        size_t offset = getOffset(align);
+        if (bytes > std::numeric_limits<size_t>::max() - offset)
+            return nullptr;
+
+        void* block = this->m_backings[node]->alloc(bytes + offset, align > alignof(Header) ? align : alignof(Header));
+        if (block == nullptr)
+            return nullptr;
+
+        return this->place(block, node, offset, bytes);
+    }
+
+    uint32_t NumaAllocator::getNodeCount() const noexcept
+    {
+        return this->m_count;
+    }
+
+    BasicAllocator* NumaAllocator::getBacking(uint32_t node) const noexcept
+    {
+        return node < this->m_count ? this->m_backings[node] : nullptr;
+    }
+
+    uint32_t NumaAllocator::getNode(const void* ptr) const noexcept
+    {
+        return getHeader(ptr)->node;
+    }
+
+    uint32_t NumaAllocator::getCurrentNode() const noexcept
+    {
+        return getThreadNode() % this->m_count;
+    }
+
+    size_t NumaAllocator::getNodeUsedBytes(uint32_t node) const
+    {
+        return node < this->m_count ? this->m_backings[node]->getUsedBytes() : 0;
+    }
+
+    size_t NumaAllocator::getNodeFreeBytes(uint32_t node) const
+    {
+        return node < this->m_count ? this->m_backings[node]->getFreeBytes() : 0;
+    }
+
+    size_t NumaAllocator::getNodeTotalBytes(uint32_t node) const
+    {
+        return node < this->m_count ? this->m_backings[node]->getTotalBytes() : 0;
+    }
+
+    bool NumaAllocator::registerNodes(AllocatorRegistry& registry, const char* prefix) const
+    {
+        bool ret = true;
+        for (uint32_t i = 0; i < this->m_count; ++i)
+        {
+            std::string name = std::string(prefix) + "/node" + std::to_string(i);
+
+            BasicAllocator* backing = this->m_backings[i];
+            if (AllocatorStatistic* statistic = dynamic_cast<AllocatorStatistic*>(backing))
+                ret = registry.add(name.c_str(), statistic) && ret;
+            else if (ObjectAllocator* object = dynamic_cast<ObjectAllocator*>(backing))
+                ret = registry.add(name.c_str(), object) && ret;
+            else
+                ret = registry.add(name.c_str(), backing) && ret;
+        }
+        return ret;
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* NumaAllocator::alloc(size_t bytes, size_t align)
+    {
+        return this->alloc(bytes, align, this->getCurrentNode());
+    }
+
+    void NumaAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        Header* header = getHeader(ptr);
+        this->m_backings[header->node]->free(reinterpret_cast<char*>(ptr) - header->offset);
+    }
+
+    void NumaAllocator::free(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return;
+
+        Header* header = getHeader(ptr);
+        this->m_backings[header->node]->free(reinterpret_cast<char*>(ptr) - header->offset, bytes + header->offset);
+    }
+
+    void* NumaAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        Header* header = getHeader(ptr);
+        uint32_t node = header->node;
+        size_t offset = header->offset;
+
+        // The header moves along with the content as long as the offset stays the same
+        if (offset == getOffset(align) && bytes <= std::numeric_limits<size_t>::max() - offset)
+        {
+            void* block = this->m_backings[node]->realloc(reinterpret_cast<char*>(ptr) - offset, bytes + offset, align > alignof(Header) ? align : alignof(Header));
+            if (block == nullptr)
+                return nullptr;
+            return this->place(block, node, offset, bytes);
+        }
+
+        void* ret = this->alloc(bytes, align, node);
+        if (ret == nullptr)
+            return nullptr;
+
+        size_t size = this->getAllocSize(ptr);
+        std::memcpy(ret, ptr, size < bytes ? size : bytes);
+        this->free(ptr);
+        return ret;
+    }
+
+    void* NumaAllocator::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        Header* header = getHeader(ptr);
+        uint32_t node = header->node;
+        size_t offset = header->offset;
+
+        if (offset == getOffset(align) && bytes <= std::numeric_limits<size_t>::max() - offset)
+        {
+            void* block = this->m_backings[node]->reallocSized(reinterpret_cast<char*>(ptr) - offset, old_bytes + offset, bytes + offset, align > alignof(Header) ? align : alignof(Header));
+            if (block == nullptr)
+                return nullptr;
+            return this->place(block, node, offset, bytes);
+        }
+
+        void* ret = this->alloc(bytes, align, node);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, old_bytes < bytes ? old_bytes : bytes);
+        this->free(ptr, old_bytes);
+        return ret;
+    }
+
+    size_t NumaAllocator::getAllocSize(const void* ptr) const
+    {
+        Header* header = getHeader(ptr);
+        return this->m_backings[header->node]->getAllocSize(reinterpret_cast<const char*>(ptr) - header->offset) - header->offset;
+    }
+
+    bool NumaAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        Header* header = getHeader(ptr);
+        if (bytes > std::numeric_limits<size_t>::max() - header->offset)
+            return false;
+        return this->m_backings[header->node]->tryExpand(reinterpret_cast<char*>(ptr) - header->offset, bytes + header->offset);
+    }
+
+    bool NumaAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        Header* header = getHeader(ptr);
+        if (bytes > std::numeric_limits<size_t>::max() - header->offset)
+            return false;
+        return this->m_backings[header->node]->tryShrink(reinterpret_cast<char*>(ptr) - header->offset, bytes + header->offset);
+    }
+
+    size_t NumaAllocator::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        size_t offset = getOffset(align);
+        if (bytes > std::numeric_limits<size_t>::max() - offset)
+            return 0;
+
+        uint32_t node = this->getCurrentNode();
+        size_t ret = this->m_backings[node]->allocBulk(bytes + offset, count, out, align > alignof(Header) ? align : alignof(Header));
+        for (size_t i = 0; i < ret; ++i)
+            out[i] = this->place(out[i], node, offset, bytes);
+        return ret;
+    }
+
+    void NumaAllocator::reset()
+    {
+        for (uint32_t i = 0; i < this->m_count; ++i)
+            this->m_backings[i]->reset();
+    }
+
+    size_t NumaAllocator::getFreeBytes() const
+    {
+        size_t ret = 0;
+        for (uint32_t i = 0; i < this->m_count; ++i)
+            ret += this->m_backings[i]->getFreeBytes();
+        return ret;
+    }
+
+    size_t NumaAllocator::getUsedBytes() const
+    {
+        size_t ret = 0;
+        for (uint32_t i = 0; i < this->m_count; ++i)
+            ret += this->m_backings[i]->getUsedBytes();
+        return ret;
+    }
+
+    size_t NumaAllocator::getTotalBytes() const
+    {
+        size_t ret = 0;
+        for (uint32_t i = 0; i < this->m_count; ++i)
+            ret += this->m_backings[i]->getTotalBytes();
+        return ret;
+    }
+
+    bool NumaAllocator::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        bool ret = false;
+        uint64_t local_sum = 0;
+        uint64_t remote_sum = 0;
+        for (uint32_t i = 0; i < this->m_count; ++i)
+        {
+            uint64_t node_local = 0;
+            uint64_t node_remote = 0;
+            if (this->m_backings[i]->getFreeCounts(node_local, node_remote))
+            {
+                local_sum += node_local;
+                remote_sum += node_remote;
+                ret = true;
+            }
+        }
+        if (ret)
+        {
+            local = local_sum;
+            remote = remote_sum;
+        }
+        return ret;
+    }
+}
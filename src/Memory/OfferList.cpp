@@ -0,0 +1,104 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/OfferList.hpp>
+#include <Shared/Util/Bits.hpp>
+
+namespace Memory
+{
+    static_assert(OfferList::BucketCount <= 64, "The bucket bitmap must fit in 64 bits");
+
+    /*
+        OfferList definitions
+    */
+
+    OfferList::OfferList() noexcept :
+        m_heads(),
+        m_tails(),
+        m_buckets(0),
+        m_count(0)
+    {
+    }
+
+    uint32_t OfferList::getBucket(uint32_t priority) noexcept
+    {
+        return Util::getBitWidth(priority);
+    }
+
+    void OfferList::push(Node* node, uint32_t priority) noexcept
+    {
+        uint32_t bucket = getBucket(priority);
+
+        node->bucket = bucket;
+        node->prev = this->m_tails[bucket];
+        node->next = nullptr;
+        if (node->prev != nullptr)
+            node->prev->next = node;
+        else
+            this->m_heads[bucket] = node;
+        this->m_tails[bucket] = node;
+
+        this->m_buckets |= uint64_t(1) << bucket;
+        ++this->m_count;
+    }
+
+    void OfferList::remove(Node* node) noexcept
+    {
+        uint32_t bucket = node->bucket;
+
+        if (node->prev != nullptr)
+            node->prev->next = node->next;
+        else
+            this->m_heads[bucket] = node->next;
+        if (node->next != nullptr)
+            node->next->prev = node->prev;
+        else
+            this->m_tails[bucket] = node->prev;
+
+        node->prev = nullptr;
+        node->next = nullptr;
+
+        if (this->m_heads[bucket] == nullptr)
+            this->m_buckets &= ~(uint64_t(1) << bucket);
+        --this->m_count;
+    }
+
+    OfferList::Node* OfferList::getOldest(uint32_t priority) const noexcept
+    {
+        uint32_t bucket = Util::getTrailingZeros(this->m_buckets);
+        if (bucket > getBucket(priority))
+            return nullptr;
+
+        return this->m_heads[bucket];
+    }
+
+    OfferList::Node* OfferList::pop(uint32_t priority) noexcept
+    {
+        Node* ret = this->getOldest(priority);
+        if (ret != nullptr)
+            this->remove(ret);
+        return ret;
+    }
+
+    void OfferList::clear() noexcept
+    {
+        for (uint32_t i = 0; i < BucketCount; ++i)
+        {
+            this->m_heads[i] = nullptr;
+            this->m_tails[i] = nullptr;
+        }
+        this->m_buckets = 0;
+        this->m_count = 0;
+    }
+
+    bool OfferList::isEmpty() const noexcept
+    {
+        return this->m_count == 0;
+    }
+
+    size_t OfferList::getCount() const noexcept
+    {
+        return this->m_count;
+    }
+}
@@ -0,0 +1,1009 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/PersistentAllocator.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include "DestructorBatch.hpp"
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    namespace
+    {
+        // Persisted in the chunk headers, the values must never change
+        enum ChunkState : uint32_t
+        {
+            StateFree = 0,
+            StateUsed,
+            StateOffered,
+            StatePurged // Offer released, the header is kept until reclaim or free
+        };
+
+        constexpr uint64_t OffsetMask = (uint64_t(1) << PersistentAllocator::OffsetBits) - 1;
+        constexpr uint64_t StampMask = (uint64_t(1) << (64 - PersistentAllocator::OffsetBits)) - 1;
+
+        const char s_file_magic[8] = { 'S', 'H', 'R', 'D', 'H', 'E', 'A', 'P' };
+
+        // Read back in a different byte order if the file came from another architecture
+        constexpr uint32_t ByteOrderMark = 0x01020304;
+
+        inline uint32_t getBin(size_t size) noexcept
+        {
+            return Util::getBitWidth(size / PersistentAllocator::Granularity) - 1;
+        }
+
+        inline size_t roundToGranularity(size_t bytes) noexcept
+        {
+            return (bytes + PersistentAllocator::Granularity - 1) & ~(PersistentAllocator::Granularity - 1);
+        }
+
+        // Generations never wrap around in practice, 0 is skipped so a zero filled header never matches
+        inline uint64_t getNextGeneration(uint64_t generation) noexcept
+        {
+            return generation + 1 != 0 ? generation + 1 : 1;
+        }
+
+        // Stamps wrap around to 1, 0 marks offsets without a stamp
+        inline uint64_t getNextStamp(uint64_t stamp) noexcept
+        {
+            return (stamp & StampMask) < StampMask ? (stamp & StampMask) + 1 : 1;
+        }
+
+        inline char* alignUp(char* ptr, size_t align) noexcept
+        {
+            return ptr + BasicAllocator::getAlignedOffset(ptr, align);
+        }
+
+        inline char* alignDown(char* ptr, size_t align) noexcept
+        {
+            return reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(ptr) & ~(align - 1));
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Header at the start of every chunk. Only the sizes, the state, the priority and the offset are meaningful in the file, the rest is rebuilt when the heap is restored
+    struct PersistentAllocator::Chunk
+    {
+        OfferList::Node node; // Must be the first member, chunks are cast from offer nodes
+        uint64_t size; // Bytes of the chunk including the header, a multiple of the granularity
+        uint64_t prev_size; // Size of the previous chunk, 0 for the first chunk
+        Chunk* free_prev; // Links in the free chunk bin
+        Chunk* free_next;
+        DestructorPtr destructor; // Destructor of used and offered chunks, only valid in the process which set it
+        uint32_t state;
+        uint32_t priority; // Offer priority, so offers can be listed again after a restart
+        uint64_t generation; // Heap generation which allocated the chunk, stale headers of discarded heaps are older than the last format
+        uint64_t stamp; // Stamp of the allocation, part of the offsets of the block
+        uint64_t offset; // Distance of the user pointer from the header, the word right before the user pointer holds it too
+    };
+
+    // Start of the file
+    struct PersistentAllocator::FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t chunk_header; // Size of the chunk header, differs between builds of other pointer sizes
+        uint32_t open; // Set while an allocator uses the file, a heap found open wasn't closed properly
+        uint64_t top; // Offset of the end of the carved chunks
+        uint64_t generation; // Bumped every time the heap is opened, stamped into the allocated chunks
+        uint64_t format_generation; // Generation of the last format, older chunk headers are stale
+        uint64_t stamp; // Stamp of the last allocation, kept across formats so the offsets of discarded blocks don't match new ones
+        uint64_t roots[RootCount]; // Offsets of the root blocks, 0 if empty
+    };
+
+    /*
+        PersistentAllocator definitions
+    */
+
+    PersistentAllocator::PersistentAllocator(const char* path, size_t file_bytes) :
+        m_file_ptr(nullptr),
+        m_file_bytes(0),
+        m_file(-1),
+        m_file_mapping(nullptr),
+        m_header(nullptr),
+        m_base(nullptr),
+        m_end(nullptr),
+        m_top(nullptr),
+        m_last(nullptr),
+        m_bins(),
+        m_bin_mask(0),
+        m_used(0),
+        m_pending(0),
+        m_restored(false),
+        m_clearing(false)
+    {
+        static_assert(sizeof(FileHeader) <= FileHeaderSize, "The file header must fit before the heap");
+
+        size_t min_bytes = FileHeaderSize + 2 * roundToGranularity(sizeof(Chunk));
+        if (file_bytes < min_bytes)
+            file_bytes = min_bytes;
+
+        SystemMemory::FileMapping mapping;
+        if (!SystemMemory::mapFile(path, file_bytes, mapping))
+            return;
+
+        this->m_file_ptr = mapping.ptr;
+        this->m_file_bytes = mapping.bytes;
+        this->m_file = mapping.file;
+        this->m_file_mapping = mapping.mapping;
+
+        char* file = reinterpret_cast<char*>(mapping.ptr);
+        this->m_header = reinterpret_cast<FileHeader*>(file);
+        this->m_base = file + FileHeaderSize;
+        this->m_end = file + ((mapping.bytes - FileHeaderSize) & ~(Granularity - 1)) + FileHeaderSize;
+
+        // Offsets only hold OffsetBits bits, the rest of a larger file stays unused
+        if (static_cast<uint64_t>(this->m_end - file) > OffsetMask + 1)
+            this->m_end = file + OffsetMask + 1;
+
+        this->m_restored = this->restore();
+        if (!this->m_restored)
+            this->format();
+
+        // A crash from here on leaves the heap marked open
+        this->m_header->open = 1;
+        SystemMemory::syncFile(mapping, this->m_header, sizeof(FileHeader));
+    }
+
+    PersistentAllocator::~PersistentAllocator()
+    {
+        if (this->m_header == nullptr)
+            return;
+
+        SystemMemory::FileMapping mapping{ this->m_file_ptr, this->m_file_bytes, this->m_file, this->m_file_mapping };
+
+        // Every page has to reach the file before the heap is marked closed
+        if (SystemMemory::syncFile(mapping, this->m_file_ptr, this->m_file_bytes))
+        {
+            this->m_header->open = 0;
+            SystemMemory::syncFile(mapping, this->m_header, sizeof(FileHeader));
+        }
+
+        SystemMemory::unmapFile(mapping);
+    }
+
+    bool PersistentAllocator::restore()
+    {
+        FileHeader* header = this->m_header;
+        if (std::memcmp(header->magic, s_file_magic, sizeof(s_file_magic)) != 0 || header->version != FormatVersion || header->byte_order != ByteOrderMark || header->chunk_header != sizeof(Chunk) || header->open != 0)
+            return false;
+
+        size_t heap_bytes = static_cast<size_t>(this->m_end - this->m_base);
+        if (header->top < FileHeaderSize || header->top - FileHeaderSize > heap_bytes || (header->top - FileHeaderSize) % Granularity != 0 || header->format_generation > header->generation || header->format_generation == 0)
+            return false;
+
+        char* top = reinterpret_cast<char*>(header) + header->top;
+
+        // Validate the whole chunk sequence before changing anything, and find the roots
+        bool rooted[RootCount] = {};
+        uint64_t prev_size = 0;
+        for (char* ptr = this->m_base; ptr < top;)
+        {
+            Chunk* chunk = reinterpret_cast<Chunk*>(ptr);
+            size_t available = static_cast<size_t>(top - ptr);
+            if (available < sizeof(Chunk) || chunk->size < sizeof(Chunk) || chunk->size > available || chunk->size % Granularity != 0 || chunk->prev_size != prev_size)
+                return false;
+
+            if (chunk->state != StateFree)
+            {
+                if (chunk->state > StatePurged || chunk->offset < sizeof(Chunk) || chunk->offset > chunk->size || reinterpret_cast<const uint64_t*>(ptr + chunk->offset)[-1] != chunk->offset)
+                    return false;
+                if (chunk->generation < header->format_generation || chunk->generation > header->generation || chunk->stamp == 0 || chunk->stamp > StampMask)
+                    return false;
+
+                uint64_t user = this->getChunkOffset(chunk);
+                for (size_t i = 0; i < RootCount; ++i)
+                    rooted[i] |= header->roots[i] == user;
+            }
+
+            prev_size = chunk->size;
+            ptr += chunk->size;
+        }
+
+        for (size_t i = 0; i < RootCount; ++i)
+        {
+            if (!rooted[i])
+                header->roots[i] = 0;
+        }
+
+        // Rebuild the bins and the offers. Blocks allocated by the previous owner are freed unless rooted, so are purged offers, nothing else can reach them
+        this->m_top = top;
+        Chunk* run = nullptr; // Free chunk absorbing its free neighbours
+        for (char* ptr = this->m_base; ptr < top;)
+        {
+            Chunk* chunk = reinterpret_cast<Chunk*>(ptr);
+            ptr += chunk->size;
+            chunk->destructor = nullptr;
+
+            if (chunk->state == StateUsed || chunk->state == StatePurged)
+            {
+                uint64_t user = this->getChunkOffset(chunk);
+                bool keep = false;
+                for (size_t i = 0; i < RootCount; ++i)
+                    keep |= header->roots[i] == user;
+                if (!keep)
+                    chunk->state = StateFree;
+            }
+
+            if (chunk->state == StateFree)
+            {
+                if (run != nullptr)
+                    run->size += chunk->size;
+                else
+                    run = chunk;
+                continue;
+            }
+
+            if (run != nullptr)
+            {
+                this->insertFree(run);
+                chunk->prev_size = run->size;
+                run = nullptr;
+            }
+
+            if (chunk->state == StateOffered)
+            {
+                this->m_offers.push(&chunk->node, chunk->priority);
+                this->m_pending += getUsable(chunk);
+            }
+            this->m_used += chunk->size;
+            this->m_last = chunk;
+        }
+
+        if (run != nullptr)
+        {
+            this->insertFree(run);
+            this->m_last = run;
+        }
+
+        header->generation = getNextGeneration(header->generation);
+
+        return true;
+    }
+
+    void PersistentAllocator::format()
+    {
+        FileHeader* header = this->m_header;
+        std::memcpy(header->magic, s_file_magic, sizeof(s_file_magic));
+        header->version = FormatVersion;
+        header->byte_order = ByteOrderMark;
+        header->chunk_header = sizeof(Chunk);
+        header->open = 0;
+
+        // The headers of the discarded heap stay in the file, they are older than the new format generation
+        header->generation = getNextGeneration(header->generation);
+        header->format_generation = header->generation;
+        header->stamp &= StampMask;
+
+        this->releaseAll();
+    }
+
+    bool PersistentAllocator::isOpen() const noexcept
+    {
+        return this->m_header != nullptr;
+    }
+
+    bool PersistentAllocator::isRestored() const noexcept
+    {
+        return this->m_restored;
+    }
+
+    bool PersistentAllocator::sync()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        SystemMemory::FileMapping mapping{ this->m_file_ptr, this->m_file_bytes, this->m_file, this->m_file_mapping };
+        return SystemMemory::syncFile(mapping, this->m_file_ptr, this->m_file_bytes);
+    }
+
+    uint64_t PersistentAllocator::getOffset(const void* ptr) const
+    {
+        if (ptr == nullptr || this->m_header == nullptr)
+            return 0;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk != nullptr && getUser(chunk) == ptr)
+            return this->getChunkOffset(chunk);
+
+        return static_cast<uint64_t>(reinterpret_cast<const char*>(ptr) - reinterpret_cast<const char*>(this->m_header));
+    }
+
+    void* PersistentAllocator::getPointer(uint64_t offset) const
+    {
+        if (this->m_header == nullptr)
+            return nullptr;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        uint64_t position = offset & OffsetMask;
+        if (position < FileHeaderSize || position >= static_cast<uint64_t>(this->m_top - reinterpret_cast<char*>(this->m_header)))
+            return nullptr;
+
+        char* ptr = reinterpret_cast<char*>(this->m_header) + position;
+
+        // Offsets of blocks carry the stamp of the allocation, the block must still be the same allocation
+        uint64_t stamp = offset >> OffsetBits;
+        if (stamp != 0)
+        {
+            Chunk* chunk = this->findChunk(ptr);
+            if (chunk == nullptr || getUser(chunk) != ptr || chunk->stamp != stamp)
+                return nullptr;
+        }
+        return ptr;
+    }
+
+    void PersistentAllocator::setRoot(size_t index, void* ptr)
+    {
+        if (index >= RootCount || this->m_header == nullptr)
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = ptr != nullptr ? this->findChunk(ptr) : nullptr;
+        this->m_header->roots[index] = chunk != nullptr && getUser(chunk) == ptr ? this->getChunkOffset(chunk) : 0;
+    }
+
+    void* PersistentAllocator::getRoot(size_t index) const
+    {
+        if (index >= RootCount || this->m_header == nullptr)
+            return nullptr;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->getPointer(this->m_header->roots[index]);
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::findChunk(const void* ptr) const noexcept
+    {
+        const char* user = reinterpret_cast<const char*>(ptr);
+        if (this->m_header == nullptr || user < this->m_base + sizeof(Chunk) || user >= this->m_top || reinterpret_cast<uintptr_t>(user) % Granularity != 0)
+            return nullptr;
+
+        // The header has to be a live chunk below the top, of a generation of the current heap
+        uint64_t offset = reinterpret_cast<const uint64_t*>(user)[-1];
+        if (offset < sizeof(Chunk) || offset > static_cast<uint64_t>(user - this->m_base) || offset % Granularity != 0)
+            return nullptr;
+
+        Chunk* chunk = getChunk(ptr);
+        if (chunk->offset != offset || chunk->size < offset || chunk->size > static_cast<uint64_t>(this->m_top - reinterpret_cast<char*>(chunk)) || chunk->size % Granularity != 0)
+            return nullptr;
+        if (chunk->state == StateFree || chunk->state > StatePurged || chunk->generation < this->m_header->format_generation || chunk->generation > this->m_header->generation)
+            return nullptr;
+
+        return chunk;
+    }
+
+    uint64_t PersistentAllocator::getChunkOffset(const Chunk* chunk) const noexcept
+    {
+        uint64_t position = static_cast<uint64_t>(reinterpret_cast<const char*>(chunk) - reinterpret_cast<const char*>(this->m_header)) + chunk->offset;
+        return (chunk->stamp << OffsetBits) | position;
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::getChunk(const void* ptr) noexcept
+    {
+        uint64_t offset = reinterpret_cast<const uint64_t*>(ptr)[-1];
+        return reinterpret_cast<Chunk*>(const_cast<char*>(reinterpret_cast<const char*>(ptr)) - offset);
+    }
+
+    void* PersistentAllocator::getUser(Chunk* chunk) noexcept
+    {
+        return reinterpret_cast<char*>(chunk) + chunk->offset;
+    }
+
+    size_t PersistentAllocator::getUsable(const Chunk* chunk) noexcept
+    {
+        return static_cast<size_t>(chunk->size - chunk->offset);
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::getNext(Chunk* chunk) const noexcept
+    {
+        char* next = reinterpret_cast<char*>(chunk) + chunk->size;
+        return next < this->m_top ? reinterpret_cast<Chunk*>(next) : nullptr;
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::getPrev(Chunk* chunk) const noexcept
+    {
+        if (chunk->prev_size == 0)
+            return nullptr;
+        return reinterpret_cast<Chunk*>(reinterpret_cast<char*>(chunk) - chunk->prev_size);
+    }
+
+    void PersistentAllocator::setTop(char* top)
+    {
+        this->m_top = top;
+        this->m_header->top = static_cast<uint64_t>(top - reinterpret_cast<char*>(this->m_header));
+    }
+
+    void PersistentAllocator::insertFree(Chunk* chunk)
+    {
+        uint32_t bin = getBin(static_cast<size_t>(chunk->size));
+
+        chunk->state = StateFree;
+        chunk->destructor = nullptr;
+        chunk->free_prev = nullptr;
+        chunk->free_next = this->m_bins[bin];
+        if (chunk->free_next != nullptr)
+            chunk->free_next->free_prev = chunk;
+        this->m_bins[bin] = chunk;
+        this->m_bin_mask |= uint64_t(1) << bin;
+    }
+
+    void PersistentAllocator::removeFree(Chunk* chunk)
+    {
+        uint32_t bin = getBin(static_cast<size_t>(chunk->size));
+
+        if (chunk->free_prev != nullptr)
+            chunk->free_prev->free_next = chunk->free_next;
+        else
+            this->m_bins[bin] = chunk->free_next;
+        if (chunk->free_next != nullptr)
+            chunk->free_next->free_prev = chunk->free_prev;
+
+        if (this->m_bins[bin] == nullptr)
+            this->m_bin_mask &= ~(uint64_t(1) << bin);
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::findFree(size_t size)
+    {
+        // First fit inside the smallest bin that may hold the request
+        uint32_t bin = getBin(size);
+        for (Chunk* chunk = this->m_bins[bin]; chunk != nullptr; chunk = chunk->free_next)
+        {
+            if (chunk->size >= size)
+                return chunk;
+        }
+
+        // Any chunk of a larger bin fits
+        if (bin + 1 >= BinCount)
+            return nullptr;
+        uint64_t larger = this->m_bin_mask & ~((uint64_t(2) << bin) - 1);
+        if (larger == 0)
+            return nullptr;
+        return this->m_bins[Util::getTrailingZeros(larger)];
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::carve(size_t size)
+    {
+        size_t available = static_cast<size_t>(this->m_end - this->m_top);
+
+        // A free chunk at the top is extended instead of leaving it behind
+        Chunk* last = this->m_last;
+        if (last != nullptr && last->state == StateFree)
+        {
+            size_t extra = size - static_cast<size_t>(last->size);
+            if (extra > available)
+                return nullptr;
+
+            this->removeFree(last);
+            last->size = size;
+            this->setTop(this->m_top + extra);
+            return last;
+        }
+
+        if (size > available)
+            return nullptr;
+
+        Chunk* chunk = reinterpret_cast<Chunk*>(this->m_top);
+        chunk->size = size;
+        chunk->prev_size = last != nullptr ? last->size : 0;
+        this->setTop(this->m_top + size);
+        this->m_last = chunk;
+        return chunk;
+    }
+
+    PersistentAllocator::Chunk* PersistentAllocator::split(Chunk* chunk, size_t size)
+    {
+        Chunk* rest = reinterpret_cast<Chunk*>(reinterpret_cast<char*>(chunk) + size);
+        rest->size = chunk->size - size;
+        rest->prev_size = size;
+        rest->destructor = nullptr;
+        rest->state = StateFree;
+
+        Chunk* next = this->getNext(rest);
+        if (next != nullptr)
+            next->prev_size = rest->size;
+        if (this->m_last == chunk)
+            this->m_last = rest;
+
+        chunk->size = size;
+        return rest;
+    }
+
+    void PersistentAllocator::absorbNext(Chunk* chunk)
+    {
+        Chunk* next = this->getNext(chunk);
+        chunk->size += next->size;
+
+        Chunk* after = this->getNext(chunk);
+        if (after != nullptr)
+            after->prev_size = chunk->size;
+        if (this->m_last == next)
+            this->m_last = chunk;
+    }
+
+    void PersistentAllocator::releaseChunk(Chunk* chunk)
+    {
+        chunk->state = StateFree;
+
+        // Free chunks never neighbour each other
+        Chunk* next = this->getNext(chunk);
+        if (next != nullptr && next->state == StateFree)
+        {
+            this->removeFree(next);
+            this->absorbNext(chunk);
+        }
+
+        Chunk* prev = this->getPrev(chunk);
+        if (prev != nullptr && prev->state == StateFree)
+        {
+            this->removeFree(prev);
+            this->absorbNext(prev);
+            chunk = prev;
+        }
+
+        this->insertFree(chunk);
+    }
+
+    void PersistentAllocator::destroyChunk(Chunk* chunk)
+    {
+        DestructorPtr destructor = chunk->destructor;
+        if (destructor != nullptr)
+        {
+            chunk->destructor = nullptr;
+            destructor(getUser(chunk));
+        }
+
+        this->m_used -= static_cast<size_t>(chunk->size);
+        this->releaseChunk(chunk);
+    }
+
+    void PersistentAllocator::updateRoots(const void* ptr, const void* replacement)
+    {
+        uint64_t offset = this->getChunkOffset(getChunk(ptr));
+        uint64_t replaced = replacement != nullptr ? this->getChunkOffset(getChunk(replacement)) : 0;
+        for (size_t i = 0; i < RootCount; ++i)
+        {
+            if (this->m_header->roots[i] == offset)
+                this->m_header->roots[i] = replaced;
+        }
+    }
+
+    void* PersistentAllocator::allocChunk(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < alignof(max_align_t))
+            align = alignof(max_align_t);
+
+        if (this->m_header == nullptr || (align & (align - 1)) != 0)
+            return nullptr;
+
+        size_t capacity = static_cast<size_t>(this->m_end - this->m_base);
+        if (bytes > capacity || align > capacity)
+            return nullptr;
+
+        // Room for the header and the alignment padding, the offset right before the user pointer ends the header
+        size_t padding = align > Granularity ? align - Granularity : 0;
+        size_t size = roundToGranularity(roundToGranularity(sizeof(Chunk)) + padding + bytes);
+        if (size > capacity)
+            return nullptr;
+
+        Chunk* chunk = this->findFree(size);
+        if (chunk != nullptr)
+        {
+            this->removeFree(chunk);
+            if (chunk->size - size >= roundToGranularity(sizeof(Chunk)) + Granularity)
+                this->insertFree(this->split(chunk, size));
+        }
+        else
+        {
+            chunk = this->carve(size);
+            if (chunk == nullptr)
+                return nullptr;
+        }
+
+        char* user = alignUp(reinterpret_cast<char*>(chunk) + sizeof(Chunk), align);
+        chunk->offset = static_cast<uint64_t>(user - reinterpret_cast<char*>(chunk));
+        reinterpret_cast<uint64_t*>(user)[-1] = chunk->offset;
+
+        chunk->destructor = destructor;
+        chunk->priority = 0;
+        chunk->state = StateUsed;
+        chunk->generation = this->m_header->generation;
+        chunk->stamp = this->m_header->stamp = getNextStamp(this->m_header->stamp);
+        this->m_used += static_cast<size_t>(chunk->size);
+
+        return user;
+    }
+
+    bool PersistentAllocator::resizeChunk(Chunk* chunk, size_t bytes)
+    {
+        if (bytes > static_cast<size_t>(this->m_end - this->m_base))
+            return false;
+
+        size_t size = roundToGranularity(static_cast<size_t>(chunk->offset) + bytes);
+        size_t min_split = roundToGranularity(sizeof(Chunk)) + Granularity;
+
+        // Shrink in place, the tail is freed
+        if (size <= chunk->size)
+        {
+            if (chunk->size - size >= min_split)
+            {
+                this->m_used -= static_cast<size_t>(chunk->size) - size;
+                this->releaseChunk(this->split(chunk, size));
+            }
+            return true;
+        }
+
+        // Grow into the following free chunk
+        Chunk* next = this->getNext(chunk);
+        if (next != nullptr && next->state == StateFree && chunk->size + next->size >= size)
+        {
+            this->removeFree(next);
+            size_t previous = static_cast<size_t>(chunk->size);
+            this->absorbNext(chunk);
+            if (chunk->size - size >= min_split)
+                this->insertFree(this->split(chunk, size));
+
+            this->m_used += static_cast<size_t>(chunk->size) - previous;
+            return true;
+        }
+
+        // Grow the chunk at the top, or through the free chunk at the top
+        size_t available = static_cast<size_t>(this->m_end - this->m_top);
+        if (next != nullptr && next == this->m_last && next->state == StateFree)
+        {
+            size_t extra = size - static_cast<size_t>(chunk->size + next->size);
+            if (extra > available)
+                return false;
+
+            this->removeFree(next);
+            size_t previous = static_cast<size_t>(chunk->size);
+            this->absorbNext(chunk);
+            chunk->size = size;
+            this->setTop(this->m_top + extra);
+            this->m_used += size - previous;
+            return true;
+        }
+
+        size_t extra = size - static_cast<size_t>(chunk->size);
+        if (chunk == this->m_last && extra <= available)
+        {
+            chunk->size = size;
+            this->setTop(this->m_top + extra);
+            this->m_used += extra;
+            return true;
+        }
+
+        return false;
+    }
+
+    void* PersistentAllocator::reallocChunk(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < alignof(max_align_t))
+            align = alignof(max_align_t);
+
+        Chunk* chunk = getChunk(ptr);
+        size_t usable = getUsable(chunk);
+
+        if (getAlignedOffset(ptr, align) == 0 && this->resizeChunk(chunk, bytes))
+        {
+            chunk->destructor = destructor;
+            return ptr;
+        }
+
+        void* ret = this->allocChunk(bytes, destructor, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, usable < bytes ? usable : bytes);
+        this->updateRoots(ptr, ret);
+        this->m_used -= static_cast<size_t>(chunk->size);
+        this->releaseChunk(chunk);
+
+        return ret;
+    }
+
+    void PersistentAllocator::discardFree()
+    {
+        size_t page = SystemMemory::getPageSize();
+
+        for (uint32_t bin = 0; bin < BinCount; ++bin)
+        {
+            for (Chunk* chunk = this->m_bins[bin]; chunk != nullptr; chunk = chunk->free_next)
+            {
+                // The header stays intact
+                char* begin = alignUp(reinterpret_cast<char*>(chunk) + sizeof(Chunk), page);
+                char* end = alignDown(reinterpret_cast<char*>(chunk) + chunk->size, page);
+                if (end > begin)
+                    SystemMemory::discardFile(begin, static_cast<size_t>(end - begin));
+            }
+        }
+
+        // Chunks released by a reset may have left data past the top
+        char* begin = alignUp(this->m_top, page);
+        char* end = alignDown(this->m_end, page);
+        if (end > begin)
+            SystemMemory::discardFile(begin, static_cast<size_t>(end - begin));
+    }
+
+    void PersistentAllocator::releaseAll()
+    {
+        for (uint32_t bin = 0; bin < BinCount; ++bin)
+            this->m_bins[bin] = nullptr;
+        this->m_bin_mask = 0;
+        this->m_offers.clear();
+
+        for (size_t i = 0; i < RootCount; ++i)
+            this->m_header->roots[i] = 0;
+
+        this->setTop(this->m_base);
+        this->m_last = nullptr;
+        this->m_used = 0;
+        this->m_pending = 0;
+    }
+
+    /*
+        Overridden ObjectAllocator function definitions
+    */
+
+    void* PersistentAllocator::alloc(size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocChunk(bytes, nullptr, align);
+    }
+
+    void* PersistentAllocator::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocChunk(bytes, destructor, align);
+    }
+
+    void PersistentAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr)
+            return;
+
+        if (this->m_clearing)
+        {
+            // Memory is released in bulk once clear finishes, only run the destructor
+            if (chunk->state == StateUsed || chunk->state == StateOffered)
+            {
+                DestructorPtr destructor = chunk->destructor;
+                chunk->state = StatePurged;
+                if (destructor != nullptr)
+                    destructor(ptr);
+            }
+            return;
+        }
+
+        this->updateRoots(ptr, nullptr);
+
+        switch (chunk->state)
+        {
+        case StateOffered:
+            this->m_offers.remove(&chunk->node);
+            this->m_pending -= getUsable(chunk);
+            this->destroyChunk(chunk);
+            break;
+        case StateUsed:
+            this->destroyChunk(chunk);
+            break;
+        case StatePurged:
+            this->m_used -= static_cast<size_t>(chunk->size);
+            this->releaseChunk(chunk);
+            break;
+        }
+    }
+
+    void* PersistentAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocChunk(bytes, nullptr, align);
+
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr || chunk->state != StateUsed)
+            return nullptr;
+
+        return this->reallocChunk(ptr, bytes, chunk->destructor, align);
+    }
+
+    void* PersistentAllocator::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocChunk(bytes, destructor, align);
+
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr || chunk->state != StateUsed)
+            return nullptr;
+
+        return this->reallocChunk(ptr, bytes, destructor, align);
+    }
+
+    size_t PersistentAllocator::getAllocSize(const void* ptr) const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        return chunk != nullptr ? getUsable(chunk) : 0;
+    }
+
+    bool PersistentAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr || chunk->state != StateUsed)
+            return false;
+        return bytes <= getUsable(chunk) || this->resizeChunk(chunk, bytes);
+    }
+
+    bool PersistentAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr || chunk->state != StateUsed)
+            return false;
+        return bytes <= getUsable(chunk) && this->resizeChunk(chunk, bytes);
+    }
+
+    void* PersistentAllocator::offer(void* ptr, uint32_t priority)
+    {
+        if (ptr == nullptr)
+            return nullptr;
+
+        // The chunk header doubles as the ticket, the offer pointer is the allocation itself, so its offset survives restarts
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr || chunk->state != StateUsed)
+            return nullptr;
+
+        chunk->state = StateOffered;
+        chunk->priority = priority;
+        this->m_offers.push(&chunk->node, priority);
+        this->m_pending += getUsable(chunk);
+
+        return ptr;
+    }
+
+    void* PersistentAllocator::reclaim(void* ptr)
+    {
+        if (ptr == nullptr)
+            return nullptr;
+
+        // Stale pointers, like the ones of a discarded heap, reclaim as purged
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Chunk* chunk = this->findChunk(ptr);
+        if (chunk == nullptr)
+            return nullptr;
+
+        if (chunk->state == StatePurged)
+        {
+            this->updateRoots(ptr, nullptr);
+            this->m_used -= static_cast<size_t>(chunk->size);
+            this->releaseChunk(chunk);
+            return nullptr;
+        }
+
+        if (chunk->state == StateOffered)
+        {
+            this->m_offers.remove(&chunk->node);
+            this->m_pending -= getUsable(chunk);
+            chunk->state = StateUsed;
+        }
+        return ptr;
+    }
+
+    void PersistentAllocator::reset()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (this->m_header != nullptr)
+            this->releaseAll();
+    }
+
+    void PersistentAllocator::purge(uint32_t priority)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (this->m_header == nullptr)
+            return;
+
+        while (OfferList::Node* node = this->m_offers.getOldest(priority))
+        {
+            Chunk* chunk = reinterpret_cast<Chunk*>(node);
+            this->m_offers.remove(node);
+            this->m_pending -= getUsable(chunk);
+            chunk->state = StatePurged;
+
+            DestructorPtr destructor = chunk->destructor;
+            if (destructor != nullptr)
+            {
+                chunk->destructor = nullptr;
+                destructor(getUser(chunk));
+            }
+
+            // Only the header up to the user pointer is kept for reclaim and free
+            size_t keep = roundToGranularity(static_cast<size_t>(chunk->offset));
+            if (chunk->size - keep >= roundToGranularity(sizeof(Chunk)) + Granularity)
+            {
+                this->m_used -= static_cast<size_t>(chunk->size) - keep;
+                this->releaseChunk(this->split(chunk, keep));
+            }
+        }
+
+        this->discardFree();
+    }
+
+    void PersistentAllocator::clear()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (this->m_header == nullptr)
+            return;
+
+        this->m_clearing = true;
+
+        auto destroy = [](DestructorPtr, void* block)
+        {
+            // Destructors earlier in the batch may have freed the chunk already
+            Chunk* chunk = reinterpret_cast<Chunk*>(block);
+            if (chunk->state == StateUsed || chunk->state == StateOffered)
+            {
+                DestructorPtr destructor = chunk->destructor;
+                chunk->state = StatePurged;
+                if (destructor != nullptr)
+                    destructor(getUser(chunk));
+            }
+        };
+
+        DestructorBatch<decltype(destroy)> batch(destroy);
+        for (char* ptr = this->m_base; ptr < this->m_top;)
+        {
+            Chunk* chunk = reinterpret_cast<Chunk*>(ptr);
+            ptr += chunk->size;
+
+            if ((chunk->state == StateUsed || chunk->state == StateOffered) && chunk->destructor != nullptr)
+                batch.add(chunk->destructor, chunk);
+        }
+        batch.run();
+
+        this->m_clearing = false;
+        this->releaseAll();
+    }
+
+    size_t PersistentAllocator::getFreeBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_top - this->m_base) - this->m_used;
+    }
+
+    size_t PersistentAllocator::getUsedBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_used;
+    }
+
+    size_t PersistentAllocator::getPendingBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_pending;
+    }
+
+    size_t PersistentAllocator::getTotalBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_top - this->m_base);
+    }
+}
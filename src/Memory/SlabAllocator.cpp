@@ -0,0 +1,475 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/SlabAllocator.hpp>
+#include <Shared/Util/Bits.hpp>
+#include <Shared/Util/BitSet.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    // Header at the start of every slab, the blocks follow it
+    struct alignas(64) SlabAllocator::Slab
+    {
+        Slab* prev; // Links in the class list, or the pool
+        Slab* next;
+        uint32_t size_class;
+        uint32_t block_size;
+        uint32_t capacity; // Blocks fitting the slab
+        uint32_t used; // Allocated blocks
+        uint32_t reciprocal; // Divides block offsets by the block size with a multiplication
+        uint32_t hint; // First bit of the lowest word that may have free blocks
+        bool listed; // Whether the slab is on its class list
+
+        Util::BitSet<SlabBlocks> free; // Set bits mark free blocks
+    };
+
+    namespace
+    {
+        template<class Slab>
+        inline char* getFirstBlock(Slab* slab) noexcept
+        {
+            return reinterpret_cast<char*>(slab) + sizeof(Slab);
+        }
+
+        // Exact for every block offset of a slab, as offsets and block sizes are far below 2^16
+        inline uint32_t getReciprocal(uint32_t block_size) noexcept
+        {
+            return static_cast<uint32_t>((uint64_t(1) << 32) / block_size + 1);
+        }
+
+        template<class Slab>
+        inline size_t getBlockIndex(Slab* slab, const void* ptr) noexcept
+        {
+            uint64_t offset = static_cast<uint64_t>(reinterpret_cast<const char*>(ptr) - getFirstBlock(slab));
+            return static_cast<size_t>((offset * slab->reciprocal) >> 32);
+        }
+
+        template<class Slab>
+        inline size_t getSlabUsed(Slab* slab) noexcept
+        {
+            return slab->capacity - slab->free.getCount();
+        }
+    }
+
+    /*
+        SlabAllocator definitions
+    */
+
+    SlabAllocator::SlabAllocator(BasicAllocator* backing, size_t reserve_bytes) :
+        m_backing(backing),
+        m_reservation(nullptr),
+        m_reserved(0),
+        m_base(nullptr),
+        m_end(nullptr),
+        m_classes(),
+        m_top(nullptr),
+        m_pool(nullptr)
+    {
+        // Reserve an extra slab so the first one can be aligned to the slab size
+        size_t bytes = SystemMemory::roundToPages(reserve_bytes - reserve_bytes % SlabSize + SlabSize);
+        this->m_reservation = reinterpret_cast<char*>(SystemMemory::reserve(bytes));
+        if (this->m_reservation == nullptr)
+            return;
+
+        this->m_reserved = bytes;
+        this->m_base = this->m_reservation + getAlignedOffset(this->m_reservation, SlabSize);
+        this->m_end = this->m_base + (reserve_bytes - reserve_bytes % SlabSize);
+        this->m_top = this->m_base;
+    }
+
+    SlabAllocator::~SlabAllocator()
+    {
+        SystemMemory::unmap(this->m_reservation, this->m_reserved);
+    }
+
+    size_t SlabAllocator::getSizeClass(size_t bytes) noexcept
+    {
+        if (bytes <= 128)
+            return bytes == 0 ? 0 : (bytes - 1) / 16;
+
+        // Four classes between consecutive powers of two
+        uint32_t width = Util::getBitWidth(bytes - 1);
+        return 8 + (width - 8) * 4 + (((bytes - 1) >> (width - 3)) & 3);
+    }
+
+    size_t SlabAllocator::getClassSize(size_t size_class) noexcept
+    {
+        if (size_class < 8)
+            return (size_class + 1) * 16;
+
+        size_t step = size_class - 8;
+        return (5 + step % 4) << (5 + step / 4);
+    }
+
+    SlabAllocator::Slab* SlabAllocator::getSlab(const void* ptr) noexcept
+    {
+        static_assert(sizeof(Slab) % alignof(max_align_t) == 0, "Blocks following the slab header must stay aligned");
+        static_assert((SlabSize - sizeof(Slab)) / 16 <= SlabBlocks, "The bitmap must cover every block of the smallest class");
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(SlabSize - 1));
+    }
+
+    void SlabAllocator::linkSlab(SizeClass& size_class, Slab* slab) noexcept
+    {
+        Slab*& first = size_class.slabs;
+
+        // Inserted after the first slab, so allocations keep filling the same one
+        slab->prev = first;
+        slab->next = first != nullptr ? first->next : nullptr;
+        if (slab->next != nullptr)
+            slab->next->prev = slab;
+        if (first != nullptr)
+            first->next = slab;
+        else
+            first = slab;
+        slab->listed = true;
+    }
+
+    void SlabAllocator::unlinkSlab(SizeClass& size_class, Slab* slab) noexcept
+    {
+        if (slab->prev != nullptr)
+            slab->prev->next = slab->next;
+        else
+            size_class.slabs = slab->next;
+        if (slab->next != nullptr)
+            slab->next->prev = slab->prev;
+
+        slab->prev = nullptr;
+        slab->next = nullptr;
+        slab->listed = false;
+    }
+
+    SlabAllocator::Slab* SlabAllocator::acquireSlab(size_t size_class)
+    {
+        Slab* slab = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+
+            if (this->m_pool != nullptr)
+            {
+                slab = this->m_pool;
+                this->m_pool = slab->next;
+            }
+            else if (this->m_top != nullptr && this->m_top < this->m_end)
+            {
+                if (!SystemMemory::commit(this->m_top, SlabSize))
+                    return nullptr;
+                slab = reinterpret_cast<Slab*>(this->m_top);
+                this->m_top += SlabSize;
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+
+        uint32_t block_size = static_cast<uint32_t>(getClassSize(size_class));
+
+        slab->prev = nullptr;
+        slab->next = nullptr;
+        slab->size_class = static_cast<uint32_t>(size_class);
+        slab->block_size = block_size;
+        slab->capacity = static_cast<uint32_t>((SlabSize - sizeof(Slab)) / block_size);
+        slab->used = 0;
+        slab->reciprocal = getReciprocal(block_size);
+        slab->hint = 0;
+        slab->free.assign(0, slab->capacity);
+        linkSlab(this->m_classes[size_class], slab);
+
+        return slab;
+    }
+
+    void SlabAllocator::releaseSlab(Slab* slab)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+
+        slab->next = this->m_pool;
+        this->m_pool = slab;
+    }
+
+    size_t SlabAllocator::allocBlocks(size_t size_class, size_t count, void** out)
+    {
+        SizeClass& list = this->m_classes[size_class];
+        size_t ret = 0;
+
+        while (ret < count)
+        {
+            Slab* slab = list.slabs;
+            if (slab == nullptr)
+            {
+                slab = this->acquireSlab(size_class);
+                if (slab == nullptr)
+                    break;
+            }
+
+            // Whole words of free bits are taken at once, the blocks are handed out in address order
+            uint64_t* words = slab->free.getWords();
+            char* first = getFirstBlock(slab);
+            size_t taken = 0;
+            size_t bit = slab->free.findFirstSet(slab->hint);
+            while (bit < SlabBlocks && ret + taken < count)
+            {
+                size_t index = bit / 64;
+                uint64_t word = words[index];
+                while (word != 0 && ret + taken < count)
+                {
+                    size_t block = index * 64 + Util::getTrailingZeros(word);
+                    word &= word - 1;
+                    out[ret + taken++] = first + block * slab->block_size;
+                }
+                words[index] = word;
+
+                bit = word != 0 ? index * 64 : slab->free.findFirstSet((index + 1) * 64);
+            }
+
+            slab->hint = static_cast<uint32_t>(bit < SlabBlocks ? bit & ~size_t(63) : SlabBlocks);
+            slab->used += static_cast<uint32_t>(taken);
+            ret += taken;
+
+            // Full slabs are only listed again once a block is freed
+            if (slab->used == slab->capacity)
+                unlinkSlab(list, slab);
+        }
+
+        return ret;
+    }
+
+    void SlabAllocator::freeBlock(SizeClass& size_class, Slab* slab, void* ptr)
+    {
+        size_t block = getBlockIndex(slab, ptr);
+        slab->free.set(block);
+        --slab->used;
+        if (block < slab->hint)
+            slab->hint = static_cast<uint32_t>(block & ~size_t(63));
+
+        if (!slab->listed)
+        {
+            linkSlab(size_class, slab);
+        }
+        else if (slab->used == 0 && (slab->prev != nullptr || slab->next != nullptr))
+        {
+            // A single empty slab is kept per class, so a workload oscillating around a slab boundary doesn't go through the pool
+            unlinkSlab(size_class, slab);
+            this->releaseSlab(slab);
+        }
+    }
+
+    size_t SlabAllocator::getSlabBytes() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_top - this->m_base);
+    }
+
+    size_t SlabAllocator::getSlabUsedBytes() const
+    {
+        // Slabs only change class through the pool, holding every class lock keeps every bitmap still
+        std::unique_lock<std::mutex> locks[ClassCount];
+        for (size_t i = 0; i < ClassCount; ++i)
+            locks[i] = std::unique_lock<std::mutex>(this->m_classes[i].mutex);
+
+        char* top;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            top = this->m_top;
+        }
+
+        // Pooled slabs are empty, their bitmaps have every block free
+        size_t ret = 0;
+        for (char* ptr = this->m_base; ptr < top; ptr += SlabSize)
+        {
+            Slab* slab = reinterpret_cast<Slab*>(ptr);
+            ret += getSlabUsed(slab) * slab->block_size;
+        }
+        return ret;
+    }
+
+    BasicAllocator* SlabAllocator::getBacking() const noexcept
+    {
+        return this->m_backing;
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* SlabAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (bytes <= MaxSmallSize && align <= alignof(max_align_t))
+        {
+            size_t size_class = getSizeClass(bytes);
+            void* ret = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(this->m_classes[size_class].mutex);
+                this->allocBlocks(size_class, 1, &ret);
+            }
+            if (ret != nullptr)
+                return ret;
+        }
+        return this->m_backing->alloc(bytes, align);
+    }
+
+    void SlabAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        if (!this->isSlabBlock(ptr))
+        {
+            this->m_backing->free(ptr);
+            return;
+        }
+
+        // The class of a slab can't change while it has allocated blocks
+        Slab* slab = getSlab(ptr);
+        SizeClass& size_class = this->m_classes[slab->size_class];
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        this->freeBlock(size_class, slab, ptr);
+    }
+
+    void SlabAllocator::free(void* ptr, size_t bytes)
+    {
+        if (ptr != nullptr && !this->isSlabBlock(ptr))
+            this->m_backing->free(ptr, bytes);
+        else
+            this->free(ptr);
+    }
+
+    void* SlabAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+        if (!this->isSlabBlock(ptr))
+            return this->m_backing->realloc(ptr, bytes, align);
+
+        // Stay in place unless the block would be less than half used
+        size_t block_size = getSlab(ptr)->block_size;
+        if (align <= alignof(max_align_t) && bytes <= block_size && (bytes > block_size / 2 || block_size == 16))
+            return ptr;
+
+        void* ret = this->alloc(bytes, align);
+        if (ret != nullptr)
+        {
+            std::memcpy(ret, ptr, bytes < block_size ? bytes : block_size);
+            this->free(ptr);
+        }
+        return ret;
+    }
+
+    void* SlabAllocator::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        if (ptr != nullptr && !this->isSlabBlock(ptr))
+            return this->m_backing->reallocSized(ptr, old_bytes, bytes, align);
+        return this->realloc(ptr, bytes, align);
+    }
+
+    size_t SlabAllocator::getAllocSize(const void* ptr) const
+    {
+        if (this->isSlabBlock(ptr))
+            return getSlab(ptr)->block_size;
+        return this->m_backing->getAllocSize(ptr);
+    }
+
+    bool SlabAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (this->isSlabBlock(ptr))
+            return bytes <= getSlab(ptr)->block_size;
+        return this->m_backing->tryExpand(ptr, bytes);
+    }
+
+    bool SlabAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (this->isSlabBlock(ptr))
+            return bytes <= getSlab(ptr)->block_size;
+        return this->m_backing->tryShrink(ptr, bytes);
+    }
+
+    size_t SlabAllocator::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        if (bytes > MaxSmallSize || align > alignof(max_align_t))
+            return this->m_backing->allocBulk(bytes, count, out, align);
+
+        size_t size_class = getSizeClass(bytes);
+        size_t ret;
+        {
+            std::lock_guard<std::mutex> lock(this->m_classes[size_class].mutex);
+            ret = this->allocBlocks(size_class, count, out);
+        }
+
+        // The rest is requested from the backing allocator once the reservation is exhausted
+        if (ret < count)
+            ret += this->m_backing->allocBulk(bytes, count - ret, out + ret, align);
+        return ret;
+    }
+
+    void SlabAllocator::freeBulk(void** ptrs, size_t count)
+    {
+        size_t i = 0;
+        while (i < count)
+        {
+            void* ptr = ptrs[i];
+            if (ptr == nullptr || !this->isSlabBlock(ptr))
+            {
+                if (ptr != nullptr)
+                    this->m_backing->free(ptr);
+                ++i;
+                continue;
+            }
+
+            // Consecutive blocks of the same class are freed under a single lock
+            uint32_t class_index = getSlab(ptr)->size_class;
+            SizeClass& size_class = this->m_classes[class_index];
+            std::lock_guard<std::mutex> lock(size_class.mutex);
+            for (; i < count; ++i)
+            {
+                ptr = ptrs[i];
+                if (ptr == nullptr || !this->isSlabBlock(ptr) || getSlab(ptr)->size_class != class_index)
+                    break;
+                this->freeBlock(size_class, getSlab(ptr), ptr);
+            }
+        }
+    }
+
+    void SlabAllocator::reset()
+    {
+        {
+            std::unique_lock<std::mutex> locks[ClassCount];
+            for (size_t i = 0; i < ClassCount; ++i)
+            {
+                locks[i] = std::unique_lock<std::mutex>(this->m_classes[i].mutex);
+                this->m_classes[i].slabs = nullptr;
+            }
+
+            // Every slab goes back to the reservation, their memory is returned to the system
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            if (this->m_top != this->m_base)
+                SystemMemory::decommit(this->m_base, static_cast<size_t>(this->m_top - this->m_base), false);
+            this->m_top = this->m_base;
+            this->m_pool = nullptr;
+        }
+        this->m_backing->reset();
+    }
+
+    size_t SlabAllocator::getFreeBytes() const
+    {
+        // Headers and the tails of the slabs count as free
+        return this->m_backing->getFreeBytes() + this->getSlabBytes() - this->getSlabUsedBytes();
+    }
+
+    size_t SlabAllocator::getUsedBytes() const
+    {
+        return this->m_backing->getUsedBytes() + this->getSlabUsedBytes();
+    }
+
+    size_t SlabAllocator::getTotalBytes() const
+    {
+        return this->m_backing->getTotalBytes() + this->getSlabBytes();
+    }
+}
@@ -0,0 +1,334 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/StackAllocator.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    /*
+        Internal structures
+    */
+
+    // Precedes every allocation, holding the state of the stack before it
+    struct StackAllocator::Header
+    {
+        Marker below;
+        size_t size; // Requested size, the highest bit marks allocations freed out of order
+    };
+
+    // Header of a mapped page, the usable region follows the structure
+    struct alignas(alignof(max_align_t)) StackAllocator::Page
+    {
+        Page* next;
+        size_t bytes; // Size of the whole mapping
+    };
+
+    namespace
+    {
+        constexpr size_t FreedBit = ~(std::numeric_limits<size_t>::max() >> 1);
+
+        template<class Page>
+        inline char* getPageBegin(Page* page) noexcept
+        {
+            return reinterpret_cast<char*>(page + 1);
+        }
+
+        template<class Page>
+        inline char* getPageEnd(Page* page) noexcept
+        {
+            return reinterpret_cast<char*>(page) + page->bytes;
+        }
+
+        template<class Header>
+        inline Header* getHeader(const void* ptr) noexcept
+        {
+            return reinterpret_cast<Header*>(const_cast<char*>(reinterpret_cast<const char*>(ptr)) - sizeof(Header));
+        }
+
+        // Aligned user pointer leaving room for the header, or nullptr if the allocation doesn't fit
+        template<class Header>
+        inline char* fitAllocation(char* top, char* end, size_t bytes, size_t align) noexcept
+        {
+            if (top == nullptr)
+                return nullptr;
+
+            uintptr_t user = reinterpret_cast<uintptr_t>(top) + sizeof(Header);
+            user += BasicAllocator::getAlignedOffset(reinterpret_cast<void*>(user), align);
+            if (user > reinterpret_cast<uintptr_t>(end) || bytes > reinterpret_cast<uintptr_t>(end) - user)
+                return nullptr;
+
+            return reinterpret_cast<char*>(user);
+        }
+    }
+
+    /*
+        StackAllocator definitions
+    */
+
+    StackAllocator::StackAllocator(size_t page_bytes) :
+        m_pages(nullptr),
+        m_current(nullptr),
+        m_buffer(nullptr),
+        m_top(nullptr),
+        m_end(nullptr),
+        m_last(nullptr),
+        m_page_bytes(page_bytes != 0 ? page_bytes : DefaultPageBytes),
+        m_used(0),
+        m_total(0)
+    {
+    }
+
+    StackAllocator::StackAllocator(void* buffer, size_t bytes) :
+        m_pages(nullptr),
+        m_current(nullptr),
+        m_buffer(reinterpret_cast<char*>(buffer)),
+        m_top(reinterpret_cast<char*>(buffer)),
+        m_end(reinterpret_cast<char*>(buffer) + bytes),
+        m_last(nullptr),
+        m_page_bytes(0),
+        m_used(0),
+        m_total(bytes)
+    {
+    }
+
+    StackAllocator::~StackAllocator()
+    {
+        Page* page = this->m_pages;
+        while (page != nullptr)
+        {
+            Page* next = page->next;
+            SystemMemory::unmap(page, page->bytes);
+            page = next;
+        }
+    }
+
+    bool StackAllocator::nextPage(size_t bytes, size_t align)
+    {
+        if (this->m_page_bytes == 0)
+            return false;
+
+        if (bytes > std::numeric_limits<size_t>::max() / 2 - align)
+            return false;
+
+        // The tail of the current page is lost until the stack moves below it
+        if (this->m_current != nullptr)
+            this->m_used += static_cast<size_t>(this->m_end - this->m_top);
+
+        // Pages kept from earlier growth are reused first
+        Page* page = this->m_current != nullptr ? this->m_current->next : this->m_pages;
+        while (page != nullptr)
+        {
+            this->setPage(page, getPageBegin(page));
+
+            if (fitAllocation<Header>(this->m_top, this->m_end, bytes, align) != nullptr)
+                return true;
+
+            this->m_used += static_cast<size_t>(this->m_end - this->m_top);
+            page = page->next;
+        }
+
+        size_t needed = SystemMemory::roundToPages(sizeof(Page) + sizeof(Header) + align + bytes);
+        if (needed < this->m_page_bytes)
+            needed = SystemMemory::roundToPages(this->m_page_bytes);
+
+        page = reinterpret_cast<Page*>(SystemMemory::map(needed));
+        if (page == nullptr)
+            return false;
+
+        page->bytes = needed;
+        page->next = nullptr;
+        if (this->m_current != nullptr)
+            this->m_current->next = page;
+        else
+            this->m_pages = page;
+
+        this->setPage(page, getPageBegin(page));
+        this->m_total += static_cast<size_t>(this->m_end - this->m_top);
+
+        return true;
+    }
+
+    void StackAllocator::setPage(Page* page, char* top) noexcept
+    {
+        this->m_top = top;
+        if (page != nullptr)
+        {
+            this->m_current = page;
+            this->m_end = getPageEnd(page);
+        }
+        else if (this->m_pages != nullptr)
+        {
+            // Captured before the first page got mapped
+            this->m_current = nullptr;
+            this->m_end = nullptr;
+        }
+    }
+
+    void StackAllocator::pop(Header* header) noexcept
+    {
+        const Marker& below = header->below;
+        this->setPage(below.page, below.top);
+        this->m_last = below.last;
+        this->m_used = below.used;
+    }
+
+    void StackAllocator::popFreed() noexcept
+    {
+        while (this->m_last != nullptr && (this->m_last->size & FreedBit) != 0)
+            this->pop(this->m_last);
+    }
+
+    StackAllocator::Marker StackAllocator::getMarker() const noexcept
+    {
+        return Marker{ this->m_top, this->m_last, this->m_current, this->m_used };
+    }
+
+    void StackAllocator::rollback(const Marker& marker) noexcept
+    {
+        this->setPage(marker.page, marker.top);
+        this->m_last = marker.last;
+        this->m_used = marker.used;
+
+        // Allocations freed out of order may be on the top now
+        this->popFreed();
+    }
+
+    bool StackAllocator::isTop(const void* ptr) const noexcept
+    {
+        return ptr != nullptr && getHeader<Header>(ptr) == this->m_last;
+    }
+
+    /*
+        Overridden BasicAllocator function definitions
+    */
+
+    void* StackAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (align < alignof(Header))
+            align = alignof(Header);
+
+        Marker below = this->getMarker();
+
+        char* user = fitAllocation<Header>(this->m_top, this->m_end, bytes, align);
+        if (user == nullptr)
+        {
+            if (!this->nextPage(bytes, align))
+            {
+                this->setPage(below.page, below.top);
+                this->m_used = below.used;
+                return nullptr;
+            }
+            user = fitAllocation<Header>(this->m_top, this->m_end, bytes, align);
+        }
+
+        Header* header = getHeader<Header>(user);
+        header->below = below;
+        header->size = bytes;
+
+        char* top = user + bytes;
+        this->m_used += static_cast<size_t>(top - this->m_top);
+        this->m_top = top;
+        this->m_last = header;
+
+        return user;
+    }
+
+    void StackAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        Header* header = getHeader<Header>(ptr);
+        if (header == this->m_last)
+        {
+            this->pop(header);
+            this->popFreed();
+        }
+        else
+        {
+            header->size |= FreedBit;
+        }
+    }
+
+    void* StackAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        if (getAlignedOffset(ptr, align) == 0 && this->StackAllocator::tryExpand(ptr, bytes))
+            return ptr;
+
+        size_t size = getHeader<Header>(ptr)->size;
+        void* ret = this->alloc(bytes, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, size < bytes ? size : bytes);
+        this->free(ptr);
+        return ret;
+    }
+
+    size_t StackAllocator::getAllocSize(const void* ptr) const
+    {
+        return getHeader<Header>(ptr)->size & ~FreedBit;
+    }
+
+    bool StackAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        char* user = reinterpret_cast<char*>(ptr);
+        Header* header = getHeader<Header>(ptr);
+
+        // The top allocation can be resized as long as the region has room
+        if (header == this->m_last && bytes <= static_cast<size_t>(this->m_end - user))
+        {
+            this->m_used = this->m_used - header->size + bytes;
+            this->m_top = user + bytes;
+            header->size = bytes;
+            return true;
+        }
+
+        return bytes <= header->size;
+    }
+
+    bool StackAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr || bytes > getHeader<Header>(ptr)->size)
+            return false;
+
+        // Only the top allocation gives its tail back
+        return this->StackAllocator::tryExpand(ptr, bytes);
+    }
+
+    void StackAllocator::reset()
+    {
+        this->m_used = 0;
+        this->m_last = nullptr;
+        if (this->m_pages != nullptr)
+            this->setPage(this->m_pages, getPageBegin(this->m_pages));
+        else
+            this->m_top = this->m_buffer;
+    }
+
+    size_t StackAllocator::getFreeBytes() const
+    {
+        return this->m_total - this->m_used;
+    }
+
+    size_t StackAllocator::getUsedBytes() const
+    {
+        return this->m_used;
+    }
+
+    size_t StackAllocator::getTotalBytes() const
+    {
+        return this->m_total;
+    }
+}
@@ -0,0 +1,329 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include "SystemMemory.hpp"
+
+#include <Shared/Platform/Target.hpp>
+
+#if defined(PLATFORM_OS_WIN)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/file.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   if defined(PLATFORM_OS_LINUX)
+#       include <sys/syscall.h>
+#       include <cstdio>
+#   endif
+#endif
+
+namespace Memory
+{
+    namespace SystemMemory
+    {
+        size_t getPageSize() noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            static const size_t page_size = []() {
+                SYSTEM_INFO info;
+                GetSystemInfo(&info);
+                return static_cast<size_t>(info.dwPageSize);
+            }();
+#else
+            static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+            return page_size;
+        }
+
+        void* map(size_t bytes) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+            void* ret = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return ret != MAP_FAILED ? ret : nullptr;
+#endif
+        }
+
+        void unmap(void* ptr, size_t bytes) noexcept
+        {
+            if (ptr == nullptr)
+                return;
+#if defined(PLATFORM_OS_WIN)
+            (void)bytes;
+            VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+            munmap(ptr, bytes);
+#endif
+        }
+
+        void* remap(void* ptr, size_t old_bytes, size_t bytes) noexcept
+        {
+#if defined(PLATFORM_OS_LINUX) && defined(MREMAP_MAYMOVE)
+            void* ret = mremap(ptr, old_bytes, bytes, MREMAP_MAYMOVE);
+            return ret != MAP_FAILED ? ret : nullptr;
+#else
+            (void)ptr;
+            (void)old_bytes;
+            (void)bytes;
+            return nullptr;
+#endif
+        }
+
+        void* reserve(size_t bytes) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            return VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+#else
+#   if defined(MAP_NORESERVE)
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#   else
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#   endif
+            void* ret = mmap(nullptr, bytes, PROT_NONE, flags, -1, 0);
+            return ret != MAP_FAILED ? ret : nullptr;
+#endif
+        }
+
+        bool commit(void* ptr, size_t bytes) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            return VirtualAlloc(ptr, bytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+            return mprotect(ptr, bytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+        }
+
+        void decommit(void* ptr, size_t bytes, bool lazy) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            (void)lazy;
+            VirtualFree(ptr, bytes, MEM_DECOMMIT);
+#else
+#   if defined(MADV_FREE)
+            if (lazy && madvise(ptr, bytes, MADV_FREE) == 0)
+                return;
+#   else
+            (void)lazy;
+#   endif
+            madvise(ptr, bytes, MADV_DONTNEED);
+#endif
+        }
+
+        bool protect(void* ptr, size_t bytes) noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            return VirtualFree(ptr, bytes, MEM_DECOMMIT) != 0;
+#else
+            madvise(ptr, bytes, MADV_DONTNEED);
+            return mprotect(ptr, bytes, PROT_NONE) == 0;
+#endif
+        }
+
+        bool mapFile(const char* path, size_t min_bytes, FileMapping& out) noexcept
+        {
+            out = FileMapping{ nullptr, 0, -1, nullptr };
+#if defined(PLATFORM_OS_WIN)
+            HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size))
+            {
+                CloseHandle(file);
+                return false;
+            }
+
+            if (static_cast<uint64_t>(size.QuadPart) < min_bytes)
+            {
+                size.QuadPart = static_cast<LONGLONG>(min_bytes);
+                if (!SetFilePointerEx(file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+                {
+                    CloseHandle(file);
+                    return false;
+                }
+            }
+
+            size_t bytes = static_cast<size_t>(size.QuadPart);
+            HANDLE mapping = bytes != 0 ? CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(uint64_t(bytes) >> 32), static_cast<DWORD>(bytes), nullptr) : nullptr;
+            void* ptr = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes) : nullptr;
+            if (ptr == nullptr)
+            {
+                if (mapping != nullptr)
+                    CloseHandle(mapping);
+                CloseHandle(file);
+                return false;
+            }
+
+            out = FileMapping{ ptr, bytes, reinterpret_cast<intptr_t>(file), mapping };
+            return true;
+#else
+            int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return false;
+
+            // Exclusive like the Windows share mode, a file mapped by another process or another mapping of this one can't be opened
+            if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+            {
+                close(fd);
+                return false;
+            }
+
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+            {
+                close(fd);
+                return false;
+            }
+
+            size_t bytes = static_cast<size_t>(info.st_size);
+            if (static_cast<uint64_t>(info.st_size) < min_bytes)
+            {
+                if (ftruncate(fd, static_cast<off_t>(min_bytes)) != 0)
+                {
+                    close(fd);
+                    return false;
+                }
+                bytes = min_bytes;
+            }
+
+            void* ptr = bytes != 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+            if (ptr == MAP_FAILED)
+            {
+                close(fd);
+                return false;
+            }
+
+            out = FileMapping{ ptr, bytes, fd, nullptr };
+            return true;
+#endif
+        }
+
+        bool syncFile(const FileMapping& mapping, void* ptr, size_t bytes) noexcept
+        {
+            if (mapping.ptr == nullptr)
+                return false;
+
+            char* begin = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(ptr) & ~(getPageSize() - 1));
+            bytes += static_cast<size_t>(reinterpret_cast<char*>(ptr) - begin);
+#if defined(PLATFORM_OS_WIN)
+            return FlushViewOfFile(begin, bytes) && FlushFileBuffers(reinterpret_cast<HANDLE>(mapping.file));
+#else
+            return msync(begin, bytes, MS_SYNC) == 0;
+#endif
+        }
+
+        void discardFile(void* ptr, size_t bytes) noexcept
+        {
+#if defined(MADV_REMOVE)
+            madvise(ptr, bytes, MADV_REMOVE);
+#else
+            (void)ptr;
+            (void)bytes;
+#endif
+        }
+
+        void unmapFile(FileMapping& mapping) noexcept
+        {
+            if (mapping.ptr == nullptr)
+                return;
+#if defined(PLATFORM_OS_WIN)
+            UnmapViewOfFile(mapping.ptr);
+            CloseHandle(reinterpret_cast<HANDLE>(mapping.mapping));
+            CloseHandle(reinterpret_cast<HANDLE>(mapping.file));
+#else
+            munmap(mapping.ptr, mapping.bytes);
+            flock(static_cast<int>(mapping.file), LOCK_UN);
+            close(static_cast<int>(mapping.file));
+#endif
+            mapping = FileMapping{ nullptr, 0, -1, nullptr };
+        }
+
+        void adviseHugePages(void* ptr, size_t bytes) noexcept
+        {
+#if defined(MADV_HUGEPAGE)
+            madvise(ptr, bytes, MADV_HUGEPAGE);
+#else
+            (void)ptr;
+            (void)bytes;
+#endif
+        }
+
+        uint32_t getNumaNodeCount() noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            static const uint32_t count = []() {
+                ULONG highest = 0;
+                return GetNumaHighestNodeNumber(&highest) ? static_cast<uint32_t>(highest) + 1 : 1;
+            }();
+#elif defined(PLATFORM_OS_LINUX)
+            static const uint32_t count = []() {
+                // The online node list looks like "0-1" or "0,2-3"
+                uint32_t highest = 0;
+                if (FILE* file = std::fopen("/sys/devices/system/node/online", "r"))
+                {
+                    unsigned int value = 0;
+                    while (std::fscanf(file, "%u", &value) == 1)
+                    {
+                        if (value > highest)
+                            highest = value;
+                        if (std::fgetc(file) == EOF)
+                            break;
+                    }
+                    std::fclose(file);
+                }
+                return highest + 1;
+            }();
+#else
+            static const uint32_t count = 1;
+#endif
+            return count;
+        }
+
+        uint32_t getNumaNode() noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            PROCESSOR_NUMBER processor;
+            GetCurrentProcessorNumberEx(&processor);
+            USHORT node = 0;
+            return GetNumaProcessorNodeEx(&processor, &node) ? static_cast<uint32_t>(node) : 0;
+#elif defined(PLATFORM_OS_LINUX) && defined(SYS_getcpu)
+            unsigned int cpu = 0;
+            unsigned int node = 0;
+            return syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? static_cast<uint32_t>(node) : 0;
+#else
+            return 0;
+#endif
+        }
+
+        bool bindToNumaNode(void* ptr, size_t bytes, uint32_t node) noexcept
+        {
+#if defined(PLATFORM_OS_LINUX) && defined(SYS_mbind)
+            // Same values as MPOL_PREFERRED and MAX_NUMNODES of the kernel headers, which may not be installed
+            const int preferred = 1;
+            const uint32_t max_nodes = 1024;
+            if (node >= max_nodes)
+                return false;
+
+            unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+            mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+            return syscall(SYS_mbind, ptr, bytes, preferred, mask, static_cast<unsigned long>(max_nodes + 1), 0u) == 0;
+#else
+            (void)ptr;
+            (void)bytes;
+            (void)node;
+            return false;
+#endif
+        }
+    }
+}
@@ -0,0 +1,209 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+/*
+ *  Internal helpers wrapping the operating system's virtual memory API.
+ *  Not part of the public interface, only used by the allocator implementations.
+ */
+#ifndef SHARED_MEMORY_SYSTEMMEMORY_HPP
+#define SHARED_MEMORY_SYSTEMMEMORY_HPP
+
+#include <Shared/Platform/Types.hpp>
+#include <Shared/Platform/Target.hpp>
+
+namespace Memory
+{
+    namespace SystemMemory
+    {
+        /**
+         * @brief Get the size of a virtual memory page.
+         *
+         * @return The page size in bytes, always a power of two.
+         */
+        size_t getPageSize() noexcept;
+
+        /**
+         * @brief Round a byte count up to the page size.
+         */
+        inline size_t roundToPages(size_t bytes) noexcept
+        {
+            size_t page = getPageSize();
+            return (bytes + page - 1) & ~(page - 1);
+        }
+
+        /**
+         * @brief Map committed, zero filled pages.
+         *
+         * @param bytes Size of the mapping, must be a multiple of the page size.
+         * @return Page aligned pointer to the mapping, @b nullptr on failure.
+         */
+        void* map(size_t bytes) noexcept;
+
+        /**
+         * @brief Unmap pages previously mapped by @ref map.
+         *
+         * @param ptr Pointer returned by @ref map. May be @b nullptr.
+         * @param bytes The size passed to @ref map.
+         */
+        void unmap(void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief Resize pages previously mapped by @ref map, moving them if needed.
+         *
+         * The contents are kept up to the smaller of the two sizes, without copying. Only supported on GNU/Linux.
+         *
+         * @param ptr Pointer returned by @ref map or @ref remap.
+         * @param old_bytes The current size of the mapping.
+         * @param bytes The new size, must be a multiple of the page size.
+         * @return Page aligned pointer to the resized mapping, @b nullptr on failure or if unsupported, then the mapping is left untouched.
+         */
+        void* remap(void* ptr, size_t old_bytes, size_t bytes) noexcept;
+
+        /**
+         * @brief Reserve address space without committing it.
+         *
+         * The pages are inaccessible until committed by @ref commit. Release with @ref unmap.
+         *
+         * @param bytes Size of the reservation, must be a multiple of the page size.
+         * @return Page aligned pointer to the reservation, @b nullptr on failure.
+         */
+        void* reserve(size_t bytes) noexcept;
+
+        /**
+         * @brief Commit reserved or decommitted pages.
+         *
+         * Committed pages are readable and writable. Newly committed pages are zero filled, recommitted pages may keep their previous content.
+         *
+         * @param ptr Page aligned pointer inside a reservation.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         * @return @b true on success.
+         */
+        bool commit(void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief Return the physical memory behind committed pages.
+         *
+         * The content of the pages is lost. On Windows the pages become inaccessible until committed again, elsewhere they stay accessible and read as zero or as their old content.
+         *
+         * @param ptr Page aligned pointer inside a reservation.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         * @param lazy Let the operating system reclaim the pages only when it runs low on memory, where supported.
+         */
+        void decommit(void* ptr, size_t bytes, bool lazy) noexcept;
+
+        /**
+         * @brief Make committed pages inaccessible and return their physical memory.
+         *
+         * Any access faults until the pages are committed again by @ref commit, which zero fills them.
+         *
+         * @param ptr Page aligned pointer inside a reservation.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         * @return @b true on success.
+         */
+        bool protect(void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief A file mapped into memory by @ref mapFile.
+         */
+        struct FileMapping
+        {
+            void* ptr; // Page aligned start of the mapping, nullptr if not mapped
+            size_t bytes; // Size of the mapping, the whole file
+            intptr_t file; // File descriptor or handle
+            void* mapping; // File mapping object on Windows, unused elsewhere
+        };
+
+        /**
+         * @brief Map a whole file shared and writable, creating it if necessary.
+         *
+         * Files shorter than @a min_bytes are extended with zero bytes, sparsely where the file system supports it.
+         * The file is held exclusively until @ref unmapFile: mapping a file already mapped, by this or by another process, fails.
+         *
+         * @param path Path of the file.
+         * @param min_bytes Smallest size of the file.
+         * @param out Receives the mapping.
+         * @return @b true on success, @a out is left unmapped on failure.
+         */
+        bool mapFile(const char* path, size_t min_bytes, FileMapping& out) noexcept;
+
+        /**
+         * @brief Write the modified pages of a range back to the file and wait for the writes.
+         *
+         * @param mapping A mapped file.
+         * @param ptr Pointer inside the mapping, rounded down to the page size.
+         * @param bytes Size of the range.
+         * @return @b true on success.
+         */
+        bool syncFile(const FileMapping& mapping, void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief Drop the content of pages of a mapped file, releasing their storage.
+         *
+         * The pages read as zero afterwards. Only has an effect on GNU/Linux, with file systems supporting hole punching.
+         *
+         * @param ptr Page aligned pointer inside a mapped file.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         */
+        void discardFile(void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief Unmap and close a file mapped by @ref mapFile.
+         *
+         * Modified pages are written back by the operating system eventually, @ref syncFile waits for them.
+         *
+         * @param mapping The mapped file, left unmapped. May be unmapped already.
+         */
+        void unmapFile(FileMapping& mapping) noexcept;
+
+        /**
+         * @brief Ask for transparent huge pages.
+         *
+         * Only has an effect on systems supporting transparent huge pages, like GNU/Linux.
+         *
+         * @param ptr Page aligned pointer inside a reservation.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         */
+        void adviseHugePages(void* ptr, size_t bytes) noexcept;
+
+        /**
+         * @brief Get the amount of NUMA nodes.
+         *
+         * @return The highest node number plus one, 1 on systems without NUMA support.
+         */
+        uint32_t getNumaNodeCount() noexcept;
+
+        /**
+         * @brief Get the NUMA node of the processor running the calling thread.
+         *
+         * The thread may be migrated to another node right after the call returns.
+         *
+         * @return The node number, 0 if unknown.
+         */
+        uint32_t getNumaNode() noexcept;
+
+        /**
+         * @brief Prefer a NUMA node for the physical memory behind a range.
+         *
+         * Pages faulted in after the call come from @a node while it has free memory, pages already present stay where they are.
+         * Only supported on GNU/Linux.
+         *
+         * @param ptr Page aligned pointer to mapped memory.
+         * @param bytes Size of the range, must be a multiple of the page size.
+         * @param node The preferred node.
+         * @return @b true on success.
+         */
+        bool bindToNumaNode(void* ptr, size_t bytes, uint32_t node) noexcept;
+
+        /**
+         * @brief Check whether decommitted pages have to be committed before access.
+         */
+        constexpr bool isDecommitInaccessible() noexcept
+        {
+#if defined(PLATFORM_OS_WIN)
+            return true;
+#else
+            return false;
+#endif
+        }
+    }
+}
+
+#endif /* SHARED_MEMORY_SYSTEMMEMORY_HPP */
@@ -0,0 +1,106 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/TaskArena.hpp>
+
+namespace Memory
+{
+    /*
+        TaskArena definitions
+    */
+
+    TaskArena::TaskArena(size_t page_bytes) :
+        m_arena(page_bytes),
+        m_live(0),
+        m_resets(0)
+    {
+    }
+
+    TaskArena::TaskArena(void* buffer, size_t bytes) :
+        m_arena(buffer, bytes),
+        m_live(0),
+        m_resets(0)
+    {
+    }
+
+    size_t TaskArena::getLiveCount() const noexcept
+    {
+        return this->m_live;
+    }
+
+    uint64_t TaskArena::getResetCount() const noexcept
+    {
+        return this->m_resets;
+    }
+
+    /*
+        Overridden BasicAllocator function definitions
+    */
+
+    void* TaskArena::alloc(size_t bytes, size_t align)
+    {
+        void* ptr = this->m_arena.alloc(bytes, align);
+        if (ptr != nullptr)
+            ++this->m_live;
+        return ptr;
+    }
+
+    void TaskArena::free(void* ptr)
+    {
+        if (ptr == nullptr || this->m_live == 0)
+            return;
+
+        if (--this->m_live == 0)
+        {
+            this->m_arena.reset();
+            ++this->m_resets;
+        }
+    }
+
+    void* TaskArena::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        // A moved block replaces the old one, the count only changes for new blocks
+        void* ret = this->m_arena.realloc(ptr, bytes, align);
+        if (ptr == nullptr && ret != nullptr)
+            ++this->m_live;
+        return ret;
+    }
+
+    size_t TaskArena::getAllocSize(const void* ptr) const
+    {
+        return this->m_arena.getAllocSize(ptr);
+    }
+
+    bool TaskArena::tryExpand(void* ptr, size_t bytes)
+    {
+        return this->m_arena.tryExpand(ptr, bytes);
+    }
+
+    bool TaskArena::tryShrink(void* ptr, size_t bytes)
+    {
+        return this->m_arena.tryShrink(ptr, bytes);
+    }
+
+    void TaskArena::reset()
+    {
+        this->m_arena.reset();
+        this->m_live = 0;
+        ++this->m_resets;
+    }
+
+    size_t TaskArena::getFreeBytes() const
+    {
+        return this->m_arena.getFreeBytes();
+    }
+
+    size_t TaskArena::getUsedBytes() const
+    {
+        return this->m_arena.getUsedBytes();
+    }
+
+    size_t TaskArena::getTotalBytes() const
+    {
+        return this->m_arena.getTotalBytes();
+    }
+}
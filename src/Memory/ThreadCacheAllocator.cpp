@@ -0,0 +1,408 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/ThreadCacheAllocator.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace Memory
+{
+    namespace
+    {
+        // Guards cache ownership: the owner registries and orphaning of caches
+        std::mutex s_registry_mutex;
+        std::atomic<uint64_t> s_next_id(1);
+
+        // Set once the thread's cache list got destroyed. Trivially destructible, so it stays readable while the remaining thread exit handlers run
+        thread_local bool t_torn_down = false;
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Per thread, per allocator cache. Mapped directly from the system so it never depends on the backing allocator's lifetime
+    struct ThreadCacheAllocator::ThreadCache
+    {
+        ThreadCacheAllocator* owner; // nullptr once the owner got destroyed
+        uint64_t owner_id;
+        ThreadCache* owner_prev; // Links in the owner's registry
+        ThreadCache* owner_next;
+        ThreadCache* thread_next; // Link in the thread's cache list
+        size_t bytes; // Size of the mapping
+
+        uint32_t counts[ClassCount];
+        void* blocks[ClassCount][MagazineSize];
+    };
+
+    // Caches of a single thread, flushed when the thread exits
+    struct ThreadCacheAllocator::ThreadList
+    {
+        ThreadCache* head = nullptr;
+        ThreadCache* last = nullptr; // Most recently used cache
+
+        ~ThreadList()
+        {
+            // Frees made by later thread exit handlers, like the C library freeing its own bookkeeping, go straight to the backing allocator
+            t_torn_down = true;
+
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+            ThreadCache* cache = this->head;
+            while (cache != nullptr)
+            {
+                ThreadCache* next = cache->thread_next;
+                if (cache->owner != nullptr)
+                {
+                    flushCache(cache);
+
+                    if (cache->owner_prev != nullptr)
+                        cache->owner_prev->owner_next = cache->owner_next;
+                    else
+                        cache->owner->m_caches = cache->owner_next;
+                    if (cache->owner_next != nullptr)
+                        cache->owner_next->owner_prev = cache->owner_prev;
+                }
+                SystemMemory::unmap(cache, cache->bytes);
+                cache = next;
+            }
+
+            this->head = nullptr;
+            this->last = nullptr;
+        }
+    };
+
+    /*
+        ThreadCacheAllocator definitions
+    */
+
+    ThreadCacheAllocator::ThreadCacheAllocator(BasicAllocator* backing) :
+        m_backing(backing),
+        m_id(s_next_id.fetch_add(1, std::memory_order_relaxed)),
+        m_caches(nullptr)
+    {
+    }
+
+    ThreadCacheAllocator::~ThreadCacheAllocator()
+    {
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        for (ThreadCache* cache = this->m_caches; cache != nullptr; cache = cache->owner_next)
+        {
+            flushCache(cache);
+            cache->owner = nullptr;
+        }
+        this->m_caches = nullptr;
+    }
+
+    ThreadCacheAllocator::ThreadList& ThreadCacheAllocator::getThreadList()
+    {
+        thread_local ThreadList list;
+        return list;
+    }
+
+    ThreadCacheAllocator::ThreadCache* ThreadCacheAllocator::getCache()
+    {
+        if (t_torn_down)
+            return nullptr;
+
+        ThreadList& list = getThreadList();
+
+        ThreadCache* cache = list.last;
+        if (cache != nullptr && cache->owner_id == this->m_id)
+            return cache;
+
+        for (cache = list.head; cache != nullptr; cache = cache->thread_next)
+        {
+            if (cache->owner_id == this->m_id)
+            {
+                list.last = cache;
+                return cache;
+            }
+        }
+
+        return this->createCache();
+    }
+
+    ThreadCacheAllocator::ThreadCache* ThreadCacheAllocator::createCache()
+    {
+        ThreadList& list = getThreadList();
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        // Drop caches left behind by destroyed allocators
+        ThreadCache** link = &list.head;
+        while (*link != nullptr)
+        {
+            ThreadCache* cache = *link;
+            if (cache->owner == nullptr)
+            {
+                *link = cache->thread_next;
+                SystemMemory::unmap(cache, cache->bytes);
+            }
+            else
+            {
+                link = &cache->thread_next;
+            }
+        }
+        list.last = nullptr;
+
+        size_t bytes = SystemMemory::roundToPages(sizeof(ThreadCache));
+        ThreadCache* cache = reinterpret_cast<ThreadCache*>(SystemMemory::map(bytes));
+        if (cache == nullptr)
+            return nullptr;
+
+        // The mapping is zero filled, so the magazines start out empty
+        cache->owner = this;
+        cache->owner_id = this->m_id;
+        cache->owner_prev = nullptr;
+        cache->owner_next = this->m_caches;
+        cache->bytes = bytes;
+        if (this->m_caches != nullptr)
+            this->m_caches->owner_prev = cache;
+        this->m_caches = cache;
+
+        cache->thread_next = list.head;
+        list.head = cache;
+        list.last = cache;
+
+        return cache;
+    }
+
+    void ThreadCacheAllocator::flushMagazine(ThreadCache* cache, size_t size_class, size_t count)
+    {
+        BasicAllocator* backing = cache->owner->m_backing;
+        void** blocks = cache->blocks[size_class];
+
+        // The oldest blocks are at the bottom of the magazine
+        backing->freeBulk(blocks, count);
+
+        size_t remaining = cache->counts[size_class] - count;
+        std::memmove(blocks, blocks + count, remaining * sizeof(void*));
+        cache->counts[size_class] = static_cast<uint32_t>(remaining);
+    }
+
+    size_t ThreadCacheAllocator::getFreeClass(void* ptr) const
+    {
+        size_t size = this->m_backing->getAllocSize(ptr);
+
+        // Blocks are cached under the largest class they can satisfy
+        if (size < 16 || size >= 2 * MaxCachedSize || getAlignedOffset(ptr, alignof(max_align_t)) != 0)
+            return ClassCount;
+
+        size_t size_class = size / 16 - 1;
+        return size_class < ClassCount ? size_class : ClassCount - 1;
+    }
+
+    void ThreadCacheAllocator::pushBlock(ThreadCache* cache, size_t size_class, void* ptr)
+    {
+        if (cache->counts[size_class] == MagazineSize)
+            flushMagazine(cache, size_class, MagazineSize / 2);
+
+        cache->blocks[size_class][cache->counts[size_class]++] = ptr;
+    }
+
+    void ThreadCacheAllocator::flushCache(ThreadCache* cache)
+    {
+        for (size_t i = 0; i < ClassCount; ++i)
+            flushMagazine(cache, i, cache->counts[i]);
+    }
+
+    void ThreadCacheAllocator::flush()
+    {
+        if (t_torn_down)
+            return;
+
+        ThreadList& list = getThreadList();
+        for (ThreadCache* cache = list.head; cache != nullptr; cache = cache->thread_next)
+        {
+            if (cache->owner_id == this->m_id)
+            {
+                flushCache(cache);
+                break;
+            }
+        }
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* ThreadCacheAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (bytes <= MaxCachedSize && align <= alignof(max_align_t))
+        {
+            size_t size_class = bytes == 0 ? 0 : (bytes - 1) / 16;
+
+            ThreadCache* cache = this->getCache();
+            if (cache != nullptr && cache->counts[size_class] != 0)
+            {
+                return cache->blocks[size_class][--cache->counts[size_class]];
+            }
+
+            // Request the whole class size, so the block can be reused by any request of the class
+            return this->m_backing->alloc((size_class + 1) * 16, alignof(max_align_t));
+        }
+        return this->m_backing->alloc(getClassSize(bytes), align);
+    }
+
+    void ThreadCacheAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        size_t size_class = this->getFreeClass(ptr);
+        if (size_class != ClassCount)
+        {
+            ThreadCache* cache = this->getCache();
+            if (cache != nullptr)
+            {
+                pushBlock(cache, size_class, ptr);
+                return;
+            }
+        }
+        this->m_backing->free(ptr);
+    }
+
+    void ThreadCacheAllocator::free(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return;
+
+        if (bytes > MaxCachedSize)
+        {
+            this->m_backing->free(ptr, bytes);
+            return;
+        }
+
+        // The block holds at least the class size of the request, no need to ask the backing allocator
+        if (getAlignedOffset(ptr, alignof(max_align_t)) == 0)
+        {
+            ThreadCache* cache = this->getCache();
+            if (cache != nullptr)
+            {
+                pushBlock(cache, bytes == 0 ? 0 : (bytes - 1) / 16, ptr);
+                return;
+            }
+        }
+
+        // Cached blocks may have been requested with a different size originally
+        this->m_backing->free(ptr);
+    }
+
+    void* ThreadCacheAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        return this->m_backing->realloc(ptr, getClassSize(bytes), align);
+    }
+
+    void* ThreadCacheAllocator::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+
+        // Only blocks never seen by the caches are known to the backing allocator by the caller's size
+        if (old_bytes > MaxCachedSize)
+            return this->m_backing->reallocSized(ptr, old_bytes, getClassSize(bytes), align);
+        return this->m_backing->realloc(ptr, getClassSize(bytes), align);
+    }
+
+    size_t ThreadCacheAllocator::getAllocSize(const void* ptr) const
+    {
+        return this->m_backing->getAllocSize(ptr);
+    }
+
+    bool ThreadCacheAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        // Keep small blocks at whole class sizes, so they can be cached once freed
+        return this->m_backing->tryExpand(ptr, getClassSize(bytes));
+    }
+
+    bool ThreadCacheAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        return this->m_backing->tryShrink(ptr, getClassSize(bytes));
+    }
+
+    size_t ThreadCacheAllocator::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        if (bytes <= MaxCachedSize && align <= alignof(max_align_t))
+        {
+            size_t size_class = bytes == 0 ? 0 : (bytes - 1) / 16;
+            size_t served = 0;
+
+            ThreadCache* cache = this->getCache();
+            if (cache != nullptr)
+            {
+                while (served < count && cache->counts[size_class] != 0)
+                    out[served++] = cache->blocks[size_class][--cache->counts[size_class]];
+            }
+
+            // The rest is requested from the backing allocator in a single batch
+            if (served == count)
+                return count;
+            return served + this->m_backing->allocBulk((size_class + 1) * 16, count - served, out + served, alignof(max_align_t));
+        }
+        return this->m_backing->allocBulk(getClassSize(bytes), count, out, align);
+    }
+
+    void ThreadCacheAllocator::freeBulk(void** ptrs, size_t count)
+    {
+        ThreadCache* cache = nullptr;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (ptrs[i] == nullptr)
+                continue;
+
+            size_t size_class = this->getFreeClass(ptrs[i]);
+            if (size_class != ClassCount)
+            {
+                // The cache is only looked up once per batch
+                if (cache == nullptr)
+                    cache = this->getCache();
+                if (cache != nullptr)
+                {
+                    pushBlock(cache, size_class, ptrs[i]);
+                    continue;
+                }
+            }
+            this->m_backing->free(ptrs[i]);
+        }
+    }
+
+    void ThreadCacheAllocator::reset()
+    {
+        {
+            // Cached blocks get invalidated by the backing allocator's reset, simply forget them
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+            for (ThreadCache* cache = this->m_caches; cache != nullptr; cache = cache->owner_next)
+                std::memset(cache->counts, 0, sizeof(cache->counts));
+        }
+        this->m_backing->reset();
+    }
+
+    size_t ThreadCacheAllocator::getFreeBytes() const
+    {
+        return this->m_backing->getFreeBytes();
+    }
+
+    size_t ThreadCacheAllocator::getUsedBytes() const
+    {
+        return this->m_backing->getUsedBytes();
+    }
+
+    size_t ThreadCacheAllocator::getTotalBytes() const
+    {
+        return this->m_backing->getTotalBytes();
+    }
+
+    bool ThreadCacheAllocator::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        return this->m_backing->getFreeCounts(local, remote);
+    }
+}
@@ -0,0 +1,629 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/ThreadHeapAllocator.hpp>
+#include <Shared/Memory/RemoteFreeQueue.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+
+namespace Memory
+{
+    namespace
+    {
+        // Guards heap ownership: the owner registries, adoption and orphaning of heaps
+        std::mutex s_registry_mutex;
+        std::atomic<uint64_t> s_next_id(1);
+
+        // Blocks of a segment start after its header, on a separate cache line
+        constexpr size_t SegmentHeaderSize = 64;
+
+        // Counters only written by the owner thread, so a plain load and store is enough
+        template<class T>
+        inline void addOwned(std::atomic<T>& counter, T value) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Header at the start of every segment, only accessed by the owner thread while the segment is in use
+    struct ThreadHeapAllocator::Segment
+    {
+        ThreadHeap* heap; // Owner heap, nullptr while pooled. Never changes while blocks are allocated
+        Segment* prev; // Links in the heap's class list, or the pool
+        Segment* next;
+        void* free_list; // Freed blocks, linked through their first word
+        char* bump; // First never allocated block
+        char* end; // End of the last whole block
+        uint32_t size_class;
+        uint32_t block_size;
+        uint32_t used; // Allocated blocks, including the ones queued for a remote free
+        bool listed; // Whether the segment is on its heap's class list
+    };
+
+    // Per thread, per allocator heap. Mapped directly from the system, so adopted and orphaned heaps never depend on the backing allocator
+    struct ThreadHeapAllocator::ThreadHeap
+    {
+        ThreadHeapAllocator* owner; // nullptr once the owner got destroyed
+        uint64_t owner_id;
+        ThreadHeap* owner_prev; // Links in the owner's registry
+        ThreadHeap* owner_next;
+        ThreadHeap* thread_next; // Link in the thread's heap list
+        size_t bytes; // Size of the mapping
+        bool attached; // Whether a live thread uses the heap, guarded by the registry mutex
+
+        Segment* classes[ClassCount]; // Segments with free blocks, by size class
+
+        std::atomic<size_t> used; // Bytes of allocated blocks
+        std::atomic<uint64_t> local_frees;
+        std::atomic<uint64_t> remote_frees;
+
+        // Written by foreign threads, kept apart from the owner's fields
+        alignas(64) RemoteFreeQueue remote;
+    };
+
+    // Heaps of a single thread, abandoned for adoption when the thread exits
+    struct ThreadHeapAllocator::ThreadList
+    {
+        ThreadHeap* head = nullptr;
+        ThreadHeap* last = nullptr; // Most recently used heap
+
+        ~ThreadList()
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+            ThreadHeap* heap = this->head;
+            while (heap != nullptr)
+            {
+                ThreadHeap* next = heap->thread_next;
+                heap->thread_next = nullptr;
+
+                // Foreign threads may still be freeing blocks of the heap, it stays registered until the owner is destroyed
+                if (heap->owner != nullptr)
+                    heap->attached = false;
+                else
+                    SystemMemory::unmap(heap, heap->bytes);
+                heap = next;
+            }
+
+            this->head = nullptr;
+            this->last = nullptr;
+        }
+    };
+
+    /*
+        ThreadHeapAllocator definitions
+    */
+
+    ThreadHeapAllocator::ThreadHeapAllocator(BasicAllocator* backing, size_t reserve_bytes) :
+        m_backing(backing),
+        m_id(s_next_id.fetch_add(1, std::memory_order_relaxed)),
+        m_heaps(nullptr),
+        m_reservation(nullptr),
+        m_reserved(0),
+        m_base(nullptr),
+        m_end(nullptr),
+        m_top(nullptr),
+        m_pool(nullptr)
+    {
+        // Reserve an extra segment so the first one can be aligned to the segment size
+        size_t bytes = SystemMemory::roundToPages(reserve_bytes - reserve_bytes % SegmentSize + SegmentSize);
+        this->m_reservation = reinterpret_cast<char*>(SystemMemory::reserve(bytes));
+        if (this->m_reservation == nullptr)
+            return;
+
+        this->m_reserved = bytes;
+        this->m_base = this->m_reservation + getAlignedOffset(this->m_reservation, SegmentSize);
+        this->m_end = this->m_base + (reserve_bytes - reserve_bytes % SegmentSize);
+        this->m_top = this->m_base;
+    }
+
+    ThreadHeapAllocator::~ThreadHeapAllocator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+            ThreadHeap* heap = this->m_heaps;
+            while (heap != nullptr)
+            {
+                ThreadHeap* next = heap->owner_next;
+                if (heap->attached)
+                    heap->owner = nullptr;
+                else
+                    SystemMemory::unmap(heap, heap->bytes);
+                heap = next;
+            }
+            this->m_heaps = nullptr;
+        }
+
+        SystemMemory::unmap(this->m_reservation, this->m_reserved);
+    }
+
+    size_t ThreadHeapAllocator::getSizeClass(size_t bytes) noexcept
+    {
+        if (bytes <= 128)
+            return bytes == 0 ? 0 : (bytes - 1) / 16;
+
+        // Four classes between consecutive powers of two
+        uint32_t width = Util::getBitWidth(bytes - 1);
+        return 8 + (width - 8) * 4 + (((bytes - 1) >> (width - 3)) & 3);
+    }
+
+    size_t ThreadHeapAllocator::getClassSize(size_t size_class) noexcept
+    {
+        if (size_class < 8)
+            return (size_class + 1) * 16;
+
+        size_t step = size_class - 8;
+        return (5 + step % 4) << (5 + step / 4);
+    }
+
+    ThreadHeapAllocator::ThreadList& ThreadHeapAllocator::getThreadList()
+    {
+        thread_local ThreadList list;
+        return list;
+    }
+
+    ThreadHeapAllocator::ThreadHeap* ThreadHeapAllocator::findHeap() const
+    {
+        ThreadList& list = getThreadList();
+
+        ThreadHeap* heap = list.last;
+        if (heap != nullptr && heap->owner_id == this->m_id)
+            return heap;
+
+        for (heap = list.head; heap != nullptr; heap = heap->thread_next)
+        {
+            if (heap->owner_id == this->m_id)
+            {
+                list.last = heap;
+                return heap;
+            }
+        }
+        return nullptr;
+    }
+
+    ThreadHeapAllocator::ThreadHeap* ThreadHeapAllocator::getHeap()
+    {
+        ThreadHeap* heap = this->findHeap();
+        return heap != nullptr ? heap : this->createHeap();
+    }
+
+    ThreadHeapAllocator::ThreadHeap* ThreadHeapAllocator::createHeap()
+    {
+        ThreadList& list = getThreadList();
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        // Drop heaps left behind by destroyed allocators
+        ThreadHeap** link = &list.head;
+        while (*link != nullptr)
+        {
+            ThreadHeap* heap = *link;
+            if (heap->owner == nullptr)
+            {
+                *link = heap->thread_next;
+                SystemMemory::unmap(heap, heap->bytes);
+            }
+            else
+            {
+                link = &heap->thread_next;
+            }
+        }
+        list.last = nullptr;
+
+        // Adopt the heap of an exited thread, the queued remote frees are released at the next allocation
+        ThreadHeap* heap = this->m_heaps;
+        while (heap != nullptr && heap->attached)
+            heap = heap->owner_next;
+
+        if (heap == nullptr)
+        {
+            size_t bytes = SystemMemory::roundToPages(sizeof(ThreadHeap));
+            void* mapping = SystemMemory::map(bytes);
+            if (mapping == nullptr)
+                return nullptr;
+
+            heap = new (mapping) ThreadHeap();
+            heap->owner = this;
+            heap->owner_id = this->m_id;
+            heap->owner_prev = nullptr;
+            heap->owner_next = this->m_heaps;
+            heap->bytes = bytes;
+            if (this->m_heaps != nullptr)
+                this->m_heaps->owner_prev = heap;
+            this->m_heaps = heap;
+        }
+
+        heap->attached = true;
+        heap->thread_next = list.head;
+        list.head = heap;
+        list.last = heap;
+
+        return heap;
+    }
+
+    ThreadHeapAllocator::Segment* ThreadHeapAllocator::getSegment(const void* ptr) noexcept
+    {
+        static_assert(sizeof(Segment) <= SegmentHeaderSize, "The segment header must fit before the first block");
+        return reinterpret_cast<Segment*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(SegmentSize - 1));
+    }
+
+    void ThreadHeapAllocator::linkSegment(ThreadHeap* heap, Segment* segment) noexcept
+    {
+        Segment*& first = heap->classes[segment->size_class];
+
+        // Inserted after the first segment, so allocations keep filling the same one
+        segment->prev = first;
+        segment->next = first != nullptr ? first->next : nullptr;
+        if (segment->next != nullptr)
+            segment->next->prev = segment;
+        if (first != nullptr)
+            first->next = segment;
+        else
+            first = segment;
+        segment->listed = true;
+    }
+
+    void ThreadHeapAllocator::unlinkSegment(ThreadHeap* heap, Segment* segment) noexcept
+    {
+        if (segment->prev != nullptr)
+            segment->prev->next = segment->next;
+        else
+            heap->classes[segment->size_class] = segment->next;
+        if (segment->next != nullptr)
+            segment->next->prev = segment->prev;
+
+        segment->prev = nullptr;
+        segment->next = nullptr;
+        segment->listed = false;
+    }
+
+    ThreadHeapAllocator::Segment* ThreadHeapAllocator::acquireSegment(ThreadHeap* heap, size_t size_class)
+    {
+        Segment* segment = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+
+            if (this->m_pool != nullptr)
+            {
+                segment = this->m_pool;
+                this->m_pool = segment->next;
+            }
+            else if (this->m_top != nullptr && this->m_top < this->m_end)
+            {
+                if (!SystemMemory::commit(this->m_top, SegmentSize))
+                    return nullptr;
+                segment = reinterpret_cast<Segment*>(this->m_top);
+                this->m_top += SegmentSize;
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+
+        size_t block_size = getClassSize(size_class);
+        char* first = reinterpret_cast<char*>(segment) + SegmentHeaderSize;
+
+        segment->heap = heap;
+        segment->prev = nullptr;
+        segment->next = nullptr;
+        segment->free_list = nullptr;
+        segment->bump = first;
+        segment->end = first + (SegmentSize - SegmentHeaderSize) / block_size * block_size;
+        segment->size_class = static_cast<uint32_t>(size_class);
+        segment->block_size = static_cast<uint32_t>(block_size);
+        segment->used = 0;
+        linkSegment(heap, segment);
+
+        return segment;
+    }
+
+    void ThreadHeapAllocator::releaseSegment(Segment* segment)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+
+        segment->heap = nullptr;
+        segment->next = this->m_pool;
+        this->m_pool = segment;
+    }
+
+    void* ThreadHeapAllocator::allocSmall(ThreadHeap* heap, size_t size_class)
+    {
+        if (!heap->remote.isEmpty())
+            this->drainRemote(heap);
+
+        Segment* segment = heap->classes[size_class];
+        if (segment == nullptr)
+        {
+            segment = this->acquireSegment(heap, size_class);
+            if (segment == nullptr)
+                return nullptr;
+        }
+
+        void* ret;
+        if (segment->free_list != nullptr)
+        {
+            ret = segment->free_list;
+            segment->free_list = *reinterpret_cast<void**>(ret);
+        }
+        else
+        {
+            ret = segment->bump;
+            segment->bump += segment->block_size;
+        }
+        ++segment->used;
+        addOwned<size_t>(heap->used, segment->block_size);
+
+        // Full segments are only listed again once a block is freed
+        if (segment->free_list == nullptr && segment->bump == segment->end)
+            unlinkSegment(heap, segment);
+
+        return ret;
+    }
+
+    void ThreadHeapAllocator::freeLocal(ThreadHeap* heap, Segment* segment, void* ptr)
+    {
+        *reinterpret_cast<void**>(ptr) = segment->free_list;
+        segment->free_list = ptr;
+        --segment->used;
+        addOwned<size_t>(heap->used, 0 - size_t(segment->block_size));
+
+        if (!segment->listed)
+        {
+            linkSegment(heap, segment);
+        }
+        else if (segment->used == 0 && (segment->prev != nullptr || segment->next != nullptr))
+        {
+            // A single empty segment is kept per class, so a thread oscillating around a segment boundary doesn't go through the pool
+            unlinkSegment(heap, segment);
+            this->releaseSegment(segment);
+        }
+    }
+
+    void ThreadHeapAllocator::freeRemote(Segment* segment, void* ptr)
+    {
+        segment->heap->remote.push(ptr);
+    }
+
+    void ThreadHeapAllocator::drainRemote(ThreadHeap* heap)
+    {
+        uint64_t count = 0;
+        void* block = heap->remote.takeAll();
+        while (block != nullptr)
+        {
+            void* next = RemoteFreeQueue::getNext(block);
+            this->freeLocal(heap, getSegment(block), block);
+            block = next;
+            ++count;
+        }
+        addOwned<uint64_t>(heap->remote_frees, count);
+    }
+
+    void ThreadHeapAllocator::collect()
+    {
+        ThreadHeap* heap = this->findHeap();
+        if (heap != nullptr)
+            this->drainRemote(heap);
+    }
+
+    uint64_t ThreadHeapAllocator::getLocalFrees() const
+    {
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        uint64_t ret = 0;
+        for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+            ret += heap->local_frees.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    uint64_t ThreadHeapAllocator::getRemoteFrees() const
+    {
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        uint64_t ret = 0;
+        for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+            ret += heap->remote_frees.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    double ThreadHeapAllocator::getRemoteFreeRate() const
+    {
+        uint64_t local = 0;
+        uint64_t remote = 0;
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+            for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+            {
+                local += heap->local_frees.load(std::memory_order_relaxed);
+                remote += heap->remote_frees.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (local + remote == 0)
+            return 0.0;
+        return static_cast<double>(remote) / static_cast<double>(local + remote);
+    }
+
+    size_t ThreadHeapAllocator::getSegmentBytes() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_top - this->m_base);
+    }
+
+    size_t ThreadHeapAllocator::getHeapUsedBytes() const
+    {
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        size_t ret = 0;
+        for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+            ret += heap->used.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    BasicAllocator* ThreadHeapAllocator::getBacking() const noexcept
+    {
+        return this->m_backing;
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* ThreadHeapAllocator::alloc(size_t bytes, size_t align)
+    {
+        if (bytes <= MaxSmallSize && align <= alignof(max_align_t))
+        {
+            ThreadHeap* heap = this->getHeap();
+            if (heap != nullptr)
+            {
+                void* ret = this->allocSmall(heap, getSizeClass(bytes));
+                if (ret != nullptr)
+                    return ret;
+            }
+        }
+        return this->m_backing->alloc(bytes, align);
+    }
+
+    void ThreadHeapAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        if (!this->isSegmentBlock(ptr))
+        {
+            this->m_backing->free(ptr);
+            return;
+        }
+
+        Segment* segment = getSegment(ptr);
+        ThreadHeap* heap = this->findHeap();
+        if (segment->heap == heap)
+        {
+            this->freeLocal(heap, segment, ptr);
+            addOwned<uint64_t>(heap->local_frees, 1);
+        }
+        else
+        {
+            this->freeRemote(segment, ptr);
+        }
+    }
+
+    void ThreadHeapAllocator::free(void* ptr, size_t bytes)
+    {
+        if (ptr != nullptr && !this->isSegmentBlock(ptr))
+            this->m_backing->free(ptr, bytes);
+        else
+            this->free(ptr);
+    }
+
+    void* ThreadHeapAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        if (ptr == nullptr)
+            return this->alloc(bytes, align);
+        if (!this->isSegmentBlock(ptr))
+            return this->m_backing->realloc(ptr, bytes, align);
+
+        // Stay in place unless the block would be less than half used
+        size_t block_size = getSegment(ptr)->block_size;
+        if (align <= alignof(max_align_t) && bytes <= block_size && (bytes > block_size / 2 || block_size == 16))
+            return ptr;
+
+        void* ret = this->alloc(bytes, align);
+        if (ret != nullptr)
+        {
+            std::memcpy(ret, ptr, bytes < block_size ? bytes : block_size);
+            this->free(ptr);
+        }
+        return ret;
+    }
+
+    void* ThreadHeapAllocator::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        if (ptr != nullptr && !this->isSegmentBlock(ptr))
+            return this->m_backing->reallocSized(ptr, old_bytes, bytes, align);
+        return this->realloc(ptr, bytes, align);
+    }
+
+    size_t ThreadHeapAllocator::getAllocSize(const void* ptr) const
+    {
+        if (this->isSegmentBlock(ptr))
+            return getSegment(ptr)->block_size;
+        return this->m_backing->getAllocSize(ptr);
+    }
+
+    bool ThreadHeapAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (this->isSegmentBlock(ptr))
+            return bytes <= getSegment(ptr)->block_size;
+        return this->m_backing->tryExpand(ptr, bytes);
+    }
+
+    bool ThreadHeapAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (this->isSegmentBlock(ptr))
+            return bytes <= getSegment(ptr)->block_size;
+        return this->m_backing->tryShrink(ptr, bytes);
+    }
+
+    void ThreadHeapAllocator::reset()
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+            for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+            {
+                std::memset(heap->classes, 0, sizeof(heap->classes));
+                heap->remote.takeAll();
+                heap->used.store(0, std::memory_order_relaxed);
+            }
+        }
+        {
+            // Every segment goes back to the reservation, their memory is returned to the system
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            if (this->m_top != this->m_base)
+                SystemMemory::decommit(this->m_base, static_cast<size_t>(this->m_top - this->m_base), false);
+            this->m_top = this->m_base;
+            this->m_pool = nullptr;
+        }
+        this->m_backing->reset();
+    }
+
+    size_t ThreadHeapAllocator::getFreeBytes() const
+    {
+        // Headers and the tails of the segments count as free
+        return this->m_backing->getFreeBytes() + this->getSegmentBytes() - this->getHeapUsedBytes();
+    }
+
+    size_t ThreadHeapAllocator::getUsedBytes() const
+    {
+        return this->m_backing->getUsedBytes() + this->getHeapUsedBytes();
+    }
+
+    size_t ThreadHeapAllocator::getTotalBytes() const
+    {
+        return this->m_backing->getTotalBytes() + this->getSegmentBytes();
+    }
+
+    bool ThreadHeapAllocator::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        local = 0;
+        remote = 0;
+        for (ThreadHeap* heap = this->m_heaps; heap != nullptr; heap = heap->owner_next)
+        {
+            local += heap->local_frees.load(std::memory_order_relaxed);
+            remote += heap->remote_frees.load(std::memory_order_relaxed);
+        }
+        return true;
+    }
+}
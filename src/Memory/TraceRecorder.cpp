@@ -0,0 +1,545 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/TraceRecorder.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include "SystemMemory.hpp"
+
+#include <chrono>
+#include <ostream>
+
+namespace Memory
+{
+    namespace
+    {
+        // Guards buffer ownership: the owner registries and orphaning of buffers
+        std::mutex s_registry_mutex;
+        std::atomic<uint64_t> s_next_id(1);
+        std::atomic<uint32_t> s_next_thread(0);
+
+        const uint8_t s_trace_magic[4] = { 'A', 'T', 'R', 'C' };
+
+        inline uint64_t getSteadyTime() noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        inline uint32_t getThreadId() noexcept
+        {
+            thread_local uint32_t id = s_next_thread.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+
+        inline void writeLittleEndian(uint8_t* out, uint64_t value, size_t bytes) noexcept
+        {
+            for (size_t i = 0; i < bytes; ++i)
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Block of records filled by a single thread. Mapped directly from the system so recording never calls into the traced allocator
+    struct TraceRecorder::Chunk
+    {
+        Chunk* next; // Link in the submitted stack
+        size_t count;
+        Record records[BufferRecords];
+    };
+
+    // Per thread, per recorder buffer
+    struct TraceRecorder::ThreadBuffer
+    {
+        TraceRecorder* owner; // nullptr once the owner got destroyed
+        uint64_t owner_id;
+        ThreadBuffer* owner_prev; // Links in the owner's registry
+        ThreadBuffer* owner_next;
+        ThreadBuffer* thread_next; // Link in the thread's buffer list
+        Chunk* chunk; // Chunk being filled, nullptr until the next record
+    };
+
+    // Buffers of a single thread, handed over when the thread exits
+    struct TraceRecorder::ThreadList
+    {
+        ThreadBuffer* head = nullptr;
+        ThreadBuffer* last = nullptr; // Most recently used buffer
+
+        ~ThreadList()
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+            ThreadBuffer* buffer = this->head;
+            while (buffer != nullptr)
+            {
+                ThreadBuffer* next = buffer->thread_next;
+                if (buffer->owner != nullptr)
+                {
+                    if (buffer->chunk != nullptr)
+                        buffer->owner->submit(buffer->chunk);
+
+                    if (buffer->owner_prev != nullptr)
+                        buffer->owner_prev->owner_next = buffer->owner_next;
+                    else
+                        buffer->owner->m_buffers = buffer->owner_next;
+                    if (buffer->owner_next != nullptr)
+                        buffer->owner_next->owner_prev = buffer->owner_prev;
+                }
+                SystemMemory::unmap(buffer, SystemMemory::roundToPages(sizeof(ThreadBuffer)));
+                buffer = next;
+            }
+
+            this->head = nullptr;
+            this->last = nullptr;
+        }
+    };
+
+    /*
+        TraceRecorder definitions
+    */
+
+    TraceRecorder::TraceRecorder(BasicAllocator* backing, std::ostream& out) :
+        m_basic_backing(backing),
+        m_object_backing(nullptr),
+        m_out(out),
+        m_id(s_next_id.fetch_add(1, std::memory_order_relaxed)),
+        m_start(getSteadyTime()),
+        m_buffers(nullptr),
+        m_submitted(nullptr),
+        m_submit_count(0),
+        m_written(0),
+        m_dropped(0),
+        m_flush_count(0),
+        m_running(true)
+    {
+        uint8_t header[HeaderSize] = {};
+        for (size_t i = 0; i < 4; ++i)
+            header[i] = s_trace_magic[i];
+        writeLittleEndian(header + 4, FormatVersion, 4);
+        writeLittleEndian(header + 8, RecordSize, 4);
+        this->m_out.write(reinterpret_cast<const char*>(header), HeaderSize);
+
+        this->m_thread = std::thread(&TraceRecorder::run, this);
+    }
+
+    TraceRecorder::TraceRecorder(ObjectAllocator* backing, std::ostream& out) :
+        TraceRecorder(static_cast<BasicAllocator*>(backing), out)
+    {
+        this->m_object_backing = backing;
+    }
+
+    TraceRecorder::~TraceRecorder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+            for (ThreadBuffer* buffer = this->m_buffers; buffer != nullptr; buffer = buffer->owner_next)
+            {
+                if (buffer->chunk != nullptr)
+                    this->submit(buffer->chunk);
+                buffer->chunk = nullptr;
+                buffer->owner = nullptr;
+            }
+            this->m_buffers = nullptr;
+        }
+
+        // The writer drains the submitted chunks before exiting
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_running = false;
+            this->m_wakeup.notify_all();
+        }
+        this->m_thread.join();
+    }
+
+    uint64_t TraceRecorder::getTime() const noexcept
+    {
+        return getSteadyTime() - this->m_start;
+    }
+
+    TraceRecorder::ThreadList& TraceRecorder::getThreadList()
+    {
+        thread_local ThreadList list;
+        return list;
+    }
+
+    TraceRecorder::ThreadBuffer* TraceRecorder::getBuffer() noexcept
+    {
+        ThreadList& list = getThreadList();
+
+        ThreadBuffer* buffer = list.last;
+        if (buffer != nullptr && buffer->owner_id == this->m_id)
+            return buffer;
+
+        for (buffer = list.head; buffer != nullptr; buffer = buffer->thread_next)
+        {
+            if (buffer->owner_id == this->m_id)
+            {
+                list.last = buffer;
+                return buffer;
+            }
+        }
+
+        return this->createBuffer();
+    }
+
+    TraceRecorder::ThreadBuffer* TraceRecorder::createBuffer() noexcept
+    {
+        ThreadList& list = getThreadList();
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+        // Drop buffers left behind by destroyed recorders
+        ThreadBuffer** link = &list.head;
+        while (*link != nullptr)
+        {
+            ThreadBuffer* buffer = *link;
+            if (buffer->owner == nullptr)
+            {
+                *link = buffer->thread_next;
+                SystemMemory::unmap(buffer, SystemMemory::roundToPages(sizeof(ThreadBuffer)));
+            }
+            else
+            {
+                link = &buffer->thread_next;
+            }
+        }
+        list.last = nullptr;
+
+        ThreadBuffer* buffer = reinterpret_cast<ThreadBuffer*>(SystemMemory::map(SystemMemory::roundToPages(sizeof(ThreadBuffer))));
+        if (buffer == nullptr)
+            return nullptr;
+
+        buffer->owner = this;
+        buffer->owner_id = this->m_id;
+        buffer->owner_prev = nullptr;
+        buffer->owner_next = this->m_buffers;
+        buffer->chunk = nullptr;
+        if (this->m_buffers != nullptr)
+            this->m_buffers->owner_prev = buffer;
+        this->m_buffers = buffer;
+
+        buffer->thread_next = list.head;
+        list.head = buffer;
+        list.last = buffer;
+
+        return buffer;
+    }
+
+    void TraceRecorder::record(Call call, uint64_t time, const void* ptr, uint64_t result, uint64_t size, size_t align) noexcept
+    {
+        ThreadBuffer* buffer = this->getBuffer();
+        if (buffer == nullptr)
+        {
+            this->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Chunk* chunk = buffer->chunk;
+        if (chunk == nullptr)
+        {
+            // The mapping is zero filled, so the chunk starts out empty
+            chunk = reinterpret_cast<Chunk*>(SystemMemory::map(SystemMemory::roundToPages(sizeof(Chunk))));
+            if (chunk == nullptr)
+            {
+                this->m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            buffer->chunk = chunk;
+        }
+
+        Record& record = chunk->records[chunk->count];
+        record.time = time;
+        record.ptr = reinterpret_cast<uintptr_t>(ptr);
+        record.result = result;
+        record.size = size;
+        record.thread = getThreadId();
+        record.call = call;
+        record.align_bits = static_cast<uint8_t>(align != 0 ? Util::getBitWidth(align) - 1 : 0);
+        record.reserved = 0;
+
+        if (++chunk->count == BufferRecords)
+        {
+            buffer->chunk = nullptr;
+            this->submit(chunk);
+        }
+    }
+
+    void TraceRecorder::submit(Chunk* chunk) noexcept
+    {
+        // Counted before the chunk can be written, so the count never lags behind the written chunks and flush can't return before its own chunk got written
+        this->m_submit_count.fetch_add(1, std::memory_order_relaxed);
+
+        Chunk* head = this->m_submitted.load(std::memory_order_relaxed);
+        do
+        {
+            chunk->next = head;
+        } while (!this->m_submitted.compare_exchange_weak(head, chunk, std::memory_order_release, std::memory_order_relaxed));
+
+        this->m_wakeup.notify_one();
+    }
+
+    void TraceRecorder::run()
+    {
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        for (;;)
+        {
+            this->m_wakeup.wait_for(lock, std::chrono::milliseconds(FlushIntervalMs), [this]() {
+                return !this->m_running || this->m_submitted.load(std::memory_order_relaxed) != nullptr;
+            });
+
+            bool running = this->m_running;
+            Chunk* chunks = this->m_submitted.exchange(nullptr, std::memory_order_acquire);
+            if (chunks != nullptr)
+            {
+                lock.unlock();
+                this->writeChunks(chunks);
+                lock.lock();
+            }
+            this->m_flushed.notify_all();
+
+            if (!running && this->m_submitted.load(std::memory_order_relaxed) == nullptr)
+                break;
+        }
+    }
+
+    void TraceRecorder::writeChunks(Chunk* chunks)
+    {
+        // The stack holds the newest chunk first, write them in submission order
+        Chunk* ordered = nullptr;
+        while (chunks != nullptr)
+        {
+            Chunk* next = chunks->next;
+            chunks->next = ordered;
+            ordered = chunks;
+            chunks = next;
+        }
+
+        uint64_t count = 0;
+        while (ordered != nullptr)
+        {
+            // Encoded in small batches on the stack, so writing never allocates through a traced global allocator
+            uint8_t encoded[64 * RecordSize];
+            for (size_t i = 0; i < ordered->count; i += 64)
+            {
+                size_t batch = ordered->count - i < 64 ? ordered->count - i : 64;
+                for (size_t n = 0; n < batch; ++n)
+                {
+                    const Record& record = ordered->records[i + n];
+                    uint8_t* out = encoded + n * RecordSize;
+                    writeLittleEndian(out, record.time, 8);
+                    writeLittleEndian(out + 8, record.ptr, 8);
+                    writeLittleEndian(out + 16, record.result, 8);
+                    writeLittleEndian(out + 24, record.size, 8);
+                    writeLittleEndian(out + 32, record.thread, 4);
+                    out[36] = record.call;
+                    out[37] = record.align_bits;
+                    writeLittleEndian(out + 38, record.reserved, 2);
+                }
+                this->m_out.write(reinterpret_cast<const char*>(encoded), static_cast<std::streamsize>(batch * RecordSize));
+            }
+            this->m_written.fetch_add(ordered->count, std::memory_order_relaxed);
+
+            Chunk* next = ordered->next;
+            SystemMemory::unmap(ordered, SystemMemory::roundToPages(sizeof(Chunk)));
+            ordered = next;
+            ++count;
+        }
+        this->m_out.flush();
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_flush_count += count;
+    }
+
+    void TraceRecorder::flush()
+    {
+        ThreadBuffer* buffer = this->getBuffer();
+        if (buffer != nullptr && buffer->chunk != nullptr)
+        {
+            this->submit(buffer->chunk);
+            buffer->chunk = nullptr;
+        }
+
+        uint64_t target = this->m_submit_count.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        this->m_wakeup.notify_all();
+        this->m_flushed.wait(lock, [this, target]() {
+            return this->m_flush_count >= target;
+        });
+    }
+
+    uint64_t TraceRecorder::getWrittenRecords() const noexcept
+    {
+        return this->m_written.load(std::memory_order_relaxed);
+    }
+
+    uint64_t TraceRecorder::getDroppedRecords() const noexcept
+    {
+        return this->m_dropped.load(std::memory_order_relaxed);
+    }
+
+    BasicAllocator* TraceRecorder::getBacking() const noexcept
+    {
+        return this->m_basic_backing;
+    }
+
+    /*
+        Overridden wrapped function definitions
+    */
+
+    void* TraceRecorder::alloc(size_t bytes, size_t align)
+    {
+        void* ret = this->m_basic_backing->alloc(bytes, align);
+        this->record(Alloc, this->getTime(), nullptr, reinterpret_cast<uintptr_t>(ret), bytes, align);
+        return ret;
+    }
+
+    void* TraceRecorder::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        void* ret = this->m_object_backing->alloc(bytes, destructor, align);
+        this->record(Alloc, this->getTime(), nullptr, reinterpret_cast<uintptr_t>(ret), bytes, align);
+        return ret;
+    }
+
+    // Calls releasing memory are timestamped before the call, the ones handing out memory after, so ordering by time never puts a reuse of an address before its release.
+    // Reallocations and offers release their block too, so they are timestamped before the call as well, otherwise another thread's allocation of the released block could sort earlier
+    void TraceRecorder::free(void* ptr)
+    {
+        if (ptr != nullptr)
+            this->record(Free, this->getTime(), ptr, 0, 0, 0);
+        this->m_basic_backing->free(ptr);
+    }
+
+    void TraceRecorder::free(void* ptr, size_t bytes)
+    {
+        if (ptr != nullptr)
+            this->record(Free, this->getTime(), ptr, 0, bytes, 0);
+        this->m_basic_backing->free(ptr, bytes);
+    }
+
+    void* TraceRecorder::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        uint64_t time = this->getTime();
+        void* ret = this->m_basic_backing->realloc(ptr, bytes, align);
+        this->record(Realloc, time, ptr, reinterpret_cast<uintptr_t>(ret), bytes, align);
+        return ret;
+    }
+
+    void* TraceRecorder::reallocSized(void* ptr, size_t old_bytes, size_t bytes, size_t align)
+    {
+        uint64_t time = this->getTime();
+        void* ret = this->m_basic_backing->reallocSized(ptr, old_bytes, bytes, align);
+        this->record(Realloc, time, ptr, reinterpret_cast<uintptr_t>(ret), bytes, align);
+        return ret;
+    }
+
+    void* TraceRecorder::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        uint64_t time = this->getTime();
+        void* ret = this->m_object_backing->realloc(ptr, bytes, destructor, align);
+        this->record(Realloc, time, ptr, reinterpret_cast<uintptr_t>(ret), bytes, align);
+        return ret;
+    }
+
+    size_t TraceRecorder::getAllocSize(const void* ptr) const
+    {
+        return this->m_basic_backing->getAllocSize(ptr);
+    }
+
+    bool TraceRecorder::tryExpand(void* ptr, size_t bytes)
+    {
+        bool ret = this->m_basic_backing->tryExpand(ptr, bytes);
+        this->record(Expand, this->getTime(), ptr, ret ? 1 : 0, bytes, 0);
+        return ret;
+    }
+
+    bool TraceRecorder::tryShrink(void* ptr, size_t bytes)
+    {
+        bool ret = this->m_basic_backing->tryShrink(ptr, bytes);
+        this->record(Shrink, this->getTime(), ptr, ret ? 1 : 0, bytes, 0);
+        return ret;
+    }
+
+    size_t TraceRecorder::allocBulk(size_t bytes, size_t count, void** out, size_t align)
+    {
+        size_t ret = this->m_basic_backing->allocBulk(bytes, count, out, align);
+
+        uint64_t time = this->getTime();
+        for (size_t i = 0; i < ret; ++i)
+            this->record(Alloc, time, nullptr, reinterpret_cast<uintptr_t>(out[i]), bytes, align);
+        if (ret != count)
+            this->record(Alloc, time, nullptr, 0, bytes, align);
+        return ret;
+    }
+
+    void TraceRecorder::freeBulk(void** ptrs, size_t count)
+    {
+        uint64_t time = this->getTime();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (ptrs[i] != nullptr)
+                this->record(Free, time, ptrs[i], 0, 0, 0);
+        }
+        this->m_basic_backing->freeBulk(ptrs, count);
+    }
+
+    void* TraceRecorder::offer(void* ptr, uint32_t priority)
+    {
+        uint64_t time = this->getTime();
+        void* ret = this->m_object_backing->offer(ptr, priority);
+        this->record(Offer, time, ptr, reinterpret_cast<uintptr_t>(ret), priority, 0);
+        return ret;
+    }
+
+    void* TraceRecorder::reclaim(void* ptr)
+    {
+        void* ret = this->m_object_backing->reclaim(ptr);
+        this->record(Reclaim, this->getTime(), ptr, reinterpret_cast<uintptr_t>(ret), 0, 0);
+        return ret;
+    }
+
+    void TraceRecorder::reset()
+    {
+        this->record(Reset, this->getTime(), nullptr, 0, 0, 0);
+        this->m_basic_backing->reset();
+    }
+
+    void TraceRecorder::purge(uint32_t priority)
+    {
+        this->record(Purge, this->getTime(), nullptr, 0, priority, 0);
+        this->m_object_backing->purge(priority);
+    }
+
+    void TraceRecorder::clear()
+    {
+        this->record(Clear, this->getTime(), nullptr, 0, 0, 0);
+        this->m_object_backing->clear();
+    }
+
+    size_t TraceRecorder::getFreeBytes() const
+    {
+        return this->m_basic_backing->getFreeBytes();
+    }
+
+    size_t TraceRecorder::getUsedBytes() const
+    {
+        return this->m_basic_backing->getUsedBytes();
+    }
+
+    size_t TraceRecorder::getPendingBytes() const
+    {
+        return this->m_object_backing->getPendingBytes();
+    }
+
+    size_t TraceRecorder::getTotalBytes() const
+    {
+        return this->m_basic_backing->getTotalBytes();
+    }
+
+    bool TraceRecorder::getFreeCounts(uint64_t& local, uint64_t& remote) const
+    {
+        return this->m_basic_backing->getFreeCounts(local, remote);
+    }
+}
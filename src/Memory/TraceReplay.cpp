@@ -0,0 +1,353 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/TraceReplay.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <unordered_map>
+#include <vector>
+
+namespace Memory
+{
+    namespace
+    {
+        using Record = TraceRecorder::Record;
+
+        inline uint64_t readLittleEndian(const uint8_t* in, size_t bytes) noexcept
+        {
+            uint64_t value = 0;
+            for (size_t i = 0; i < bytes; ++i)
+                value |= static_cast<uint64_t>(in[i]) << (8 * i);
+            return value;
+        }
+
+        // Calls between samples of the target's used bytes, a power of two
+        constexpr uint64_t UsedSampleInterval = 64;
+
+        // Recorded address to live pointer
+        using AddressMap = std::unordered_map<uint64_t, void*>;
+    }
+
+    /*
+        Internal structures
+    */
+
+    struct TraceReplay::Records
+    {
+        std::vector<Record> records;
+    };
+
+    /*
+        TraceReplay definitions
+    */
+
+    TraceReplay::TraceReplay() :
+        m_records(new Records()),
+        m_threads(0)
+    {
+    }
+
+    TraceReplay::~TraceReplay()
+    {
+        delete this->m_records;
+    }
+
+    bool TraceReplay::load(std::istream& in)
+    {
+        this->m_records->records.clear();
+        this->m_threads = 0;
+
+        uint8_t header[TraceRecorder::HeaderSize];
+        if (!in.read(reinterpret_cast<char*>(header), TraceRecorder::HeaderSize))
+            return false;
+        if (header[0] != 'A' || header[1] != 'T' || header[2] != 'R' || header[3] != 'C')
+            return false;
+        if (readLittleEndian(header + 4, 4) != TraceRecorder::FormatVersion)
+            return false;
+
+        // Newer writers may append fields to the records, those are ignored
+        size_t record_size = static_cast<size_t>(readLittleEndian(header + 8, 4));
+        if (record_size < TraceRecorder::RecordSize)
+            return false;
+
+        std::vector<uint8_t> buffer(record_size * 256);
+        std::vector<bool> threads;
+        for (;;)
+        {
+            in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            size_t count = static_cast<size_t>(in.gcount()) / record_size;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const uint8_t* data = buffer.data() + i * record_size;
+
+                Record record;
+                record.time = readLittleEndian(data, 8);
+                record.ptr = readLittleEndian(data + 8, 8);
+                record.result = readLittleEndian(data + 16, 8);
+                record.size = readLittleEndian(data + 24, 8);
+                record.thread = static_cast<uint32_t>(readLittleEndian(data + 32, 4));
+                record.call = data[36];
+                record.align_bits = data[37];
+                record.reserved = static_cast<uint16_t>(readLittleEndian(data + 38, 2));
+                this->m_records->records.push_back(record);
+
+                if (record.thread >= threads.size())
+                    threads.resize(record.thread + 1, false);
+                if (!threads[record.thread])
+                {
+                    threads[record.thread] = true;
+                    ++this->m_threads;
+                }
+            }
+
+            if (!in)
+                break;
+        }
+
+        // Every thread's records are in call order with increasing timestamps, a stable sort keeps that order
+        std::stable_sort(this->m_records->records.begin(), this->m_records->records.end(), [](const Record& a, const Record& b) {
+            return a.time < b.time;
+        });
+
+        return true;
+    }
+
+    size_t TraceReplay::getRecordCount() const noexcept
+    {
+        return this->m_records->records.size();
+    }
+
+    uint32_t TraceReplay::getThreadCount() const noexcept
+    {
+        return this->m_threads;
+    }
+
+    const TraceRecorder::Record& TraceReplay::getRecord(size_t index) const noexcept
+    {
+        return this->m_records->records[index];
+    }
+
+    TraceReplay::Result TraceReplay::replay(BasicAllocator* target) const
+    {
+        return this->replay(target, nullptr);
+    }
+
+    TraceReplay::Result TraceReplay::replay(ObjectAllocator* target) const
+    {
+        return this->replay(target, target);
+    }
+
+    TraceReplay::Result TraceReplay::replay(BasicAllocator* basic, ObjectAllocator* object) const
+    {
+        Result result = {};
+
+        AddressMap blocks; // Live allocations
+        AddressMap offers; // Live offer pointers, the offered blocks themselves without an object target
+        blocks.reserve(1024);
+
+        // Removes a recorded address, returning its live pointer or nullptr if unknown
+        auto take = [](AddressMap& map, uint64_t address) -> void* {
+            auto it = map.find(address);
+            if (it == map.end())
+                return nullptr;
+            void* ptr = it->second;
+            map.erase(it);
+            return ptr;
+        };
+        // An address still in use was reused by a call ordered before the release of the previous block, the previous block is dropped
+        auto insert = [&](uint64_t address, void* ptr) {
+            void*& slot = blocks[address];
+            if (slot != nullptr)
+            {
+                basic->free(slot);
+                ++result.skipped;
+            }
+            slot = ptr;
+        };
+        auto releaseAll = [&]() {
+            for (auto& block : blocks)
+                basic->free(block.second);
+            blocks.clear();
+            for (auto& offer : offers)
+                basic->free(offer.second);
+            offers.clear();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        for (const Record& record : this->m_records->records)
+        {
+            size_t align = size_t(1) << record.align_bits;
+            size_t bytes = static_cast<size_t>(record.size);
+
+            switch (record.call)
+            {
+            case TraceRecorder::Alloc:
+            {
+                if (record.result == 0)
+                {
+                    ++result.skipped;
+                    continue;
+                }
+                void* ptr = basic->alloc(bytes, align);
+                if (ptr != nullptr)
+                    insert(record.result, ptr);
+                else
+                    ++result.failed;
+                break;
+            }
+            case TraceRecorder::Free:
+            {
+                void* ptr = take(blocks, record.ptr);
+                if (ptr == nullptr)
+                {
+                    // An offer pointer may be freed as well
+                    ptr = take(offers, record.ptr);
+                    if (ptr == nullptr)
+                    {
+                        ++result.skipped;
+                        continue;
+                    }
+                }
+                basic->free(ptr);
+                break;
+            }
+            case TraceRecorder::Realloc:
+            {
+                void* old_ptr = nullptr;
+                if (record.ptr != 0)
+                {
+                    auto it = blocks.find(record.ptr);
+                    if (it == blocks.end())
+                    {
+                        ++result.skipped;
+                        continue;
+                    }
+                    old_ptr = it->second;
+                }
+                if (record.result == 0)
+                {
+                    // A failed reallocation left the block in place
+                    ++result.skipped;
+                    continue;
+                }
+
+                void* ptr = basic->realloc(old_ptr, bytes, align);
+                if (ptr != nullptr)
+                {
+                    if (record.ptr != 0)
+                        blocks.erase(record.ptr);
+                    insert(record.result, ptr);
+                }
+                else
+                {
+                    ++result.failed;
+                }
+                break;
+            }
+            case TraceRecorder::Offer:
+            {
+                void* ptr = take(blocks, record.ptr);
+                if (ptr == nullptr)
+                {
+                    ++result.skipped;
+                    continue;
+                }
+
+                if (object != nullptr)
+                {
+                    void* ticket = object->offer(ptr, static_cast<uint32_t>(record.size));
+                    if (ticket != nullptr && record.result != 0)
+                        offers[record.result] = ticket;
+                    else if (ticket != nullptr)
+                        object->free(ticket);
+                }
+                else if (record.result != 0)
+                {
+                    offers[record.result] = ptr;
+                }
+                else
+                {
+                    basic->free(ptr);
+                }
+                break;
+            }
+            case TraceRecorder::Reclaim:
+            {
+                void* ticket = take(offers, record.ptr);
+                if (ticket == nullptr)
+                {
+                    ++result.skipped;
+                    continue;
+                }
+
+                void* ptr = object != nullptr ? object->reclaim(ticket) : ticket;
+                if (ptr != nullptr && record.result != 0)
+                {
+                    insert(record.result, ptr);
+                }
+                else if (ptr != nullptr)
+                {
+                    // The block got purged while recording
+                    basic->free(ptr);
+                }
+                else if (record.result != 0)
+                {
+                    ++result.failed;
+                }
+                break;
+            }
+            case TraceRecorder::Purge:
+                if (object != nullptr)
+                    object->purge(static_cast<uint32_t>(record.size));
+                break;
+            case TraceRecorder::Reset:
+                blocks.clear();
+                offers.clear();
+                basic->reset();
+                break;
+            case TraceRecorder::Clear:
+                if (object != nullptr)
+                {
+                    blocks.clear();
+                    offers.clear();
+                    object->clear();
+                }
+                else
+                {
+                    releaseAll();
+                }
+                break;
+            case TraceRecorder::Expand:
+            case TraceRecorder::Shrink:
+            {
+                auto it = blocks.find(record.ptr);
+                if (it == blocks.end())
+                {
+                    ++result.skipped;
+                    continue;
+                }
+                bool ret = record.call == TraceRecorder::Expand ? basic->tryExpand(it->second, bytes) : basic->tryShrink(it->second, bytes);
+                if (!ret && record.result != 0)
+                    ++result.failed;
+                break;
+            }
+            default:
+                ++result.skipped;
+                continue;
+            }
+
+            if ((++result.replayed & (UsedSampleInterval - 1)) == 0)
+                result.highest_used = std::max(result.highest_used, basic->getUsedBytes());
+        }
+        result.highest_used = std::max(result.highest_used, basic->getUsedBytes());
+        result.elapsed_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        result.leaked = blocks.size() + offers.size();
+        releaseAll();
+
+        return result;
+    }
+}
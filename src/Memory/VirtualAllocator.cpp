@@ -0,0 +1,774 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Memory/VirtualAllocator.hpp>
+#include <Shared/Util/Bits.hpp>
+
+#include "DestructorBatch.hpp"
+#include "SystemMemory.hpp"
+
+#include <cstring>
+
+namespace Memory
+{
+    namespace
+    {
+        enum RunState : uint8_t
+        {
+            StateFree = 0,
+            StateUsed,
+            StateOffered,
+            StatePurged // Offer released, the header is kept until reclaim or free
+        };
+
+        inline uint32_t getBin(size_t pages) noexcept
+        {
+            return Util::getBitWidth(pages) - 1;
+        }
+
+        inline char* alignUp(char* ptr, size_t align) noexcept
+        {
+            return ptr + BasicAllocator::getAlignedOffset(ptr, align);
+        }
+    }
+
+    /*
+        Internal structures
+    */
+
+    // Header at the start of every run of pages
+    struct VirtualAllocator::Run
+    {
+        OfferList::Node node; // Must be the first member, runs are cast from offer nodes
+        size_t pages; // Size of the run
+        size_t prev_pages; // Size of the previous run, 0 for the first run
+        size_t offset; // Distance of the user pointer from the header
+        DestructorPtr destructor; // Destructor of used and offered runs
+        Run* free_prev; // Links in the free run bin
+        Run* free_next;
+        size_t decommitted; // Decommitted pages of a free run, the header page is never decommitted
+        uint8_t state;
+    };
+
+    /*
+        VirtualAllocator definitions
+    */
+
+    VirtualAllocator::VirtualAllocator(size_t reserve_bytes, uint32_t options) :
+        m_base(nullptr),
+        m_end(nullptr),
+        m_top(nullptr),
+        m_committed(nullptr),
+        m_last(nullptr),
+        m_page(SystemMemory::getPageSize()),
+        m_bins(),
+        m_bin_mask(0),
+        m_used(0),
+        m_pending(0),
+        m_decommitted(0),
+        m_options(options),
+        m_clearing(false)
+    {
+        size_t align = (options & HugePages) != 0 && HugePageSize > this->m_page ? HugePageSize : this->m_page;
+        if (reserve_bytes == 0 || reserve_bytes > std::numeric_limits<size_t>::max() / 2)
+            return;
+        size_t bytes = (reserve_bytes + align - 1) & ~(align - 1);
+
+        char* base = nullptr;
+#if !defined(PLATFORM_OS_WIN)
+        // Reserve more and trim to get an aligned range, parts of a reservation can't be released on Windows
+        if (align > this->m_page)
+        {
+            char* raw = reinterpret_cast<char*>(SystemMemory::reserve(bytes + align));
+            if (raw != nullptr)
+            {
+                base = alignUp(raw, align);
+                if (base != raw)
+                    SystemMemory::unmap(raw, static_cast<size_t>(base - raw));
+                SystemMemory::unmap(base + bytes, static_cast<size_t>(raw + align - base));
+            }
+        }
+#endif
+        if (base == nullptr)
+            base = reinterpret_cast<char*>(SystemMemory::reserve(bytes));
+        if (base == nullptr)
+            return;
+
+        this->m_base = base;
+        this->m_end = base + bytes;
+        this->m_top = base;
+        this->m_committed = base;
+    }
+
+    VirtualAllocator::~VirtualAllocator()
+    {
+        this->clear();
+        SystemMemory::unmap(this->m_base, static_cast<size_t>(this->m_end - this->m_base));
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::getRun(const void* ptr) noexcept
+    {
+        size_t offset = reinterpret_cast<const size_t*>(ptr)[-1];
+        return reinterpret_cast<Run*>(const_cast<char*>(reinterpret_cast<const char*>(ptr)) - offset);
+    }
+
+    void* VirtualAllocator::getUser(Run* run) noexcept
+    {
+        return reinterpret_cast<char*>(run) + run->offset;
+    }
+
+    size_t VirtualAllocator::getUsable(const Run* run) const noexcept
+    {
+        return run->pages * this->m_page - run->offset;
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::getNext(Run* run) const noexcept
+    {
+        char* next = reinterpret_cast<char*>(run) + run->pages * this->m_page;
+        return next < this->m_top ? reinterpret_cast<Run*>(next) : nullptr;
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::getPrev(Run* run) const noexcept
+    {
+        if (run->prev_pages == 0)
+            return nullptr;
+        return reinterpret_cast<Run*>(reinterpret_cast<char*>(run) - run->prev_pages * this->m_page);
+    }
+
+    void VirtualAllocator::insertFree(Run* run)
+    {
+        uint32_t bin = getBin(run->pages);
+
+        run->state = StateFree;
+        run->destructor = nullptr;
+        run->free_prev = nullptr;
+        run->free_next = this->m_bins[bin];
+        if (run->free_next != nullptr)
+            run->free_next->free_prev = run;
+        this->m_bins[bin] = run;
+        this->m_bin_mask |= uint64_t(1) << bin;
+    }
+
+    void VirtualAllocator::removeFree(Run* run)
+    {
+        uint32_t bin = getBin(run->pages);
+
+        if (run->free_prev != nullptr)
+            run->free_prev->free_next = run->free_next;
+        else
+            this->m_bins[bin] = run->free_next;
+        if (run->free_next != nullptr)
+            run->free_next->free_prev = run->free_prev;
+
+        if (this->m_bins[bin] == nullptr)
+            this->m_bin_mask &= ~(uint64_t(1) << bin);
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::findFree(size_t pages)
+    {
+        // First fit inside the smallest bin that may hold the request
+        uint32_t bin = getBin(pages);
+        for (Run* run = this->m_bins[bin]; run != nullptr; run = run->free_next)
+        {
+            if (run->pages >= pages)
+                return run;
+        }
+
+        // Any run of a larger bin fits
+        if (bin + 1 >= BinCount)
+            return nullptr;
+        uint64_t larger = this->m_bin_mask & ~((uint64_t(2) << bin) - 1);
+        if (larger == 0)
+            return nullptr;
+        return this->m_bins[Util::getTrailingZeros(larger)];
+    }
+
+    bool VirtualAllocator::growTop(size_t bytes)
+    {
+        char* needed = this->m_top + bytes;
+        if (needed <= this->m_committed)
+            return true;
+
+        // Commit ahead in steps, falling back to the exact amount close to the end of the reservation
+        size_t step = (this->m_options & HugePages) != 0 ? HugePageSize : CommitStep;
+        size_t target = (static_cast<size_t>(needed - this->m_base) + step - 1) & ~(step - 1);
+        char* end = target < static_cast<size_t>(this->m_end - this->m_base) ? this->m_base + target : this->m_end;
+
+        if (!SystemMemory::commit(this->m_committed, static_cast<size_t>(end - this->m_committed)))
+        {
+            end = needed;
+            if (!SystemMemory::commit(this->m_committed, static_cast<size_t>(end - this->m_committed)))
+                return false;
+        }
+
+        this->m_committed = end;
+        return true;
+    }
+
+    bool VirtualAllocator::recommit(Run* run, size_t pages)
+    {
+        if (run->decommitted == 0 || !SystemMemory::isDecommitInaccessible())
+            return true;
+
+        // The header of a remainder split off after the used pages has to be accessible as well
+        size_t count = pages < run->pages ? pages + 1 : run->pages;
+        if (count <= 1)
+            return true;
+        return SystemMemory::commit(reinterpret_cast<char*>(run) + this->m_page, (count - 1) * this->m_page);
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::carve(size_t pages)
+    {
+        size_t available = static_cast<size_t>(this->m_end - this->m_top) / this->m_page;
+
+        // A free run at the top is extended instead of leaving it behind
+        Run* last = this->m_last;
+        if (last != nullptr && last->state == StateFree)
+        {
+            size_t extra = pages - last->pages;
+            if (extra > available || !this->recommit(last, last->pages) || !this->growTop(extra * this->m_page))
+                return nullptr;
+
+            this->removeFree(last);
+            this->m_decommitted -= last->decommitted * this->m_page;
+            last->decommitted = 0;
+            last->pages = pages;
+            this->m_top += extra * this->m_page;
+            return last;
+        }
+
+        if (pages > available || !this->growTop(pages * this->m_page))
+            return nullptr;
+
+        Run* run = reinterpret_cast<Run*>(this->m_top);
+        run->pages = pages;
+        run->prev_pages = last != nullptr ? last->pages : 0;
+        run->decommitted = 0;
+        this->m_top += pages * this->m_page;
+        this->m_last = run;
+        return run;
+    }
+
+    VirtualAllocator::Run* VirtualAllocator::split(Run* run, size_t pages)
+    {
+        Run* rest = reinterpret_cast<Run*>(reinterpret_cast<char*>(run) + pages * this->m_page);
+        rest->pages = run->pages - pages;
+        rest->prev_pages = pages;
+        rest->decommitted = 0;
+        rest->destructor = nullptr;
+        rest->state = StateFree;
+
+        Run* next = this->getNext(rest);
+        if (next != nullptr)
+            next->prev_pages = rest->pages;
+        if (this->m_last == run)
+            this->m_last = rest;
+
+        run->pages = pages;
+        return rest;
+    }
+
+    void VirtualAllocator::absorbNext(Run* run)
+    {
+        Run* next = this->getNext(run);
+        run->pages += next->pages;
+
+        Run* after = this->getNext(run);
+        if (after != nullptr)
+            after->prev_pages = run->pages;
+        if (this->m_last == next)
+            this->m_last = run;
+    }
+
+    void VirtualAllocator::releaseRun(Run* run)
+    {
+        run->state = StateFree;
+
+        // Free runs never neighbour each other
+        Run* next = this->getNext(run);
+        if (next != nullptr && next->state == StateFree)
+        {
+            this->removeFree(next);
+            run->decommitted += next->decommitted;
+            this->absorbNext(run);
+        }
+
+        Run* prev = this->getPrev(run);
+        if (prev != nullptr && prev->state == StateFree)
+        {
+            this->removeFree(prev);
+            prev->decommitted += run->decommitted;
+            this->absorbNext(prev);
+            run = prev;
+        }
+
+        this->insertFree(run);
+    }
+
+    void VirtualAllocator::destroyRun(Run* run)
+    {
+        DestructorPtr destructor = run->destructor;
+        if (destructor != nullptr)
+        {
+            run->destructor = nullptr;
+            destructor(getUser(run));
+        }
+
+        this->m_used -= run->pages * this->m_page;
+        this->releaseRun(run);
+    }
+
+    void VirtualAllocator::adviseRun(Run* run)
+    {
+        if ((this->m_options & HugePages) == 0 || run->pages * this->m_page < HugePageSize)
+            return;
+
+        char* begin = alignUp(reinterpret_cast<char*>(run), HugePageSize);
+        char* end = reinterpret_cast<char*>(run) + run->pages * this->m_page;
+        end -= getAlignedOffset(end, HugePageSize) != 0 ? HugePageSize - getAlignedOffset(end, HugePageSize) : 0;
+        if (end > begin)
+            SystemMemory::adviseHugePages(begin, static_cast<size_t>(end - begin));
+    }
+
+    void* VirtualAllocator::allocRun(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < alignof(max_align_t))
+            align = alignof(max_align_t);
+
+        if (this->m_base == nullptr || (align & (align - 1)) != 0)
+            return nullptr;
+
+        size_t reserved = static_cast<size_t>(this->m_end - this->m_base);
+        if (bytes > reserved || align > reserved)
+            return nullptr;
+
+        // Room for the header, the offset right before the user pointer and the alignment padding
+        size_t pages = (sizeof(Run) + sizeof(size_t) + align - 1 + bytes + this->m_page - 1) / this->m_page;
+
+        Run* run = this->findFree(pages);
+        if (run != nullptr)
+        {
+            if (!this->recommit(run, pages))
+                return nullptr;
+
+            this->removeFree(run);
+            size_t decommitted = run->decommitted;
+            run->decommitted = 0;
+            if (run->pages > pages)
+            {
+                // The decommitted pages are assumed to be at the end of the run
+                Run* rest = this->split(run, pages);
+                rest->decommitted = decommitted < rest->pages - 1 ? decommitted : rest->pages - 1;
+                decommitted -= rest->decommitted;
+                this->insertFree(rest);
+            }
+            this->m_decommitted -= decommitted * this->m_page;
+        }
+        else
+        {
+            run = this->carve(pages);
+            if (run == nullptr)
+                return nullptr;
+        }
+
+        char* user = alignUp(reinterpret_cast<char*>(run) + sizeof(Run) + sizeof(size_t), align);
+        reinterpret_cast<size_t*>(user)[-1] = static_cast<size_t>(user - reinterpret_cast<char*>(run));
+
+        run->offset = static_cast<size_t>(user - reinterpret_cast<char*>(run));
+        run->destructor = destructor;
+        run->state = StateUsed;
+        this->m_used += run->pages * this->m_page;
+        this->adviseRun(run);
+
+        return user;
+    }
+
+    bool VirtualAllocator::resizeRun(Run* run, size_t bytes)
+    {
+        if (bytes > static_cast<size_t>(this->m_end - this->m_base))
+            return false;
+
+        size_t pages = (run->offset + bytes + this->m_page - 1) / this->m_page;
+        if (pages == 0)
+            pages = 1;
+
+        // Shrink in place, the tail pages are freed
+        if (pages <= run->pages)
+        {
+            if (pages < run->pages)
+            {
+                this->m_used -= (run->pages - pages) * this->m_page;
+                this->releaseRun(this->split(run, pages));
+            }
+            return true;
+        }
+
+        // Grow into the following free run
+        Run* next = this->getNext(run);
+        if (next != nullptr && next->state == StateFree && run->pages + next->pages >= pages && this->recommit(next, pages - run->pages))
+        {
+            this->removeFree(next);
+            size_t decommitted = next->decommitted;
+            size_t previous = run->pages;
+            this->absorbNext(run);
+            if (run->pages > pages)
+            {
+                Run* rest = this->split(run, pages);
+                rest->decommitted = decommitted < rest->pages - 1 ? decommitted : rest->pages - 1;
+                decommitted -= rest->decommitted;
+                this->insertFree(rest);
+            }
+            this->m_decommitted -= decommitted * this->m_page;
+
+            this->m_used += (run->pages - previous) * this->m_page;
+            this->adviseRun(run);
+            return true;
+        }
+
+        // Grow the run at the top, or through the free run at the top
+        size_t available = static_cast<size_t>(this->m_end - this->m_top) / this->m_page;
+        if (next != nullptr && next == this->m_last && next->state == StateFree)
+        {
+            size_t extra = pages - run->pages - next->pages;
+            if (extra > available || !this->recommit(next, next->pages) || !this->growTop(extra * this->m_page))
+                return false;
+
+            this->removeFree(next);
+            this->m_decommitted -= next->decommitted * this->m_page;
+            size_t previous = run->pages;
+            this->absorbNext(run);
+            run->pages = pages;
+            this->m_top += extra * this->m_page;
+            this->m_used += (pages - previous) * this->m_page;
+            this->adviseRun(run);
+            return true;
+        }
+
+        size_t extra = pages - run->pages;
+        if (run == this->m_last && extra <= available && this->growTop(extra * this->m_page))
+        {
+            run->pages = pages;
+            this->m_top += extra * this->m_page;
+            this->m_used += extra * this->m_page;
+            this->adviseRun(run);
+            return true;
+        }
+
+        return false;
+    }
+
+    void* VirtualAllocator::reallocRun(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        if (align < alignof(max_align_t))
+            align = alignof(max_align_t);
+
+        Run* run = getRun(ptr);
+        size_t usable = this->getUsable(run);
+
+        if (getAlignedOffset(ptr, align) == 0 && this->resizeRun(run, bytes))
+        {
+            run->destructor = destructor;
+            return ptr;
+        }
+
+        void* ret = this->allocRun(bytes, destructor, align);
+        if (ret == nullptr)
+            return nullptr;
+
+        std::memcpy(ret, ptr, usable < bytes ? usable : bytes);
+        this->m_used -= run->pages * this->m_page;
+        this->releaseRun(run);
+
+        return ret;
+    }
+
+    void VirtualAllocator::decommitFree()
+    {
+        bool lazy = (this->m_options & LazyDecommit) != 0;
+
+        for (uint32_t bin = 0; bin < BinCount; ++bin)
+        {
+            for (Run* run = this->m_bins[bin]; run != nullptr; run = run->free_next)
+            {
+                size_t body = run->pages - 1;
+                if (body > run->decommitted)
+                {
+                    SystemMemory::decommit(reinterpret_cast<char*>(run) + this->m_page, body * this->m_page, lazy);
+                    this->m_decommitted += (body - run->decommitted) * this->m_page;
+                    run->decommitted = body;
+                }
+            }
+        }
+
+        if (this->m_committed > this->m_top)
+        {
+            SystemMemory::decommit(this->m_top, static_cast<size_t>(this->m_committed - this->m_top), lazy);
+            this->m_committed = this->m_top;
+        }
+    }
+
+    void VirtualAllocator::releaseAll()
+    {
+        // Committed pages are kept for reuse, purge or decommit return them
+        for (uint32_t bin = 0; bin < BinCount; ++bin)
+            this->m_bins[bin] = nullptr;
+        this->m_bin_mask = 0;
+        this->m_offers.clear();
+
+        if (this->m_decommitted != 0 && SystemMemory::isDecommitInaccessible())
+            this->m_committed = this->m_base;
+
+        this->m_top = this->m_base;
+        this->m_last = nullptr;
+        this->m_used = 0;
+        this->m_pending = 0;
+        this->m_decommitted = 0;
+    }
+
+    void VirtualAllocator::decommit()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->decommitFree();
+    }
+
+    size_t VirtualAllocator::getReservedBytes() const noexcept
+    {
+        return static_cast<size_t>(this->m_end - this->m_base);
+    }
+
+    size_t VirtualAllocator::getDecommittedBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_decommitted;
+    }
+
+    /*
+        Overridden ObjectAllocator function definitions
+    */
+
+    void* VirtualAllocator::alloc(size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocRun(bytes, nullptr, align);
+    }
+
+    void* VirtualAllocator::alloc(size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->allocRun(bytes, destructor, align);
+    }
+
+    void VirtualAllocator::free(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Run* run = getRun(ptr);
+
+        if (this->m_clearing)
+        {
+            // Memory is released in bulk once clear finishes, only run the destructor
+            if (run->state == StateUsed || run->state == StateOffered)
+            {
+                DestructorPtr destructor = run->destructor;
+                run->state = StatePurged;
+                if (destructor != nullptr)
+                    destructor(ptr);
+            }
+            return;
+        }
+
+        switch (run->state)
+        {
+        case StateOffered:
+            this->m_offers.remove(&run->node);
+            this->m_pending -= this->getUsable(run);
+            this->destroyRun(run);
+            break;
+        case StateUsed:
+            this->destroyRun(run);
+            break;
+        case StatePurged:
+            this->m_used -= run->pages * this->m_page;
+            this->releaseRun(run);
+            break;
+        }
+    }
+
+    void* VirtualAllocator::realloc(void* ptr, size_t bytes, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocRun(bytes, nullptr, align);
+
+        return this->reallocRun(ptr, bytes, getRun(ptr)->destructor, align);
+    }
+
+    void* VirtualAllocator::realloc(void* ptr, size_t bytes, DestructorPtr destructor, size_t align)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        if (ptr == nullptr)
+            return this->allocRun(bytes, destructor, align);
+
+        return this->reallocRun(ptr, bytes, destructor, align);
+    }
+
+    size_t VirtualAllocator::getAllocSize(const void* ptr) const
+    {
+        return this->getUsable(getRun(ptr));
+    }
+
+    bool VirtualAllocator::tryExpand(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Run* run = getRun(ptr);
+        return bytes <= this->getUsable(run) || this->resizeRun(run, bytes);
+    }
+
+    bool VirtualAllocator::tryShrink(void* ptr, size_t bytes)
+    {
+        if (ptr == nullptr)
+            return false;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Run* run = getRun(ptr);
+        return bytes <= this->getUsable(run) && this->resizeRun(run, bytes);
+    }
+
+    void* VirtualAllocator::offer(void* ptr, uint32_t priority)
+    {
+        if (ptr == nullptr)
+            return nullptr;
+
+        // The run header doubles as the ticket, the offer pointer is the allocation itself
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Run* run = getRun(ptr);
+        run->state = StateOffered;
+        this->m_offers.push(&run->node, priority);
+        this->m_pending += this->getUsable(run);
+
+        return ptr;
+    }
+
+    void* VirtualAllocator::reclaim(void* ptr)
+    {
+        if (ptr == nullptr)
+            return nullptr;
+
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        Run* run = getRun(ptr);
+
+        if (run->state == StatePurged)
+        {
+            this->m_used -= run->pages * this->m_page;
+            this->releaseRun(run);
+            return nullptr;
+        }
+
+        if (run->state == StateOffered)
+        {
+            this->m_offers.remove(&run->node);
+            this->m_pending -= this->getUsable(run);
+            run->state = StateUsed;
+        }
+        return ptr;
+    }
+
+    void VirtualAllocator::reset()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->releaseAll();
+    }
+
+    void VirtualAllocator::purge(uint32_t priority)
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+
+        while (OfferList::Node* node = this->m_offers.getOldest(priority))
+        {
+            Run* run = reinterpret_cast<Run*>(node);
+            this->m_offers.remove(node);
+            this->m_pending -= this->getUsable(run);
+            run->state = StatePurged;
+
+            DestructorPtr destructor = run->destructor;
+            if (destructor != nullptr)
+            {
+                run->destructor = nullptr;
+                destructor(getUser(run));
+            }
+
+            // Only the pages up to the stored offset are kept for reclaim and free
+            size_t keep = (run->offset - sizeof(size_t)) / this->m_page + 1;
+            if (run->pages > keep)
+            {
+                this->m_used -= (run->pages - keep) * this->m_page;
+                this->releaseRun(this->split(run, keep));
+            }
+        }
+
+        this->decommitFree();
+    }
+
+    void VirtualAllocator::clear()
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        this->m_clearing = true;
+
+        auto destroy = [](DestructorPtr, void* block)
+        {
+            // Destructors earlier in the batch may have freed the run already
+            Run* run = reinterpret_cast<Run*>(block);
+            if (run->state == StateUsed || run->state == StateOffered)
+            {
+                DestructorPtr destructor = run->destructor;
+                run->state = StatePurged;
+                if (destructor != nullptr)
+                    destructor(getUser(run));
+            }
+        };
+
+        DestructorBatch<decltype(destroy)> batch(destroy);
+        for (char* ptr = this->m_base; ptr < this->m_top;)
+        {
+            Run* run = reinterpret_cast<Run*>(ptr);
+            ptr += run->pages * this->m_page;
+
+            if ((run->state == StateUsed || run->state == StateOffered) && run->destructor != nullptr)
+                batch.add(run->destructor, run);
+        }
+        batch.run();
+
+        this->m_clearing = false;
+        this->releaseAll();
+    }
+
+    size_t VirtualAllocator::getFreeBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_committed - this->m_base) - this->m_decommitted - this->m_used;
+    }
+
+    size_t VirtualAllocator::getUsedBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_used;
+    }
+
+    size_t VirtualAllocator::getPendingBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return this->m_pending;
+    }
+
+    size_t VirtualAllocator::getTotalBytes() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(this->m_mutex);
+        return static_cast<size_t>(this->m_committed - this->m_base) - this->m_decommitted;
+    }
+}
@@ -0,0 +1,130 @@
+// Licensed under the MIT License. Copyright (c) 2021 Gergely Pintr.
+#ifndef SHARED_LIB_BUILDING
+#   define SHARED_LIB_BUILDING
+#endif
+#include <Shared/Util/LatencyHistogram.hpp>
+
+#include <Shared/Util/Bits.hpp>
+
+namespace Util
+{
+    /*
+        Bucket layout
+
+        Values below 2 * SubBuckets map to themselves. Larger values are identified by their bit width and the first 5 bits,
+        the leading one and 4 bits of mantissa, so each power of two range gets SubBuckets buckets of equal width.
+    */
+
+    LatencyHistogram::LatencyHistogram() noexcept :
+        m_count(0),
+        m_sum(0),
+        m_max(0)
+    {
+        for (size_t i = 0; i < BucketCount; ++i)
+            this->m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    size_t LatencyHistogram::getBucket(uint64_t value) noexcept
+    {
+        if (value < 2 * SubBuckets)
+            return static_cast<size_t>(value);
+
+        uint32_t shift = getBitWidth(value) - 5;
+        return static_cast<size_t>(shift) * SubBuckets + static_cast<size_t>(value >> shift);
+    }
+
+    uint64_t LatencyHistogram::getBucketMin(size_t bucket) noexcept
+    {
+        if (bucket < 2 * SubBuckets)
+            return bucket;
+
+        uint32_t shift = static_cast<uint32_t>(bucket / SubBuckets) - 1;
+        uint64_t mantissa = bucket % SubBuckets + SubBuckets;
+        return mantissa << shift;
+    }
+
+    uint64_t LatencyHistogram::getBucketMax(size_t bucket) noexcept
+    {
+        if (bucket < 2 * SubBuckets)
+            return bucket;
+
+        uint32_t shift = static_cast<uint32_t>(bucket / SubBuckets) - 1;
+        return getBucketMin(bucket) + ((uint64_t(1) << shift) - 1);
+    }
+
+    void LatencyHistogram::record(uint64_t value, uint64_t count) noexcept
+    {
+        this->m_buckets[getBucket(value)].fetch_add(count, std::memory_order_relaxed);
+        this->m_count.fetch_add(count, std::memory_order_relaxed);
+        this->m_sum.fetch_add(value * count, std::memory_order_relaxed);
+
+        uint64_t expected = this->m_max.load(std::memory_order_relaxed);
+        while (expected < value)
+            if (this->m_max.compare_exchange_weak(expected, value, std::memory_order_relaxed))
+                break;
+    }
+
+    void LatencyHistogram::reset() noexcept
+    {
+        for (size_t i = 0; i < BucketCount; ++i)
+            this->m_buckets[i].store(0, std::memory_order_relaxed);
+        this->m_count.store(0, std::memory_order_relaxed);
+        this->m_sum.store(0, std::memory_order_relaxed);
+        this->m_max.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::getCount() const noexcept
+    {
+        return this->m_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::getMax() const noexcept
+    {
+        return this->m_max.load(std::memory_order_relaxed);
+    }
+
+    double LatencyHistogram::getMean() const noexcept
+    {
+        uint64_t count = this->getCount();
+        if (count == 0)
+            return 0.0;
+        return static_cast<double>(this->m_sum.load(std::memory_order_relaxed)) / static_cast<double>(count);
+    }
+
+    uint64_t LatencyHistogram::getPercentile(double percentile) const noexcept
+    {
+        // The buckets are summed instead of relying on m_count, so concurrent recording can't push the target out of range
+        uint64_t total = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+            total += this->m_buckets[i].load(std::memory_order_relaxed);
+        if (total == 0)
+            return 0;
+
+        if (percentile < 0.0)
+            percentile = 0.0;
+        else if (percentile > 1.0)
+            percentile = 1.0;
+
+        uint64_t target = static_cast<uint64_t>(percentile * static_cast<double>(total) + 0.5);
+        if (target == 0)
+            target = 1;
+
+        uint64_t max = this->getMax();
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += this->m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+            {
+                uint64_t ret = getBucketMax(i);
+                return ret < max ? ret : max;
+            }
+        }
+        return max;
+    }
+
+    uint64_t LatencyHistogram::getBucketCount(size_t bucket) const noexcept
+    {
+        return this->m_buckets[bucket].load(std::memory_order_relaxed);
+    }
+}